@@ -48,6 +48,8 @@ namespace contract
 		typedef std::shared_ptr<ContractInfo> ContractInfoP;
 
 		fcrypto::sha256 ordered_json_digest(const jsondiff::JsonValue& json_value);
+		// the size of the json ordered_json_digest hashes
+		size_t ordered_json_size(const jsondiff::JsonValue& json_value);
 		
 	}
 }
@@ -4,6 +4,8 @@
 #include <contract_storage/contract_info.hpp>
 #include <contract_storage/commit.hpp>
 #include <contract_storage/change.hpp>
+#include <contract_storage/undo.hpp>
+#include <contract_storage/state_trie.hpp>
 #include <boost/exception/all.hpp>
 #include <fjson/array.hpp>
 #include <fcrypto/ripemd160.hpp>
@@ -13,35 +15,139 @@
 #include <boost/uuid/sha1.hpp>
 #include <exception>
 #include <memory>
+#include <map>
+#include <set>
+#include <list>
+#include <unordered_map>
 #include <leveldb/db.h>
-#include <sqlite3.h>
+#include <leveldb/write_batch.h>
 
 namespace contract
 {
 	namespace storage
 	{
+		// leveldb mutations of one commit, applied to db in a single write.
+		// reads through the batch see the staged values before the db values
+		class ContractStorageBatch final
+		{
+		private:
+			leveldb::WriteBatch _batch;
+			std::map<std::string, std::pair<bool, std::string>> _pending; // key => (exists, value)
+			std::map<std::string, jsondiff::JsonValue> _storage_values; // decoded values of staged contract storages
+			bool _capture_undo = false;
+			std::map<std::string, std::pair<bool, std::string>> _undo_staged; // prior values of captured keys staged before capture
+			std::set<std::string> _undo_unstaged; // captured keys whose prior values are in db
+
+			void capture_undo(const std::string& key);
+		public:
+			void put(const std::string& key, const std::string& value);
+			// stage an encoded contract storage value and keep the decoded value for the storage cache
+			void put_storage(const std::string& key, const jsondiff::JsonValue& value);
+			void erase(const std::string& key);
+			// return true when the key is staged. found is set to whether the staged key exists
+			bool get_staged(const std::string& key, std::string* value, bool* found) const;
+			bool get_staged_storage(const std::string& key, jsondiff::JsonValue* value) const;
+			// stage the mutations of other after the mutations of this batch
+			void merge(const ContractStorageBatch& other);
+			bool empty() const { return _pending.empty(); }
+			const std::map<std::string, std::pair<bool, std::string>>& pending() const { return _pending; }
+			const std::map<std::string, jsondiff::JsonValue>& storage_values() const { return _storage_values; }
+			leveldb::WriteBatch* write_batch() { return &_batch; }
+
+			// record the prior value of every key first touched between start and stop
+			void start_undo_capture() { _capture_undo = true; }
+			void stop_undo_capture() { _capture_undo = false; }
+			const std::map<std::string, std::pair<bool, std::string>>& undo_staged() const { return _undo_staged; }
+			const std::set<std::string>& undo_unstaged() const { return _undo_unstaged; }
+		};
+
+		struct ContractStorageCacheStats
+		{
+			uint64_t hits = 0;
+			uint64_t misses = 0;
+			size_t entries = 0;
+			size_t memory_usage = 0;
+			size_t max_memory_usage = 0;
+		};
+
+#define CONTRACT_STORAGE_DEFAULT_CACHE_SIZE (32 << 20)
+#define CONTRACT_STORAGE_DEFAULT_DB_CACHE_SIZE (16 << 20)
+
+		// leveldb tuning of the contract storage db, the same as the chainstate db gets from dbwrapper
+		struct ContractStorageDBOptions
+		{
+			size_t cache_size = CONTRACT_STORAGE_DEFAULT_DB_CACHE_SIZE; // split between block cache and write buffers
+			bool force_compact = false; // compact the whole db when opened
+		};
+
 		class ContractStorageService final
 		{
 		private:
-			leveldb::DB *_db;
-			sqlite3 *_sql_db;
+			// shared with snapshot handles, which keep it open after close
+			std::shared_ptr<leveldb::DB> _db;
+			ContractStorageDBOptions _db_options;
+			// set for snapshot handles, which read the db at the snapshot and can't write
+			std::shared_ptr<const leveldb::Snapshot> _snapshot;
+			// set for overlays, which keep their writes in _overlay_batch and read the keys they didn't write from _base
+			std::shared_ptr<ContractStorageService> _base;
+			std::unique_ptr<ContractStorageBatch> _overlay_batch;
 			uint32_t _current_block_height = 0;
 			uint32_t _magic_number;
 			std::string _storage_db_path;
-			std::string _storage_sql_db_path;
+			std::string _storage_sql_db_path; // commit_info sqlite db of older versions, migrated to the commit log on open
+
+			// decoded contract storage values by storage key, evicted in lru order when over _storage_cache_max_usage
+			struct StorageCacheEntry
+			{
+				jsondiff::JsonValue value;
+				size_t memory_usage;
+				std::list<std::string>::iterator lru_it;
+			};
+			mutable std::unordered_map<std::string, StorageCacheEntry> _storage_cache;
+			mutable std::list<std::string> _storage_cache_lru;
+			mutable size_t _storage_cache_usage = 0;
+			size_t _storage_cache_max_usage = CONTRACT_STORAGE_DEFAULT_CACHE_SIZE;
+			mutable uint64_t _storage_cache_hits = 0;
+			mutable uint64_t _storage_cache_misses = 0;
+			// set while recording the keys read or written through this service
+			std::set<std::string>* _read_keys = nullptr;
+			std::set<std::string>* _written_keys = nullptr;
 		public:
 			// suggest use get_instance
 			ContractStorageService(uint32_t magic_number, const std::string& storage_db_path, const std::string& storage_sql_db_path, bool auto_open = true);
 			~ContractStorageService();
 
-			static std::shared_ptr<ContractStorageService> get_instance(uint32_t magic_number, const std::string& storage_db_path, const std::string& storage_sql_db_path);
+			// returns a handle to the process-wide service which holds the storage lock until it is released.
+			// the databases are opened on first acquire and stay open until close_instance. db_options is used when the service is created
+			static std::shared_ptr<ContractStorageService> get_instance(uint32_t magic_number, const std::string& storage_db_path, const std::string& storage_sql_db_path,
+				const ContractStorageDBOptions& db_options = ContractStorageDBOptions());
+			// returns a read-only handle pinned to the state of the process-wide service at its last handle release.
+			// it doesn't take the storage lock, so it can be used concurrently with the writer
+			static std::shared_ptr<ContractStorageService> get_snapshot(uint32_t magic_number, const std::string& storage_db_path, const std::string& storage_sql_db_path,
+				const ContractStorageDBOptions& db_options = ContractStorageDBOptions());
+			// returns an in-memory overlay over base, like CCoinsViewCache over its backing view.
+			// commits and rollbacks on the overlay don't touch base until flush, dropping the overlay discards them
+			static std::shared_ptr<ContractStorageService> create_overlay(std::shared_ptr<ContractStorageService> base);
+			// returns a read-only handle pinned to the current state of this service, unlike get_snapshot it sees
+			// the commits not yet published. each handle has its own state, so handles can be read in parallel
+			std::shared_ptr<ContractStorageService> create_snapshot() const;
+			// close the process-wide service, call it on shutdown
+			static void close_instance();
 			
 			// these apis may throws boost::exception
 			void open();
 			void close();
 			bool is_open() const;
+			bool is_snapshot() const { return _snapshot != nullptr; }
+			bool is_overlay() const { return _overlay_batch != nullptr; }
+			// apply the changes of this overlay to its base
+			void flush();
+			// takes effect on next open
+			void set_db_options(const ContractStorageDBOptions& db_options) { _db_options = db_options; }
 
 			ContractInfoP get_contract_info(const AddressType& contract_id) const;
+			// whether the contract exists, without decoding its info
+			bool has_contract_info(const AddressType& contract_id) const;
 			ContractCommitId save_contract_info(ContractInfoP contract_info);
 			AddressType find_contract_id_by_name(const std::string& name) const;
 
@@ -55,7 +161,7 @@ namespace contract
 			void rollback_contract_state(const ContractCommitId& dest_commit_id);
 
 			// don't call this in production usage
-			void clear_sql_db();
+			void clear_commit_log();
 
 			// hash the all contract-storage world
 			// new-root-hash = hash(old-root-hash, commit-diff, block_height)
@@ -77,21 +183,69 @@ namespace contract
 			void set_current_block_height(uint32_t block_height) { this->_current_block_height = block_height; }
 
 			ContractCommitInfoP get_commit_info(const ContractCommitId& commit_id) const;
+
+			// merkle commitment over all contract infos(with balances) and contract storages, maintained by every commit.
+			// hashes are raw sha256 digests
+			std::string state_trie_root() const;
+			// state trie root right after commit_id, empty when the commit was saved before the state trie existed
+			std::string state_trie_root_of_commit(const ContractCommitId& commit_id) const;
+			// value is set to the proved value as hashed in the leaf, null when it doesn't exist
+			ContractStateProof prove_contract_storage(const AddressType& contract_id, const std::string& storage_name, jsondiff::JsonValue* value) const;
+			ContractStateProof prove_contract_info(const AddressType& contract_id, jsondiff::JsonValue* value) const;
+			// state trie leaf of a contract storage is contract_storage_state_key_hash => state_value_hash(storage value)
+			static std::string contract_storage_state_key_hash(const AddressType& contract_id, const std::string& storage_name);
+			static std::string contract_info_state_key_hash(const AddressType& contract_id);
+			static std::string state_value_hash(const jsondiff::JsonValue& value);
+
+			// record the db keys read by contract apis into read_keys, nullptr stops recording
+			void set_read_keys(std::set<std::string>* read_keys) { _read_keys = read_keys; }
+			// record the db keys written by commits and rollbacks into written_keys, nullptr stops recording
+			void set_written_keys(std::set<std::string>* written_keys) { _written_keys = written_keys; }
+
+			void set_storage_cache_max_usage(size_t max_usage);
+			ContractStorageCacheStats storage_cache_stats() const;
 		private:
 			// check db opened? if not, throw boost::exception
 			void check_db() const;
-			void begin_sql_transaction();
-			void commit_sql_transaction();
-			void rollback_sql_transaction();
-			void rollback_leveldb_transaction(const leveldb::Snapshot* snapshot_to_rollback, const std::vector<std::string>& changed_keys);
-			void rollback_to_root_state_hash_without_transactional(const ContractCommitId& dest_commit_id, std::vector<std::string>& changed_leveldb_keys);
-			// init commits sql table
-			void init_commits_table();
-			// add commit info to sql db
-			void add_commit_info(ContractCommitId commit_id, const std::string &change_type, const std::string &diff_str, const std::string &contract_id);
-			// get value from key-value db by key
-			std::string get_value_by_key_or_error(const std::string &key);
-			jsondiff::JsonValue get_json_value_by_key_or_null(const std::string &key);
+			// check db opened and not a snapshot handle, if not, throw boost::exception
+			void check_writable_db() const;
+			leveldb::ReadOptions db_read_options() const;
+			// make the current db state the one new snapshot handles read
+			void publish_snapshot();
+			// apply the staged mutations to leveldb in one write and update the storage cache
+			void write_batch(ContractStorageBatch& batch);
+			bool get_cached_storage(const std::string& key, jsondiff::JsonValue* value) const;
+			void cache_storage(const std::string& key, const jsondiff::JsonValue& value) const;
+			void uncache_storage(const std::string& key) const;
+			void trim_storage_cache() const;
+			void rollback_to_root_state_hash_without_transactional(const ContractCommitId& dest_commit_id, ContractStorageBatch& batch);
+			// move the commit_info rows of the legacy sqlite db to the commit log and rename the sqlite db to .migrated
+			void migrate_sql_commits();
+			// re-encode values saved in json text by older versions to the current binary value format
+			void migrate_value_format();
+			// build the state trie over the state saved by older versions
+			void migrate_state_trie();
+			// state trie reading through batch and staging its node changes in batch when batch is not null
+			ContractStateTrie state_trie(ContractStorageBatch* batch) const;
+			// stage the state trie leaves of the contract infos and storages staged in batch
+			void update_state_trie(ContractStorageBatch& batch);
+			ContractStateProof prove_state(const std::string& key, jsondiff::JsonValue* value) const;
+			// append commit info to the commit log
+			void add_commit_info(ContractCommitId commit_id, const std::string &change_type, const std::string &diff_str, const std::string &contract_id, ContractStorageBatch& batch);
+			// stage the undo record of commit_id built from the prior values captured in batch
+			void add_commit_undo(const ContractCommitId& commit_id, ContractStorageBatch& batch);
+			// stage the undo record of commit_id. returns false when the commit has no undo record(saved by older versions)
+			bool undo_commit(const ContractCommitId& commit_id, ContractStorageBatch& batch);
+			// get value from key-value db by key, seeing the mutations staged in batch when batch is not null
+			bool read_value(const std::string& key, std::string* value, const ContractStorageBatch* batch = nullptr) const;
+			jsondiff::JsonValue get_json_value_by_key_or_null(const std::string &key, const ContractStorageBatch* batch) const;
+			ContractInfoP get_contract_info(const AddressType& contract_id, const ContractStorageBatch* batch) const;
+			jsondiff::JsonValue get_contract_storage(const AddressType& contract_id, const std::string& storage_name, const ContractStorageBatch* batch) const;
+			std::vector<ContractBalance> get_contract_balances(const AddressType& contract_id, const ContractStorageBatch* batch) const;
+
+			ContractCommitInfoP get_commit_info(const ContractCommitId& commit_id, const ContractStorageBatch* batch) const;
+			// sequence number of the last commit in the commit log, 0 when empty
+			uint64_t last_commit_seq(const ContractStorageBatch* batch) const;
 
 			ContractCommitId generate_next_root_hash(const std::string& old_root_state_hash, const fcrypto::sha256& diff_hash) const;
 
@@ -0,0 +1,53 @@
+#pragma once
+#include <string>
+#include <vector>
+#include <functional>
+#include <cstdint>
+
+namespace contract
+{
+	namespace storage
+	{
+		// merkle proof of one key of the state trie
+		struct ContractStateProof
+		{
+			std::vector<std::string> siblings; // sibling hashes on the path, from the root down
+			// leaf the path ends at, empty when it ends at an empty subtree.
+			// a leaf of another key on the path of the proved key proves the key absent
+			std::string leaf_key_hash;
+			std::string leaf_value_hash;
+		};
+
+		// sparse merkle tree of sha256(key) => sha256(value), kept as nodes in the contract storage db.
+		// a subtree with a single leaf is stored as that leaf at the subtree root, so paths are O(log n) long
+		// and the root hash only depends on the leaves, not on the update order
+		class ContractStateTrie final
+		{
+		public:
+			// node_key => encoded node, returns false when the node doesn't exist
+			typedef std::function<bool(const std::string& node_key, std::string* node)> NodeReader;
+			// node is nullptr to erase the node
+			typedef std::function<void(const std::string& node_key, const std::string* node)> NodeWriter;
+		private:
+			NodeReader _reader;
+			NodeWriter _writer;
+
+			std::string update(uint32_t depth, const std::string& key_hash, const std::string& value_hash);
+		public:
+			ContractStateTrie(NodeReader reader, NodeWriter writer);
+
+			std::string root_hash() const;
+			// set the leaf of key_hash to value_hash, an empty value_hash removes the leaf
+			void update(const std::string& key_hash, const std::string& value_hash);
+			ContractStateProof prove(const std::string& key_hash) const;
+
+			// hashes are raw 32 bytes sha256 digests. empty subtree hash is 32 zero bytes
+			static std::string empty_hash();
+			static std::string leaf_hash(const std::string& key_hash, const std::string& value_hash);
+			static std::string branch_hash(const std::string& left, const std::string& right);
+			// root hash proof leads to when key_hash has value_hash(empty to prove absence).
+			// returns empty string when the proof can't prove it for any root
+			static std::string proof_root(const std::string& key_hash, const std::string& value_hash, const ContractStateProof& proof);
+		};
+	}
+}
@@ -0,0 +1,27 @@
+#pragma once
+#include <string>
+#include <vector>
+
+namespace contract
+{
+	namespace storage
+	{
+		// prior raw value of one leveldb key changed by a commit
+		struct ContractStorageUndoItem
+		{
+			std::string key;
+			bool existed = false; // false when the commit created the key
+			std::string value;
+		};
+
+		// undo information for one commit. rolling back the commit restores every item
+		struct ContractCommitUndo
+		{
+			std::vector<ContractStorageUndoItem> items;
+
+			std::string encode() const;
+			// @throws ContractStorageException
+			static ContractCommitUndo decode(const std::string& data);
+		};
+	}
+}
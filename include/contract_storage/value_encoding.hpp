@@ -0,0 +1,40 @@
+#pragma once
+#include <string>
+#include <jsondiff/jsondiff.h>
+
+namespace contract
+{
+	namespace storage
+	{
+		// version of the binary encoding of contract storage values and contract infos in db
+		#define CONTRACT_STORAGE_VALUE_FORMAT_VERSION 1
+
+		// first byte of binary encoded values. never the first byte of a json text
+		#define CONTRACT_STORAGE_BINARY_VALUE_MAGIC '\xff'
+
+		// value tags of the binary encoding. scalar, table and array tags share the numbers of uvm::blockchain::StorageValueTypes
+		enum StorageValueEncodingTags
+		{
+			storage_value_tag_null = 0,
+			storage_value_tag_int = 1, // negative integer
+			storage_value_tag_number = 2,
+			storage_value_tag_bool = 3,
+			storage_value_tag_string = 4,
+			storage_value_tag_uint = 6, // non-negative integer
+			storage_value_tag_table = 50,
+			storage_value_tag_array = 100
+		};
+
+		// encode value to binary format. values the binary format can't represent exactly as json text round-trip fall back to json text
+		std::string encode_storage_value(const jsondiff::JsonValue& value);
+		// decode value from binary format or legacy json text
+		jsondiff::JsonValue decode_storage_value(const std::string& data);
+		bool is_binary_storage_value(const std::string& data);
+
+		// varint and length-prefixed bytes helpers of the binary formats. readers throw ContractStorageException on truncated data
+		void write_varint(std::string& out, uint64_t n);
+		uint64_t read_varint(const std::string& data, size_t& pos);
+		void write_bytes(std::string& out, const std::string& str);
+		std::string read_bytes(const std::string& data, size_t& pos);
+	}
+}
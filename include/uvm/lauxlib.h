@@ -107,6 +107,13 @@ LUALIB_API int (luaL_loadstring)(lua_State *L, const char *s);
 
 LUALIB_API lua_State *(luaL_newstate)(void);
 
+/* a state whose memory comes from its own arena, capped at 'max_size' live bytes.
+   close it with luaL_closearenastate, which frees the arena after the state */
+LUALIB_API lua_State *(luaL_newarenastate)(size_t max_size);
+LUALIB_API void (luaL_closearenastate)(lua_State *L);
+/* changes the cap of an arena state, which must not be under its live memory yet */
+LUALIB_API void (luaL_setarenamaxsize)(lua_State *L, size_t max_size);
+
 LUALIB_API lua_Integer(luaL_len) (lua_State *L, int idx);
 
 LUALIB_API const char *(luaL_gsub)(lua_State *L, const char *s, const char *p,
@@ -0,0 +1,91 @@
+/*
+** Jump table for the main loop of 'luaV_execute', included inside it
+** when LUA_USE_JUMPTABLE is set (see lvm.h)
+** See Copyright Notice in lua.h
+*/
+
+#undef vmdispatch
+#undef vmcase
+#undef vmdefault
+#undef vmbreak
+
+#define vmdispatch(x)	goto *disptab[x];
+
+#define vmcase(l)	L_##l:
+
+#define vmdefault	L_UOP_UNKNOWN:
+
+/* fetch, charge and dispatch the next instruction right away (see 'vmfetch') */
+#define vmbreak		{ vmfetch(); vmdispatch(GET_OPCODE(i)); }
+
+
+static_assert(UNUM_OPCODES == 55, "update disptab with the opcodes");
+
+/* ORDER OP. the opcode field can hold opcodes the vm doesn't know, they do nothing as with the switch */
+static const void *const disptab[1 << SIZE_OP] = {
+
+&&L_UOP_MOVE,
+&&L_UOP_LOADK,
+&&L_UOP_LOADKX,
+&&L_UOP_LOADBOOL,
+&&L_UOP_LOADNIL,
+&&L_UOP_GETUPVAL,
+&&L_UOP_GETTABUP,
+&&L_UOP_GETTABLE,
+&&L_UOP_SETTABUP,
+&&L_UOP_SETUPVAL,
+&&L_UOP_SETTABLE,
+&&L_UOP_NEWTABLE,
+&&L_UOP_SELF,
+&&L_UOP_ADD,
+&&L_UOP_SUB,
+&&L_UOP_MUL,
+&&L_UOP_MOD,
+&&L_UOP_POW,
+&&L_UOP_DIV,
+&&L_UOP_IDIV,
+&&L_UOP_BAND,
+&&L_UOP_BOR,
+&&L_UOP_BXOR,
+&&L_UOP_SHL,
+&&L_UOP_SHR,
+&&L_UOP_UNM,
+&&L_UOP_BNOT,
+&&L_UOP_NOT,
+&&L_UOP_LEN,
+&&L_UOP_CONCAT,
+&&L_UOP_JMP,
+&&L_UOP_EQ,
+&&L_UOP_LT,
+&&L_UOP_LE,
+&&L_UOP_TEST,
+&&L_UOP_TESTSET,
+&&L_UOP_CALL,
+&&L_UOP_TAILCALL,
+&&L_UOP_RETURN,
+&&L_UOP_FORLOOP,
+&&L_UOP_FORPREP,
+&&L_UOP_TFORCALL,
+&&L_UOP_TFORLOOP,
+&&L_UOP_SETLIST,
+&&L_UOP_CLOSURE,
+&&L_UOP_VARARG,
+&&L_UOP_EXTRAARG,
+&&L_UOP_PUSH,
+&&L_UOP_POP,
+&&L_UOP_GETTOP,
+&&L_UOP_CMP,
+&&L_UOP_CMP_EQ,
+&&L_UOP_CMP_NE,
+&&L_UOP_CMP_GT,
+&&L_UOP_CMP_LT,
+&&L_UOP_UNKNOWN,
+&&L_UOP_UNKNOWN,
+&&L_UOP_UNKNOWN,
+&&L_UOP_UNKNOWN,
+&&L_UOP_UNKNOWN,
+&&L_UOP_UNKNOWN,
+&&L_UOP_UNKNOWN,
+&&L_UOP_UNKNOWN,
+&&L_UOP_UNKNOWN
+};
@@ -427,6 +427,7 @@ typedef struct Proto {
     struct LClosure *cache;  /* last-created closure with this prototype */
     TString  *source;  /* used for debug information */
     GCObject *gclist;
+    lu_byte *gasblocks;  /* gas blocks of 'code', built on first run (see lvm.cpp) */
 } Proto;
 
 
@@ -19,6 +19,11 @@
 #include <uvm/uvm_api.h>
 
 #define LUA_MALLOC_TOTAL_SIZE	(50*1024*1024)
+/* malloc buffers of closed states kept for reuse, see lua_newstate */
+#define LUA_MALLOC_BUFFER_POOL_SIZE	8
+#define LUA_MALLOC_POOLED_BUFFER_MAX_USED_SIZE	(4*1024*1024)
+/* live memory of a contract state, an allocation over it fails as out of memory, see luaL_newarenastate */
+#define LUA_STATE_MAX_MEMORY_SIZE	(256*1024*1024)
 
 #define LUA_COMPILE_ERROR_MAX_LENGTH 4096
 
@@ -214,6 +219,7 @@ struct lua_State {
     bool force_stopping;
 	int exit_code;
     UvmStatePreProcessorFunction *preprocessor;
+    struct UvmStateValues *state_values; // shared values of the state, see uvm_lib
 
 	StkId evalstack; //for calulate
 	StkId evalstacktop;//first free slot
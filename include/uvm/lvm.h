@@ -37,6 +37,20 @@
 #endif
 
 
+/*
+** 'luaV_execute' dispatches through a table of label addresses (see
+** ljumptab.h) when the compiler supports it, else through a switch.
+** Define LUA_USE_JUMPTABLE to 0 to force the switch
+*/
+#if !defined(LUA_USE_JUMPTABLE)
+#if defined(__GNUC__)
+#define LUA_USE_JUMPTABLE	1
+#else
+#define LUA_USE_JUMPTABLE	0
+#endif
+#endif
+
+
 #define tonumber(o,n) \
 	(ttisfloat(o) ? (*(n) = fltvalue(o), 1) : luaV_tonumber_(o,n))
 
@@ -105,6 +119,9 @@ LUAI_FUNC void luaV_finishset(lua_State *L, const TValue *t, TValue *key,
     StkId val, const TValue *oldval);
 LUAI_FUNC void luaV_finishOp(lua_State *L);
 LUAI_FUNC void luaV_execute(lua_State *L);
+/* charge gas per block of instructions that can't see the count, on by default.
+   turning it off charges every instruction alone, with the same counts */
+LUAI_FUNC void luaV_setgasblocks(bool enabled);
 LUAI_FUNC void luaV_concat(lua_State *L, int total);
 LUAI_FUNC lua_Integer luaV_div(lua_State *L, lua_Integer x, lua_Integer y);
 LUAI_FUNC lua_Integer luaV_mod(lua_State *L, lua_Integer x, lua_Integer y);
@@ -436,6 +436,8 @@ bool lua_push_storage_value(lua_State *L, const UvmStorageValue &value);
 
 UvmStorageValue json_to_uvm_storage_value(lua_State *L, jsondiff::JsonValue json_value);
 jsondiff::JsonValue uvm_storage_value_to_json(UvmStorageValue value);
+// JsonDiff::diff of the json values of before and after. tables only convert their changed entries
+jsondiff::DiffResultP uvm_storage_value_diff(const UvmStorageValue &before, const UvmStorageValue &after);
 
 typedef std::unordered_map<std::string, UvmStorageChangeItem> ContractChangesMap;
 
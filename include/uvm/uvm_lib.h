@@ -65,6 +65,38 @@ typedef struct _UvmStateValueNode {
     UvmStateValue value;
 } UvmStateValueNode;
 
+/**
+* values the vm and the chain apis read on hot paths, kept in typed slots of the lua_State
+* instead of by string key. the string keyed apis map the keys of these values to their slots
+*/
+enum UvmStateSlot {
+    UVM_STATE_SLOT_INSTRUCTIONS_LIMIT = 0, // INSTRUCTIONS_LIMIT_LUA_STATE_MAP_KEY
+    UVM_STATE_SLOT_INSTRUCTIONS_EXECUTED_COUNT, // INSTRUCTIONS_EXECUTED_COUNT_LUA_STATE_MAP_KEY
+    UVM_STATE_SLOT_STOP_TO_RUN_IN_LVM, // LUA_STATE_STOP_TO_RUN_IN_LVM_STATE_MAP_KEY
+    UVM_STATE_SLOT_CONTRACT_API_CALL_STACK, // GLUA_CONTRACT_API_CALL_STACK_STATE_MAP_KEY
+    UVM_STATE_SLOT_STORAGE_CHANGELIST, // LUA_STORAGE_CHANGELIST_KEY
+    UVM_STATE_SLOT_EVALUATOR, // UVM_STATE_EVALUATOR_KEY
+    UVM_STATE_SLOT_STORAGE_SERVICE, // UVM_STATE_STORAGE_SERVICE_KEY
+    UVM_STATE_SLOT_EXCEPTION_CODE, // UVM_STATE_EXCEPTION_CODE_KEY
+    UVM_STATE_SLOT_EXCEPTION_MSG, // UVM_STATE_EXCEPTION_MSG_KEY
+    UVM_STATE_SLOT_PROFILE, // UVM_STATE_PROFILE_KEY
+    UVM_STATE_SLOT_COUNT
+};
+
+#define UVM_STATE_EVALUATOR_KEY "evaluator"
+#define UVM_STATE_STORAGE_SERVICE_KEY "storage_service"
+#define UVM_STATE_EXCEPTION_CODE_KEY "exception_code"
+#define UVM_STATE_EXCEPTION_MSG_KEY "exception_msg"
+#define UVM_STATE_PROFILE_KEY "execution_profile"
+
+/**
+* shared values of one lua_State, owned by lua_State::state_values
+*/
+struct UvmStateValues {
+    UvmStateValueNode slots[UVM_STATE_SLOT_COUNT];
+    std::unordered_map<std::string, UvmStateValueNode> values; // values of keys without a slot
+};
+
 
 namespace uvm
 {
@@ -298,11 +330,28 @@ namespace uvm
             /**
             * share some values in L
             */
-            void close_all_lua_state_values();
             void close_lua_state_values(lua_State *L);
 
             UvmStateValueNode get_lua_state_value_node(lua_State *L, const char *key);
             UvmStateValue get_lua_state_value(lua_State *L, const char *key);
+
+            inline UvmStateValueNode get_lua_state_slot_node(lua_State *L, UvmStateSlot slot)
+            {
+                if (nullptr == L || nullptr == L->state_values)
+                {
+                    UvmStateValueNode nil_value_node;
+                    nil_value_node.type = LUA_STATE_VALUE_nullptr;
+                    nil_value_node.value.pointer_value = nullptr;
+                    return nil_value_node;
+                }
+                return L->state_values->slots[slot];
+            }
+            inline UvmStateValue get_lua_state_slot_value(lua_State *L, UvmStateSlot slot)
+            {
+                return get_lua_state_slot_node(L, slot).value;
+            }
+            void set_lua_state_slot_value(lua_State *L, UvmStateSlot slot, UvmStateValue value, enum UvmStateValueType type);
+
             void set_lua_state_instructions_limit(lua_State *L, int limit);
 
             int get_lua_state_instructions_limit(lua_State *L);
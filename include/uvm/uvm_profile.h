@@ -0,0 +1,88 @@
+#ifndef uvm_profile_h
+#define uvm_profile_h
+
+#include <uvm/lprefix.h>
+
+#include <chrono>
+#include <cstdint>
+#include <map>
+#include <string>
+
+#include <uvm/lopcodes.h>
+#include <uvm/uvm_lib.h>
+
+typedef struct _UvmHostApiProfile {
+    uint64_t calls = 0;
+    int64_t time_ns = 0;
+} UvmHostApiProfile;
+
+/**
+* what contract executions spent, by opcode and by host api.
+* the vm and the chain api record into the profile in the UVM_STATE_SLOT_PROFILE slot of the
+* lua_State, states without one are not profiled
+*/
+struct UvmExecutionProfile {
+    uint64_t opcode_counts[UNUM_OPCODES] = {};
+    std::map<std::string, UvmHostApiProfile> host_apis;
+    uint64_t storage_read_bytes = 0;
+    uint64_t storage_write_bytes = 0;
+    int host_api_depth = 0; // host api calls in progress, see UvmHostApiTimer
+
+    void merge(const UvmExecutionProfile& other)
+    {
+        for (int op = 0; op < UNUM_OPCODES; op++)
+            opcode_counts[op] += other.opcode_counts[op];
+        for (const auto& p : other.host_apis)
+        {
+            auto& api = host_apis[p.first];
+            api.calls += p.second.calls;
+            api.time_ns += p.second.time_ns;
+        }
+        storage_read_bytes += other.storage_read_bytes;
+        storage_write_bytes += other.storage_write_bytes;
+    }
+};
+
+namespace uvm
+{
+    namespace lua
+    {
+        namespace lib
+        {
+            inline UvmExecutionProfile *get_lua_state_profile(lua_State *L)
+            {
+                return static_cast<UvmExecutionProfile*>(get_lua_state_slot_value(L, UVM_STATE_SLOT_PROFILE).pointer_value);
+            }
+
+            /**
+            * counts and times a host api call in the profile of L, if it has one.
+            * host apis called by another host api are part of the outer call
+            */
+            class UvmHostApiTimer
+            {
+            private:
+                UvmExecutionProfile *_profile;
+                const char *_name;
+                std::chrono::steady_clock::time_point _start;
+            public:
+                UvmHostApiTimer(lua_State *L, const char *name)
+                    : _profile(get_lua_state_profile(L)), _name(name)
+                {
+                    if (_profile && _profile->host_api_depth++ == 0)
+                        _start = std::chrono::steady_clock::now();
+                }
+                ~UvmHostApiTimer()
+                {
+                    if (_profile && --_profile->host_api_depth == 0)
+                    {
+                        auto& api = _profile->host_apis[_name];
+                        api.calls++;
+                        api.time_ns += std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - _start).count();
+                    }
+                }
+            };
+        }
+    }
+}
+
+#endif
@@ -0,0 +1,124 @@
+// Copyright (c) 2018 The Bitcoin Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include <bench/bench.h>
+#include <fs.h>
+#include <contract_storage/contract_storage.hpp>
+#include <contract_engine/native_contract.hpp>
+
+static const uint32_t BENCH_CONTRACT_STORAGE_MAGIC_NUMBER = 0x1234;
+
+static fs::path ContractStorageBenchDir()
+{
+    static fs::path bench_dir = fs::temp_directory_path() / fs::unique_path("bench_contract_storage_%%%%-%%%%");
+    fs::create_directories(bench_dir);
+    return bench_dir;
+}
+
+// Acquire the process-wide storage service handle, as validation does for every contract tx
+static void ContractStorageAcquire(benchmark::State& state)
+{
+    const auto& dir = ContractStorageBenchDir();
+    while (state.KeepRunning()) {
+        auto service = ::contract::storage::ContractStorageService::get_instance(BENCH_CONTRACT_STORAGE_MAGIC_NUMBER, (dir / "db").string(), (dir / "sql.db").string());
+        service->current_root_state_hash();
+    }
+}
+
+// Reopen the database on every acquire, which is what every handle used to cost
+static void ContractStorageReopen(benchmark::State& state)
+{
+    const auto& dir = ContractStorageBenchDir();
+    while (state.KeepRunning()) {
+        ::contract::storage::ContractStorageService service(BENCH_CONTRACT_STORAGE_MAGIC_NUMBER, (dir / "reopen_db").string(), (dir / "reopen_sql.db").string());
+        service.current_root_state_hash();
+    }
+}
+
+// Open a read-only snapshot handle, as the contract query RPCs do
+static void ContractStorageSnapshot(benchmark::State& state)
+{
+    const auto& dir = ContractStorageBenchDir();
+    while (state.KeepRunning()) {
+        auto service = ::contract::storage::ContractStorageService::get_snapshot(BENCH_CONTRACT_STORAGE_MAGIC_NUMBER, (dir / "db").string(), (dir / "sql.db").string());
+        service->current_root_state_hash();
+    }
+}
+
+// Connect block_count blocks each changing a few contract storages, then disconnect them all
+static void ContractStorageRollback(benchmark::State& state, uint32_t block_count)
+{
+    using namespace ::contract::storage;
+    const auto& dir = ContractStorageBenchDir();
+    auto service = ContractStorageService::get_instance(BENCH_CONTRACT_STORAGE_MAGIC_NUMBER, (dir / "db").string(), (dir / "sql.db").string());
+    const auto contract_id = std::string("CONBENCHROLLBACK");
+    jsondiff::JsonDiff differ;
+    while (state.KeepRunning()) {
+        const auto start_root = service->current_root_state_hash();
+        for (uint32_t height = 1; height <= block_count; height++) {
+            auto changes = std::make_shared<ContractChanges>();
+            ContractStorageChange storage_change;
+            storage_change.contract_id = contract_id;
+            for (int i = 0; i < 4; i++) {
+                ContractStorageItemChange item;
+                item.name = "storage" + std::to_string(i);
+                jsondiff::JsonObject new_value;
+                new_value["height"] = height;
+                new_value["owner"] = "bench";
+                item.diff = differ.diff(service->get_contract_storage(contract_id, item.name), new_value);
+                storage_change.items.push_back(item);
+            }
+            changes->storage_changes.push_back(storage_change);
+            service->set_current_block_height(height);
+            service->commit_contract_changes(changes);
+        }
+        service->rollback_contract_state(start_root);
+    }
+}
+
+// Hash the changes of a block that rewrote a storage table of 10k rows, as the root state hash does
+static void ContractChangesDigest(benchmark::State& state)
+{
+    jsondiff::JsonObject table;
+    table.reserve(10000);
+    for (int64_t i = 0; i < 10000; i++) {
+        jsondiff::JsonObject row;
+        row("owner", "addr" + std::to_string(i));
+        row("amount", i);
+        table("key" + std::to_string(i), jsondiff::JsonValue(std::move(row)));
+    }
+    const jsondiff::JsonValue changes(std::move(table));
+    while (state.KeepRunning()) {
+        ::contract::storage::ordered_json_digest(changes);
+    }
+}
+
+// Invoke the init api of a dgp native contract, which reads and sets four storages, then list its admins
+static void NativeContractInvoke(benchmark::State& state)
+{
+    using namespace blockchain::contract;
+    const auto& dir = ContractStorageBenchDir();
+    auto service = ::contract::storage::ContractStorageService::get_instance(BENCH_CONTRACT_STORAGE_MAGIC_NUMBER, (dir / "db").string(), (dir / "sql.db").string());
+    PendingState pending_state(service.get());
+    native_contract_sender sender;
+    sender.caller_address = "bench_admin";
+    while (state.KeepRunning()) {
+        auto contract = native_contract_finder::create_native_contract_by_key(&pending_state, dgp_native_contract::native_contract_key(), "CONBENCHDGP", sender);
+        contract->invoke("init", "");
+        contract->invoke("admins", "");
+    }
+}
+
+static void ContractStorageRollback1(benchmark::State& state) { ContractStorageRollback(state, 1); }
+static void ContractStorageRollback10(benchmark::State& state) { ContractStorageRollback(state, 10); }
+static void ContractStorageRollback100(benchmark::State& state) { ContractStorageRollback(state, 100); }
+
+BENCHMARK(ContractStorageAcquire, 500 * 1000);
+BENCHMARK(ContractStorageReopen, 100);
+BENCHMARK(ContractStorageSnapshot, 500 * 1000);
+BENCHMARK(ContractChangesDigest, 100);
+BENCHMARK(NativeContractInvoke, 10 * 1000);
+BENCHMARK(ContractStorageRollback1, 100);
+BENCHMARK(ContractStorageRollback10, 20);
+BENCHMARK(ContractStorageRollback100, 2);
@@ -0,0 +1,52 @@
+// Copyright (c) 2018 The Bitcoin Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include <bench/bench.h>
+#include <jsondiff/jsondiff.h>
+
+#include <cassert>
+
+// A storage table of 10k rows as contracts keep them, each row a table itself
+static jsondiff::JsonValue MakeStorageTable(int64_t changed_amount)
+{
+    jsondiff::JsonObject table;
+    table.reserve(10000);
+    for (int64_t i = 0; i < 10000; i++) {
+        jsondiff::JsonObject row;
+        row("owner", "addr" + std::to_string(i));
+        row("amount", i == 5000 ? changed_amount : i);
+        row("tags", jsondiff::JsonArray{ jsondiff::JsonValue("token"), jsondiff::JsonValue(i) });
+        table("key" + std::to_string(i), jsondiff::JsonValue(std::move(row)));
+    }
+    return table;
+}
+
+// Diff a large table against itself with one row changed, as every storage commit does
+static void JsonDiffLargeTable(benchmark::State& state)
+{
+    const auto old_table = MakeStorageTable(5000);
+    const auto new_table = MakeStorageTable(1);
+    jsondiff::JsonDiff differ;
+    while (state.KeepRunning()) {
+        auto diff = differ.diff(old_table, new_table);
+        assert(!diff->is_undefined());
+    }
+}
+
+// Apply and roll back that diff, as connecting and disconnecting a block do
+static void JsonPatchLargeTable(benchmark::State& state)
+{
+    const auto old_table = MakeStorageTable(5000);
+    const auto new_table = MakeStorageTable(1);
+    jsondiff::JsonDiff differ;
+    const auto diff = differ.diff(old_table, new_table);
+    while (state.KeepRunning()) {
+        auto patched = differ.patch(old_table, diff);
+        auto rolled_back = differ.rollback(patched, diff);
+        assert(rolled_back.get_object().size() == old_table.get_object().size());
+    }
+}
+
+BENCHMARK(JsonDiffLargeTable, 50);
+BENCHMARK(JsonPatchLargeTable, 20);
@@ -0,0 +1,108 @@
+// Copyright (c) 2018 The Bitcoin Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include <bench/bench.h>
+#include <btc_uvm_api.h>
+#include <uvm/lprefix.h>
+#include <uvm/uvm_lib.h>
+#include <uvm/lauxlib.h>
+#include <uvm/uvm_storage.h>
+
+#include <cassert>
+
+static void InitBenchUvmChainApi()
+{
+    if (!uvm::lua::api::global_uvm_chain_api)
+        uvm::lua::api::global_uvm_chain_api = new uvm::lua::api::BtcUvmChainApi();
+}
+
+// Create and close the lua state of a contract execution, as every contract tx does
+static void UvmStateSetup(benchmark::State& state)
+{
+    InitBenchUvmChainApi();
+    while (state.KeepRunning()) {
+        uvm::lua::lib::UvmStateScope scope(true);
+        assert(scope.L());
+    }
+}
+
+// A trivial call in a fresh state, so the state setup dominates
+static void UvmTrivialCall(benchmark::State& state)
+{
+    InitBenchUvmChainApi();
+    while (state.KeepRunning()) {
+        uvm::lua::lib::UvmStateScope scope(true);
+        auto L = scope.L();
+        int ret = luaL_dostring(L, "local t = {} for i = 1, 10 do t[i] = i end return #t");
+        assert(ret == 0);
+        (void)ret;
+    }
+}
+
+// Contract loops that spend their time in the interpreter loop rather than in the state setup
+static void RunUvmLoop(benchmark::State& state, const char* code)
+{
+    InitBenchUvmChainApi();
+    while (state.KeepRunning()) {
+        uvm::lua::lib::UvmStateScope scope(true);
+        int ret = luaL_dostring(scope.L(), code);
+        assert(ret == 0);
+        (void)ret;
+    }
+}
+
+static void UvmArithmeticLoop(benchmark::State& state)
+{
+    RunUvmLoop(state, "local s = 0 for i = 1, 10000 do s = s + i * 3 - (i // 2) s = s ~ (i << 1) end return s");
+}
+
+static void UvmTableLoop(benchmark::State& state)
+{
+    RunUvmLoop(state, "local t = {} for i = 1, 2000 do t[i] = i end "
+                      "local m = {} for i = 1, 500 do m['k' .. (i % 50)] = t[i] + #t end "
+                      "local s = 0 for i = 1, #t do s = s + t[i] end return s");
+}
+
+static void UvmStringLoop(benchmark::State& state)
+{
+    RunUvmLoop(state, "local n = 0 for i = 1, 2000 do local s = 'key' .. tostring(i) .. ',' .. i n = n + #s end return n");
+}
+
+// pairs iterates keys in order, as contracts walking holder maps do
+static void UvmPairsLoop(benchmark::State& state)
+{
+    RunUvmLoop(state, "local t = {} for i = 1, 200 do t['holder' .. i] = i end for i = 1, 50 do t[i] = i end "
+                      "local s = 0 for r = 1, 10 do for k, v in pairs(t) do s = s + v end end return s");
+}
+
+// Storage changes of a contract updating one entry of a big balances table
+static void UvmStorageTableDiff(benchmark::State& state)
+{
+    UvmTableMap before_map;
+    for (int i = 0; i < 10000; i++) {
+        UvmStorageValue balance;
+        balance.type = uvm::blockchain::StorageValueTypes::storage_value_int;
+        balance.value.int_value = i;
+        before_map["holder" + std::to_string(i)] = balance;
+    }
+    UvmTableMap after_map(before_map);
+    after_map["holder7"].value.int_value = 0;
+    UvmStorageValue before;
+    before.type = uvm::blockchain::StorageValueTypes::storage_value_int_table;
+    before.value.table_value = &before_map;
+    UvmStorageValue after = before;
+    after.value.table_value = &after_map;
+    while (state.KeepRunning()) {
+        auto diff = uvm_storage_value_diff(before, after);
+        assert(!diff->is_undefined());
+    }
+}
+
+BENCHMARK(UvmStateSetup, 10 * 1000);
+BENCHMARK(UvmTrivialCall, 10 * 1000);
+BENCHMARK(UvmArithmeticLoop, 200);
+BENCHMARK(UvmTableLoop, 200);
+BENCHMARK(UvmStringLoop, 200);
+BENCHMARK(UvmPairsLoop, 200);
+BENCHMARK(UvmStorageTableDiff, 200);
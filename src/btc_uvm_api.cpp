@@ -15,6 +15,7 @@
 #include <uvm/uvm_api.h>
 #include <uvm/uvm_lib.h>
 #include <uvm/uvm_lutil.h>
+#include <uvm/uvm_profile.h>
 #include <uvm/lobject.h>
 #include <uvm/lstate.h>
 #include <amount.h>
@@ -25,6 +26,8 @@
 #include <validation.h>
 #include <contract_engine/pending_state.hpp>
 #include <contract_engine/contract_helper.hpp>
+#include <contract_engine/contract_code_cache.hpp>
+#include <contract_storage/contract_info.hpp>
 #include <uvm/exceptions.h>
 #include <fcrypto/sha1.hpp>
 #include <fcrypto/sha256.hpp>
@@ -38,7 +41,8 @@ namespace uvm {
     namespace lua {
         namespace api {
 
-            static int has_error = 0;
+            // per thread, contracts of a block may execute on several threads
+            static thread_local int has_error = 0;
 
             /**
             * whether exception happen in L
@@ -81,7 +85,7 @@ namespace uvm {
                 }
                 lua_set_compile_error(L, msg);
 
-                int last_code = uvm::lua::lib::get_lua_state_value(L, "exception_code").int_value;
+                int last_code = uvm::lua::lib::get_lua_state_slot_value(L, UVM_STATE_SLOT_EXCEPTION_CODE).int_value;
                 if (last_code != code && last_code != 0)
                 {
                     return;
@@ -93,18 +97,26 @@ namespace uvm {
                 UvmStateValue val_msg;
                 val_msg.string_value = msg;
 
-                uvm::lua::lib::set_lua_state_value(L, "exception_code", val_code, UvmStateValueType::LUA_STATE_VALUE_INT);
-                uvm::lua::lib::set_lua_state_value(L, "exception_msg", val_msg, UvmStateValueType::LUA_STATE_VALUE_STRING);
+                uvm::lua::lib::set_lua_state_slot_value(L, UVM_STATE_SLOT_EXCEPTION_CODE, val_code, UvmStateValueType::LUA_STATE_VALUE_INT);
+                uvm::lua::lib::set_lua_state_slot_value(L, UVM_STATE_SLOT_EXCEPTION_MSG, val_msg, UvmStateValueType::LUA_STATE_VALUE_STRING);
             }
 
             static ::blockchain::contract::PendingState* get_evaluator(lua_State *L)
             {
-                return (::blockchain::contract::PendingState*) uvm::lua::lib::get_lua_state_value(L, "evaluator").pointer_value;
+                return (::blockchain::contract::PendingState*) uvm::lua::lib::get_lua_state_slot_value(L, UVM_STATE_SLOT_EVALUATOR).pointer_value;
+            }
+
+            // the tip the executing block builds on. contract txs of a block may run in worker threads, which
+            // mustn't read chainActive
+            static const CBlockIndex* get_chain_tip(lua_State *L)
+            {
+                auto evaluator = get_evaluator(L);
+                return evaluator && evaluator->tip ? evaluator->tip : chainActive.Tip();
             }
 
 			static ::contract::storage::ContractStorageService* get_contract_storage_service(lua_State *L)
 			{
-				return (::contract::storage::ContractStorageService*) uvm::lua::lib::get_lua_state_value(L, "storage_service").pointer_value;
+				return (::contract::storage::ContractStorageService*) uvm::lua::lib::get_lua_state_slot_value(L, UVM_STATE_SLOT_STORAGE_SERVICE).pointer_value;
 			}
 
             /**
@@ -114,7 +126,6 @@ namespace uvm {
             */
             int BtcUvmChainApi::check_contract_api_instructions_over_limit(lua_State *L)
             {
-                auto evaluator = get_evaluator(L);
                 auto gas_limit = uvm::lua::lib::get_lua_state_instructions_limit(L);
                 auto gas_count = uvm::lua::lib::get_lua_state_instructions_executed_count(L);
                 if(gas_limit <= 0)
@@ -124,6 +135,7 @@ namespace uvm {
 
             int BtcUvmChainApi::get_stored_contract_info(lua_State *L, const char *name, std::shared_ptr<UvmContractInfo> contract_info_ret)
             {
+                uvm::lua::lib::UvmHostApiTimer host_api_timer(L, __func__);
                 auto service = get_contract_storage_service(L);
                 FJSON_ASSERT(service != nullptr);
                 auto&& addr = service->find_contract_id_by_name(std::string(name));
@@ -167,6 +179,7 @@ namespace uvm {
             }
             int BtcUvmChainApi::get_stored_contract_info_by_address(lua_State *L, const char *contract_id, std::shared_ptr<UvmContractInfo> contract_info_ret)
             {
+                uvm::lua::lib::UvmHostApiTimer host_api_timer(L, __func__);
                 if(!contract_info_ret)
                     return 0;
                 auto evaluator = get_evaluator(L);
@@ -208,6 +221,7 @@ namespace uvm {
 
             std::shared_ptr<UvmModuleByteStream> BtcUvmChainApi::get_bytestream_from_code(lua_State *L, const uvm::blockchain::Code& code)
             {
+                uvm::lua::lib::UvmHostApiTimer host_api_timer(L, __func__);
                 if (code.code.size() > LUA_MODULE_BYTE_STREAM_BUF_SIZE)
                     return nullptr;
                 auto p_luamodule = std::make_shared<UvmModuleByteStream>();
@@ -235,6 +249,7 @@ namespace uvm {
 
             void BtcUvmChainApi::get_contract_address_by_name(lua_State *L, const char *name, char *address, size_t *address_size)
             {
+                uvm::lua::lib::UvmHostApiTimer host_api_timer(L, __func__);
                 auto service = get_contract_storage_service(L);
                 if(!service)
                     return;
@@ -254,6 +269,7 @@ namespace uvm {
 
             bool BtcUvmChainApi::check_contract_exist_by_address(lua_State *L, const char *address)
             {
+                uvm::lua::lib::UvmHostApiTimer host_api_timer(L, __func__);
                 auto evaluator = get_evaluator(L);
                 for(const auto &pair : evaluator->pending_contracts_to_create)
                 {
@@ -273,6 +289,7 @@ namespace uvm {
 
             bool BtcUvmChainApi::check_contract_exist(lua_State *L, const char *name)
             {
+                uvm::lua::lib::UvmHostApiTimer host_api_timer(L, __func__);
                 auto service = get_contract_storage_service(L);
                 if(!service)
                     return false;
@@ -283,11 +300,25 @@ namespace uvm {
                     return true;
             }
 
+            // code of a stored contract, decoded once and then served from the process-wide code cache
+            static ::blockchain::contract::ContractCodeP get_stored_contract_code(::contract::storage::ContractStorageService* service, const std::string& contract_id)
+            {
+                auto& code_cache = ::blockchain::contract::ContractCodeCache::instance();
+                auto code = code_cache.get(contract_id);
+                if (code)
+                    return service->has_contract_info(contract_id) ? code : nullptr;
+                auto contract = service->get_contract_info(contract_id);
+                if (!contract)
+                    return nullptr;
+                return code_cache.put(*contract);
+            }
+
             /**
             * load contract lua byte stream from uvm api
             */
             std::shared_ptr<UvmModuleByteStream> BtcUvmChainApi::open_contract(lua_State *L, const char *name)
             {
+                uvm::lua::lib::UvmHostApiTimer host_api_timer(L, __func__);
                 uvm::lua::lib::increment_lvm_instructions_executed_count(L, CHAIN_GLUA_API_EACH_INSTRUCTIONS_COUNT - 1);
                 auto service = get_contract_storage_service(L);
                 FJSON_ASSERT(service != nullptr);
@@ -315,23 +346,15 @@ namespace uvm {
                         return stream;
                     }
                 }
-				auto contract = service->get_contract_info(addr);
-				if (contract)
+				auto code = get_stored_contract_code(service, addr);
+				if (code)
 				{
 					auto stream = std::make_shared<UvmModuleByteStream>();
 					if (nullptr == stream)
 						return nullptr;
-					stream->buff.resize(contract->bytecode.size());
-					memcpy(stream->buff.data(), contract->bytecode.data(), contract->bytecode.size());
-					stream->is_bytes = true;
+					code->fill_stream(*stream);
 					stream->contract_name = name;
 					stream->contract_id = addr;
-					for (const auto& api : contract->apis)
-						stream->contract_apis.push_back(api);
-					for (const auto& offline_api : contract->offline_apis)
-						stream->offline_apis.push_back(offline_api);
-					for (const auto& p : contract->storage_types)
-						stream->contract_storage_properties[p.first] = (uvm::blockchain::StorageValueTypes) p.second;
 					return stream;
 				}
                 return nullptr;
@@ -339,6 +362,7 @@ namespace uvm {
 
             std::shared_ptr<UvmModuleByteStream> BtcUvmChainApi::open_contract_by_address(lua_State *L, const char *address)
             {
+                uvm::lua::lib::UvmHostApiTimer host_api_timer(L, __func__);
                 uvm::lua::lib::increment_lvm_instructions_executed_count(L, CHAIN_GLUA_API_EACH_INSTRUCTIONS_COUNT - 1);
                 auto evaluator = get_evaluator(L);
                 for(const auto &pair : evaluator->pending_contracts_to_create) {
@@ -363,23 +387,15 @@ namespace uvm {
                 }
 				auto service = get_contract_storage_service(L);
                 FJSON_ASSERT(service != nullptr);
-				auto contract = service->get_contract_info(std::string(address));
-				if (contract)
+				auto code = get_stored_contract_code(service, std::string(address));
+				if (code)
 				{
 					auto stream = std::make_shared<UvmModuleByteStream>();
 					if (nullptr == stream)
 						return nullptr;
-					stream->buff.resize(contract->bytecode.size());
-					memcpy(stream->buff.data(), contract->bytecode.data(), contract->bytecode.size());
-					stream->is_bytes = true;
+					code->fill_stream(*stream);
 					stream->contract_name = "";
 					stream->contract_id = std::string(address);
-					for (const auto& api : contract->apis)
-						stream->contract_apis.push_back(api);
-					for (const auto& offline_api : contract->offline_apis)
-						stream->offline_apis.push_back(offline_api);
-					for (const auto& p : contract->storage_types)
-					 	stream->contract_storage_properties[p.first] = (uvm::blockchain::StorageValueTypes) p.second;
 					return stream;
 				}
 				return nullptr;
@@ -387,6 +403,7 @@ namespace uvm {
 
             UvmStorageValue BtcUvmChainApi::get_storage_value_from_uvm(lua_State *L, const char *contract_name, const std::string& name, const std::string& flat_map_key, bool is_flat_map)
             {
+                uvm::lua::lib::UvmHostApiTimer host_api_timer(L, __func__);
                 auto service = get_contract_storage_service(L);
                 FJSON_ASSERT(service != nullptr);
 				auto&& contract_address = service->find_contract_id_by_name(std::string(contract_name));
@@ -396,6 +413,7 @@ namespace uvm {
 
             UvmStorageValue BtcUvmChainApi::get_storage_value_from_uvm_by_address(lua_State *L, const char *contract_address, const std::string& name, const std::string& flat_map_key, bool is_flat_map)
             {
+                uvm::lua::lib::UvmHostApiTimer host_api_timer(L, __func__);
 				uvm::lua::lib::increment_lvm_instructions_executed_count(L, CHAIN_GLUA_API_EACH_INSTRUCTIONS_COUNT - 1);
 				auto evaluator = get_evaluator(L);
 				auto storage_service = get_contract_storage_service(L);
@@ -404,66 +422,19 @@ namespace uvm {
                     storage_key = name + "." + flat_map_key;
                 }
 				auto json_value = storage_service->get_contract_storage(std::string(contract_address), storage_key);
+				auto profile = uvm::lua::lib::get_lua_state_profile(L);
+				if (profile)
+					profile->storage_read_bytes += jsondiff::json_dumps(json_value).size();
 				UvmStorageValue value = json_to_uvm_storage_value(L, json_value);
                 return value;
             }
 
-			static bool compare_key(const std::string& first, const std::string& second)
-			{
-				unsigned int i = 0;
-				while ((i<first.length()) && (i<second.length()))
-				{
-					if (first[i] < second[i])
-						return true;
-					else if (first[i] > second[i])
-						return false;
-					else
-						++i;
-				}
-				return (first.length() < second.length());
-			}
-
-			// parse arg to json_array when it's json object. otherwhile return itself. And recursively process child elements
-			static jsondiff::JsonValue nested_json_object_to_array(const jsondiff::JsonValue& json_value)
-			{
-				if (json_value.is_object())
-				{
-					const auto& obj = json_value.as<jsondiff::JsonObject>();
-					jsondiff::JsonArray json_array;
-					std::list<std::string> keys;
-					for (auto it = obj.begin(); it != obj.end(); it++)
-					{
-						keys.push_back(it->key());
-					}
-					keys.sort(&compare_key);
-					for (const auto& key : keys)
-					{
-						jsondiff::JsonArray item_json;
-						item_json.push_back(key);
-						item_json.push_back(nested_json_object_to_array(obj[key]));
-						json_array.push_back(item_json);
-					}
-					return json_array;
-				}
-				if (json_value.is_array())
-				{
-					const auto& arr = json_value.as<jsondiff::JsonArray>();
-					jsondiff::JsonArray result;
-					for (const auto& item : arr)
-					{
-						result.push_back(nested_json_object_to_array(item));
-					}
-					return result;
-				}
-				return json_value;
-			}
-
             bool BtcUvmChainApi::commit_storage_changes_to_uvm(lua_State *L, AllContractsChangesMap &changes)
             {
+                uvm::lua::lib::UvmHostApiTimer host_api_timer(L, __func__);
 				auto evaluator = get_evaluator(L);
 				if (!evaluator)
 					return true;
-				jsondiff::JsonDiff differ;
 			    int64_t storage_gas = 0;
 
 				auto gas_limit = uvm::lua::lib::get_lua_state_instructions_limit(L);
@@ -482,19 +453,22 @@ namespace uvm {
 						if (storage_change.is_fast_map)
 							storage_key = storage_change.key + "." + storage_change.fast_map_key;
 						if (storage_change.diff.is_undefined())
-                            nested_changes[storage_key] = differ.diff(uvm_storage_value_to_json(storage_change.before), uvm_storage_value_to_json(storage_change.after))->value();
+                            nested_changes[storage_key] = uvm_storage_value_diff(storage_change.before, storage_change.after)->value();
 						else
                             nested_changes[storage_key] = storage_change.diff.value();
 					}
 					// count gas by changes size
-					const auto& changes_parsed_to_array = nested_json_object_to_array(nested_changes);
-					auto changes_size = jsondiff::json_dumps(changes_parsed_to_array).size();
+					jsondiff::JsonValue nested_changes_json(std::move(nested_changes));
+					auto changes_size = ::contract::storage::ordered_json_size(nested_changes_json);
 					storage_gas += changes_size * 10; // 1 byte storage cost 10 gas
+					auto profile = uvm::lua::lib::get_lua_state_profile(L);
+					if (profile)
+						profile->storage_write_bytes += changes_size;
 					if (storage_gas < 0 && gas_limit > 0) {
 						throw_exception(L, UVM_API_LVM_LIMIT_OVER_ERROR, out_of_gas_error);
 						return false;
 					}
-					evaluator->contract_storage_changes.push_back(std::make_pair(contract_id, std::make_shared<jsondiff::DiffResult>(nested_changes)));
+					evaluator->contract_storage_changes.push_back(std::make_pair(contract_id, std::make_shared<jsondiff::DiffResult>(nested_changes_json)));
 				}
 				if (gas_limit > 0) {
 					if (storage_gas > gas_limit || storage_gas + uvm::lua::lib::get_lua_state_instructions_executed_count(L) > gas_limit) {
@@ -599,6 +573,7 @@ namespace uvm {
             lua_Integer BtcUvmChainApi::transfer_from_contract_to_address(lua_State *L, const char *contract_address, const char *to_address,
                                                                             const char *asset_type, int64_t amount)
             {
+                uvm::lua::lib::UvmHostApiTimer host_api_timer(L, __func__);
                 uvm::lua::lib::increment_lvm_instructions_executed_count(L, CHAIN_GLUA_API_EACH_INSTRUCTIONS_COUNT - 1);
 				std::string contract_addr_str(contract_address);
 				std::string to_addr_str(to_address);
@@ -629,6 +604,7 @@ namespace uvm {
             lua_Integer BtcUvmChainApi::transfer_from_contract_to_public_account(lua_State *L, const char *contract_address, const char *to_account_name,
                                                                                    const char *asset_type, int64_t amount)
             {
+                uvm::lua::lib::UvmHostApiTimer host_api_timer(L, __func__);
                 // not supported
                 uvm::lua::lib::increment_lvm_instructions_executed_count(L, CHAIN_GLUA_API_EACH_INSTRUCTIONS_COUNT - 1);
                 return 1;
@@ -636,6 +612,7 @@ namespace uvm {
 
             int64_t BtcUvmChainApi::get_contract_balance_amount(lua_State *L, const char *contract_address, const char* asset_symbol)
             {
+                uvm::lua::lib::UvmHostApiTimer host_api_timer(L, __func__);
                 uvm::lua::lib::increment_lvm_instructions_executed_count(L, CHAIN_GLUA_API_EACH_INSTRUCTIONS_COUNT - 1);
                 auto service = get_contract_storage_service(L);
                 if(!service)
@@ -653,6 +630,7 @@ namespace uvm {
 
             int64_t BtcUvmChainApi::get_transaction_fee(lua_State *L)
             {
+                uvm::lua::lib::UvmHostApiTimer host_api_timer(L, __func__);
                 uvm::lua::lib::increment_lvm_instructions_executed_count(L, CHAIN_GLUA_API_EACH_INSTRUCTIONS_COUNT - 1);
                 auto pending_state = get_evaluator(L);
                 return pending_state->nTxFee;
@@ -660,15 +638,17 @@ namespace uvm {
 
             uint32_t BtcUvmChainApi::get_chain_now(lua_State *L)
             {
+                uvm::lua::lib::UvmHostApiTimer host_api_timer(L, __func__);
                 uvm::lua::lib::increment_lvm_instructions_executed_count(L, CHAIN_GLUA_API_EACH_INSTRUCTIONS_COUNT - 1);
-                auto bindex = chainActive.Tip();
+                auto bindex = get_chain_tip(L);
                 return bindex->nTime;
             }
 
             uint32_t BtcUvmChainApi::get_chain_random(lua_State *L)
             {
+                uvm::lua::lib::UvmHostApiTimer host_api_timer(L, __func__);
                 uvm::lua::lib::increment_lvm_instructions_executed_count(L, CHAIN_GLUA_API_EACH_INSTRUCTIONS_COUNT - 1);
-                auto bindex = chainActive.Tip();
+                auto bindex = get_chain_tip(L);
                 CBlock block;
                 auto res = ReadBlockFromDisk(block, bindex, Params().GetConsensus());
                 if(!res)
@@ -679,6 +659,7 @@ namespace uvm {
 
             std::string BtcUvmChainApi::get_transaction_id(lua_State *L)
             {
+                uvm::lua::lib::UvmHostApiTimer host_api_timer(L, __func__);
                 uvm::lua::lib::increment_lvm_instructions_executed_count(L, CHAIN_GLUA_API_EACH_INSTRUCTIONS_COUNT - 1);
 				auto pending_state = get_evaluator(L);
 				uint256 tx_id = pending_state->tx_id;
@@ -687,15 +668,17 @@ namespace uvm {
 
             uint32_t BtcUvmChainApi::get_header_block_num(lua_State *L)
             {
+                uvm::lua::lib::UvmHostApiTimer host_api_timer(L, __func__);
                 uvm::lua::lib::increment_lvm_instructions_executed_count(L, CHAIN_GLUA_API_EACH_INSTRUCTIONS_COUNT - 1);
-				auto bindex = chainActive.Tip();
+				auto bindex = get_chain_tip(L);
 				return bindex->nHeight;
             }
 
             uint32_t BtcUvmChainApi::wait_for_future_random(lua_State *L, int next)
             {
+                uvm::lua::lib::UvmHostApiTimer host_api_timer(L, __func__);
                 uvm::lua::lib::increment_lvm_instructions_executed_count(L, CHAIN_GLUA_API_EACH_INSTRUCTIONS_COUNT - 1);
-				auto bindex = chainActive.Tip();
+				auto bindex = get_chain_tip(L);
 				auto target = bindex->nHeight + next;
 				if (target < next)
 					return 0;
@@ -705,11 +688,12 @@ namespace uvm {
 
             int32_t BtcUvmChainApi::get_waited(lua_State *L, uint32_t num)
             {
+                uvm::lua::lib::UvmHostApiTimer host_api_timer(L, __func__);
                 uvm::lua::lib::increment_lvm_instructions_executed_count(L, CHAIN_GLUA_API_EACH_INSTRUCTIONS_COUNT - 1);
-				auto bindex = chainActive.Tip();
+				auto bindex = get_chain_tip(L);
 				if (bindex->nHeight < num || num < 1)
 					return 0;
-				CBlockIndex* cur_index = bindex;
+				const CBlockIndex* cur_index = bindex;
 				while (true) {
 					if (!cur_index)
 						return 0;
@@ -739,6 +723,7 @@ namespace uvm {
 
             void BtcUvmChainApi::emit(lua_State *L, const char* contract_id, const char* event_name, const char* event_param)
             {
+                uvm::lua::lib::UvmHostApiTimer host_api_timer(L, __func__);
                 uvm::lua::lib::increment_lvm_instructions_executed_count(L, CHAIN_GLUA_API_EACH_INSTRUCTIONS_COUNT - 1);
 				std::string event_name_str(event_name);
 				std::string event_arg_str(event_param ? event_param : "");
@@ -759,6 +744,7 @@ namespace uvm {
 
             bool BtcUvmChainApi::is_valid_address(lua_State *L, const char *address_str)
             {
+                uvm::lua::lib::UvmHostApiTimer host_api_timer(L, __func__);
                 try {
                     if(is_valid_contract_address(L, address_str))
                         return true;
@@ -772,6 +758,7 @@ namespace uvm {
 
             bool BtcUvmChainApi::is_valid_contract_address(lua_State *L, const char *address_str)
             {
+                uvm::lua::lib::UvmHostApiTimer host_api_timer(L, __func__);
                 return ContractHelper::is_valid_contract_address_format(address_str);
             }
 
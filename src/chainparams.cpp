@@ -132,6 +132,7 @@ public:
 	    consensus.ForkV4Height = 813500;
 	    UB_FORK4_BLOCK_NUM = consensus.ForkV4Height;
 	    consensus.ForkV5Height = 860000;
+	    consensus.CONTRACT_MEMORY_LIMIT_Height = 900000;
 
         // UnionBitcoin foundation multisig address
         consensus.UBCfoundationAddress = "31rZdrTpN57Wbfhg7xTPxeFGjEQaMBjxoo";
@@ -276,6 +277,7 @@ public:
     	consensus.ForkV4Height = 200;
     	UB_FORK4_BLOCK_NUM = consensus.ForkV4Height;
     	consensus.ForkV5Height = 220;
+    	consensus.CONTRACT_MEMORY_LIMIT_Height = 250;
 	
         // UnionBitcoin foundation
         consensus.UBCfoundationPubkey = "026b440cc0f0533a0144a66ac8d297e5df557f3c3c33224e3c40c79c45beda9406";
@@ -396,6 +398,7 @@ public:
     	consensus.ForkV4Height = 1800;
     	UB_FORK4_BLOCK_NUM = consensus.ForkV4Height;
     	consensus.ForkV5Height = 2000;
+    	consensus.CONTRACT_MEMORY_LIMIT_Height = 2000;
     	
         // UnionBitcoin foundation
         consensus.UBCfoundationPubkey = "026b440cc0f0533a0144a66ac8d297e5df557f3c3c33224e3c40c79c45beda9406";
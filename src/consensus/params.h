@@ -85,6 +85,8 @@ struct Params {
 
     int UBCONTRACT_Height;
     int SCANBADTX_Height;
+    /** Block height from which the live memory of a contract execution is capped at LUA_STATE_MAX_MEMORY_SIZE */
+    int CONTRACT_MEMORY_LIMIT_Height;
 	
     /**
      * Minimum blocks including miner confirmation of the total of 2016 blocks in a retargeting period,
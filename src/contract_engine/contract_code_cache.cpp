@@ -0,0 +1,136 @@
+#include <contract_engine/contract_code_cache.hpp>
+#include <validation.h>
+
+namespace blockchain {
+    namespace contract {
+
+        ContractCodeP ContractCode::from_contract_info(const ::contract::storage::ContractInfo& contract_info)
+        {
+            auto result = std::make_shared<ContractCode>();
+            uvm::blockchain::Code code;
+            code.code = contract_info.bytecode;
+            result->code_hash = code.GetHash();
+            result->bytecode = std::move(code.code);
+            result->apis = contract_info.apis;
+            result->offline_apis = contract_info.offline_apis;
+            for (const auto& p : contract_info.storage_types)
+                result->storage_properties[p.first] = (uvm::blockchain::StorageValueTypes) p.second;
+            return result;
+        }
+
+        void ContractCode::fill_stream(UvmModuleByteStream& stream) const
+        {
+            stream.buff.assign(bytecode.begin(), bytecode.end());
+            stream.is_bytes = true;
+            stream.contract_apis = apis;
+            stream.offline_apis = offline_apis;
+            stream.contract_storage_properties = storage_properties;
+        }
+
+        size_t ContractCode::memory_usage() const
+        {
+            size_t usage = sizeof(ContractCode) + code_hash.capacity() + bytecode.capacity();
+            for (const auto& api : apis)
+                usage += sizeof(api) + api.capacity();
+            for (const auto& api : offline_apis)
+                usage += sizeof(api) + api.capacity();
+            for (const auto& p : storage_properties)
+                usage += sizeof(p) + p.first.capacity() + 32; // map node overhead
+            return usage;
+        }
+
+        ContractCodeCache& ContractCodeCache::instance()
+        {
+            static ContractCodeCache cache;
+            return cache;
+        }
+
+        ContractCodeP ContractCodeCache::get(const std::string& contract_id)
+        {
+            std::lock_guard<std::mutex> lock(_mutex);
+            auto hash_it = _contract_code_hashes.find(contract_id);
+            if (hash_it == _contract_code_hashes.end())
+            {
+                ++_misses;
+                return nullptr;
+            }
+            auto& entry = _entries.at(hash_it->second);
+            ++_hits;
+            _lru.splice(_lru.begin(), _lru, entry.lru_it);
+            return entry.code;
+        }
+
+        ContractCodeP ContractCodeCache::put(const ::contract::storage::ContractInfo& contract_info)
+        {
+            auto code = ContractCode::from_contract_info(contract_info);
+            std::lock_guard<std::mutex> lock(_mutex);
+            if (_max_memory_usage == 0)
+                return code;
+            // index entries are charged to the code entry and evicted with it
+            const size_t contract_id_usage = contract_info.id.capacity() + code->code_hash.capacity() + 64;
+            auto it = _entries.find(code->code_hash);
+            if (it == _entries.end())
+            {
+                Entry entry;
+                entry.code = code;
+                entry.memory_usage = code->memory_usage();
+                _lru.push_front(code->code_hash);
+                entry.lru_it = _lru.begin();
+                _memory_usage += entry.memory_usage;
+                it = _entries.emplace(code->code_hash, std::move(entry)).first;
+            }
+            else
+            {
+                _lru.splice(_lru.begin(), _lru, it->second.lru_it);
+            }
+            if (_contract_code_hashes.emplace(contract_info.id, code->code_hash).second)
+            {
+                it->second.contract_ids.push_back(contract_info.id);
+                it->second.memory_usage += contract_id_usage;
+                _memory_usage += contract_id_usage;
+            }
+            auto result = it->second.code;
+            trim();
+            return result;
+        }
+
+        void ContractCodeCache::erase(const std::string& code_hash)
+        {
+            auto it = _entries.find(code_hash);
+            if (it == _entries.end())
+                return;
+            for (const auto& contract_id : it->second.contract_ids)
+                _contract_code_hashes.erase(contract_id);
+            _memory_usage -= it->second.memory_usage;
+            _lru.erase(it->second.lru_it);
+            _entries.erase(it);
+        }
+
+        void ContractCodeCache::trim()
+        {
+            while (_memory_usage > _max_memory_usage && !_lru.empty())
+            {
+                erase(_lru.back());
+            }
+        }
+
+        void ContractCodeCache::set_max_memory_usage(size_t max_usage)
+        {
+            std::lock_guard<std::mutex> lock(_mutex);
+            _max_memory_usage = max_usage;
+            trim();
+        }
+
+        ContractCodeCacheStats ContractCodeCache::stats() const
+        {
+            std::lock_guard<std::mutex> lock(_mutex);
+            ContractCodeCacheStats stats;
+            stats.hits = _hits;
+            stats.misses = _misses;
+            stats.entries = _entries.size();
+            stats.memory_usage = _memory_usage;
+            stats.max_memory_usage = _max_memory_usage;
+            return stats;
+        }
+    }
+}
@@ -0,0 +1,80 @@
+#pragma once
+
+#include <uvm/lprefix.h>
+#include <uvm/uvm_api.h>
+#include <contract_storage/contract_info.hpp>
+
+#include <list>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+namespace blockchain {
+    namespace contract {
+
+        // bytecode, apis and storage types of a contract. they never change after the contract is created
+        struct ContractCode
+        {
+            std::string code_hash; // same as uvm::blockchain::Code::code_hash of the bytecode
+            std::vector<unsigned char> bytecode;
+            std::vector<std::string> apis;
+            std::vector<std::string> offline_apis;
+            std::map<std::string, uvm::blockchain::StorageValueTypes> storage_properties;
+
+            static std::shared_ptr<const ContractCode> from_contract_info(const ::contract::storage::ContractInfo& contract_info);
+            // copy the code into stream, contract id and name are left to the caller
+            void fill_stream(UvmModuleByteStream& stream) const;
+            size_t memory_usage() const;
+        };
+        typedef std::shared_ptr<const ContractCode> ContractCodeP;
+
+        struct ContractCodeCacheStats
+        {
+            uint64_t hits = 0;
+            uint64_t misses = 0;
+            size_t entries = 0;
+            size_t memory_usage = 0;
+            size_t max_memory_usage = 0;
+        };
+
+#define CONTRACT_CODE_DEFAULT_CACHE_SIZE (16 << 20)
+
+        // process-wide lru cache of contract codes by code hash, shared by all contract executions.
+        // contracts with the same bytecode share one entry. contract ids loaded through the cache are indexed
+        // to their code hash, so a cached contract is opened without decoding its contract info again
+        class ContractCodeCache final
+        {
+        private:
+            struct Entry
+            {
+                ContractCodeP code;
+                std::vector<std::string> contract_ids;
+                size_t memory_usage;
+                std::list<std::string>::iterator lru_it;
+            };
+            mutable std::mutex _mutex;
+            std::unordered_map<std::string, Entry> _entries; // code hash => entry
+            std::unordered_map<std::string, std::string> _contract_code_hashes; // contract id => code hash
+            std::list<std::string> _lru;
+            size_t _memory_usage = 0;
+            size_t _max_memory_usage = CONTRACT_CODE_DEFAULT_CACHE_SIZE;
+            uint64_t _hits = 0;
+            uint64_t _misses = 0;
+
+            void erase(const std::string& code_hash);
+            void trim();
+        public:
+            static ContractCodeCache& instance();
+
+            // cached code of contract_id, nullptr when not cached. the caller checks the contract still exists
+            ContractCodeP get(const std::string& contract_id);
+            // cache the code of contract_info and return it
+            ContractCodeP put(const ::contract::storage::ContractInfo& contract_info);
+            void set_max_memory_usage(size_t max_usage);
+            ContractCodeCacheStats stats() const;
+        };
+    }
+}
@@ -26,6 +26,8 @@ namespace blockchain
 			virtual void set_no_gas_limit() = 0;
 			virtual void set_gas_used(int64_t gas_used) = 0;
 			virtual void add_gas_used(int64_t delta_used) = 0;
+			// caps the live memory of the vm, an allocation over it fails as out of memory
+			virtual void set_memory_limit(size_t max_memory_size) = 0;
 
 			virtual void stop()=0;
 
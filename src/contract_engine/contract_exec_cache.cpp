@@ -0,0 +1,118 @@
+#include <contract_engine/contract_exec_cache.hpp>
+#include <contract_storage/contract_info.hpp>
+
+namespace blockchain {
+    namespace contract {
+
+        static size_t exec_result_memory_usage(const ContractExecResult& result)
+        {
+            size_t usage = sizeof(ContractExecResult) + result.error_message.capacity() + result.api_result.capacity();
+            for (const auto& p : result.contract_storage_changes)
+            {
+                usage += sizeof(p) + p.first.capacity();
+                if (p.second)
+                    usage += sizeof(*p.second) + ::contract::storage::ordered_json_size(p.second->value());
+            }
+            for (const auto& info : result.balance_changes)
+                usage += sizeof(info) + info.address.capacity();
+            for (const auto& info : result.contract_upgrade_infos)
+                usage += sizeof(info) + info.address.capacity() + info.name.capacity() + info.description.capacity();
+            for (const auto& info : result.events)
+                usage += sizeof(info) + info.transaction_id.capacity() + info.contract_id.capacity() + info.event_name.capacity() + info.event_arg.capacity();
+            usage += result.dgp_int_params_changes.size() * (sizeof(DgpChangeIntParamType) + sizeof(int64_t) + 32); // map node overhead
+            return usage;
+        }
+
+        ContractExecCache& ContractExecCache::instance()
+        {
+            static ContractExecCache cache;
+            return cache;
+        }
+
+        std::string ContractExecCache::make_key(const uint256& txid, const std::string& pre_state_root, const uint256& tip_hash)
+        {
+            std::string key(txid.begin(), txid.end());
+            key.append(tip_hash.begin(), tip_hash.end());
+            key += pre_state_root;
+            return key;
+        }
+
+        std::shared_ptr<const ContractExecResult> ContractExecCache::get(const uint256& txid, CAmount tx_fee, const std::string& pre_state_root,
+            const uint256& tip_hash, std::string* post_state_root)
+        {
+            const auto& key = make_key(txid, pre_state_root, tip_hash);
+            std::lock_guard<std::mutex> lock(_mutex);
+            auto it = _entries.find(key);
+            if (it == _entries.end() || it->second.tx_fee != tx_fee)
+            {
+                ++_misses;
+                return nullptr;
+            }
+            ++_hits;
+            _lru.splice(_lru.begin(), _lru, it->second.lru_it);
+            if (post_state_root)
+                *post_state_root = it->second.post_state_root;
+            return it->second.result;
+        }
+
+        void ContractExecCache::put(const uint256& txid, CAmount tx_fee, const std::string& pre_state_root, const uint256& tip_hash,
+            const ContractExecResult& result, const std::string& post_state_root)
+        {
+            {
+                std::lock_guard<std::mutex> lock(_mutex);
+                if (_max_memory_usage == 0)
+                    return;
+            }
+            const auto& key = make_key(txid, pre_state_root, tip_hash);
+            Entry entry;
+            entry.tx_fee = tx_fee;
+            entry.result = std::make_shared<const ContractExecResult>(result);
+            entry.post_state_root = post_state_root;
+            entry.memory_usage = exec_result_memory_usage(result) + 2 * key.capacity() + post_state_root.capacity() + 64;
+            std::lock_guard<std::mutex> lock(_mutex);
+            erase(key);
+            _lru.push_front(key);
+            entry.lru_it = _lru.begin();
+            _memory_usage += entry.memory_usage;
+            _entries.emplace(key, std::move(entry));
+            trim();
+        }
+
+        void ContractExecCache::erase(const std::string& key)
+        {
+            auto it = _entries.find(key);
+            if (it == _entries.end())
+                return;
+            _memory_usage -= it->second.memory_usage;
+            _lru.erase(it->second.lru_it);
+            _entries.erase(it);
+        }
+
+        void ContractExecCache::trim()
+        {
+            while (_memory_usage > _max_memory_usage && !_lru.empty())
+            {
+                erase(_lru.back());
+            }
+        }
+
+        void ContractExecCache::set_max_memory_usage(size_t max_usage)
+        {
+            std::lock_guard<std::mutex> lock(_mutex);
+            _max_memory_usage = max_usage;
+            trim();
+        }
+
+        ContractExecCacheStats ContractExecCache::stats() const
+        {
+            std::lock_guard<std::mutex> lock(_mutex);
+            ContractExecCacheStats stats;
+            stats.hits = _hits;
+            stats.misses = _misses;
+            stats.entries = _entries.size();
+            stats.memory_usage = _memory_usage;
+            stats.max_memory_usage = _max_memory_usage;
+            return stats;
+        }
+    }
+}
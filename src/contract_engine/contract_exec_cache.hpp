@@ -0,0 +1,66 @@
+#pragma once
+
+#include <validation.h>
+#include <amount.h>
+#include <uint256.h>
+
+#include <list>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+
+namespace blockchain {
+    namespace contract {
+
+        struct ContractExecCacheStats
+        {
+            uint64_t hits = 0;
+            uint64_t misses = 0;
+            size_t entries = 0;
+            size_t memory_usage = 0;
+            size_t max_memory_usage = 0;
+        };
+
+#define CONTRACT_EXEC_DEFAULT_CACHE_SIZE (16 << 20)
+
+        // process-wide lru cache of the successful executions of contract txs, so that a tx executed on mempool
+        // entry or in block assembly isn't executed again by the templates and the connect of a locally mined block.
+        // an execution only depends on the tx, its fee, the contract state it ran on, which the root state hash
+        // commits to, and the chain tip the chain apis read
+        class ContractExecCache final
+        {
+        private:
+            struct Entry
+            {
+                CAmount tx_fee;
+                std::shared_ptr<const ContractExecResult> result;
+                std::string post_state_root;
+                size_t memory_usage;
+                std::list<std::string>::iterator lru_it;
+            };
+            mutable std::mutex _mutex;
+            std::unordered_map<std::string, Entry> _entries; // make_key => entry
+            std::list<std::string> _lru;
+            size_t _memory_usage = 0;
+            size_t _max_memory_usage = CONTRACT_EXEC_DEFAULT_CACHE_SIZE;
+            uint64_t _hits = 0;
+            uint64_t _misses = 0;
+
+            static std::string make_key(const uint256& txid, const std::string& pre_state_root, const uint256& tip_hash);
+            void erase(const std::string& key);
+            void trim();
+        public:
+            static ContractExecCache& instance();
+
+            // the cached execution of txid with tx_fee left for gas on the contract state at pre_state_root, nullptr
+            // when not cached. post_state_root is set to the root state hash after its changes were committed
+            std::shared_ptr<const ContractExecResult> get(const uint256& txid, CAmount tx_fee, const std::string& pre_state_root,
+                const uint256& tip_hash, std::string* post_state_root = nullptr);
+            void put(const uint256& txid, CAmount tx_fee, const std::string& pre_state_root, const uint256& tip_hash,
+                const ContractExecResult& result, const std::string& post_state_root);
+            void set_max_memory_usage(size_t max_usage);
+            ContractExecCacheStats stats() const;
+        };
+    }
+}
@@ -0,0 +1,76 @@
+#include <contract_engine/contract_profiler.hpp>
+
+#include <sstream>
+
+namespace blockchain {
+    namespace contract {
+
+        ContractProfiler& ContractProfiler::instance()
+        {
+            static ContractProfiler profiler;
+            return profiler;
+        }
+
+        void ContractProfiler::record(const std::string& contract_id, const std::string& api_name, const UvmExecutionProfile& execution,
+            int64_t gas, int64_t time_ns, bool error)
+        {
+            std::lock_guard<std::mutex> lock(_mutex);
+            auto& profile = _profiles[std::make_pair(contract_id, api_name)];
+            profile.calls++;
+            if (error)
+                profile.errors++;
+            profile.gas += gas;
+            profile.time_ns += time_ns;
+            profile.execution.merge(execution);
+        }
+
+        ContractProfiles ContractProfiler::profiles(bool reset)
+        {
+            std::lock_guard<std::mutex> lock(_mutex);
+            ContractProfiles result;
+            if (reset)
+                result.swap(_profiles);
+            else
+                result = _profiles;
+            return result;
+        }
+
+        // the vm frame of an api is what its host api calls don't cover, likewise for gas
+        std::string ContractProfiler::folded(const ContractProfiles& profiles, bool by_gas)
+        {
+            std::ostringstream out;
+            for (const auto& p : profiles)
+            {
+                const std::string stack = p.first.first + ";" + p.first.second + ";";
+                const auto& profile = p.second;
+                if (by_gas)
+                {
+                    int64_t opcodes_gas = 0;
+                    for (int op = 0; op < UNUM_OPCODES; op++)
+                    {
+                        const auto count = profile.execution.opcode_counts[op];
+                        if (count == 0)
+                            continue;
+                        out << stack << luaP_opnames[op] << " " << count << "\n";
+                        opcodes_gas += count;
+                    }
+                    if (profile.gas > opcodes_gas)
+                        out << stack << "[host]" << " " << profile.gas - opcodes_gas << "\n";
+                }
+                else
+                {
+                    int64_t host_time_ns = 0;
+                    for (const auto& api : profile.execution.host_apis)
+                    {
+                        if (api.second.time_ns / 1000 > 0)
+                            out << stack << api.first << " " << api.second.time_ns / 1000 << "\n";
+                        host_time_ns += api.second.time_ns;
+                    }
+                    if ((profile.time_ns - host_time_ns) / 1000 > 0)
+                        out << stack << "[vm]" << " " << (profile.time_ns - host_time_ns) / 1000 << "\n";
+                }
+            }
+            return out.str();
+        }
+    }
+}
@@ -0,0 +1,50 @@
+#pragma once
+
+#include <uvm/lprefix.h>
+#include <uvm/uvm_profile.h>
+
+#include <atomic>
+#include <cstdint>
+#include <map>
+#include <mutex>
+#include <string>
+#include <utility>
+
+namespace blockchain {
+    namespace contract {
+
+        // executions of one api of one contract, summed
+        struct ContractApiProfile
+        {
+            uint64_t calls = 0;
+            uint64_t errors = 0;
+            int64_t gas = 0;
+            int64_t time_ns = 0;
+            UvmExecutionProfile execution;
+        };
+
+        // (contract id, api name) => profile
+        typedef std::map<std::pair<std::string, std::string>, ContractApiProfile> ContractProfiles;
+
+        // process-wide profile of uvm contract executions, off unless -contractprofile.
+        // nested contract calls are counted in the api called by the transaction
+        class ContractProfiler final
+        {
+        private:
+            mutable std::mutex _mutex;
+            std::atomic<bool> _enabled{ false };
+            ContractProfiles _profiles;
+        public:
+            static ContractProfiler& instance();
+
+            bool enabled() const { return _enabled; }
+            void set_enabled(bool enabled) { _enabled = enabled; }
+            void record(const std::string& contract_id, const std::string& api_name, const UvmExecutionProfile& execution,
+                int64_t gas, int64_t time_ns, bool error);
+            // the profiles so far, cleared if reset
+            ContractProfiles profiles(bool reset = false);
+            // folded stacks of flamegraph.pl, weighted by microseconds or by gas
+            static std::string folded(const ContractProfiles& profiles, bool by_gas);
+        };
+    }
+}
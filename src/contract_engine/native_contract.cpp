@@ -2,6 +2,7 @@
 #include <policy/policy.h>
 #include <base58.h>
 #include <script/standard.h>
+#include <algorithm>
 #include <memory>
 #include <cstdio>
 #include <boost/lexical_cast.hpp>
@@ -12,70 +13,38 @@ namespace blockchain {
 
         bool native_contract_finder::has_native_contract_with_key(const std::string& key)
         {
-			std::vector<std::string> native_contract_keys = {
-					dgp_native_contract::native_contract_key()
-            };
-            return std::find(native_contract_keys.begin(), native_contract_keys.end(), key) != native_contract_keys.end();
+            return native_contracts::has_key(key);
         }
         std::shared_ptr<abstract_native_contract> native_contract_finder::create_native_contract_by_key(
 			blockchain::contract::PendingState* pending_state, const std::string& key, const std::string& contract_address, const native_contract_sender& sender)
         {
-            if (key == dgp_native_contract::native_contract_key()) {
-				return std::make_shared<dgp_native_contract>(pending_state, contract_address, sender);
-			}
-            else
-            {
-                return nullptr;
-            }
-            return nullptr;
+            return native_contracts::create(pending_state, key, contract_address, sender);
         }
 
-        void abstract_native_contract::set_contract_storage(const std::string& contract_address, const std::string& storage_name, const JsonValue& value)
-        {
+		native_storage_slot& abstract_native_contract::storage_slot(const std::string& contract_address, const std::string& storage_name)
+		{
+			auto& storages = _contract_storages[contract_address];
+			auto it = storages.find(storage_name);
+			if (it == storages.end())
+			{
+				native_storage_slot slot;
+				slot.before = _pending_state->storage_service->get_contract_storage(contract_address, storage_name);
+				it = storages.insert(std::make_pair(storage_name, std::move(slot))).first;
+			}
+			return it->second;
+		}
 
-            if (_contract_storage_changes.find(contract_address) == _contract_storage_changes.end())
-            {
-				_contract_storage_changes[contract_address] = std::map<std::string, StorageDataChangeType>();
-            }
-            auto& storage_changes = _contract_storage_changes[contract_address];
-            if (storage_changes.find(storage_name) == storage_changes.end())
-            {
-                StorageDataChangeType change;
-                change.after = value;
-				const auto &before = _pending_state->storage_service->get_contract_storage(contract_address, storage_name);
-                jsondiff::JsonDiff differ;
-				const auto& before_json_str = jsondiff::json_dumps(before);
-				const auto& after_json_str = jsondiff::json_dumps(change.after);
-				auto diff = differ.diff(before, change.after);
-                change.storage_diff = diff->value();
-				change.before = before;
-                storage_changes[storage_name] = change;
-            }
-            else
-            {
-                auto& change = storage_changes[storage_name];
-                auto before = change.before;
-                auto after = value;
-                change.after = after;
-                jsondiff::JsonDiff differ;
-				const auto& before_json_str = json_dumps(before);
-                auto after_json_str = jsondiff::json_dumps(after);
-				auto diff = differ.diff(before, after);
-                change.storage_diff = diff->value();
-            }
+        void abstract_native_contract::set_contract_storage(const std::string& contract_address, const std::string& storage_name, JsonValue value)
+        {
+			auto& slot = storage_slot(contract_address, storage_name);
+			slot.after = std::move(value);
+			slot.changed = true;
         }
-		JsonValue abstract_native_contract::get_contract_storage(const std::string& contract_address, const std::string& storage_name)
+
+		const JsonValue& abstract_native_contract::get_contract_storage(const std::string& contract_address, const std::string& storage_name)
         {
-            if (_contract_storage_changes.find(contract_address) == _contract_storage_changes.end())
-            {
-                return _pending_state->storage_service->get_contract_storage(contract_address, storage_name);
-            }
-            auto& storage_changes = _contract_storage_changes[contract_address];
-            if (storage_changes.find(storage_name) == storage_changes.end())
-            {
-                return _pending_state->storage_service->get_contract_storage(contract_address, storage_name);
-            }
-            return storage_changes[storage_name].after;
+			const auto& slot = storage_slot(contract_address, storage_name);
+			return slot.changed ? slot.after : slot.before;
         }
 
         void abstract_native_contract::emit_event(const std::string& contract_address, const std::string& event_name, const std::string& event_arg)
@@ -90,16 +59,19 @@ namespace blockchain {
 
 		void abstract_native_contract::merge_storage_changes_to_exec_result()
 		{
-			for (const auto& p : _contract_storage_changes) {
+			for (const auto& p : _contract_storages) {
 				const auto& contract_id = p.first;
-				if (p.second.empty()) {
-					continue;
-				}
 				JsonObject diff_json;
 				for (const auto& p2 : p.second) {
 					const auto& key = p2.first;
-					const auto& change = p2.second;
-					diff_json[key] = change.storage_diff;
+					const auto& slot = p2.second;
+					if (!slot.changed)
+						continue;
+					jsondiff::JsonDiff differ;
+					diff_json[key] = differ.diff(slot.before, slot.after)->value();
+				}
+				if (diff_json.size() == 0) {
+					continue;
 				}
 				_contract_exec_result.contract_storage_changes.push_back(std::make_pair(contract_id, std::make_shared<DiffResult>(diff_json)));
 			}
@@ -117,33 +89,93 @@ namespace blockchain {
             return api_names.find(api_name) != api_names.end();
         }
 
-		// dgp native contract
-		std::string dgp_native_contract::contract_key() const
+		// native contracts with an api table
+		template<typename NativeContract>
+		std::string table_native_contract<NativeContract>::contract_key() const
 		{
-			return dgp_native_contract::native_contract_key();
+			return NativeContract::native_contract_key();
 		}
-		std::string dgp_native_contract::contract_address() const {
+		template<typename NativeContract>
+		std::string table_native_contract<NativeContract>::contract_address() const
+		{
 			return contract_id;
 		}
-		std::set<std::string> dgp_native_contract::apis() const {
-			return { "init", "create_change_admin_proposal", "cancel_change_admin_proposal", "vote_admin", "admins",
-				"current_change_admin_proposal", "current_change_params_proposal",
-				"vote_change_param", "min_gas_price", "set_min_gas_price", "block_gas_limit", "set_block_gas_limit",
-				"min_gas_count", "set_min_gas_count", "max_contract_bytecode_store_fee_gas_count", "set_max_contract_bytecode_store_fee_gas_count",
-				"on_destroy", "on_upgrade", "on_deposit" };
+		template<typename NativeContract>
+		std::set<std::string> table_native_contract<NativeContract>::apis() const
+		{
+			std::set<std::string> result;
+			for (const auto& api : NativeContract::api_table)
+				result.insert(api.name);
+			return result;
+		}
+		template<typename NativeContract>
+		std::set<std::string> table_native_contract<NativeContract>::offline_apis() const
+		{
+			std::set<std::string> result;
+			for (const auto& api : NativeContract::api_table)
+			{
+				if (api.offline)
+					result.insert(api.name);
+			}
+			return result;
 		}
-		std::set<std::string> dgp_native_contract::offline_apis() const {
-			return {"admins", "current_change_admin_proposal", "current_change_params_proposal",
-				"min_gas_price", "block_gas_limit", "min_gas_count", "max_contract_bytecode_store_fee_gas_count"};
+
+		template<typename NativeContract>
+		ContractExecResult table_native_contract<NativeContract>::invoke(const std::string& api_name, const std::string& api_arg)
+		{
+			ContractExecResult result;
+			const native_contract_api<NativeContract>* found = nullptr;
+			for (const auto& api : NativeContract::api_table)
+			{
+				if (api.handler && api_name == api.name)
+				{
+					found = &api;
+					break;
+				}
+			}
+			if (!found) {
+				result.exit_code = 1;
+				result.error_message = std::string("Can't find ") + NativeContract::native_contract_key() + " api " + api_name;
+				return result;
+			}
+			result.api_result = (static_cast<NativeContract*>(this)->*(found->handler))(api_name, api_arg);
+
+			merge_storage_changes_to_exec_result();
+			result.contract_storage_changes = _contract_exec_result.contract_storage_changes;
+			return result;
 		}
+
+		// dgp native contract
+		const native_contract_api<dgp_native_contract> dgp_native_contract::api_table[] = {
+			{ "init", &dgp_native_contract::init_api, false },
+			{ "create_change_admin_proposal", &dgp_native_contract::create_change_admin_proposal_api, false },
+			{ "cancel_change_admin_proposal", &dgp_native_contract::cancel_change_admin_proposal_api, false },
+			{ "vote_admin", &dgp_native_contract::vote_admin_api, false },
+			{ "admins", &dgp_native_contract::admins_api, true },
+			{ "current_change_admin_proposal", &dgp_native_contract::current_change_admin_proposal_api, true },
+			{ "current_change_params_proposal", &dgp_native_contract::current_change_params_proposal_api, true },
+			{ "vote_change_param", &dgp_native_contract::vote_change_param_api, false },
+			{ "min_gas_price", &dgp_native_contract::min_gas_price_api, true },
+			{ "set_min_gas_price", &dgp_native_contract::set_min_gas_price_api, false },
+			{ "block_gas_limit", &dgp_native_contract::block_gas_limit_api, true },
+			{ "set_block_gas_limit", &dgp_native_contract::set_block_gas_limit_api, false },
+			{ "min_gas_count", &dgp_native_contract::min_gas_count_api, true },
+			{ "set_min_gas_count", &dgp_native_contract::set_min_gas_count_api, false },
+			{ "max_contract_bytecode_store_fee_gas_count", &dgp_native_contract::max_contract_bytecode_store_fee_gas_count_api, true },
+			{ "set_max_contract_bytecode_store_fee_gas_count", &dgp_native_contract::set_max_contract_bytecode_store_fee_gas_count_api, false },
+			{ "on_destroy", nullptr, false },
+			{ "on_upgrade", nullptr, false },
+			{ "on_deposit", nullptr, false }
+		};
+
+		template class table_native_contract<dgp_native_contract>;
+
 		std::set<std::string> dgp_native_contract::events() const {
 			return {};
 		}
 
 		std::string dgp_native_contract::init_api(const std::string& api_name, const std::string& api_arg) {
-			jsondiff::JsonArray admins;
-			admins.push_back(sender.caller_address);
-			set_contract_storage(contract_id, "admins", admins);
+			set_storage(contract_id, "admins", std::vector<std::string>{ sender.caller_address });
 			jsondiff::JsonObject dgp_params;
 			dgp_params["min_gas_price"] = DEFAULT_MIN_GAS_PRICE;
 			dgp_params["block_gas_limit"] = DEFAULT_BLOCK_GAS_LIMIT;
@@ -160,20 +192,15 @@ namespace blockchain {
 			return jsondiff::json_dumps(admins);
 		}
 
-		bool dgp_native_contract::is_address_in_admins(const jsondiff::JsonArray& admins, const std::string& addr) const
+		bool dgp_native_contract::is_address_in_admins(const std::vector<std::string>& admins, const std::string& addr) const
 		{
-			for (size_t i = 0; i < admins.size(); i++) {
-				if (addr == admins[i].as_string()) {
-					return true;
-				}
-			}
-			return false;
+			return std::find(admins.begin(), admins.end(), addr) != admins.end();
 		}
 
 		std::string dgp_native_contract::create_change_admin_proposal_api(const std::string& api_name, const std::string& api_arg) {
 			// only admin can call this api
 			// api_arg: {address: string, add: bool, needAgreeCount: int}
-			const auto& admins = get_contract_storage(contract_id, "admins").as<jsondiff::JsonArray>();
+			const auto& admins = get_storage<std::vector<std::string>>(contract_id, "admins");
 			if (!is_address_in_admins(admins, sender.caller_address)) {
 				set_error(1, "only admin can call this api");
 				return "";
@@ -244,7 +271,7 @@ namespace blockchain {
 		}
 		std::string dgp_native_contract::vote_admin_api(const std::string& api_name, const std::string& api_arg) {
 			
-			auto admins = get_contract_storage(contract_id, "admins").as<jsondiff::JsonArray>();
+			auto admins = get_storage<std::vector<std::string>>(contract_id, "admins");
 			if (!is_address_in_admins(admins, sender.caller_address)) {
 				set_error(1, "only admin can call this api");
 				return "";
@@ -266,18 +293,18 @@ namespace blockchain {
 				[&](const jsondiff::JsonObject&) {
 				if (add) {
 					admins.push_back(addr);
-					set_contract_storage(contract_id, "admins", admins);
+					set_storage(contract_id, "admins", admins);
 					set_contract_storage(contract_id, "current_change_admin_proposal", jsondiff::JsonValue()); // clear current admin-change proposal
 					emit_event(contract_id, "AddedAdmin", addr);
 				}
 				else {
 					// clear current admin-change and params-change proposal because of admins count's reduction
-					jsondiff::JsonArray new_admins;
+					std::vector<std::string> new_admins;
 					for (const auto& item : admins) {
-						if (item.as_string() != addr)
-							new_admins.push_back(item.as_string());
+						if (item != addr)
+							new_admins.push_back(item);
 					}
-					set_contract_storage(contract_id, "admins", new_admins);
+					set_storage(contract_id, "admins", new_admins);
 					set_contract_storage(contract_id, "current_change_admin_proposal", jsondiff::JsonValue());
 					set_contract_storage(contract_id, "current_change_params_proposal", jsondiff::JsonValue());
 					emit_event(contract_id, "RemovedAdmin", addr);
@@ -302,12 +329,12 @@ namespace blockchain {
 			return result;
 		}
 
-		static jsondiff::JsonArray parse_json_object_to_json_array(const jsondiff::JsonObject& obj) {
+		static jsondiff::JsonArray parse_json_object_to_json_array(const fjson::variant_object& obj) {
 			jsondiff::JsonArray result;
 			for (const auto& p : obj) {
 				const auto& value = p.value();
 				if (value.is_object()) {
-					result.push_back(make_json_pair(p.key(), parse_json_object_to_json_array(value.as<jsondiff::JsonObject>())));
+					result.push_back(make_json_pair(p.key(), parse_json_object_to_json_array(value.get_object())));
 				}
 				else {
 					result.push_back(make_json_pair(p.key(), p.value()));
@@ -321,8 +348,7 @@ namespace blockchain {
 			if (!current_change_admin_proposal_json.is_object()) {
 				return "null";
 			}
-			const auto& current_change_admin_proposal = current_change_admin_proposal_json.as<jsondiff::JsonObject>();
-			const auto& result = parse_json_object_to_json_array(current_change_admin_proposal);
+			const auto& result = parse_json_object_to_json_array(current_change_admin_proposal_json.get_object());
 			return jsondiff::json_dumps(result);
 		}
 
@@ -331,8 +357,7 @@ namespace blockchain {
 			if (!proposal_json.is_object()) {
 				return "null";
 			}
-			const auto& proposal = proposal_json.as<jsondiff::JsonObject>();
-			const auto& result = parse_json_object_to_json_array(proposal);
+			const auto& result = parse_json_object_to_json_array(proposal_json.get_object());
 			return jsondiff::json_dumps(result);
 		}
 
@@ -343,8 +368,7 @@ namespace blockchain {
 				set_error(1, "there is no change-admin-proposal now");
 				return "";
 			}
-			const auto& current_change_admin_proposal = current_change_admin_proposal_json.as<jsondiff::JsonObject>();
-			const auto& proposal_creator = current_change_admin_proposal["creator"].as_string();
+			const auto& proposal_creator = current_change_admin_proposal_json.get_object()["creator"].as_string();
 			if (sender.caller_address != proposal_creator) {
 				set_error(1, "only proposal creator can cancel it");
 				return "";
@@ -398,7 +422,7 @@ namespace blockchain {
 
 		std::string dgp_native_contract::vote_change_param_api(const std::string& api_name, const std::string& api_arg)
 		{
-			const auto& admins = get_contract_storage(contract_id, "admins").as<jsondiff::JsonArray>();
+			const auto& admins = get_storage<std::vector<std::string>>(contract_id, "admins");
 			if (!is_address_in_admins(admins, sender.caller_address)) {
 				set_error(1, "only admin can call this api");
 				return "";
@@ -437,7 +461,7 @@ namespace blockchain {
 
 		std::string dgp_native_contract::get_dgp_param_json_string(const std::string& param_name)
 		{
-			const auto& dgp_params = get_contract_storage(contract_id, "dgp_params").as<jsondiff::JsonObject>();
+			const auto& dgp_params = get_contract_storage(contract_id, "dgp_params").get_object();
 			if (dgp_params.find(param_name) == dgp_params.end())
 				return jsondiff::json_dumps(jsondiff::JsonValue());
 			else
@@ -512,7 +536,7 @@ namespace blockchain {
 					return false;
 				}
 			}
-			const auto& dgp_params = get_contract_storage(contract_id, "dgp_params").as<jsondiff::JsonObject>();
+			const auto& dgp_params = get_contract_storage(contract_id, "dgp_params").get_object();
 			if (dgp_params[property_name].as_int64() == value) {
 				set_error(1, "param value not changed, proposal failed");
 				return false;
@@ -532,7 +556,7 @@ namespace blockchain {
 		std::string dgp_native_contract::set_min_gas_price_api(const std::string& api_name, const std::string& api_arg)
 		{
 			// argument: integer_value,needAgreeCount
-			const auto& admins = get_contract_storage(contract_id, "admins").as<jsondiff::JsonArray>();
+			const auto& admins = get_storage<std::vector<std::string>>(contract_id, "admins");
 			if (!is_address_in_admins(admins, sender.caller_address)) {
 				set_error(1, "only admin can call this api");
 				return "";
@@ -544,7 +568,7 @@ namespace blockchain {
 		std::string dgp_native_contract::set_block_gas_limit_api(const std::string& api_name, const std::string& api_arg)
 		{
 			// argument: integer_value,needAgreeCount
-			const auto& admins = get_contract_storage(contract_id, "admins").as<jsondiff::JsonArray>();
+			const auto& admins = get_storage<std::vector<std::string>>(contract_id, "admins");
 			if (!is_address_in_admins(admins, sender.caller_address)) {
 				set_error(1, "only admin can call this api");
 				return "";
@@ -556,7 +580,7 @@ namespace blockchain {
 		std::string dgp_native_contract::set_min_gas_count_api(const std::string& api_name, const std::string& api_arg)
 		{
 			// argument: integer_value,needAgreeCount
-			const auto& admins = get_contract_storage(contract_id, "admins").as<jsondiff::JsonArray>();
+			const auto& admins = get_storage<std::vector<std::string>>(contract_id, "admins");
 			if (!is_address_in_admins(admins, sender.caller_address)) {
 				set_error(1, "only admin can call this api");
 				return "";
@@ -567,7 +591,7 @@ namespace blockchain {
 
 		std::string dgp_native_contract::set_max_contract_bytecode_store_fee_gas_count_api(const std::string& api_name, const std::string& api_arg) {
 			// argument: integer_value,needAgreeCount
-			const auto& admins = get_contract_storage(contract_id, "admins").as<jsondiff::JsonArray>();
+			const auto& admins = get_storage<std::vector<std::string>>(contract_id, "admins");
 			if (!is_address_in_admins(admins, sender.caller_address)) {
 				set_error(1, "only admin can call this api");
 				return "";
@@ -576,38 +600,5 @@ namespace blockchain {
 			return "";
 		}
 
-		ContractExecResult dgp_native_contract::invoke(const std::string& api_name, const std::string& api_arg) {
-			ContractExecResult result;
-			std::map<std::string, std::function<std::string (const std::string&, const std::string&)> > apis_mapping = {
-				{ "init", std::bind(&dgp_native_contract::init_api, this, std::placeholders::_1, std::placeholders::_2) },
-				{ "admins", std::bind(&dgp_native_contract::admins_api, this, std::placeholders::_1, std::placeholders::_2) },
-				{ "create_change_admin_proposal", std::bind(&dgp_native_contract::create_change_admin_proposal_api, this, std::placeholders::_1, std::placeholders::_2) },
-				{ "vote_admin", std::bind(&dgp_native_contract::vote_admin_api, this, std::placeholders::_1, std::placeholders::_2) },
-				{ "current_change_admin_proposal", std::bind(&dgp_native_contract::current_change_admin_proposal_api, this, std::placeholders::_1, std::placeholders::_2) },
-				{ "current_change_params_proposal", std::bind(&dgp_native_contract::current_change_params_proposal_api, this, std::placeholders::_1, std::placeholders::_2) },
-				{ "cancel_change_admin_proposal", std::bind(&dgp_native_contract::cancel_change_admin_proposal_api, this, std::placeholders::_1, std::placeholders::_2) },
-				{ "vote_change_param", std::bind(&dgp_native_contract::vote_change_param_api, this, std::placeholders::_1, std::placeholders::_2) },
-				{ "min_gas_price", std::bind(&dgp_native_contract::min_gas_price_api, this, std::placeholders::_1, std::placeholders::_2) },
-				{ "set_min_gas_price", std::bind(&dgp_native_contract::set_min_gas_price_api, this, std::placeholders::_1, std::placeholders::_2) },
-				{ "block_gas_limit", std::bind(&dgp_native_contract::block_gas_limit_api, this, std::placeholders::_1, std::placeholders::_2) },
-				{ "set_block_gas_limit", std::bind(&dgp_native_contract::set_block_gas_limit_api, this, std::placeholders::_1, std::placeholders::_2) },
-				{ "min_gas_count", std::bind(&dgp_native_contract::min_gas_count_api, this, std::placeholders::_1, std::placeholders::_2) },
-				{ "set_min_gas_count", std::bind(&dgp_native_contract::set_min_gas_count_api, this, std::placeholders::_1, std::placeholders::_2) },
-				{ "max_contract_bytecode_store_fee_gas_count", std::bind(&dgp_native_contract::max_contract_bytecode_store_fee_gas_count_api, this, std::placeholders::_1, std::placeholders::_2) },
-				{ "set_max_contract_bytecode_store_fee_gas_count", std::bind(&dgp_native_contract::set_max_contract_bytecode_store_fee_gas_count_api, this, std::placeholders::_1, std::placeholders::_2) }
-			};
-			if (apis_mapping.find(api_name) != apis_mapping.end()) {
-				result.api_result = apis_mapping[api_name](api_name, api_arg);
-			} else {
-				result.exit_code = 1;
-				result.error_message = std::string("Can't find dgp api ") + api_name;
-				return result;
-			}
-
-			merge_storage_changes_to_exec_result();
-			result.contract_storage_changes = _contract_exec_result.contract_storage_changes;
-			return result;
-		}
-
     }
 }
\ No newline at end of file
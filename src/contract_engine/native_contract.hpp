@@ -3,6 +3,7 @@
 #include <string>
 #include <memory>
 #include <map>
+#include <vector>
 #include <validation.h>
 #include <amount.h>
 #include <contract_engine/pending_state.hpp>
@@ -15,11 +16,61 @@ namespace blockchain {
 
 		using namespace jsondiff;
 
-		struct StorageDataChangeType
+		// a storage of a native contract as read by the current call and as set by it.
+		// the diff of a changed storage is only made when the call merges its changes
+		struct native_storage_slot
 		{
-			JsonValue storage_diff;
 			JsonValue before;
 			JsonValue after;
+			bool changed = false;
+		};
+
+		// json encoding of the typed storages of native contracts, see abstract_native_contract::get_storage
+		template<typename T>
+		struct native_storage_codec;
+
+		template<>
+		struct native_storage_codec<int64_t>
+		{
+			static int64_t decode(const JsonValue& json) { return json.as_int64(); }
+			static JsonValue encode(int64_t value) { return JsonValue(value); }
+		};
+
+		template<>
+		struct native_storage_codec<bool>
+		{
+			static bool decode(const JsonValue& json) { return json.as_bool(); }
+			static JsonValue encode(bool value) { return JsonValue(value); }
+		};
+
+		// strings, and addresses which are stored as their string form
+		template<>
+		struct native_storage_codec<std::string>
+		{
+			static std::string decode(const JsonValue& json) { return json.as_string(); }
+			static JsonValue encode(const std::string& value) { return JsonValue(value); }
+		};
+
+		template<typename T>
+		struct native_storage_codec<std::vector<T>>
+		{
+			static std::vector<T> decode(const JsonValue& json)
+			{
+				std::vector<T> result;
+				const auto& items = json.get_array();
+				result.reserve(items.size());
+				for (const auto& item : items)
+					result.push_back(native_storage_codec<T>::decode(item));
+				return result;
+			}
+			static JsonValue encode(const std::vector<T>& value)
+			{
+				JsonArray items;
+				items.reserve(value.size());
+				for (const auto& item : value)
+					items.push_back(native_storage_codec<T>::encode(item));
+				return JsonValue(std::move(items));
+			}
 		};
 
 		struct native_contract_sender {
@@ -35,7 +86,7 @@ namespace blockchain {
             std::string contract_id;
 			native_contract_sender sender;
             ContractExecResult _contract_exec_result;
-			std::map<std::string, std::map<std::string, StorageDataChangeType>> _contract_storage_changes;
+			std::map<std::string, std::map<std::string, native_storage_slot>> _contract_storages; // contract => storage name => slot
         public:
             abstract_native_contract(blockchain::contract::PendingState* pending_state, const std::string& _contract_id, const native_contract_sender& _sender)
 				: _pending_state(pending_state), contract_id(_contract_id), sender(_sender) {}
@@ -56,10 +107,24 @@ namespace blockchain {
             }
             bool has_api(const std::string& api_name);
 
-            void set_contract_storage(const std::string& contract_address, const std::string& storage_name, const JsonValue& value);
-			JsonValue get_contract_storage(const std::string& contract_address, const std::string& storage_name);
+            void set_contract_storage(const std::string& contract_address, const std::string& storage_name, JsonValue value);
+			// the storage as set by this call so far. it is read from the storage service once per call.
+			// the reference is into the slot of the storage, a set_contract_storage of the same storage invalidates it
+			const JsonValue& get_contract_storage(const std::string& contract_address, const std::string& storage_name);
+
+			template<typename T>
+			T get_storage(const std::string& contract_address, const std::string& storage_name)
+			{
+				return native_storage_codec<T>::decode(get_contract_storage(contract_address, storage_name));
+			}
+			template<typename T>
+			void set_storage(const std::string& contract_address, const std::string& storage_name, const T& value)
+			{
+				set_contract_storage(contract_address, storage_name, native_storage_codec<T>::encode(value));
+			}
             void emit_event(const std::string& contract_address, const std::string& event_name, const std::string& event_arg);
 		protected:
+			native_storage_slot& storage_slot(const std::string& contract_address, const std::string& storage_name);
 			void merge_storage_changes_to_exec_result();
 
 			void set_error(int32_t error_code, const std::string& error_msg);
@@ -73,20 +138,42 @@ namespace blockchain {
 				blockchain::contract::PendingState* pending_state, const std::string& key, const std::string& contract_address, const native_contract_sender& sender);
         };
 
-		class dgp_native_contract final : public abstract_native_contract {
-		public:
-			static std::string native_contract_key() { return "dgp"; }
+		// an entry of the static api table of a native contract. apis without a handler are
+		// listed by apis() but can't be invoked
+		template<typename NativeContract>
+		struct native_contract_api
+		{
+			const char* name;
+			std::string (NativeContract::*handler)(const std::string& api_name, const std::string& api_arg);
+			bool offline;
+		};
 
-			dgp_native_contract(blockchain::contract::PendingState* pending_state, const std::string& _contract_id, const native_contract_sender& _sender)
+		// base of the native contracts whose apis are dispatched from their static table
+		// NativeContract::api_table. the members are instantiated next to the table in native_contract.cpp
+		template<typename NativeContract>
+		class table_native_contract : public abstract_native_contract
+		{
+		public:
+			table_native_contract(blockchain::contract::PendingState* pending_state, const std::string& _contract_id, const native_contract_sender& _sender)
 				: abstract_native_contract(pending_state, _contract_id, _sender) {}
-			virtual ~dgp_native_contract() {}
+			virtual ~table_native_contract() {}
 			virtual std::string contract_key() const;
 			virtual std::string contract_address() const;
 			virtual std::set<std::string> apis() const;
 			virtual std::set<std::string> offline_apis() const;
-			virtual std::set<std::string> events() const;
 
 			virtual ContractExecResult invoke(const std::string& api_name, const std::string& api_arg);
+		};
+
+		class dgp_native_contract final : public table_native_contract<dgp_native_contract> {
+		public:
+			static std::string native_contract_key() { return "dgp"; }
+			static const native_contract_api<dgp_native_contract> api_table[];
+
+			dgp_native_contract(blockchain::contract::PendingState* pending_state, const std::string& _contract_id, const native_contract_sender& _sender)
+				: table_native_contract<dgp_native_contract>(pending_state, _contract_id, _sender) {}
+			virtual ~dgp_native_contract() {}
+			virtual std::set<std::string> events() const;
 
 		private:
 			std::string init_api(const std::string& api_name, const std::string& api_arg);
@@ -108,7 +195,7 @@ namespace blockchain {
 			std::string max_contract_bytecode_store_fee_gas_count_api(const std::string& api_name, const std::string& api_arg);
 			std::string set_max_contract_bytecode_store_fee_gas_count_api(const std::string& api_name, const std::string& api_arg);
 			
-			bool is_address_in_admins(const jsondiff::JsonArray& admins, const std::string& addr) const;
+			bool is_address_in_admins(const std::vector<std::string>& admins, const std::string& addr) const;
 			std::string get_dgp_param_json_string(const std::string& param_name);
 			void set_dgp_param(const std::string& param_name, const jsondiff::JsonValue& value);
 			void vote_for_proposal(jsondiff::JsonObject& proposal, bool agree, uint32_t admins_count,
@@ -118,5 +205,35 @@ namespace blockchain {
 			bool create_int_param_proposal(const std::string& property_name, const std::string& api_arg, uint32_t admins_count);
 		};
 
+		// the native contracts known to native_contract_finder, by native_contract_key()
+		template<typename... NativeContracts>
+		struct native_contract_registry
+		{
+			static bool has_key(const std::string& key) { return false; }
+			static std::shared_ptr<abstract_native_contract> create(
+				blockchain::contract::PendingState* pending_state, const std::string& key, const std::string& contract_address, const native_contract_sender& sender)
+			{
+				return nullptr;
+			}
+		};
+
+		template<typename NativeContract, typename... Rest>
+		struct native_contract_registry<NativeContract, Rest...>
+		{
+			static bool has_key(const std::string& key)
+			{
+				return key == NativeContract::native_contract_key() || native_contract_registry<Rest...>::has_key(key);
+			}
+			static std::shared_ptr<abstract_native_contract> create(
+				blockchain::contract::PendingState* pending_state, const std::string& key, const std::string& contract_address, const native_contract_sender& sender)
+			{
+				if (key == NativeContract::native_contract_key())
+					return std::make_shared<NativeContract>(pending_state, contract_address, sender);
+				return native_contract_registry<Rest...>::create(pending_state, key, contract_address, sender);
+			}
+		};
+
+		typedef native_contract_registry<dgp_native_contract> native_contracts;
+
     }
 }
\ No newline at end of file
@@ -5,6 +5,7 @@ namespace blockchain {
         PendingState::PendingState(::contract::storage::ContractStorageService* _storage_service)
         {
 			this->storage_service = _storage_service;
+			this->tip = nullptr;
         }
 
         void PendingState::add_balance_change(const std::string& address, bool is_contract, bool add, uint64_t amount)
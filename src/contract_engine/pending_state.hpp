@@ -17,6 +17,7 @@ namespace blockchain {
             uint256 tx_id;
             CAmount nTxFee;
 			int origin_opcode;
+			const CBlockIndex* tip; // the tip the executing block builds on, the chain apis read it instead of chainActive
 
             std::unordered_map<std::string, ContractInfo> pending_contracts_to_create;
 			std::vector<std::pair<std::string, StorageChanges>> contract_storage_changes; // contract_id => changes
@@ -1,8 +1,47 @@
 #include <contract_engine/uvm_contract_engine.hpp>
+#include <contract_engine/contract_profiler.hpp>
+#include <uvm/lauxlib.h>
 #include <util.h>
 
+#include <chrono>
+#include <exception>
+
 namespace uvm
 {
+	namespace
+	{
+		// records an api execution into the contract profiler, an execution left by an exception counts as an error
+		class ProfiledExecution
+		{
+		private:
+			UvmExecutionProfile *_profile;
+			const ::blockchain::contract_engine::ContractEngine& _engine;
+			const std::string& _contract_id;
+			const std::string& _api_name;
+			int64_t _gas_before;
+			std::chrono::steady_clock::time_point _start;
+		public:
+			ProfiledExecution(UvmExecutionProfile *profile, const ::blockchain::contract_engine::ContractEngine& engine,
+				const std::string& contract_id, const std::string& api_name)
+				: _profile(profile), _engine(engine), _contract_id(contract_id), _api_name(api_name)
+			{
+				if (!_profile)
+					return;
+				*_profile = UvmExecutionProfile();
+				_gas_before = _engine.gas_used();
+				_start = std::chrono::steady_clock::now();
+			}
+			~ProfiledExecution()
+			{
+				if (!_profile)
+					return;
+				auto time_ns = std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - _start).count();
+				::blockchain::contract::ContractProfiler::instance().record(_contract_id, _api_name, *_profile,
+					_engine.gas_used() - _gas_before, time_ns, std::uncaught_exception());
+			}
+		};
+	}
+
 	UvmContractEngine::UvmContractEngine(bool use_contract)
 	{
         auto allow_print = gArgs.GetBoolArg("-contractprint", false);
@@ -12,6 +51,11 @@ namespace uvm
 			_scope->L()->out = nullptr;
 			_scope->L()->err = nullptr;
         }
+		if (::blockchain::contract::ContractProfiler::instance().enabled())
+		{
+			_profile = std::make_shared<UvmExecutionProfile>();
+			set_state_pointer_value(UVM_STATE_PROFILE_KEY, _profile.get());
+		}
 	}
 	UvmContractEngine::~UvmContractEngine()
 	{
@@ -39,7 +83,7 @@ namespace uvm
 	}
 	void UvmContractEngine::set_gas_used(int64_t gas_used)
 	{
-		int *insts_executed_count = lua::lib::get_lua_state_value(_scope->L(), INSTRUCTIONS_EXECUTED_COUNT_LUA_STATE_MAP_KEY).int_pointer_value;
+		int *insts_executed_count = lua::lib::get_lua_state_slot_value(_scope->L(), UVM_STATE_SLOT_INSTRUCTIONS_EXECUTED_COUNT).int_pointer_value;
 		if (insts_executed_count)
 		{
 			*insts_executed_count = gas_used;
@@ -53,6 +97,10 @@ namespace uvm
 	{
 		set_gas_used(gas_used() + delta_used);
 	}
+	void UvmContractEngine::set_memory_limit(size_t max_memory_size)
+	{
+		luaL_setarenamaxsize(_scope->L(), max_memory_size);
+	}
 
 	void UvmContractEngine::stop()
 	{
@@ -92,12 +140,13 @@ namespace uvm
 
 	void UvmContractEngine::execute_contract_api_by_address(std::string contract_id, std::string method, std::string argument, std::string *result_json_string)
 	{
+		ProfiledExecution profiled(_profile.get(), *this, contract_id, method);
 		clear_exceptions();
 		lua::lib::execute_contract_api_by_address(_scope->L(), contract_id.c_str(), method.c_str(), argument.c_str(), result_json_string);
 		if (_scope->L()->force_stopping == true && _scope->L()->exit_code == LUA_API_INTERNAL_ERROR)
 			throw uvm::core::UvmException("execute contract internal error");
-		int exception_code = lua::lib::get_lua_state_value(_scope->L(), "exception_code").int_value;
-		char* exception_msg = (char*)lua::lib::get_lua_state_value(_scope->L(), "exception_msg").string_value;
+		int exception_code = lua::lib::get_lua_state_slot_value(_scope->L(), UVM_STATE_SLOT_EXCEPTION_CODE).int_value;
+		char* exception_msg = (char*)lua::lib::get_lua_state_slot_value(_scope->L(), UVM_STATE_SLOT_EXCEPTION_MSG).string_value;
 		if (exception_code > 0)
 		{
 			if (exception_code == UVM_API_LVM_LIMIT_OVER_ERROR)
@@ -111,12 +160,14 @@ namespace uvm
 
 	void UvmContractEngine::execute_contract_init_by_address(std::string contract_id, std::string argument, std::string *result_json_string)
 	{
+		const std::string method("init");
+		ProfiledExecution profiled(_profile.get(), *this, contract_id, method);
 		clear_exceptions();
 		lua::lib::execute_contract_init_by_address(_scope->L(), contract_id.c_str(), argument.c_str(), result_json_string);
 		if (_scope->L()->force_stopping == true && _scope->L()->exit_code == LUA_API_INTERNAL_ERROR)
 			throw uvm::core::UvmException("execute contract internal error");
-		int exception_code = lua::lib::get_lua_state_value(_scope->L(), "exception_code").int_value;
-		char* exception_msg = (char*)lua::lib::get_lua_state_value(_scope->L(), "exception_msg").string_value;
+		int exception_code = lua::lib::get_lua_state_slot_value(_scope->L(), UVM_STATE_SLOT_EXCEPTION_CODE).int_value;
+		char* exception_msg = (char*)lua::lib::get_lua_state_slot_value(_scope->L(), UVM_STATE_SLOT_EXCEPTION_MSG).string_value;
 		if (exception_code > 0)
 		{
 			if (exception_code == UVM_API_LVM_LIMIT_OVER_ERROR)
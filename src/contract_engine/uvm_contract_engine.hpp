@@ -2,6 +2,7 @@
 
 #include <contract_engine/contract_engine.hpp>
 #include <uvm/uvm_lib.h>
+#include <uvm/uvm_profile.h>
 #include <uvm/exceptions.h>
 
 namespace uvm
@@ -9,6 +10,7 @@ namespace uvm
 	class UvmContractEngine : public ::blockchain::contract_engine::ContractEngine
 	{
 	private:
+		std::shared_ptr<UvmExecutionProfile> _profile; // profile of the running api with -contractprofile, outlives the state
 		std::shared_ptr<lua::lib::UvmStateScope> _scope;
 	public:
 		UvmContractEngine(bool use_contract=true);
@@ -21,6 +23,7 @@ namespace uvm
 		virtual void set_no_gas_limit();
 		virtual void set_gas_used(int64_t gas_used);
 		virtual void add_gas_used(int64_t delta_used);
+		virtual void set_memory_limit(size_t max_memory_size);
 
 		virtual void stop();
 
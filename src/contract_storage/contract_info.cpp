@@ -7,8 +7,11 @@
 #include <fjson/crypto/base64.hpp>
 #include <fcrypto/sha256.hpp>
 #include <boost/uuid/sha1.hpp>
+#include <algorithm>
+#include <cstring>
 #include <memory>
 #include <list>
+#include <vector>
 
 namespace contract
 {
@@ -168,41 +171,154 @@ namespace contract
 		}
 
 
-		// parse arg to json_array when it's json object. otherwhile return itself. And recursively process child elements
-		static jsondiff::JsonValue nested_json_object_to_array(const jsondiff::JsonValue& json_value)
+		// the string escaping of json_dumps
+		template<typename Output>
+		static void write_json_string(Output& out, const std::string& str)
 		{
-			if (json_value.is_object())
+			out.put('"');
+			for (auto c : str)
 			{
-				const auto& obj = json_value.as<jsondiff::JsonObject>();
-				jsondiff::JsonArray json_array;
-				std::list<std::string> keys;
-				for (auto it = obj.begin(); it != obj.end(); it++)
+				switch (c)
 				{
-					keys.push_back(it->key());
+				case '\t': out.write("\\t", 2); break;
+				case '\n': out.write("\\n", 2); break;
+				case '\\': out.write("\\\\", 2); break;
+				case '\r': out.write("\\r", 2); break;
+				case '\a': out.write("\\a", 2); break;
+				case '"': out.write("\\\"", 2); break;
+				default: out.put(c);
 				}
-				keys.sort(&compare_key);
-				for (const auto& key : keys)
+			}
+			out.put('"');
+		}
+
+		// writes json_dumps of json_value with every object turned into an array of [key, value] pairs
+		// sorted by key, the canonical json ordered_json_digest hashes, without building either of them.
+		// a duplicated key gets the value of its first entry each time, like a lookup of the object
+		template<typename Output>
+		static void write_ordered_json(Output& out, const jsondiff::JsonValue& json_value)
+		{
+			switch (json_value.get_type())
+			{
+			case fjson::variant::object_type:
+			{
+				const auto& obj = json_value.get_object();
+				std::vector<const fjson::variant_object::entry*> entries;
+				entries.reserve(obj.size());
+				for (const auto& item : obj)
+					entries.push_back(&item);
+				std::stable_sort(entries.begin(), entries.end(), [](const fjson::variant_object::entry* a, const fjson::variant_object::entry* b) {
+					return compare_key(a->key(), b->key());
+				});
+				out.put('[');
+				const jsondiff::JsonValue* value = nullptr;
+				for (size_t i = 0; i < entries.size(); i++)
 				{
-					jsondiff::JsonArray item_json;
-					item_json.push_back(key);
-					item_json.push_back(nested_json_object_to_array(obj[key]));
-					json_array.push_back(item_json);
+					if (i > 0)
+						out.put(',');
+					if (i == 0 || entries[i]->key() != entries[i - 1]->key())
+						value = &entries[i]->value();
+					out.put('[');
+					write_json_string(out, entries[i]->key());
+					out.put(',');
+					write_ordered_json(out, *value);
+					out.put(']');
 				}
-				return json_array;
+				out.put(']');
+				return;
 			}
-			if (json_value.is_array())
+			case fjson::variant::array_type:
 			{
-				const auto& arr = json_value.as<jsondiff::JsonArray>();
-				jsondiff::JsonArray result;
-				for (const auto& item : arr)
+				const auto& arr = json_value.get_array();
+				out.put('[');
+				for (size_t i = 0; i < arr.size(); i++)
 				{
-					result.push_back(nested_json_object_to_array(item));
+					if (i > 0)
+						out.put(',');
+					write_ordered_json(out, arr[i]);
 				}
-				return result;
+				out.put(']');
+				return;
+			}
+			case fjson::variant::null_type:
+				out.write("null", 4);
+				return;
+			case fjson::variant::int64_type:
+			{
+				const auto& str = std::to_string(json_value.as_int64());
+				out.write(str.data(), str.size());
+				return;
+			}
+			case fjson::variant::uint64_type:
+			{
+				const auto& str = std::to_string(json_value.as_uint64());
+				out.write(str.data(), str.size());
+				return;
+			}
+			case fjson::variant::bool_type:
+				if (json_value.as_bool())
+					out.write("true", 4);
+				else
+					out.write("false", 5);
+				return;
+			case fjson::variant::string_type:
+				write_json_string(out, json_value.get_string());
+				return;
+			default:
+			{
+				const auto& str = json_dumps(json_value);
+				out.write(str.data(), str.size());
+				return;
+			}
 			}
-			return json_value;
 		}
 
+		// feeds the sha256 encoder in blocks, it is slow on the small writes of write_ordered_json
+		class OrderedJsonHasher
+		{
+		private:
+			fcrypto::sha256::encoder _encoder;
+			char _buffer[4096];
+			size_t _size = 0;
+		public:
+			void put(char c)
+			{
+				if (_size == sizeof(_buffer))
+					flush();
+				_buffer[_size++] = c;
+			}
+			void write(const char* data, size_t len)
+			{
+				if (_size + len > sizeof(_buffer))
+					flush();
+				if (len > sizeof(_buffer))
+				{
+					_encoder.write(data, (uint32_t)len);
+					return;
+				}
+				memcpy(_buffer + _size, data, len);
+				_size += len;
+			}
+			void flush()
+			{
+				_encoder.write(_buffer, (uint32_t)_size);
+				_size = 0;
+			}
+			fcrypto::sha256 result()
+			{
+				flush();
+				return _encoder.result();
+			}
+		};
+
+		class OrderedJsonCounter
+		{
+		public:
+			size_t size = 0;
+			void put(char) { size++; }
+			void write(const char*, size_t len) { size += len; }
+		};
+
 		static void sha256(char *string, char outputBuffer[65])
 		{
 			unsigned char hash[SHA256_DIGEST_LENGTH];
@@ -220,9 +336,16 @@ namespace contract
 
 		fcrypto::sha256 ordered_json_digest(const jsondiff::JsonValue& json_value)
 		{
-			const auto& parsed_json = nested_json_object_to_array(json_value);
-			const auto& dumped = json_dumps(parsed_json);
-			return fcrypto::sha256::hash(dumped);
+			OrderedJsonHasher hasher;
+			write_ordered_json(hasher, json_value);
+			return hasher.result();
+		}
+
+		size_t ordered_json_size(const jsondiff::JsonValue& json_value)
+		{
+			OrderedJsonCounter counter;
+			write_ordered_json(counter, json_value);
+			return counter.size;
 		}
 	}
 }
\ No newline at end of file
@@ -1,12 +1,17 @@
 #include <contract_storage/contract_storage.hpp>
 #include <contract_storage/config.hpp>
 #include <contract_storage/exceptions.hpp>
+#include <contract_storage/value_encoding.hpp>
 #include <fjson/io/json.hpp>
 #include <fjson/string.hpp>
 #include <fjson/crypto/base64.hpp>
 #include <boost/scope_exit.hpp>
 #include <boost/algorithm/string.hpp>
 #include <boost/algorithm/string/predicate.hpp>
+#include <leveldb/cache.h>
+#include <leveldb/filter_policy.h>
+#include <sqlite3.h>
+#include <cstdio>
 #include <set>
 #include <vector>
 #include <map>
@@ -22,23 +27,57 @@ namespace contract
 
 		static const std::string root_state_hash_key = "ROOT_STATE_HASH";
 		static const std::string top_root_state_hash_key = "TOP_ROOT_STATE_HASH";
+		static const std::string value_format_version_key = "VALUE_FORMAT_VERSION";
+		static const std::string commit_log_seq_key = "COMMIT_LOG_SEQ";
+		static const std::string state_trie_version_key = "STATE_TRIE_VERSION";
+
+		static const std::string contract_info_key_prefix = "contract_info_key_";
+		static const std::string contract_storage_key_prefix = "contract_storage_key_";
 
 		static std::recursive_mutex storage_mutex;
 
 		static std::string make_contract_info_key(const std::string& contract_id)
 		{
-			return std::string("contract_info_key_") + contract_id;
+			return contract_info_key_prefix + contract_id;
 		}
 
 		static std::string make_contract_storage_key(const std::string& contract_id, const std::string &storage_name)
 		{
-			return std::string("contract_storage_key_") + contract_id + "_" + storage_name;
+			return contract_storage_key_prefix + contract_id + "_" + storage_name;
 		}
 
 		static std::string make_commit_events_key(const ContractCommitId& commit_id) {
 			return std::string("commit_events$") + commit_id;
 		}
 
+		// commit log entry, seq => commit id. fixed width hex keeps the entries in commit order
+		static std::string make_commit_log_key(uint64_t seq) {
+			char seq_hex[17];
+			snprintf(seq_hex, sizeof(seq_hex), "%016llx", (unsigned long long) seq);
+			return std::string("commit_log$") + seq_hex;
+		}
+
+		// commit index entry, commit id => (seq, change type, contract id)
+		static std::string make_commit_index_key(const ContractCommitId& commit_id) {
+			return std::string("commit_index$") + commit_id;
+		}
+
+		static std::string make_commit_undo_key(const ContractCommitId& commit_id) {
+			return std::string("commit_undo$") + commit_id;
+		}
+
+		// state trie leaf key of a contract info or contract storage db key
+		static std::string state_key_hash(const std::string& key)
+		{
+			auto digest = fcrypto::sha256::hash(key);
+			return std::string(digest.data(), digest.data_size());
+		}
+
+		// state trie root right after the commit
+		static std::string make_state_trie_root_key(const ContractCommitId& commit_id) {
+			return std::string("state_trie_root$") + commit_id;
+		}
+
 		static std::string make_transaction_events_key(const std::string& transaction_id) {
 			return std::string("transaction_events$") + transaction_id;
 		}
@@ -48,8 +87,102 @@ namespace contract
 			return std::string("contract_name_id_mapping_") + contract_name;
 		}
 
+		void ContractStorageBatch::capture_undo(const std::string& key)
+		{
+			if (!_capture_undo || _undo_staged.find(key) != _undo_staged.end() || _undo_unstaged.find(key) != _undo_unstaged.end())
+				return;
+			auto it = _pending.find(key);
+			if (it != _pending.end())
+				_undo_staged[key] = it->second;
+			else
+				_undo_unstaged.insert(key);
+		}
+
+		void ContractStorageBatch::put(const std::string& key, const std::string& value)
+		{
+			capture_undo(key);
+			_batch.Put(key, value);
+			_pending[key] = std::make_pair(true, value);
+			_storage_values.erase(key);
+		}
+
+		void ContractStorageBatch::put_storage(const std::string& key, const jsondiff::JsonValue& value)
+		{
+			put(key, encode_storage_value(value));
+			_storage_values[key] = value;
+		}
+
+		void ContractStorageBatch::erase(const std::string& key)
+		{
+			capture_undo(key);
+			_batch.Delete(key);
+			_pending[key] = std::make_pair(false, std::string());
+			_storage_values.erase(key);
+		}
+
+		bool ContractStorageBatch::get_staged(const std::string& key, std::string* value, bool* found) const
+		{
+			auto it = _pending.find(key);
+			if (it == _pending.end())
+				return false;
+			*found = it->second.first;
+			if (it->second.first)
+				*value = it->second.second;
+			return true;
+		}
+
+		bool ContractStorageBatch::get_staged_storage(const std::string& key, jsondiff::JsonValue* value) const
+		{
+			auto it = _storage_values.find(key);
+			if (it == _storage_values.end())
+				return false;
+			*value = it->second;
+			return true;
+		}
+
+		void ContractStorageBatch::merge(const ContractStorageBatch& other)
+		{
+			for (const auto& p : other._pending)
+			{
+				if (p.second.first)
+					put(p.first, p.second.second);
+				else
+					erase(p.first);
+			}
+			for (const auto& p : other._storage_values)
+			{
+				_storage_values[p.first] = p.second;
+			}
+		}
+
+		// approximate heap usage of a decoded json value
+		static size_t json_value_memory_usage(const jsondiff::JsonValue& value)
+		{
+			size_t usage = sizeof(jsondiff::JsonValue);
+			switch (value.get_type())
+			{
+			case jsondiff::JsonValue::string_type:
+				usage += value.get_string().capacity();
+				break;
+			case jsondiff::JsonValue::array_type:
+				for (const auto& item : value.get_array())
+					usage += json_value_memory_usage(item);
+				break;
+			case jsondiff::JsonValue::object_type:
+			{
+				const auto& obj = value.get_object();
+				for (auto it = obj.begin(); it != obj.end(); it++)
+					usage += sizeof(fjson::variant_object::entry) + it->key().capacity() + json_value_memory_usage(it->value());
+				break;
+			}
+			default:
+				break;
+			}
+			return usage;
+		}
+
 		ContractStorageService::ContractStorageService(uint32_t magic_number, const std::string& storage_db_path, const std::string& storage_sql_db_path, bool auto_open)
-			: _db(nullptr), _sql_db(nullptr), _magic_number(magic_number), _storage_db_path(storage_db_path), _storage_sql_db_path(storage_sql_db_path)
+			: _db(nullptr), _magic_number(magic_number), _storage_db_path(storage_db_path), _storage_sql_db_path(storage_sql_db_path)
 		{
 			if(auto_open)
 				open();
@@ -59,47 +192,249 @@ namespace contract
 			close();
 		}
 
-		std::shared_ptr<ContractStorageService> ContractStorageService::get_instance(uint32_t magic_number, const std::string& storage_db_path, const std::string& storage_sql_db_path)
+		// process-lifetime service, opened on first acquire and closed by close_instance on shutdown
+		static std::unique_ptr<ContractStorageService> service_instance;
+		// live handles of service_instance, guarded by storage_mutex
+		static int service_instance_handles = 0;
+
+		// db of the process-wide service and its state at the last handle release, read by snapshot handles.
+		// the db stays open here when the service closes it, so reopening reuses it while snapshots are alive
+		static std::mutex published_mutex;
+		static std::string published_db_path;
+		static std::shared_ptr<leveldb::DB> published_db;
+		static std::shared_ptr<const leveldb::Snapshot> published_snapshot;
+
+		std::shared_ptr<ContractStorageService> ContractStorageService::get_instance(uint32_t magic_number, const std::string& storage_db_path, const std::string& storage_sql_db_path,
+			const ContractStorageDBOptions& db_options)
 		{
-			static ContractStorageService service_instance(magic_number, storage_db_path, storage_sql_db_path, false);
-			storage_mutex.lock();
-			service_instance.open();
-			return std::shared_ptr<ContractStorageService>(&service_instance, [&](ContractStorageService* ptr) {
-				ptr->close();
+			std::unique_lock<std::recursive_mutex> lock(storage_mutex);
+			if (!service_instance)
+			{
+				service_instance.reset(new ContractStorageService(magic_number, storage_db_path, storage_sql_db_path, false));
+				service_instance->set_db_options(db_options);
+			}
+			// open is a no-op when the databases are already open
+			service_instance->open();
+			++service_instance_handles;
+			// the handle keeps the storage lock until released, the databases stay open
+			lock.release();
+			return std::shared_ptr<ContractStorageService>(service_instance.get(), [](ContractStorageService* ptr) {
+				// changes in progress are done when the outermost handle is released
+				if (--service_instance_handles == 0)
+					ptr->publish_snapshot();
 				storage_mutex.unlock();
 			});
 		}
 
+		std::shared_ptr<ContractStorageService> ContractStorageService::get_snapshot(uint32_t magic_number, const std::string& storage_db_path, const std::string& storage_sql_db_path,
+			const ContractStorageDBOptions& db_options)
+		{
+			std::unique_lock<std::mutex> lock(published_mutex);
+			if (!published_snapshot || published_db_path != storage_db_path)
+			{
+				// nothing published yet, open the process-wide service and release it to publish its state
+				lock.unlock();
+				get_instance(magic_number, storage_db_path, storage_sql_db_path, db_options);
+				lock.lock();
+				if (!published_snapshot || published_db_path != storage_db_path)
+					BOOST_THROW_EXCEPTION(ContractStorageException("contract storage snapshot not available"));
+			}
+			auto service = std::make_shared<ContractStorageService>(magic_number, storage_db_path, storage_sql_db_path, false);
+			service->_db = published_db;
+			service->_snapshot = published_snapshot;
+			// snapshot handles are short-lived, don't cache their reads
+			service->_storage_cache_max_usage = 0;
+			return service;
+		}
+
+		std::shared_ptr<ContractStorageService> ContractStorageService::create_overlay(std::shared_ptr<ContractStorageService> base)
+		{
+			base->check_db();
+			auto service = std::make_shared<ContractStorageService>(base->_magic_number, base->_storage_db_path, base->_storage_sql_db_path, false);
+			service->_db = base->_db;
+			service->_snapshot = base->_snapshot;
+			service->_base = base;
+			service->_overlay_batch.reset(new ContractStorageBatch());
+			service->_current_block_height = base->_current_block_height;
+			// storages the overlay didn't write are read through the cache of base
+			service->_storage_cache_max_usage = 0;
+			return service;
+		}
+
+		std::shared_ptr<ContractStorageService> ContractStorageService::create_snapshot() const
+		{
+			check_db();
+			if (_overlay_batch)
+				BOOST_THROW_EXCEPTION(ContractStorageException("can't create a snapshot of a contract storage overlay"));
+			auto service = std::make_shared<ContractStorageService>(_magic_number, _storage_db_path, _storage_sql_db_path, false);
+			auto db = _db;
+			service->_db = db;
+			if (_snapshot)
+				service->_snapshot = _snapshot;
+			else
+				service->_snapshot.reset(db->GetSnapshot(), [db](const leveldb::Snapshot* snapshot) {
+					db->ReleaseSnapshot(snapshot);
+				});
+			service->_current_block_height = _current_block_height;
+			service->_storage_cache_max_usage = 0;
+			return service;
+		}
+
+		void ContractStorageService::flush()
+		{
+			if (!_overlay_batch)
+				return;
+			_base->write_batch(*_overlay_batch);
+			_overlay_batch.reset(new ContractStorageBatch());
+		}
+
+		void ContractStorageService::publish_snapshot()
+		{
+			std::lock_guard<std::mutex> lock(published_mutex);
+			// the db stays published when this service closed it
+			auto db = published_db;
+			if (!db || (_db && _db != db))
+				return;
+			published_snapshot.reset(db->GetSnapshot(), [db](const leveldb::Snapshot* snapshot) {
+				db->ReleaseSnapshot(snapshot);
+			});
+		}
+
+		void ContractStorageService::close_instance()
+		{
+			std::lock_guard<std::recursive_mutex> lock(storage_mutex);
+			if (service_instance)
+			{
+				service_instance->close();
+				service_instance.reset();
+			}
+			// the db is deleted when the last snapshot handle is released
+			std::lock_guard<std::mutex> published_lock(published_mutex);
+			published_snapshot.reset();
+			published_db.reset();
+			published_db_path.clear();
+		}
+
 		void ContractStorageService::open()
 		{
 			if (!_db)
 			{
+				// reuse the db kept open for snapshot handles
+				std::lock_guard<std::mutex> lock(published_mutex);
+				if (published_db && published_db_path == _storage_db_path)
+					_db = published_db;
+			}
+			if (!_db)
+			{
+				// same tuning as the chainstate db(GetOptions in dbwrapper.cpp) but keeps the default compression,
+				// contract values compress well. the bloom filter saves disk reads for missing storage keys
+				auto block_cache = leveldb::NewLRUCache(_db_options.cache_size / 2);
+				auto filter_policy = leveldb::NewBloomFilterPolicy(10);
 				leveldb::Options options;
 				options.create_if_missing = true;
-				auto status = leveldb::DB::Open(options, _storage_db_path, &_db);
+				options.block_cache = block_cache;
+				options.write_buffer_size = _db_options.cache_size / 4; // up to two write buffers may be held in memory simultaneously
+				options.filter_policy = filter_policy;
+				options.max_open_files = 64;
+				options.paranoid_checks = true;
+				leveldb::DB *db = nullptr;
+				auto status = leveldb::DB::Open(options, _storage_db_path, &db);
 				assert(status.ok());
-			}
-			if (!_sql_db)
-			{
-				auto status = sqlite3_open(_storage_sql_db_path.c_str(), &_sql_db);
-				assert(status == SQLITE_OK);
-				// init tables
-				this->init_commits_table();
+				// leveldb::Options doesn't own the block cache and filter policy
+				_db.reset(db, [block_cache, filter_policy](leveldb::DB* db) {
+					delete db;
+					delete block_cache;
+					delete filter_policy;
+				});
+				if (_db_options.force_compact)
+					_db->CompactRange(nullptr, nullptr);
+				this->migrate_value_format();
+				this->migrate_sql_commits();
+				this->migrate_state_trie();
+				if (this == service_instance.get())
+				{
+					std::lock_guard<std::mutex> lock(published_mutex);
+					published_db = _db;
+					published_db_path = _storage_db_path;
+					published_snapshot.reset();
+				}
 			}
 		}
 
 		void ContractStorageService::close()
 		{
-			if (_db)
+			_snapshot.reset();
+			_db.reset();
+			_storage_cache.clear();
+			_storage_cache_lru.clear();
+			_storage_cache_usage = 0;
+		}
+
+		void ContractStorageService::migrate_value_format()
+		{
+			leveldb::ReadOptions read_options;
+			leveldb::WriteOptions write_options;
+			std::string version;
+			if (_db->Get(read_options, value_format_version_key, &version).ok() && version == std::to_string(CONTRACT_STORAGE_VALUE_FORMAT_VERSION))
+				return;
+			// re-encode json text contract infos and storages written by older versions
+			const size_t max_batch_count = 1000;
+			for (const auto& prefix : { contract_info_key_prefix, contract_storage_key_prefix })
 			{
-				delete _db;
-				_db = nullptr;
+				leveldb::WriteBatch batch;
+				size_t batch_count = 0;
+				std::unique_ptr<leveldb::Iterator> it(_db->NewIterator(read_options));
+				for (it->Seek(prefix); it->Valid() && it->key().starts_with(prefix); it->Next())
+				{
+					const auto& value = it->value().ToString();
+					if (is_binary_storage_value(value))
+						continue;
+					batch.Put(it->key(), encode_storage_value(jsondiff::json_loads(value)));
+					if (++batch_count >= max_batch_count)
+					{
+						if (!_db->Write(write_options, &batch).ok())
+							BOOST_THROW_EXCEPTION(ContractStorageException("migrate contract storage value format error"));
+						batch.Clear();
+						batch_count = 0;
+					}
+				}
+				if (batch_count > 0 && !_db->Write(write_options, &batch).ok())
+					BOOST_THROW_EXCEPTION(ContractStorageException("migrate contract storage value format error"));
 			}
-			if (_sql_db)
+			if (!_db->Put(write_options, value_format_version_key, std::to_string(CONTRACT_STORAGE_VALUE_FORMAT_VERSION)).ok())
+				BOOST_THROW_EXCEPTION(ContractStorageException("migrate contract storage value format error"));
+		}
+
+		void ContractStorageService::migrate_state_trie()
+		{
+			std::string version;
+			if (read_value(state_trie_version_key, &version))
+				return;
+			// leaf updates are idempotent, so an interrupted migration just starts over
+			const size_t max_batch_count = 1000;
+			std::unique_ptr<ContractStorageBatch> batch(new ContractStorageBatch());
+			size_t batch_count = 0;
+			leveldb::ReadOptions read_options;
+			for (const auto& prefix : { contract_info_key_prefix, contract_storage_key_prefix })
 			{
-				sqlite3_close(_sql_db);
-				_sql_db = nullptr;
+				std::unique_ptr<leveldb::Iterator> it(_db->NewIterator(read_options));
+				for (it->Seek(prefix); it->Valid() && it->key().starts_with(prefix); it->Next())
+				{
+					const auto& value_hash = state_value_hash(decode_storage_value(it->value().ToString()));
+					state_trie(batch.get()).update(state_key_hash(it->key().ToString()), value_hash);
+					if (++batch_count >= max_batch_count)
+					{
+						write_batch(*batch);
+						batch.reset(new ContractStorageBatch());
+						batch_count = 0;
+					}
+				}
 			}
+			const auto& top_commit_id = top_root_state_hash();
+			if (top_commit_id != EMPTY_COMMIT_ID)
+				batch->put(make_state_trie_root_key(top_commit_id), state_trie(batch.get()).root_hash());
+			batch->put(state_trie_version_key, "1");
+			write_batch(*batch);
 		}
 
 		bool ContractStorageService::is_open() const
@@ -107,112 +442,210 @@ namespace contract
 			return _db ? true : false;
 		}
 
-		static int empty_sql_callback(void *notUsed, int argc, char **argv, char **colNames)
+		static std::string encode_commit_info(const ContractCommitInfo& commit_info)
+		{
+			std::string out;
+			write_varint(out, commit_info.id);
+			write_bytes(out, commit_info.change_type);
+			write_bytes(out, commit_info.contract_id);
+			return out;
+		}
+
+		static ContractCommitInfoP decode_commit_info(const ContractCommitId& commit_id, const std::string& data)
 		{
-			return 0;
+			auto commit_info = std::make_shared<ContractCommitInfo>();
+			size_t pos = 0;
+			commit_info->id = read_varint(data, pos);
+			commit_info->commit_id = commit_id;
+			commit_info->change_type = read_bytes(data, pos);
+			commit_info->contract_id = read_bytes(data, pos);
+			return commit_info;
 		}
 
-		void ContractStorageService::init_commits_table()
+		static std::string sql_column_text(sqlite3_stmt* stmt, int col)
 		{
-			char *errMsg;
-			auto status = sqlite3_exec(_sql_db, "CREATE TABLE IF NOT EXISTS commit_info (id INTEGER PRIMARY KEY, commit_id varchar(255) not null, change_type varchar(50) not null, contract_id varchar(255))",
-				&empty_sql_callback, nullptr, &errMsg);
-			if (status != SQLITE_OK)
+			auto text = sqlite3_column_text(stmt, col);
+			return text ? std::string((const char*) text) : std::string();
+		}
+
+		void ContractStorageService::migrate_sql_commits()
+		{
+			leveldb::ReadOptions read_options;
+			leveldb::WriteOptions write_options;
+			std::string seq;
+			if (_db->Get(read_options, commit_log_seq_key, &seq).ok())
+				return;
+			auto sql_db_file = std::fopen(_storage_sql_db_path.c_str(), "rb");
+			if (!sql_db_file)
 			{
-				sqlite3_free(errMsg);
-				BOOST_THROW_EXCEPTION(ContractStorageException(errMsg));
+				// no commits saved by older versions
+				return;
 			}
-			status = sqlite3_exec(_sql_db, "CREATE INDEX IF NOT EXISTS commit_id_key ON commit_info (commit_id)",
-				&empty_sql_callback, nullptr, &errMsg);
-			if (status != SQLITE_OK)
+			std::fclose(sql_db_file);
+			sqlite3 *sql_db = nullptr;
+			if (sqlite3_open_v2(_storage_sql_db_path.c_str(), &sql_db, SQLITE_OPEN_READONLY, nullptr) != SQLITE_OK)
 			{
-				sqlite3_free(errMsg);
-				BOOST_THROW_EXCEPTION(ContractStorageException(errMsg));
+				std::string error_msg = sql_db ? sqlite3_errmsg(sql_db) : "out of memory";
+				sqlite3_close(sql_db);
+				BOOST_THROW_EXCEPTION(ContractStorageException(std::string("open contract commits sql db error ") + error_msg));
 			}
+			const size_t max_batch_count = 1000;
+			leveldb::WriteBatch batch;
+			size_t batch_count = 0;
+			uint64_t last_seq = 0;
+			{
+				BOOST_SCOPE_EXIT_ALL(&) {
+					sqlite3_close(sql_db);
+				};
+				// any error but a missing commit_info table, as left by a version which saved no commits, stops the open
+				// rather than losing the commits rollbacks depend on
+				sqlite3_stmt *stmt = nullptr;
+				if (sqlite3_prepare_v2(sql_db, "select count(*) from sqlite_master where type = 'table' and name = 'commit_info'", -1, &stmt, nullptr) != SQLITE_OK)
+					BOOST_THROW_EXCEPTION(ContractStorageException(std::string("read contract commits from sql db error ") + sqlite3_errmsg(sql_db)));
+				int status = sqlite3_step(stmt);
+				bool has_commits_table = status == SQLITE_ROW && sqlite3_column_int(stmt, 0) > 0;
+				sqlite3_finalize(stmt);
+				stmt = nullptr;
+				if (status != SQLITE_ROW)
+					BOOST_THROW_EXCEPTION(ContractStorageException(std::string("read contract commits from sql db error ") + sqlite3_errmsg(sql_db)));
+				if (has_commits_table)
+				{
+					if (sqlite3_prepare_v2(sql_db, "select id, commit_id, change_type, contract_id from commit_info order by id", -1, &stmt, nullptr) != SQLITE_OK)
+						BOOST_THROW_EXCEPTION(ContractStorageException(std::string("read contract commits from sql db error ") + sqlite3_errmsg(sql_db)));
+					BOOST_SCOPE_EXIT_ALL(&) {
+						sqlite3_finalize(stmt);
+					};
+					while ((status = sqlite3_step(stmt)) == SQLITE_ROW)
+					{
+						ContractCommitInfo commit_info;
+						commit_info.id = (uint64_t) sqlite3_column_int64(stmt, 0);
+						commit_info.commit_id = sql_column_text(stmt, 1);
+						commit_info.change_type = sql_column_text(stmt, 2);
+						commit_info.contract_id = sql_column_text(stmt, 3);
+						batch.Put(make_commit_log_key(commit_info.id), commit_info.commit_id);
+						batch.Put(make_commit_index_key(commit_info.commit_id), encode_commit_info(commit_info));
+						last_seq = commit_info.id;
+						if (++batch_count >= max_batch_count)
+						{
+							if (!_db->Write(write_options, &batch).ok())
+								BOOST_THROW_EXCEPTION(ContractStorageException("migrate contract commits error"));
+							batch.Clear();
+							batch_count = 0;
+						}
+					}
+					if (status != SQLITE_DONE)
+						BOOST_THROW_EXCEPTION(ContractStorageException(std::string("read contract commits from sql db error ") + sqlite3_errmsg(sql_db)));
+				}
+			}
+			// the seq key is written last, so an interrupted migration runs again on next open
+			batch.Put(commit_log_seq_key, std::to_string(last_seq));
+			if (!_db->Write(write_options, &batch).ok())
+				BOOST_THROW_EXCEPTION(ContractStorageException("migrate contract commits error"));
+			// kept aside rather than deleted, the commits can still be recovered from it
+			std::rename(_storage_sql_db_path.c_str(), (_storage_sql_db_path + ".migrated").c_str());
 		}
 
-		static int query_records_sql_callback(void *json_array_ptr, int argc, char **argv, char **colNames)
+		ContractCommitInfoP ContractStorageService::get_commit_info(const ContractCommitId& commit_id) const
 		{
-			auto json_array = (jsondiff::JsonArray*) json_array_ptr;
-			jsondiff::JsonObject record;
-			int i;
-			for (i = 0; i < argc; i++) {
-				auto colName = colNames[i];
-				if (argv[i])
-					record[colName] = argv[i];
-				else
-					record[colName] = jsondiff::JsonValue();
-			}
-			json_array->push_back(record);
-			return 0;
+			return get_commit_info(commit_id, nullptr);
 		}
 
-		ContractCommitInfoP ContractStorageService::get_commit_info(const ContractCommitId& commit_id) const
+		ContractCommitInfoP ContractStorageService::get_commit_info(const ContractCommitId& commit_id, const ContractStorageBatch* batch) const
 		{
 			check_db();
-			char *errMsg;
-			jsondiff::JsonArray records;
-			auto query_sql = std::string("select id, commit_id, change_type, contract_id from commit_info where commit_id='") + commit_id + "'";
-			auto status = sqlite3_exec(_sql_db, query_sql.c_str(),
-				&query_records_sql_callback, &records, &errMsg);
-			if (status != SQLITE_OK)
-			{
-				std::string err_msg_str(errMsg);
-				sqlite3_free(errMsg);
-				BOOST_THROW_EXCEPTION(ContractStorageException(err_msg_str));
-			}
-			if (records.empty())
+			std::string value;
+			if (!read_value(make_commit_index_key(commit_id), &value, batch))
 				return nullptr;
-			jsondiff::JsonObject found_record = records[0].as<jsondiff::JsonObject>();
-			auto commit_info = std::make_shared<ContractCommitInfo>();
-			commit_info->id = found_record["id"].as_uint64();
-			commit_info->commit_id = found_record["commit_id"].as_string();
-			commit_info->contract_id = found_record["contract_id"].as_string();
-			commit_info->change_type = found_record["change_type"].as_string();
-			return commit_info;
+			return decode_commit_info(commit_id, value);
 		}
 
-		void ContractStorageService::add_commit_info(ContractCommitId commit_id, const std::string &change_type, const std::string &diff_str, const std::string &contract_id)
+		uint64_t ContractStorageService::last_commit_seq(const ContractStorageBatch* batch) const
+		{
+			std::string value;
+			if (!read_value(commit_log_seq_key, &value, batch))
+				return 0;
+			return std::stoull(value);
+		}
+
+		void ContractStorageService::add_commit_info(ContractCommitId commit_id, const std::string &change_type, const std::string &diff_str, const std::string &contract_id, ContractStorageBatch& batch)
 		{
 			check_db();
-			auto commit_info_existed = get_commit_info(commit_id);
-			if (commit_info_existed)
+			if (get_commit_info(commit_id, &batch))
 			{
 				BOOST_THROW_EXCEPTION(ContractStorageException("same commitId existed before"));
 			}
-			char *insert_err;
-			auto insert_sql = std::string("insert into commit_info (commit_id, change_type, contract_id) values ('") + commit_id + "','" + change_type + "', '" + contract_id + "')";
-			auto insert_status = sqlite3_exec(_sql_db,
-				insert_sql.c_str(), &empty_sql_callback, nullptr, &insert_err);
-			if (insert_status != SQLITE_OK)
+			ContractCommitInfo commit_info;
+			commit_info.id = last_commit_seq(&batch) + 1;
+			commit_info.commit_id = commit_id;
+			commit_info.change_type = change_type;
+			commit_info.contract_id = contract_id;
+			batch.put(make_commit_log_key(commit_info.id), commit_id);
+			batch.put(make_commit_index_key(commit_id), encode_commit_info(commit_info));
+			batch.put(commit_log_seq_key, std::to_string(commit_info.id));
+			batch.put(commit_id, diff_str);
+		}
+
+		void ContractStorageService::add_commit_undo(const ContractCommitId& commit_id, ContractStorageBatch& batch)
+		{
+			ContractCommitUndo undo;
+			for (const auto& p : batch.undo_staged())
+			{
+				ContractStorageUndoItem item;
+				item.key = p.first;
+				item.existed = p.second.first;
+				item.value = p.second.second;
+				undo.items.push_back(std::move(item));
+			}
+			// keys not staged before the capture still have their prior values in db
+			for (const auto& key : batch.undo_unstaged())
 			{
-				sqlite3_free(insert_err);
-				BOOST_THROW_EXCEPTION(ContractStorageException("insert contract change commit to db error"));
+				ContractStorageUndoItem item;
+				item.key = key;
+				item.existed = read_value(key, &item.value);
+				undo.items.push_back(std::move(item));
 			}
-			leveldb::WriteOptions write_options;
-			auto save_diff_status = _db->Put(write_options, commit_id, diff_str);
-			if (!save_diff_status.ok())
-				BOOST_THROW_EXCEPTION(ContractStorageException("save contract info diff to db error"));
+			batch.put(make_commit_undo_key(commit_id), undo.encode());
 		}
 
-		std::string ContractStorageService::get_value_by_key_or_error(const std::string &key)
+		bool ContractStorageService::undo_commit(const ContractCommitId& commit_id, ContractStorageBatch& batch)
 		{
-			check_db();
-			leveldb::ReadOptions read_options;
+			const auto& undo_key = make_commit_undo_key(commit_id);
 			std::string value;
-			auto status = _db->Get(read_options, key, &value);
-			if (!status.ok())
-				BOOST_THROW_EXCEPTION(ContractStorageException(std::string("Can't find value by key ") + key));
-			return value;
+			if (!read_value(undo_key, &value, &batch))
+				return false;
+			const auto& undo = ContractCommitUndo::decode(value);
+			for (const auto& item : undo.items)
+			{
+				if (item.existed)
+					batch.put(item.key, item.value);
+				else
+					batch.erase(item.key);
+			}
+			batch.erase(undo_key);
+			return true;
 		}
 
-		jsondiff::JsonValue ContractStorageService::get_json_value_by_key_or_null(const std::string &key)
+		bool ContractStorageService::read_value(const std::string& key, std::string* value, const ContractStorageBatch* batch) const
+		{
+			if (_read_keys)
+				_read_keys->insert(key);
+			bool found = false;
+			if (batch && batch->get_staged(key, value, &found))
+				return found;
+			if (_overlay_batch)
+			{
+				if (_overlay_batch->get_staged(key, value, &found))
+					return found;
+				return _base->read_value(key, value);
+			}
+			return _db->Get(db_read_options(), key, value).ok();
+		}
+
+		jsondiff::JsonValue ContractStorageService::get_json_value_by_key_or_null(const std::string &key, const ContractStorageBatch* batch) const
 		{
 			check_db();
-			leveldb::ReadOptions read_options;
 			std::string value;
-			auto status = _db->Get(read_options, key, &value);
-			if (!status.ok())
+			if (!read_value(key, &value, batch))
 				return jsondiff::JsonValue();
 			return jsondiff::json_loads(value);
 		}
@@ -231,74 +664,137 @@ namespace contract
 		{
 			if (!_db)
 				BOOST_THROW_EXCEPTION(ContractStorageException("contract storage db not opened"));
-			if (!_sql_db)
-				BOOST_THROW_EXCEPTION(ContractStorageException("contract storage sql db not opened"));
 		}
 
-		void ContractStorageService::begin_sql_transaction()
+		void ContractStorageService::check_writable_db() const
 		{
 			check_db();
-			char *err;
-			if (sqlite3_exec(_sql_db, "BEGIN", nullptr, nullptr, &err) != SQLITE_OK)
+			if (_snapshot && !_overlay_batch)
+				BOOST_THROW_EXCEPTION(ContractStorageException("contract storage snapshot is read only"));
+		}
+
+		leveldb::ReadOptions ContractStorageService::db_read_options() const
+		{
+			leveldb::ReadOptions read_options;
+			read_options.snapshot = _snapshot.get();
+			return read_options;
+		}
+
+		void ContractStorageService::write_batch(ContractStorageBatch& batch)
+		{
+			check_writable_db();
+			if (batch.empty())
+				return;
+			if (_written_keys)
+			{
+				for (const auto& p : batch.pending())
+					_written_keys->insert(p.first);
+			}
+			if (_overlay_batch)
+			{
+				_overlay_batch->merge(batch);
+				return;
+			}
+			leveldb::WriteOptions write_options;
+			auto status = _db->Write(write_options, batch.write_batch());
+			if (!status.ok())
+				BOOST_THROW_EXCEPTION(ContractStorageException(std::string("contract storage write batch error ") + status.ToString()));
+			// written storages replace their cached values, other written keys leave the cache
+			for (const auto& p : batch.pending())
+			{
+				if (_storage_cache.find(p.first) != _storage_cache.end())
+					uncache_storage(p.first);
+			}
+			for (const auto& p : batch.storage_values())
 			{
-				std::string err_str = std::string("contract sql transaction begin error ") + err;
-				sqlite3_free(err);
-				BOOST_THROW_EXCEPTION(ContractStorageException(err_str));
+				cache_storage(p.first, p.second);
 			}
 		}
-		void ContractStorageService::commit_sql_transaction()
+
+		bool ContractStorageService::get_cached_storage(const std::string& key, jsondiff::JsonValue* value) const
 		{
-			check_db();
-			char *err;
-			if (sqlite3_exec(_sql_db, "COMMIT", nullptr, nullptr, &err) != SQLITE_OK)
+			auto it = _storage_cache.find(key);
+			if (it == _storage_cache.end())
 			{
-				std::string err_str = std::string("contract sql transaction commit error ") + err;
-				sqlite3_free(err);
-				BOOST_THROW_EXCEPTION(ContractStorageException(err_str));
+				++_storage_cache_misses;
+				return false;
 			}
+			++_storage_cache_hits;
+			_storage_cache_lru.splice(_storage_cache_lru.begin(), _storage_cache_lru, it->second.lru_it);
+			*value = it->second.value;
+			return true;
 		}
-		void ContractStorageService::rollback_sql_transaction()
+
+		void ContractStorageService::cache_storage(const std::string& key, const jsondiff::JsonValue& value) const
 		{
-			check_db();
-			char *err;
-			if (sqlite3_exec(_sql_db, "ROLLBACK", nullptr, nullptr, &err) != SQLITE_OK)
+			if (_storage_cache_max_usage == 0)
+				return;
+			uncache_storage(key);
+			StorageCacheEntry entry;
+			entry.value = value;
+			entry.memory_usage = key.capacity() * 2 + json_value_memory_usage(value) + sizeof(StorageCacheEntry);
+			_storage_cache_lru.push_front(key);
+			entry.lru_it = _storage_cache_lru.begin();
+			_storage_cache_usage += entry.memory_usage;
+			_storage_cache[key] = std::move(entry);
+			trim_storage_cache();
+		}
+
+		void ContractStorageService::uncache_storage(const std::string& key) const
+		{
+			auto it = _storage_cache.find(key);
+			if (it == _storage_cache.end())
+				return;
+			_storage_cache_usage -= it->second.memory_usage;
+			_storage_cache_lru.erase(it->second.lru_it);
+			_storage_cache.erase(it);
+		}
+
+		void ContractStorageService::trim_storage_cache() const
+		{
+			while (_storage_cache_usage > _storage_cache_max_usage && !_storage_cache_lru.empty())
 			{
-				std::string err_str = std::string("contract sql transaction rollback error ") + err;
-				sqlite3_free(err);
-				BOOST_THROW_EXCEPTION(ContractStorageException(err_str));
+				uncache_storage(_storage_cache_lru.back());
 			}
 		}
 
-		void ContractStorageService::rollback_leveldb_transaction(const leveldb::Snapshot* snapshot_to_rollback, const std::vector<std::string>& changed_keys)
+		void ContractStorageService::set_storage_cache_max_usage(size_t max_usage)
 		{
-			// leveldb rollback using snapshot
-			leveldb::WriteOptions write_options;
-			leveldb::ReadOptions read_options_for_snapshot;
-			read_options_for_snapshot.snapshot = snapshot_to_rollback;
-			for (const auto& key : changed_keys) {
-				std::string old_value;
-				auto status = _db->Get(read_options_for_snapshot, key, &old_value);
-				if (status.ok())
-				{
-					_db->Put(write_options, key, old_value);
-				}
-				else if (status.IsNotFound())
-				{
-					_db->Delete(write_options, key);
-				}
-			}
+			_storage_cache_max_usage = max_usage;
+			trim_storage_cache();
+		}
+
+		ContractStorageCacheStats ContractStorageService::storage_cache_stats() const
+		{
+			ContractStorageCacheStats stats;
+			stats.hits = _storage_cache_hits;
+			stats.misses = _storage_cache_misses;
+			stats.entries = _storage_cache.size();
+			stats.memory_usage = _storage_cache_usage;
+			stats.max_memory_usage = _storage_cache_max_usage;
+			return stats;
 		}
 
 		ContractInfoP ContractStorageService::get_contract_info(const AddressType& contract_id) const
+		{
+			return get_contract_info(contract_id, nullptr);
+		}
+
+		bool ContractStorageService::has_contract_info(const AddressType& contract_id) const
 		{
 			check_db();
-			leveldb::ReadOptions options;
 			std::string value;
-			auto status = _db->Get(options, make_contract_info_key(contract_id), &value);
-			if (!status.ok()) {
+			return read_value(make_contract_info_key(contract_id), &value);
+		}
+
+		ContractInfoP ContractStorageService::get_contract_info(const AddressType& contract_id, const ContractStorageBatch* batch) const
+		{
+			check_db();
+			std::string value;
+			if (!read_value(make_contract_info_key(contract_id), &value, batch)) {
 				return nullptr;
 			}
-			auto json_value = jsondiff::json_loads(value);
+			auto json_value = decode_storage_value(value);
 			if (!json_value.is_object())
 				BOOST_THROW_EXCEPTION(ContractStorageException("contract info db data error"));
 			auto json_obj = json_value.as<jsondiff::JsonObject>();
@@ -309,10 +805,8 @@ namespace contract
 		AddressType ContractStorageService::find_contract_id_by_name(const std::string& name) const
 		{
 			check_db();
-			leveldb::ReadOptions options;
 			std::string contract_id;
-			auto status = _db->Get(options, make_contract_name_id_mapping_key(name), &contract_id);
-			if (!status.ok())
+			if (!read_value(make_contract_name_id_mapping_key(name), &contract_id))
 			{
 				return "";
 			}
@@ -326,9 +820,8 @@ namespace contract
 		ContractCommitId ContractStorageService::current_root_state_hash() const
 		{
 			check_db();
-			leveldb::ReadOptions read_options;
 			std::string state_hash;
-			if (!_db->Get(read_options, root_state_hash_key, &state_hash).ok())
+			if (!read_value(root_state_hash_key, &state_hash))
 				state_hash = EMPTY_COMMIT_ID;
 			return state_hash;
 		}
@@ -357,58 +850,33 @@ namespace contract
 		ContractCommitId ContractStorageService::top_root_state_hash() const
 		{
 			check_db();
-			leveldb::ReadOptions read_options;
 			std::string state_hash;
-			if (!_db->Get(read_options, top_root_state_hash_key, &state_hash).ok())
+			if (!read_value(top_root_state_hash_key, &state_hash))
 				state_hash = EMPTY_COMMIT_ID;
 			return state_hash;
 		}
 
 		ContractCommitId ContractStorageService::save_contract_info(ContractInfoP contract_info)
 		{
-			check_db();
-			bool success = false;
-			leveldb::WriteOptions write_options;
-			// snapshot leveldb for rollback
-			const auto snapshot = _db->GetSnapshot();
-			BOOST_SCOPE_EXIT_ALL(&) {
-				_db->ReleaseSnapshot(snapshot);
-			};
-			std::vector<std::string> changed_leveldb_keys;
-			begin_sql_transaction();
-			BOOST_SCOPE_EXIT_ALL(&) {
-				if (success)
-				{
-					commit_sql_transaction();
-				}
-				else
-				{
-					rollback_sql_transaction();
-					rollback_leveldb_transaction(snapshot, changed_leveldb_keys);
-				}
-			};
+			check_writable_db();
+			ContractStorageBatch batch;
 			const auto& old_root_state_hash = current_root_state_hash();
 			const auto& top_commit_id = top_root_state_hash();
 			if (old_root_state_hash != top_commit_id) {
-				rollback_to_root_state_hash_without_transactional(old_root_state_hash, changed_leveldb_keys);
-				assert(current_root_state_hash() == old_root_state_hash);
+				rollback_to_root_state_hash_without_transactional(old_root_state_hash, batch);
 			}
+			batch.start_undo_capture();
 
 			auto key = make_contract_info_key(contract_info->id);
-			leveldb::ReadOptions read_options;
 			std::string old_value;
 			jsondiff::JsonObject old_json_value;
-			auto read_status = _db->Get(read_options, key, &old_value);
-			if (read_status.ok())
+			if (read_value(key, &old_value, &batch))
 			{
-				old_json_value = jsondiff::json_loads(old_value).as<jsondiff::JsonObject>();
+				old_json_value = decode_storage_value(old_value).as<jsondiff::JsonObject>();
 			}
 
 			auto json_obj = contract_info->to_json();
-			auto status = _db->Put(write_options, key, jsondiff::json_dumps(json_obj));
-			if (!status.ok())
-				BOOST_THROW_EXCEPTION(ContractStorageException("save contract info to db error"));
-			changed_leveldb_keys.push_back(key);
+			batch.put(key, encode_storage_value(json_obj));
 			jsondiff::JsonDiff differ;
 			auto contract_info_diff = differ.diff(old_json_value, json_obj);
 			std::string contract_info_diff_str = contract_info_diff->str();
@@ -419,24 +887,22 @@ namespace contract
 				// check name unique(exist contract with this name's id must be same or empty)
 				const auto& contract_name_id_mapping_key = make_contract_name_id_mapping_key(contract_info->name);
 				std::string exist_name_id;
-				if (_db->Get(read_options, contract_name_id_mapping_key, &exist_name_id).ok() && exist_name_id != contract_info->id)
+				if (read_value(contract_name_id_mapping_key, &exist_name_id, &batch) && exist_name_id != contract_info->id)
 					BOOST_THROW_EXCEPTION(ContractStorageException(std::string("contract name ") + contract_info->name + " existed before"));
-				if (!_db->Put(write_options, contract_name_id_mapping_key, contract_info->id).ok())
-					BOOST_THROW_EXCEPTION(ContractStorageException("save contract name => contract id mapping to db error"));
-				changed_leveldb_keys.push_back(contract_name_id_mapping_key);
+				batch.put(contract_name_id_mapping_key, contract_info->id);
 			}
 
 			// update root-state-hash
 			const auto& root_state_hash = generate_next_root_hash(old_root_state_hash, hash_new_contract_info_commit(contract_info));
 			ContractCommitId commitId = root_state_hash;
-			add_commit_info(commitId, CONTRACT_INFO_CHANGE_TYPE, contract_info_diff_str, contract_info->id);
-			if (!_db->Put(write_options, root_state_hash_key, root_state_hash).ok())
-				BOOST_THROW_EXCEPTION(ContractStorageException("update root state hash error"));
-			changed_leveldb_keys.push_back(root_state_hash_key);
-			if (!_db->Put(write_options, top_root_state_hash_key, root_state_hash).ok())
-				BOOST_THROW_EXCEPTION(ContractStorageException("update top root state hash error"));
-			changed_leveldb_keys.push_back(top_root_state_hash_key);
-			success = true;
+			update_state_trie(batch);
+			batch.put(make_state_trie_root_key(commitId), state_trie(&batch).root_hash());
+			batch.stop_undo_capture();
+			add_commit_undo(commitId, batch);
+			add_commit_info(commitId, CONTRACT_INFO_CHANGE_TYPE, contract_info_diff_str, contract_info->id, batch);
+			batch.put(root_state_hash_key, root_state_hash);
+			batch.put(top_root_state_hash_key, root_state_hash);
+			write_batch(batch);
 			return commitId;
 		}
 
@@ -449,40 +915,56 @@ namespace contract
 		}
 
 		jsondiff::JsonValue ContractStorageService::get_contract_storage(AddressType contract_id, const std::string& storage_name) const
+		{
+			return get_contract_storage(contract_id, storage_name, nullptr);
+		}
+
+		jsondiff::JsonValue ContractStorageService::get_contract_storage(const AddressType& contract_id, const std::string& storage_name, const ContractStorageBatch* batch) const
 		{
 			check_db();
 			auto key = make_contract_storage_key(contract_id, storage_name);
-			auto snapshot = _db->GetSnapshot();
-			BOOST_SCOPE_EXIT_ALL(&) {
-				_db->ReleaseSnapshot(snapshot);
-			};
-			leveldb::ReadOptions options;
-			options.snapshot = snapshot;
+			if (_read_keys)
+				_read_keys->insert(key);
+			jsondiff::JsonValue result;
+			if (batch && batch->get_staged_storage(key, &result))
+				return result;
 			std::string value;
-			auto status = _db->Get(options, key, &value);
-			if (!status.ok())
-				return jsondiff::JsonValue();
-			return jsondiff::json_loads(value);
+			bool found = false;
+			if (batch && batch->get_staged(key, &value, &found))
+				return found ? decode_storage_value(value) : jsondiff::JsonValue();
+			if (_overlay_batch)
+			{
+				if (_overlay_batch->get_staged_storage(key, &result))
+					return result;
+				if (_overlay_batch->get_staged(key, &value, &found))
+					return found ? decode_storage_value(value) : jsondiff::JsonValue();
+				return _base->get_contract_storage(contract_id, storage_name);
+			}
+			if (get_cached_storage(key, &result))
+				return result;
+			if (read_value(key, &value))
+				result = decode_storage_value(value);
+			// missing storages are cached as null too
+			cache_storage(key, result);
+			return result;
 		}
+
 		std::vector<ContractBalance> ContractStorageService::get_contract_balances(const AddressType& contract_id) const
+		{
+			return get_contract_balances(contract_id, nullptr);
+		}
+
+		std::vector<ContractBalance> ContractStorageService::get_contract_balances(const AddressType& contract_id, const ContractStorageBatch* batch) const
 		{
 			check_db();
-			auto snapshot = _db->GetSnapshot();
-			BOOST_SCOPE_EXIT_ALL(&) {
-				_db->ReleaseSnapshot(snapshot);
-			};
-			leveldb::ReadOptions options;
-			options.snapshot = snapshot;
 			std::string value;
 			std::vector<ContractBalance> result;
-			auto status = _db->Get(options, make_contract_info_key(contract_id), &value);
-			if (!status.ok()) {
+			if (!read_value(make_contract_info_key(contract_id), &value, batch)) {
 				return result;
 			}
-			auto json_value = jsondiff::json_loads(value);
+			auto json_value = decode_storage_value(value);
 			if (!json_value.is_object())
 				BOOST_THROW_EXCEPTION(ContractStorageException("contract info db data error"));
-			auto contract_info = std::make_shared<ContractInfo>();
 			auto json_obj = json_value.as<jsondiff::JsonObject>();
 			auto balances_json_array = json_obj["balances"].as<jsondiff::JsonArray>();
 			for (size_t i = 0; i < balances_json_array.size(); i++)
@@ -500,16 +982,10 @@ namespace contract
 		{
 			check_db();
 			auto events = std::make_shared<std::vector<ContractEventInfo>>();
-			auto snapshot = _db->GetSnapshot();
-			BOOST_SCOPE_EXIT_ALL(&) {
-				_db->ReleaseSnapshot(snapshot);
-			};
-			leveldb::ReadOptions read_options;
-			read_options.snapshot = snapshot;
 			const auto& commit_events_key = make_commit_events_key(commit_id);
 
 			std::string events_str_value;
-			if (_db->Get(read_options, commit_events_key, &events_str_value).ok()) {
+			if (read_value(commit_events_key, &events_str_value)) {
 				const auto& json_obj = jsondiff::json_loads(events_str_value);
 				if (json_obj.is_array()) {
 					*events = ContractChanges::events_from_json(json_obj.as<jsondiff::JsonArray>());
@@ -522,16 +998,9 @@ namespace contract
 		{
 			check_db();
 			auto events = std::make_shared<std::vector<ContractEventInfo>>();
-			auto snapshot = _db->GetSnapshot();
-			BOOST_SCOPE_EXIT_ALL(&) {
-				_db->ReleaseSnapshot(snapshot);
-			};
-			leveldb::ReadOptions read_options;
-			read_options.snapshot = snapshot;
-
 			const auto& tx_events_key = make_transaction_events_key(transaction_id);
 			std::string value;
-			if (_db->Get(read_options, tx_events_key, &value).ok()) {
+			if (read_value(tx_events_key, &value)) {
 				const auto& events_json = jsondiff::json_loads(value);
 				if (events_json.is_array()) {
 					*events = ContractChanges::events_from_json(events_json.as<jsondiff::JsonArray>());
@@ -540,64 +1009,51 @@ namespace contract
 			return events;
 		}
 
-		void ContractStorageService::clear_sql_db()
+		void ContractStorageService::clear_commit_log()
 		{
-			check_db();
-			char *err_msg;
-			auto drop_status = sqlite3_exec(_sql_db, "delete from commit_info", &empty_sql_callback, nullptr, &err_msg);
-			if (drop_status != SQLITE_OK)
+			check_writable_db();
+			ContractStorageBatch batch;
+			for (auto seq = last_commit_seq(nullptr); seq > 0; seq--)
 			{
-				std::string err_msg_str(err_msg);
-				sqlite3_free(err_msg);
-				BOOST_THROW_EXCEPTION(ContractStorageException(err_msg_str));
+				std::string commit_id;
+				if (!read_value(make_commit_log_key(seq), &commit_id))
+					continue;
+				batch.erase(make_commit_log_key(seq));
+				batch.erase(make_commit_index_key(commit_id));
 			}
+			batch.put(commit_log_seq_key, "0");
+			write_batch(batch);
 		}
 
 		// save commit history with all diffs
 		ContractCommitId ContractStorageService::commit_contract_changes(ContractChangesP changes)
 		{
-			check_db();
-			leveldb::ReadOptions read_options;
-			leveldb::WriteOptions write_options;
-			// snapshot leveldb for rollback
-			const auto snapshot = _db->GetSnapshot();
-			BOOST_SCOPE_EXIT_ALL(&) {
-				_db->ReleaseSnapshot(snapshot);
-			};
-			std::vector<std::string> changed_leveldb_keys;
+			check_writable_db();
+			// all leveldb mutations of this commit are staged in batch and written at once,
+			// so a failed commit leaves the db untouched
+			ContractStorageBatch batch;
 			const auto& old_root_state_hash = current_root_state_hash();
 			const auto& top_commit_id = top_root_state_hash();
 			if (old_root_state_hash != top_commit_id) {
-				rollback_to_root_state_hash_without_transactional(old_root_state_hash, changed_leveldb_keys);
-				assert(current_root_state_hash() == old_root_state_hash);
+				rollback_to_root_state_hash_without_transactional(old_root_state_hash, batch);
 			}
 			if (changes->empty()) {
+				write_batch(batch);
 				return old_root_state_hash;
 			}
 			const auto& root_state_hash = generate_next_root_hash(old_root_state_hash, hash_contract_changes(changes));
 			ContractCommitId commitId = root_state_hash;
 			// check commitId not conflict
-			if(get_commit_info(commitId))
+			if(get_commit_info(commitId, &batch))
 				BOOST_THROW_EXCEPTION(ContractStorageException("same commitId existed before"));
-			bool success = false;
-			begin_sql_transaction();
-			BOOST_SCOPE_EXIT_ALL(&) {
-				if (success)
-				{
-					commit_sql_transaction();
-				}
-				else
-				{
-					rollback_sql_transaction();
-					rollback_leveldb_transaction(snapshot, changed_leveldb_keys);
-				}
-			};
+			// prior values of the keys this commit changes make up its undo record
+			batch.start_undo_capture();
 			// merge change to leveldb
 			for (const auto &balance_change : changes->balance_changes)
 			{
 				if (!balance_change.is_contract)
 					continue;
-				auto balances = get_contract_balances(balance_change.address);
+				auto balances = get_contract_balances(balance_change.address, &batch);
 				auto found_balance = false;
 				for (auto &balance : balances)
 				{
@@ -620,11 +1076,10 @@ namespace contract
 				}
 				std::string value;
 				auto contract_info_key = make_contract_info_key(balance_change.address);
-				auto status = _db->Get(read_options, contract_info_key, &value);
-				if (!status.ok()) {
+				if (!read_value(contract_info_key, &value, &batch)) {
 					BOOST_THROW_EXCEPTION(ContractStorageException("contract info not found to transfer balance"));
 				}
-				auto json_value = jsondiff::json_loads(value);
+				auto json_value = decode_storage_value(value);
 				if (!json_value.is_object())
 					BOOST_THROW_EXCEPTION(ContractStorageException("contract info db data error"));
 				auto json_obj = json_value.as<jsondiff::JsonObject>();
@@ -634,11 +1089,7 @@ namespace contract
 					balances_json_array.push_back(balance.to_json());
 				}
 				json_obj["balances"] = balances_json_array;
-				const auto& new_contract_info_value = jsondiff::json_dumps(json_obj);
-				auto write_status = _db->Put(write_options, contract_info_key, new_contract_info_value);
-				if(!write_status.ok())
-					BOOST_THROW_EXCEPTION(ContractStorageException("contract info write to db error"));
-				changed_leveldb_keys.push_back(contract_info_key);
+				batch.put(contract_info_key, encode_storage_value(json_obj));
 			}
 			jsondiff::JsonDiff differ;
 			for (const auto &storage_change : changes->storage_changes)
@@ -646,13 +1097,10 @@ namespace contract
 				const auto &contract_id = storage_change.contract_id;
 				for (const auto &storage_change_item : storage_change.items)
 				{
-					const auto& storage_old_value = get_contract_storage(contract_id, storage_change_item.name);
+					const auto& storage_old_value = get_contract_storage(contract_id, storage_change_item.name, &batch);
 					const auto& storage_value = differ.patch(storage_old_value, storage_change_item.diff);
 					const auto& key = make_contract_storage_key(contract_id, storage_change_item.name);
-					auto status = _db->Put(write_options, key, jsondiff::json_dumps(storage_value));
-					if (!status.ok())
-						BOOST_THROW_EXCEPTION(ContractStorageException("contract storage write to db error"));
-					changed_leveldb_keys.push_back(key);
+					batch.put_storage(key, storage_value);
 				}
 			}
 
@@ -672,19 +1120,13 @@ namespace contract
 			{
 				const auto& commit_events_key = make_commit_events_key(commitId);
 				const auto& events_json = ContractChanges::events_to_json(changes->events);
-				if (!_db->Put(write_options, commit_events_key, jsondiff::json_dumps(events_json)).ok()) {
-					BOOST_THROW_EXCEPTION(ContractStorageException("commit events save error"));
-				}
-				changed_leveldb_keys.push_back(commit_events_key);
+				batch.put(commit_events_key, jsondiff::json_dumps(events_json));
 			}
 			// transactionId=>events
 			for (const auto& p : *transaction_events) {
 				const auto& tx_events_key = make_transaction_events_key(p.first);
 				const auto& tx_events_json = ContractChanges::events_to_json(p.second);
-				if (!_db->Put(write_options, tx_events_key, jsondiff::json_dumps(tx_events_json)).ok()) {
-					BOOST_THROW_EXCEPTION(ContractStorageException("commit events save error"));
-				}
-				changed_leveldb_keys.push_back(tx_events_key);
+				batch.put(tx_events_key, jsondiff::json_dumps(tx_events_json));
 			}
 
 			// upgrade infos
@@ -693,11 +1135,10 @@ namespace contract
 				const auto& contract_id = upgrade_info.contract_id;
 				std::string value;
 				auto contract_info_key = make_contract_info_key(contract_id);
-				auto status = _db->Get(read_options, contract_info_key, &value);
-				if (!status.ok()) {
+				if (!read_value(contract_info_key, &value, &batch)) {
 					BOOST_THROW_EXCEPTION(ContractStorageException("contract info not found to upgrade"));
 				}
-				auto json_value = jsondiff::json_loads(value);
+				auto json_value = decode_storage_value(value);
 				if (!json_value.is_object())
 					BOOST_THROW_EXCEPTION(ContractStorageException("contract info db data error"));
 				auto contract_info = ContractInfo::from_json(json_value);
@@ -708,58 +1149,39 @@ namespace contract
 					contract_info->name = differ.patch(contract_info->name, upgrade_info.name_diff).as_string();
 				if(upgrade_info.description_diff)
 					contract_info->description = differ.patch(contract_info->description, upgrade_info.description_diff).as_string();
-				const auto& new_contract_info_value = jsondiff::json_dumps(contract_info->to_json());
-				auto write_status = _db->Put(write_options, contract_info_key, new_contract_info_value);
-				if (!write_status.ok())
-					BOOST_THROW_EXCEPTION(ContractStorageException("contract info write to db error"));
-				changed_leveldb_keys.push_back(contract_info_key);
+				batch.put(contract_info_key, encode_storage_value(contract_info->to_json()));
 
 				if (!old_contract_name.empty()) {
-					const auto& contract_name_id_mapping_key = make_contract_name_id_mapping_key(old_contract_name);
-					auto delete_status = _db->Delete(write_options, contract_name_id_mapping_key);
-					if (!delete_status.ok() && !delete_status.IsNotFound())
-						BOOST_THROW_EXCEPTION(ContractStorageException("contract info write to db error"));
-					changed_leveldb_keys.push_back(contract_name_id_mapping_key);
+					batch.erase(make_contract_name_id_mapping_key(old_contract_name));
 				}
 				if (!contract_info->name.empty()) {
-					const auto& contract_name_id_mapping_key = make_contract_name_id_mapping_key(contract_info->name);
-					if (!_db->Put(write_options, contract_name_id_mapping_key, contract_info->id).ok())
-						BOOST_THROW_EXCEPTION(ContractStorageException("contract info write to db error"));
-					changed_leveldb_keys.push_back(contract_name_id_mapping_key);
+					batch.put(make_contract_name_id_mapping_key(contract_info->name), contract_info->id);
 				}
 			}
 
+			update_state_trie(batch);
+			batch.put(make_state_trie_root_key(commitId), state_trie(&batch).root_hash());
+			batch.stop_undo_capture();
+			add_commit_undo(commitId, batch);
+
 			// save commit info
 			const auto& diff_json = changes->to_json();
 			const auto& diff_str = jsondiff::json_dumps(diff_json);
-			add_commit_info(commitId, CONTRACT_STORAGE_CHANGE_TYPE, diff_str, "");
-			if (!_db->Put(write_options, root_state_hash_key, root_state_hash).ok())
-				BOOST_THROW_EXCEPTION(ContractStorageException("update root state hash error"));
-			changed_leveldb_keys.push_back(root_state_hash_key);
-			if (!_db->Put(write_options, top_root_state_hash_key, root_state_hash).ok())
-				BOOST_THROW_EXCEPTION(ContractStorageException("update top root state hash error"));
-			changed_leveldb_keys.push_back(top_root_state_hash_key);
-			success = true;
+			add_commit_info(commitId, CONTRACT_STORAGE_CHANGE_TYPE, diff_str, "", batch);
+			batch.put(root_state_hash_key, root_state_hash);
+			batch.put(top_root_state_hash_key, root_state_hash);
+			write_batch(batch);
 			return commitId;
 		}
 
 		ContractCommitId ContractStorageService::top_commit_id() const
 		{
 			check_db();
-			char *errMsg;
-			jsondiff::JsonArray records;
-			auto query_sql = "select id, commit_id, change_type, contract_id from commit_info order by id desc limit 1";
-			auto status = sqlite3_exec(_sql_db, query_sql,
-				&query_records_sql_callback, &records, &errMsg);
-			if (status != SQLITE_OK)
-			{
-				std::string err_msg_str(errMsg);
-				sqlite3_free(errMsg);
-				BOOST_THROW_EXCEPTION(ContractStorageException(err_msg_str));
-			}
-			if (records.size() > 0)
-				return records[0]["commit_id"].as_string();
-			return EMPTY_COMMIT_ID;
+			auto seq = last_commit_seq(nullptr);
+			std::string commit_id;
+			if (seq == 0 || !read_value(make_commit_log_key(seq), &commit_id))
+				return EMPTY_COMMIT_ID;
+			return commit_id;
 		}
 
 		ContractCommitId ContractStorageService::generate_next_root_hash(const std::string& old_root_state_hash, const fcrypto::sha256& diff_hash) const
@@ -769,82 +1191,65 @@ namespace contract
 
 		void ContractStorageService::reset_root_state_hash(const ContractCommitId& dest_commit_id)
 		{
-			check_db();
+			check_writable_db();
 			auto commit_info = get_commit_info(dest_commit_id);
 			if (!commit_info && dest_commit_id != EMPTY_COMMIT_ID)
 				BOOST_THROW_EXCEPTION(ContractStorageException(std::string("Can't find commit ") + dest_commit_id));
-			leveldb::WriteOptions write_options;
-			if (!_db->Put(write_options, root_state_hash_key, dest_commit_id).ok())
-				BOOST_THROW_EXCEPTION(ContractStorageException("update root state hash error"));
+			ContractStorageBatch batch;
+			batch.put(root_state_hash_key, dest_commit_id);
+			write_batch(batch);
 		}
 
-		void ContractStorageService::rollback_to_root_state_hash_without_transactional(const ContractCommitId& dest_commit_id, std::vector<std::string>& changed_leveldb_keys)
+		void ContractStorageService::rollback_to_root_state_hash_without_transactional(const ContractCommitId& dest_commit_id, ContractStorageBatch& batch)
 		{
 			check_db();
-			leveldb::WriteOptions write_options;
-			leveldb::ReadOptions read_options;
-			// find all commits after this commit
-			auto commit_info = get_commit_info(dest_commit_id);
+			// find all commits after this commit, newest first
+			auto commit_info = get_commit_info(dest_commit_id, &batch);
 			if (!commit_info && dest_commit_id != EMPTY_COMMIT_ID)
 				BOOST_THROW_EXCEPTION(ContractStorageException(std::string("Can't find commit ") + dest_commit_id));
-			char *errMsg;
-			jsondiff::JsonArray records;
-			std::string query_sql;
-			if (dest_commit_id == EMPTY_COMMIT_ID)
-				query_sql = "select id, commit_id, change_type, contract_id from commit_info order by id desc";
-			else
-				query_sql = std::string("select id, commit_id, change_type, contract_id from commit_info where id>") + std::to_string(commit_info->id) + " order by id desc";
-
-			auto status = sqlite3_exec(_sql_db, query_sql.c_str(),
-				&query_records_sql_callback, &records, &errMsg);
-			if (status != SQLITE_OK)
-			{
-				std::string err_msg_str(errMsg);
-				sqlite3_free(errMsg);
-				BOOST_THROW_EXCEPTION(ContractStorageException(err_msg_str));
-			}
+			uint64_t dest_seq = commit_info ? commit_info->id : 0;
 			std::vector<ContractCommitInfo> newerCommitInfos;
-			for (const auto &item_json : records)
+			for (auto seq = last_commit_seq(&batch); seq > dest_seq; seq--)
 			{
-				jsondiff::JsonObject found_record = item_json.as<jsondiff::JsonObject>();
-				ContractCommitInfo commit_info;
-				commit_info.id = found_record["id"].as_uint64();
-				commit_info.commit_id = found_record["commit_id"].as_string();
-				commit_info.change_type = found_record["change_type"].as_string();
-				commit_info.contract_id = found_record["contract_id"].as_string();
-				newerCommitInfos.push_back(commit_info);
+				std::string commit_id;
+				if (!read_value(make_commit_log_key(seq), &commit_id, &batch))
+					continue;
+				auto newer_commit_info = get_commit_info(commit_id, &batch);
+				if (!newer_commit_info)
+					BOOST_THROW_EXCEPTION(ContractStorageException(std::string("commit log data error, can't find commit ") + commit_id));
+				newerCommitInfos.push_back(*newer_commit_info);
 			}
 
 			jsondiff::JsonDiff differ;
+			bool replayed_diffs = false;
 
-			// rollback contracts info, contract balances, contract storages, upgrade infos and events
+			// rollback contracts info, contract balances, contract storages, upgrade infos and events.
+			// commits with an undo record restore the prior values of their changed keys,
+			// commits saved by older versions replay their diffs backwards
 			for (auto i = newerCommitInfos.begin(); i != newerCommitInfos.end(); i++)
 			{
-				if (i->change_type == CONTRACT_INFO_CHANGE_TYPE)
+				if (undo_commit(i->commit_id, batch))
+				{
+					// restored the prior values of the changed keys, no diff replay needed
+				}
+				else if (i->change_type == CONTRACT_INFO_CHANGE_TYPE)
 				{
 					// contract info change rollback
-					auto diff_json = get_json_value_by_key_or_null(i->commit_id);
+					replayed_diffs = true;
+					auto diff_json = get_json_value_by_key_or_null(i->commit_id, &batch);
 					auto contract_info_diff = std::make_shared<jsondiff::DiffResult>(diff_json);
-					auto contract_info = get_contract_info(i->contract_id);
+					auto contract_info = get_contract_info(i->contract_id, &batch);
 					auto rollbakced_contract_info_json = differ.rollback(contract_info->to_json(), contract_info_diff);
 					auto rollbakced_contract_info = ContractInfo::from_json(rollbakced_contract_info_json);
 					if (!rollbakced_contract_info)
 					{
 						// delete this contract in db
-						const auto& delete_key = make_contract_info_key(i->contract_id);
-						auto delete_contract_status = _db->Delete(write_options, delete_key);
-						if (!delete_contract_status.ok())
-							BOOST_THROW_EXCEPTION(ContractStorageException("delete contract info from db error"));
-						changed_leveldb_keys.push_back(delete_key);
+						batch.erase(make_contract_info_key(i->contract_id));
 					}
 					else
 					{
 						// set older data
-						const auto& set_key = make_contract_info_key(i->contract_id);
-						auto update_status = _db->Put(write_options, set_key, jsondiff::json_dumps(rollbakced_contract_info->to_json()));
-						if (!update_status.ok())
-							BOOST_THROW_EXCEPTION(ContractStorageException("rollback contract info to db error"));
-						changed_leveldb_keys.push_back(set_key);
+						batch.put(make_contract_info_key(i->contract_id), encode_storage_value(rollbakced_contract_info->to_json()));
 					}
 					if (contract_info && contract_info->name.size() > 0)
 					{
@@ -852,17 +1257,15 @@ namespace contract
 						if (!rollbakced_contract_info || rollbakced_contract_info->name.empty())
 						{
 							// when not have name before, delete name => id mapping
-							const auto& contract_name_id_mapping_key = make_contract_name_id_mapping_key(contract_info->name);
-							if (!_db->Delete(write_options, contract_name_id_mapping_key).ok())
-								BOOST_THROW_EXCEPTION(ContractStorageException("rollback contract info(delete contract name=>id mapping) to db error"));
-							changed_leveldb_keys.push_back(contract_name_id_mapping_key);
+							batch.erase(make_contract_name_id_mapping_key(contract_info->name));
 						}
 					}
 				}
 				else if (i->change_type == CONTRACT_STORAGE_CHANGE_TYPE)
 				{
 					// contract balance and storage chagne rollback
-					auto diff_json = get_json_value_by_key_or_null(i->commit_id);
+					replayed_diffs = true;
+					auto diff_json = get_json_value_by_key_or_null(i->commit_id, &batch);
 					auto changes = ContractChanges::from_json(diff_json.as<jsondiff::JsonObject>());
 					for (const auto &balance_change : changes.balance_changes)
 					{
@@ -871,11 +1274,10 @@ namespace contract
 							continue;
 						std::string value;
 						auto contract_info_key = make_contract_info_key(balance_change.address);
-						auto status = _db->Get(read_options, contract_info_key, &value);
-						if (!status.ok()) {
+						if (!read_value(contract_info_key, &value, &batch)) {
 							BOOST_THROW_EXCEPTION(ContractStorageException("contract info not found to transfer balance"));
 						}
-						auto json_value = jsondiff::json_loads(value);
+						auto json_value = decode_storage_value(value);
 						if (!json_value.is_object())
 							BOOST_THROW_EXCEPTION(ContractStorageException("contract info db data error"));
 						auto contract_info = ContractInfo::from_json(json_value);
@@ -898,11 +1300,7 @@ namespace contract
 							balances.push_back(balance);
 						}
 						contract_info->balances = balances;
-						auto new_contract_info_value = jsondiff::json_dumps(contract_info->to_json());
-						auto write_status = _db->Put(write_options, contract_info_key, new_contract_info_value);
-						if (!write_status.ok())
-							BOOST_THROW_EXCEPTION(ContractStorageException("contract info write to db error"));
-						changed_leveldb_keys.push_back(contract_info_key);
+						batch.put(contract_info_key, encode_storage_value(contract_info->to_json()));
 					}
 					for (const auto &storage_change : changes.storage_changes)
 					{
@@ -910,13 +1308,9 @@ namespace contract
 						const auto &contract_id = storage_change.contract_id;
 						for (const auto &storage_change_item : storage_change.items)
 						{
-							auto storage_new_value = get_contract_storage(contract_id, storage_change_item.name);
+							auto storage_new_value = get_contract_storage(contract_id, storage_change_item.name, &batch);
 							auto storage_value = differ.rollback(storage_new_value, storage_change_item.diff);
-							auto key = make_contract_storage_key(contract_id, storage_change_item.name);
-							auto status = _db->Put(write_options, key, jsondiff::json_dumps(storage_value));
-							if (!status.ok())
-								BOOST_THROW_EXCEPTION(ContractStorageException("contract storage write to db error"));
-							changed_leveldb_keys.push_back(key);
+							batch.put_storage(make_contract_storage_key(contract_id, storage_change_item.name), storage_value);
 						}
 					}
 					for (const auto& upgrade_info : changes.upgrade_infos)
@@ -924,11 +1318,10 @@ namespace contract
 						const auto& contract_id = upgrade_info.contract_id;
 						std::string value;
 						auto contract_info_key = make_contract_info_key(contract_id);
-						auto status = _db->Get(read_options, contract_info_key, &value);
-						if (!status.ok()) {
+						if (!read_value(contract_info_key, &value, &batch)) {
 							BOOST_THROW_EXCEPTION(ContractStorageException("contract info not found to rollback upgrade"));
 						}
-						auto json_value = jsondiff::json_loads(value);
+						auto json_value = decode_storage_value(value);
 						if (!json_value.is_object())
 							BOOST_THROW_EXCEPTION(ContractStorageException("contract info db data error"));
 						auto contract_info = ContractInfo::from_json(json_value);
@@ -945,23 +1338,13 @@ namespace contract
 						else
 							old_contract_desc = contract_info->description;
 						contract_info->description = old_contract_desc.is_string() ? old_contract_desc.as_string() : "";
-						status = _db->Put(write_options, contract_info_key, jsondiff::json_dumps(contract_info->to_json()));
-						if (!status.ok())
-							BOOST_THROW_EXCEPTION(ContractStorageException("contract upgrade info rollback failed"));
-						changed_leveldb_keys.push_back(contract_info_key);
+						batch.put(contract_info_key, encode_storage_value(contract_info->to_json()));
 						// mapping name=>id
 						if (!now_contract_name.empty()) {
-							const auto& contract_name_id_mapping_key = make_contract_name_id_mapping_key(now_contract_name);
-							auto delete_status = _db->Delete(write_options, contract_name_id_mapping_key);
-							if (!delete_status.ok() && !delete_status.IsNotFound())
-								BOOST_THROW_EXCEPTION(ContractStorageException("contract upgrade info rollback failed"));
-							changed_leveldb_keys.push_back(contract_name_id_mapping_key);
+							batch.erase(make_contract_name_id_mapping_key(now_contract_name));
 						}
 						if (!contract_info->name.empty()) {
-							const auto& contract_name_id_mapping_key = make_contract_name_id_mapping_key(contract_info->name);
-							if (!_db->Put(write_options, contract_name_id_mapping_key, contract_info->id).ok())
-								BOOST_THROW_EXCEPTION(ContractStorageException("contract upgrade info rollback failed"));
-							changed_leveldb_keys.push_back(contract_name_id_mapping_key);
+							batch.put(make_contract_name_id_mapping_key(contract_info->name), contract_info->id);
 						}
 					}
 					std::set<std::string> transaction_ids;
@@ -970,86 +1353,134 @@ namespace contract
 							transaction_ids.insert(event_info.transaction_id);
 						}
 					}
-					{
-						// transactionId=>events delete
-						for (const auto& txid : transaction_ids) {
-							const auto& tx_events_key = make_transaction_events_key(txid);
-							auto status = _db->Delete(write_options, tx_events_key);
-							if (!status.ok() && !status.IsNotFound()) {
-								BOOST_THROW_EXCEPTION(ContractStorageException("rollback commit events failed"));
-							}
-							if (status.ok())
-								changed_leveldb_keys.push_back(tx_events_key);
-						}
-					}
-					{
-						// events key delete
-						const auto& commit_events_key = make_commit_events_key(i->commit_id);
-						auto delete_commit_events_key_status = _db->Delete(write_options, commit_events_key);
-						if (!delete_commit_events_key_status.ok() && !delete_commit_events_key_status.IsNotFound()) {
-							BOOST_THROW_EXCEPTION(ContractStorageException("rollback commit events failed"));
-						}
-						if (delete_commit_events_key_status.ok())
-							changed_leveldb_keys.push_back(commit_events_key);
+					// transactionId=>events delete
+					for (const auto& txid : transaction_ids) {
+						batch.erase(make_transaction_events_key(txid));
 					}
+					// events key delete
+					batch.erase(make_commit_events_key(i->commit_id));
 				}
 				else
 				{
 					BOOST_THROW_EXCEPTION(ContractStorageException(std::string("not supported change type ") + i->change_type));
 				}
 
-				// delete the rollbacked commit_info
-				char *delete_commit_info_err_msg;
-				std::string delete_commit_info_sql = std::string("delete from commit_info where commit_id='") + i->commit_id + "'";
-				auto delete_commit_info_status = sqlite3_exec(_sql_db, delete_commit_info_sql.c_str(), &empty_sql_callback, nullptr, &delete_commit_info_err_msg);
-				if (delete_commit_info_status != SQLITE_OK)
-				{
-					std::string err_msg_str(delete_commit_info_err_msg);
-					sqlite3_free(delete_commit_info_err_msg);
-					BOOST_THROW_EXCEPTION(ContractStorageException(err_msg_str));
-				}
+				// delete the rollbacked commit from commit log
+				batch.erase(make_commit_log_key(i->id));
+				batch.erase(make_commit_index_key(i->commit_id));
 
 				// delete the rollbackedCommitId => value in db
-				auto deleteCommitIdValueStatus = _db->Delete(write_options, i->commit_id);
-				if (!deleteCommitIdValueStatus.ok())
-					BOOST_THROW_EXCEPTION(ContractStorageException(std::string("delete commit ") + i->commit_id + " error"));
+				batch.erase(i->commit_id);
 			}
+			// undo records restore the state trie nodes too, replayed diffs need the trie updated
+			if (replayed_diffs)
+				update_state_trie(batch);
 
+			batch.put(commit_log_seq_key, std::to_string(dest_seq));
 			const auto& root_state_hash = dest_commit_id;
-			if (!_db->Put(write_options, root_state_hash_key, root_state_hash).ok())
-				BOOST_THROW_EXCEPTION(ContractStorageException("update root state hash error"));
-			changed_leveldb_keys.push_back(root_state_hash_key);
-			if (!_db->Put(write_options, top_root_state_hash_key, root_state_hash).ok())
-				BOOST_THROW_EXCEPTION(ContractStorageException("update top root state hash error"));
-			changed_leveldb_keys.push_back(top_root_state_hash_key);
+			batch.put(root_state_hash_key, root_state_hash);
+			batch.put(top_root_state_hash_key, root_state_hash);
 		}
 
-		void ContractStorageService::rollback_contract_state(const ContractCommitId& dest_commit_id)
+		ContractStateTrie ContractStorageService::state_trie(ContractStorageBatch* batch) const
 		{
-			check_db();
-			
-			bool success = false;
-			leveldb::WriteOptions write_options;
-			leveldb::ReadOptions read_options;
-			auto snapshot = _db->GetSnapshot();
-			std::vector<std::string> changed_leveldb_keys;
-			begin_sql_transaction();
-			BOOST_SCOPE_EXIT_ALL(&) {
-				if (success)
-				{
-					commit_sql_transaction();
-				}
+			return ContractStateTrie([this, batch](const std::string& node_key, std::string* node) {
+				return read_value(node_key, node, batch);
+			}, [batch](const std::string& node_key, const std::string* node) {
+				if (!batch)
+					BOOST_THROW_EXCEPTION(ContractStorageException("contract state trie is read only without batch"));
+				if (node)
+					batch->put(node_key, *node);
 				else
+					batch->erase(node_key);
+			});
+		}
+
+		void ContractStorageService::update_state_trie(ContractStorageBatch& batch)
+		{
+			std::vector<std::string> keys;
+			for (const auto& p : batch.pending())
+			{
+				if (boost::starts_with(p.first, contract_info_key_prefix) || boost::starts_with(p.first, contract_storage_key_prefix))
+					keys.push_back(p.first);
+			}
+			auto trie = state_trie(&batch);
+			for (const auto& key : keys)
+			{
+				std::string value;
+				bool found = false;
+				batch.get_staged(key, &value, &found);
+				std::string value_hash;
+				if (found)
 				{
-					rollback_sql_transaction();
-					rollback_leveldb_transaction(snapshot, changed_leveldb_keys);
+					jsondiff::JsonValue json_value;
+					if (!batch.get_staged_storage(key, &json_value))
+						json_value = decode_storage_value(value);
+					value_hash = state_value_hash(json_value);
 				}
-			};
+				trie.update(state_key_hash(key), value_hash);
+			}
+		}
+
+		std::string ContractStorageService::state_trie_root() const
+		{
+			check_db();
+			return state_trie(nullptr).root_hash();
+		}
+
+		std::string ContractStorageService::state_trie_root_of_commit(const ContractCommitId& commit_id) const
+		{
+			check_db();
+			std::string root;
+			if (!read_value(make_state_trie_root_key(commit_id), &root))
+				return std::string();
+			return root;
+		}
+
+		ContractStateProof ContractStorageService::prove_state(const std::string& key, jsondiff::JsonValue* value) const
+		{
+			check_db();
+			std::string raw_value;
+			*value = read_value(key, &raw_value) ? decode_storage_value(raw_value) : jsondiff::JsonValue();
+			return state_trie(nullptr).prove(state_key_hash(key));
+		}
+
+		ContractStateProof ContractStorageService::prove_contract_storage(const AddressType& contract_id, const std::string& storage_name, jsondiff::JsonValue* value) const
+		{
+			return prove_state(make_contract_storage_key(contract_id, storage_name), value);
+		}
+
+		ContractStateProof ContractStorageService::prove_contract_info(const AddressType& contract_id, jsondiff::JsonValue* value) const
+		{
+			return prove_state(make_contract_info_key(contract_id), value);
+		}
+
+		std::string ContractStorageService::contract_storage_state_key_hash(const AddressType& contract_id, const std::string& storage_name)
+		{
+			return state_key_hash(make_contract_storage_key(contract_id, storage_name));
+		}
+
+		std::string ContractStorageService::contract_info_state_key_hash(const AddressType& contract_id)
+		{
+			return state_key_hash(make_contract_info_key(contract_id));
+		}
+
+		std::string ContractStorageService::state_value_hash(const jsondiff::JsonValue& value)
+		{
+			auto digest = ordered_json_digest(value);
+			return std::string(digest.data(), digest.data_size());
+		}
+
+		void ContractStorageService::rollback_contract_state(const ContractCommitId& dest_commit_id)
+		{
+			check_writable_db();
+			
 			auto commit_info = get_commit_info(dest_commit_id);
 			if (!commit_info && dest_commit_id != EMPTY_COMMIT_ID)
 				BOOST_THROW_EXCEPTION(ContractStorageException(std::string("Can't find commit ") + dest_commit_id));
-			rollback_to_root_state_hash_without_transactional(dest_commit_id, changed_leveldb_keys);
-			success = true;
+			ContractStorageBatch batch;
+			rollback_to_root_state_hash_without_transactional(dest_commit_id, batch);
+			write_batch(batch);
 		}
 
 	}
@@ -0,0 +1,245 @@
+#include <contract_storage/state_trie.hpp>
+#include <contract_storage/exceptions.hpp>
+#include <fcrypto/sha256.hpp>
+#include <boost/exception/all.hpp>
+
+namespace contract
+{
+	namespace storage
+	{
+		static const std::string state_trie_node_key_prefix = "state_trie$";
+
+		static const size_t hash_size = 32;
+		static const uint32_t max_depth = hash_size * 8;
+
+		static const char node_tag_leaf = 0;
+		static const char node_tag_branch = 1;
+
+		static int key_bit(const std::string& key_hash, uint32_t depth)
+		{
+			return ((unsigned char)key_hash[depth / 8] >> (7 - depth % 8)) & 1;
+		}
+
+		// node at depth on the path of key_hash, keyed by depth and the first depth bits of the path
+		static std::string make_node_key(uint32_t depth, const std::string& key_hash)
+		{
+			std::string result(state_trie_node_key_prefix);
+			result.push_back((char)(depth >> 8));
+			result.push_back((char)depth);
+			result.append(key_hash, 0, (depth + 7) / 8);
+			if (depth % 8)
+				result.back() = (char)((unsigned char)result.back() & (0xff << (8 - depth % 8)));
+			return result;
+		}
+
+		// node key of the child of the node at depth on the path of key_hash
+		static std::string make_child_node_key(uint32_t depth, const std::string& key_hash, int bit)
+		{
+			std::string path(key_hash);
+			auto mask = (char)(1 << (7 - depth % 8));
+			path[depth / 8] = bit ? (path[depth / 8] | mask) : (path[depth / 8] & ~mask);
+			return make_node_key(depth + 1, path);
+		}
+
+		static std::string encode_node(char tag, const std::string& first, const std::string& second)
+		{
+			std::string node;
+			node.push_back(tag);
+			node.append(first);
+			node.append(second);
+			return node;
+		}
+
+		static void check_node(const std::string& node)
+		{
+			if (node.size() != 1 + 2 * hash_size || (node[0] != node_tag_leaf && node[0] != node_tag_branch))
+				BOOST_THROW_EXCEPTION(ContractStorageException("contract state trie node data error"));
+		}
+
+		static std::string node_hash(const std::string& node)
+		{
+			check_node(node);
+			if (node[0] == node_tag_leaf)
+				return ContractStateTrie::leaf_hash(node.substr(1, hash_size), node.substr(1 + hash_size));
+			return ContractStateTrie::branch_hash(node.substr(1, hash_size), node.substr(1 + hash_size));
+		}
+
+		static std::string sha256_bytes(const std::string& data)
+		{
+			auto digest = fcrypto::sha256::hash(data);
+			return std::string(digest.data(), digest.data_size());
+		}
+
+		ContractStateTrie::ContractStateTrie(NodeReader reader, NodeWriter writer)
+			: _reader(reader), _writer(writer)
+		{
+		}
+
+		std::string ContractStateTrie::empty_hash()
+		{
+			return std::string(hash_size, '\0');
+		}
+
+		std::string ContractStateTrie::leaf_hash(const std::string& key_hash, const std::string& value_hash)
+		{
+			return sha256_bytes(encode_node(node_tag_leaf, key_hash, value_hash));
+		}
+
+		std::string ContractStateTrie::branch_hash(const std::string& left, const std::string& right)
+		{
+			return sha256_bytes(encode_node(node_tag_branch, left, right));
+		}
+
+		std::string ContractStateTrie::root_hash() const
+		{
+			std::string node;
+			if (!_reader(make_node_key(0, std::string()), &node))
+				return empty_hash();
+			return node_hash(node);
+		}
+
+		void ContractStateTrie::update(const std::string& key_hash, const std::string& value_hash)
+		{
+			if (key_hash.size() != hash_size || !(value_hash.empty() || value_hash.size() == hash_size))
+				BOOST_THROW_EXCEPTION(ContractStorageException("invalid contract state trie leaf"));
+			update(0, key_hash, value_hash);
+		}
+
+		// returns the new hash of the subtree at depth on the path of key_hash
+		std::string ContractStateTrie::update(uint32_t depth, const std::string& key_hash, const std::string& value_hash)
+		{
+			if (depth >= max_depth)
+				BOOST_THROW_EXCEPTION(ContractStorageException("contract state trie too deep"));
+			const auto& node_key = make_node_key(depth, key_hash);
+			std::string node;
+			if (!_reader(node_key, &node))
+			{
+				if (value_hash.empty())
+					return empty_hash();
+				const auto& leaf = encode_node(node_tag_leaf, key_hash, value_hash);
+				_writer(node_key, &leaf);
+				return leaf_hash(key_hash, value_hash);
+			}
+			check_node(node);
+			std::string left, right;
+			if (node[0] == node_tag_leaf)
+			{
+				const auto& leaf_key_hash = node.substr(1, hash_size);
+				if (leaf_key_hash == key_hash)
+				{
+					if (value_hash.empty())
+					{
+						_writer(node_key, nullptr);
+						return empty_hash();
+					}
+					const auto& leaf = encode_node(node_tag_leaf, key_hash, value_hash);
+					_writer(node_key, &leaf);
+					return leaf_hash(key_hash, value_hash);
+				}
+				if (value_hash.empty())
+					return node_hash(node);
+				// the subtree gets a second leaf, move the existing leaf one level down
+				_writer(make_node_key(depth + 1, leaf_key_hash), &node);
+				left = right = empty_hash();
+				(key_bit(leaf_key_hash, depth) ? right : left) = node_hash(node);
+			}
+			else
+			{
+				left = node.substr(1, hash_size);
+				right = node.substr(1 + hash_size);
+			}
+			auto bit = key_bit(key_hash, depth);
+			(bit ? right : left) = update(depth + 1, key_hash, value_hash);
+
+			const auto& empty = empty_hash();
+			if (left == empty && right == empty)
+			{
+				_writer(node_key, nullptr);
+				return empty;
+			}
+			if (left == empty || right == empty)
+			{
+				// a subtree left with a single leaf is stored as that leaf
+				const auto& child_key = make_child_node_key(depth, key_hash, left == empty ? 1 : 0);
+				std::string child;
+				if (_reader(child_key, &child) && !child.empty() && child[0] == node_tag_leaf)
+				{
+					_writer(child_key, nullptr);
+					_writer(node_key, &child);
+					return node_hash(child);
+				}
+			}
+			const auto& branch = encode_node(node_tag_branch, left, right);
+			_writer(node_key, &branch);
+			return branch_hash(left, right);
+		}
+
+		ContractStateProof ContractStateTrie::prove(const std::string& key_hash) const
+		{
+			if (key_hash.size() != hash_size)
+				BOOST_THROW_EXCEPTION(ContractStorageException("invalid contract state trie key"));
+			ContractStateProof proof;
+			for (uint32_t depth = 0; depth < max_depth; depth++)
+			{
+				std::string node;
+				if (!_reader(make_node_key(depth, key_hash), &node))
+					return proof;
+				check_node(node);
+				if (node[0] == node_tag_leaf)
+				{
+					proof.leaf_key_hash = node.substr(1, hash_size);
+					proof.leaf_value_hash = node.substr(1 + hash_size);
+					return proof;
+				}
+				proof.siblings.push_back(key_bit(key_hash, depth) ? node.substr(1, hash_size) : node.substr(1 + hash_size));
+			}
+			BOOST_THROW_EXCEPTION(ContractStorageException("contract state trie too deep"));
+		}
+
+		std::string ContractStateTrie::proof_root(const std::string& key_hash, const std::string& value_hash, const ContractStateProof& proof)
+		{
+			if (key_hash.size() != hash_size || proof.siblings.size() >= max_depth)
+				return std::string();
+			for (const auto& sibling : proof.siblings)
+			{
+				if (sibling.size() != hash_size)
+					return std::string();
+			}
+			std::string hash;
+			if (proof.leaf_key_hash.empty())
+			{
+				if (!value_hash.empty() || !proof.leaf_value_hash.empty())
+					return std::string();
+				hash = empty_hash();
+			}
+			else
+			{
+				if (proof.leaf_key_hash.size() != hash_size || proof.leaf_value_hash.size() != hash_size)
+					return std::string();
+				if (proof.leaf_key_hash == key_hash)
+				{
+					if (proof.leaf_value_hash != value_hash)
+						return std::string();
+				}
+				else
+				{
+					// the leaf of another key must be on the path of key_hash
+					if (!value_hash.empty())
+						return std::string();
+					for (uint32_t depth = 0; depth < proof.siblings.size(); depth++)
+					{
+						if (key_bit(proof.leaf_key_hash, depth) != key_bit(key_hash, depth))
+							return std::string();
+					}
+				}
+				hash = leaf_hash(proof.leaf_key_hash, proof.leaf_value_hash);
+			}
+			for (auto depth = proof.siblings.size(); depth-- > 0;)
+			{
+				const auto& sibling = proof.siblings[depth];
+				hash = key_bit(key_hash, depth) ? branch_hash(sibling, hash) : branch_hash(hash, sibling);
+			}
+			return hash;
+		}
+	}
+}
@@ -0,0 +1,45 @@
+#include <contract_storage/undo.hpp>
+#include <contract_storage/value_encoding.hpp>
+#include <contract_storage/exceptions.hpp>
+#include <boost/exception/all.hpp>
+
+namespace contract
+{
+	namespace storage
+	{
+		std::string ContractCommitUndo::encode() const
+		{
+			std::string out;
+			write_varint(out, items.size());
+			for (const auto& item : items)
+			{
+				write_bytes(out, item.key);
+				out.push_back(item.existed ? 1 : 0);
+				if (item.existed)
+					write_bytes(out, item.value);
+			}
+			return out;
+		}
+
+		ContractCommitUndo ContractCommitUndo::decode(const std::string& data)
+		{
+			ContractCommitUndo undo;
+			size_t pos = 0;
+			auto count = read_varint(data, pos);
+			for (uint64_t i = 0; i < count; i++)
+			{
+				ContractStorageUndoItem item;
+				item.key = read_bytes(data, pos);
+				if (pos >= data.size())
+					BOOST_THROW_EXCEPTION(ContractStorageException("contract commit undo truncated"));
+				item.existed = data[pos++] != 0;
+				if (item.existed)
+					item.value = read_bytes(data, pos);
+				undo.items.push_back(std::move(item));
+			}
+			if (pos != data.size())
+				BOOST_THROW_EXCEPTION(ContractStorageException("contract commit undo has trailing bytes"));
+			return undo;
+		}
+	}
+}
@@ -0,0 +1,227 @@
+#include <contract_storage/value_encoding.hpp>
+#include <contract_storage/exceptions.hpp>
+#include <fjson/string.hpp>
+#include <boost/exception/all.hpp>
+#include <algorithm>
+
+namespace contract
+{
+	namespace storage
+	{
+		using namespace jsondiff;
+
+		void write_varint(std::string& out, uint64_t n)
+		{
+			while (n >= 0x80)
+			{
+				out.push_back((char)((n & 0x7f) | 0x80));
+				n >>= 7;
+			}
+			out.push_back((char)n);
+		}
+
+		uint64_t read_varint(const std::string& data, size_t& pos)
+		{
+			uint64_t n = 0;
+			for (int shift = 0; shift < 64; shift += 7)
+			{
+				if (pos >= data.size())
+					BOOST_THROW_EXCEPTION(ContractStorageException("contract storage value truncated"));
+				auto b = (unsigned char)data[pos++];
+				n |= (uint64_t)(b & 0x7f) << shift;
+				if (!(b & 0x80))
+					return n;
+			}
+			BOOST_THROW_EXCEPTION(ContractStorageException("contract storage value varint too long"));
+		}
+
+		void write_bytes(std::string& out, const std::string& str)
+		{
+			write_varint(out, str.size());
+			out.append(str);
+		}
+
+		std::string read_bytes(const std::string& data, size_t& pos)
+		{
+			auto size = read_varint(data, pos);
+			if (size > data.size() - pos)
+				BOOST_THROW_EXCEPTION(ContractStorageException("contract storage value truncated"));
+			std::string result(data, pos, size);
+			pos += size;
+			return result;
+		}
+
+		// json text parser turns "\a" into "a" and can't read 0x04, so these strings keep the json format
+		static bool is_binary_safe_string(const std::string& str)
+		{
+			return str.find('\a') == std::string::npos && str.find('\x04') == std::string::npos;
+		}
+
+		static bool write_integer_text(std::string& out, const std::string& text)
+		{
+			// the json parser reads negative integers as int64 and others as uint64
+			if (text.empty() || text == "-")
+				return false;
+			if (text[0] == '-')
+			{
+				// negative value v is saved as ~v to keep the varint short
+				out.push_back((char)storage_value_tag_int);
+				write_varint(out, ~(uint64_t)fjson::to_int64(text));
+			}
+			else
+			{
+				out.push_back((char)storage_value_tag_uint);
+				write_varint(out, fjson::to_uint64(text));
+			}
+			return true;
+		}
+
+		// returns false when value can't be encoded to the same value json_loads(json_dumps(value)) gives
+		static bool write_value(std::string& out, const JsonValue& value)
+		{
+			switch (value.get_type())
+			{
+			case JsonValue::null_type:
+				out.push_back((char)storage_value_tag_null);
+				return true;
+			case JsonValue::int64_type:
+			case JsonValue::uint64_type:
+				return write_integer_text(out, value.as_string());
+			case JsonValue::double_type:
+			{
+				const auto& text = value.as_string();
+				if (text.find_first_not_of("-0123456789.") != std::string::npos || text.find('-', 1) != std::string::npos)
+					return false;
+				auto dot_count = std::count(text.begin(), text.end(), '.');
+				if (dot_count == 0)
+					return write_integer_text(out, text);
+				if (dot_count > 1 || text == "." || text == "-.")
+					return false;
+				out.push_back((char)storage_value_tag_number);
+				write_bytes(out, text);
+				return true;
+			}
+			case JsonValue::bool_type:
+				out.push_back((char)storage_value_tag_bool);
+				out.push_back(value.as_bool() ? 1 : 0);
+				return true;
+			case JsonValue::string_type:
+			{
+				const auto& str = value.get_string();
+				if (!is_binary_safe_string(str))
+					return false;
+				out.push_back((char)storage_value_tag_string);
+				write_bytes(out, str);
+				return true;
+			}
+			case JsonValue::array_type:
+			{
+				const auto& arr = value.get_array();
+				out.push_back((char)storage_value_tag_array);
+				write_varint(out, arr.size());
+				for (const auto& item : arr)
+				{
+					if (!write_value(out, item))
+						return false;
+				}
+				return true;
+			}
+			case JsonValue::object_type:
+			{
+				const auto& obj = value.get_object();
+				out.push_back((char)storage_value_tag_table);
+				write_varint(out, obj.size());
+				for (auto it = obj.begin(); it != obj.end(); it++)
+				{
+					if (!is_binary_safe_string(it->key()))
+						return false;
+					write_bytes(out, it->key());
+					if (!write_value(out, it->value()))
+						return false;
+				}
+				return true;
+			}
+			default:
+				return false;
+			}
+		}
+
+		static JsonValue read_value(const std::string& data, size_t& pos)
+		{
+			if (pos >= data.size())
+				BOOST_THROW_EXCEPTION(ContractStorageException("contract storage value truncated"));
+			auto tag = (unsigned char)data[pos++];
+			switch (tag)
+			{
+			case storage_value_tag_null:
+				return JsonValue();
+			case storage_value_tag_int:
+				return JsonValue((int64_t)~read_varint(data, pos));
+			case storage_value_tag_uint:
+				return JsonValue(read_varint(data, pos));
+			case storage_value_tag_number:
+				return JsonValue(fjson::to_double(read_bytes(data, pos)));
+			case storage_value_tag_bool:
+			{
+				if (pos >= data.size())
+					BOOST_THROW_EXCEPTION(ContractStorageException("contract storage value truncated"));
+				return JsonValue(data[pos++] != 0);
+			}
+			case storage_value_tag_string:
+				return JsonValue(read_bytes(data, pos));
+			case storage_value_tag_array:
+			{
+				auto size = read_varint(data, pos);
+				JsonArray arr;
+				arr.reserve(std::min<uint64_t>(size, data.size() - pos));
+				for (uint64_t i = 0; i < size; i++)
+				{
+					arr.push_back(read_value(data, pos));
+				}
+				return arr;
+			}
+			case storage_value_tag_table:
+			{
+				auto size = read_varint(data, pos);
+				JsonObject obj;
+				for (uint64_t i = 0; i < size; i++)
+				{
+					auto key = read_bytes(data, pos);
+					obj(std::move(key), read_value(data, pos));
+				}
+				return obj;
+			}
+			default:
+				BOOST_THROW_EXCEPTION(ContractStorageException(std::string("unknown contract storage value tag ") + std::to_string(tag)));
+			}
+		}
+
+		std::string encode_storage_value(const jsondiff::JsonValue& value)
+		{
+			std::string out;
+			out.push_back(CONTRACT_STORAGE_BINARY_VALUE_MAGIC);
+			out.push_back((char)CONTRACT_STORAGE_VALUE_FORMAT_VERSION);
+			if (!write_value(out, value))
+				return json_dumps(value);
+			return out;
+		}
+
+		bool is_binary_storage_value(const std::string& data)
+		{
+			return !data.empty() && data[0] == CONTRACT_STORAGE_BINARY_VALUE_MAGIC;
+		}
+
+		jsondiff::JsonValue decode_storage_value(const std::string& data)
+		{
+			if (!is_binary_storage_value(data))
+				return json_loads(data);
+			if (data.size() < 2 || data[1] != (char)CONTRACT_STORAGE_VALUE_FORMAT_VERSION)
+				BOOST_THROW_EXCEPTION(ContractStorageException("unsupported contract storage value format version"));
+			size_t pos = 2;
+			auto value = read_value(data, pos);
+			if (pos != data.size())
+				BOOST_THROW_EXCEPTION(ContractStorageException("contract storage value has trailing bytes"));
+			return value;
+		}
+	}
+}
@@ -43,6 +43,10 @@
 #include <util.h>
 #include <utilmoneystr.h>
 #include <validationinterface.h>
+#include <contract_engine/contract_code_cache.hpp>
+#include <contract_engine/contract_exec_cache.hpp>
+#include <contract_engine/contract_profiler.hpp>
+#include <uvm/lvm.h>
 #ifdef ENABLE_WALLET
 #include <wallet/init.h>
 #endif
@@ -259,6 +263,7 @@ void Shutdown()
         pcoinscatcher.reset();
         pcoinsdbview.reset();
         pblocktree.reset();
+        close_contract_storage_service();
     }
 #ifdef ENABLE_WALLET
     StopWallets();
@@ -373,6 +378,11 @@ std::string HelpMessage(HelpMessageMode mode)
         strUsage += HelpMessageOpt("-dbbatchsize", strprintf("Maximum database write batch size in bytes (default: %u)", nDefaultDbBatchSize));
     }
     strUsage += HelpMessageOpt("-dbcache=<n>", strprintf(_("Set database cache size in megabytes (%d to %d, default: %d)"), nMinDbCache, nMaxDbCache, nDefaultDbCache));
+    strUsage += HelpMessageOpt("-contractcache=<n>", strprintf(_("Set contract storage value cache size in megabytes (default: %d)"), DEFAULT_CONTRACT_STORAGE_CACHE));
+    strUsage += HelpMessageOpt("-contractdbcache=<n>", strprintf(_("Set contract storage database cache size in megabytes (default: %d)"), DEFAULT_CONTRACT_STORAGE_DB_CACHE));
+    strUsage += HelpMessageOpt("-contractcodecache=<n>", strprintf(_("Set decoded contract code cache size in megabytes (default: %d)"), DEFAULT_CONTRACT_CODE_CACHE));
+    strUsage += HelpMessageOpt("-contractexeccache=<n>", strprintf(_("Set cache size in megabytes of contract tx executions reused by block assembly and by the connection of locally assembled blocks (default: %d)"), DEFAULT_CONTRACT_EXEC_CACHE));
+    strUsage += HelpMessageOpt("-contractprofile", strprintf(_("Profile opcodes, host api calls and storage bytes of contract executions, see getcontractprofile (default: %u)"), DEFAULT_CONTRACT_PROFILE));
     if (showDebug)
         strUsage += HelpMessageOpt("-feefilter", strprintf("Tell other nodes to filter invs to us by our mempool min fee (default: %u)", DEFAULT_FEEFILTER));
     strUsage += HelpMessageOpt("-loadblock=<file>", _("Imports blocks from external blk000??.dat file on startup"));
@@ -387,6 +397,8 @@ std::string HelpMessage(HelpMessageMode mode)
     strUsage += HelpMessageOpt("-blockreconstructionextratxn=<n>", strprintf(_("Extra transactions to keep in memory for compact block reconstructions (default: %u)"), DEFAULT_BLOCK_RECONSTRUCTION_EXTRA_TXN));
     strUsage += HelpMessageOpt("-par=<n>", strprintf(_("Set the number of script verification threads (%u to %d, 0 = auto, <0 = leave that many cores free, default: %d)"),
         -GetNumCores(), MAX_SCRIPTCHECK_THREADS, DEFAULT_SCRIPTCHECK_THREADS));
+    strUsage += HelpMessageOpt("-contractexecthreads=<n>", strprintf(_("Set the number of threads executing the contract transactions of a block (%u to %d, 0 = auto, 1 = one after another, <0 = leave that many cores free, default: %d)"),
+        -GetNumCores(), MAX_CONTRACT_EXEC_THREADS, DEFAULT_CONTRACT_EXEC_THREADS));
 #ifndef WIN32
     strUsage += HelpMessageOpt("-pid=<file>", strprintf(_("Specify pid file (default: %s)"), BITCOIN_PID_FILENAME));
 #endif
@@ -461,6 +473,7 @@ std::string HelpMessage(HelpMessageMode mode)
         strUsage += HelpMessageOpt("-checkblockindex", strprintf("Do a full consistency check for mapBlockIndex, setBlockIndexCandidates, chainActive and mapBlocksUnlinked occasionally. Also sets -checkmempool (default: %u)", defaultChainParams->DefaultConsistencyChecks()));
         strUsage += HelpMessageOpt("-checkmempool=<n>", strprintf("Run checks every <n> transactions (default: %u)", defaultChainParams->DefaultConsistencyChecks()));
         strUsage += HelpMessageOpt("-checkpoints", strprintf("Disable expensive verification for known chain history (default: %u)", DEFAULT_CHECKPOINTS_ENABLED));
+        strUsage += HelpMessageOpt("-contractgasblocks", strprintf("Charge contract gas per block of instructions instead of per instruction, gas counts are the same either way (default: %u)", DEFAULT_CONTRACT_GAS_BLOCKS));
         strUsage += HelpMessageOpt("-disablesafemode", strprintf("Disable safemode, override a real safe mode event (default: %u)", DEFAULT_DISABLE_SAFEMODE));
         strUsage += HelpMessageOpt("-deprecatedrpc=<method>", "Allows deprecated RPC method(s) to be used");
         strUsage += HelpMessageOpt("-testsafemode", strprintf("Force safe mode (default: %u)", DEFAULT_TESTSAFEMODE));
@@ -473,6 +486,7 @@ std::string HelpMessage(HelpMessageMode mode)
         strUsage += HelpMessageOpt("-limitancestorsize=<n>", strprintf("Do not accept transactions whose size with all in-mempool ancestors exceeds <n> kilobytes (default: %u)", DEFAULT_ANCESTOR_SIZE_LIMIT));
         strUsage += HelpMessageOpt("-limitdescendantcount=<n>", strprintf("Do not accept transactions if any ancestor would have <n> or more in-mempool descendants (default: %u)", DEFAULT_DESCENDANT_LIMIT));
         strUsage += HelpMessageOpt("-limitdescendantsize=<n>", strprintf("Do not accept transactions if any ancestor would have more than <n> kilobytes of in-mempool descendants (default: %u).", DEFAULT_DESCENDANT_SIZE_LIMIT));
+        strUsage += HelpMessageOpt("-limitcontracttxs=<n>", strprintf("Do not accept contract transactions touching a contract which has <n> or more in-mempool transactions (default: %u)", DEFAULT_CONTRACT_TXS_LIMIT));
         strUsage += HelpMessageOpt("-vbparams=deployment:start:end", "Use given start/end times for specified version bits deployment (regtest-only)");
     }
     strUsage += HelpMessageOpt("-debug=<category>", strprintf(_("Output debugging information (default: %u, supplying <category> is optional)"), 0) + ". " +
@@ -1042,6 +1056,8 @@ bool AppInitParameterInteraction()
     }
     fCheckBlockIndex = gArgs.GetBoolArg("-checkblockindex", chainparams.DefaultConsistencyChecks());
     fCheckpointsEnabled = gArgs.GetBoolArg("-checkpoints", DEFAULT_CHECKPOINTS_ENABLED);
+    luaV_setgasblocks(gArgs.GetBoolArg("-contractgasblocks", DEFAULT_CONTRACT_GAS_BLOCKS));
+    blockchain::contract::ContractProfiler::instance().set_enabled(gArgs.GetBoolArg("-contractprofile", DEFAULT_CONTRACT_PROFILE));
 
     hashAssumeValid = uint256S(gArgs.GetArg("-assumevalid", chainparams.GetConsensus().defaultAssumeValid.GetHex()));
     if (!hashAssumeValid.IsNull())
@@ -1087,6 +1103,15 @@ bool AppInitParameterInteraction()
     else if (nScriptCheckThreads > MAX_SCRIPTCHECK_THREADS)
         nScriptCheckThreads = MAX_SCRIPTCHECK_THREADS;
 
+    // -contractexecthreads=0 means autodetect, but nContractExecThreads==0 means no concurrency
+    nContractExecThreads = gArgs.GetArg("-contractexecthreads", DEFAULT_CONTRACT_EXEC_THREADS);
+    if (nContractExecThreads <= 0)
+        nContractExecThreads += GetNumCores();
+    if (nContractExecThreads <= 1)
+        nContractExecThreads = 0;
+    else if (nContractExecThreads > MAX_CONTRACT_EXEC_THREADS)
+        nContractExecThreads = MAX_CONTRACT_EXEC_THREADS;
+
     // block pruning; get the amount of disk space (in MiB) to allot for block & undo files
     int64_t nPruneArg = gArgs.GetArg("-prune", 0);
     if (nPruneArg < 0) {
@@ -1296,6 +1321,7 @@ bool AppInitMain()
     InitScriptExecutionCache();
 
     LogPrintf("Using %u threads for script verification\n", nScriptCheckThreads);
+    LogPrintf("Using %u threads for contract execution\n", nContractExecThreads);
     if (nScriptCheckThreads) {
         for (int i=0; i<nScriptCheckThreads-1; i++)
             threadGroup.create_thread(&ThreadScriptCheck);
@@ -1464,11 +1490,21 @@ bool AppInitMain()
     nCoinDBCache = std::min(nCoinDBCache, nMaxCoinsDBCache << 20); // cap total coins db cache
     nTotalCache -= nCoinDBCache;
     nCoinCacheUsage = nTotalCache; // the rest goes to in-memory cache
+    nContractStorageCacheUsage = std::max<int64_t>(gArgs.GetArg("-contractcache", DEFAULT_CONTRACT_STORAGE_CACHE), 0) << 20;
+    nContractStorageDBCache = std::max<int64_t>(gArgs.GetArg("-contractdbcache", DEFAULT_CONTRACT_STORAGE_DB_CACHE), 1) << 20;
+    size_t nContractCodeCache = std::max<int64_t>(gArgs.GetArg("-contractcodecache", DEFAULT_CONTRACT_CODE_CACHE), 0) << 20;
+    blockchain::contract::ContractCodeCache::instance().set_max_memory_usage(nContractCodeCache);
+    size_t nContractExecCache = std::max<int64_t>(gArgs.GetArg("-contractexeccache", DEFAULT_CONTRACT_EXEC_CACHE), 0) << 20;
+    blockchain::contract::ContractExecCache::instance().set_max_memory_usage(nContractExecCache);
     int64_t nMempoolSizeMax = gArgs.GetArg("-maxmempool", DEFAULT_MAX_MEMPOOL_SIZE) * 1000000;
     LogPrintf("Cache configuration:\n");
     LogPrintf("* Using %.1fMiB for block index database\n", nBlockTreeDBCache * (1.0 / 1024 / 1024));
     LogPrintf("* Using %.1fMiB for chain state database\n", nCoinDBCache * (1.0 / 1024 / 1024));
     LogPrintf("* Using %.1fMiB for in-memory UTXO set (plus up to %.1fMiB of unused mempool space)\n", nCoinCacheUsage * (1.0 / 1024 / 1024), nMempoolSizeMax * (1.0 / 1024 / 1024));
+    LogPrintf("* Using %.1fMiB for contract storage value cache\n", nContractStorageCacheUsage * (1.0 / 1024 / 1024));
+    LogPrintf("* Using %.1fMiB for contract storage database\n", nContractStorageDBCache * (1.0 / 1024 / 1024));
+    LogPrintf("* Using %.1fMiB for contract code cache\n", nContractCodeCache * (1.0 / 1024 / 1024));
+    LogPrintf("* Using %.1fMiB for contract execution cache\n", nContractExecCache * (1.0 / 1024 / 1024));
 
     bool fLoaded = false;
     while (!fLoaded && !fRequestShutdown) {
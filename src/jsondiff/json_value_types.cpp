@@ -1,8 +1,131 @@
 #include <jsondiff/json_value_types.h>
 #include <jsondiff/exceptions.h>
 
+#include <memory>
+
 namespace jsondiff
 {
+	namespace
+	{
+		// fjson::json::from_string refuses json nested this deep
+		static const int MAX_JSON_PARSE_DEPTH = 100;
+
+		// whether json_dumps writes the string so that json_loads reads it back as it is and
+		// counts no brackets in it for the nesting depth. \a comes back as a and 0x04 ends the string
+		bool is_plain_json_string(const std::string& str)
+		{
+			for (auto c : str)
+			{
+				switch (c)
+				{
+				case '\a':
+				case 0x04:
+				case '{':
+				case '}':
+				case '[':
+				case ']':
+					return false;
+				default:
+					break;
+				}
+			}
+			return true;
+		}
+
+		// whether json_loads(json_dumps(json_value)) is json_value but for the uint64s the parser
+		// makes of non-negative int64s. doubles and blobs are formatted as strings, so they are not
+		bool has_plain_json_round_trip(const JsonValue& json_value, int object_depth, int array_depth)
+		{
+			switch (json_value.get_type())
+			{
+			case fjson::variant::null_type:
+			case fjson::variant::int64_type:
+			case fjson::variant::uint64_type:
+			case fjson::variant::bool_type:
+				return true;
+			case fjson::variant::string_type:
+				return is_plain_json_string(json_value.get_string());
+			case fjson::variant::object_type:
+				if (object_depth + 1 >= MAX_JSON_PARSE_DEPTH)
+					return false;
+				for (const auto& item : json_value.get_object())
+				{
+					if (!is_plain_json_string(item.key()) || !has_plain_json_round_trip(item.value(), object_depth + 1, array_depth))
+						return false;
+				}
+				return true;
+			case fjson::variant::array_type:
+				if (array_depth + 1 >= MAX_JSON_PARSE_DEPTH)
+					return false;
+				for (const auto& item : json_value.get_array())
+				{
+					if (!has_plain_json_round_trip(item, object_depth, array_depth + 1))
+						return false;
+				}
+				return true;
+			default:
+				return false;
+			}
+		}
+
+		// sets result to json_loads(json_dumps(json_value)) of a value with a plain json round trip and
+		// returns true, or returns false if that is json_value itself. unchanged objects are shared
+		bool plain_json_round_trip(const JsonValue& json_value, JsonValue& result)
+		{
+			switch (json_value.get_type())
+			{
+			case fjson::variant::int64_type:
+				if (json_value.as_int64() < 0)
+					return false;
+				result = JsonValue(static_cast<uint64_t>(json_value.as_int64()));
+				return true;
+			case fjson::variant::object_type:
+			{
+				const auto& obj = json_value.get_object();
+				std::unique_ptr<JsonObject> changed_obj;
+				for (auto it = obj.begin(); it != obj.end(); ++it)
+				{
+					JsonValue item;
+					bool changed = plain_json_round_trip(it->value(), item);
+					if (changed && !changed_obj)
+					{
+						changed_obj.reset(new JsonObject());
+						changed_obj->reserve(obj.size());
+						for (auto prev = obj.begin(); prev != it; ++prev)
+							(*changed_obj)(prev->key(), prev->value());
+					}
+					if (changed_obj)
+						(*changed_obj)(it->key(), changed ? std::move(item) : it->value());
+				}
+				if (!changed_obj)
+					return false;
+				result = JsonValue(std::move(*changed_obj));
+				return true;
+			}
+			case fjson::variant::array_type:
+			{
+				const auto& arr = json_value.get_array();
+				std::unique_ptr<JsonArray> changed_arr;
+				for (size_t i = 0; i < arr.size(); i++)
+				{
+					JsonValue item;
+					if (!plain_json_round_trip(arr[i], item))
+						continue;
+					if (!changed_arr)
+						changed_arr.reset(new JsonArray(arr));
+					(*changed_arr)[i] = std::move(item);
+				}
+				if (!changed_arr)
+					return false;
+				result = JsonValue(std::move(*changed_arr));
+				return true;
+			}
+			default:
+				return false;
+			}
+		}
+	}
+
 	JsonValueType guess_json_value_type(const JsonValue& json_data)
 	{
 		if (json_data.is_null())
@@ -33,9 +156,16 @@ namespace jsondiff
 		return fjson::json::to_pretty_string(json_value, fjson::json::legacy_generator);
 	}
 
+	// the same as json_loads(json_dumps(json_value)), without the round trip through json text when
+	// the value has no strings, numbers or nesting the text would change
 	JsonValue json_deep_clone(const JsonValue& json_value)
 	{
-		return json_loads(json_dumps(json_value));
+		if (!has_plain_json_round_trip(json_value, 0, 0))
+			return json_loads(json_dumps(json_value));
+		JsonValue result;
+		if (plain_json_round_trip(json_value, result))
+			return result;
+		return json_value;
 	}
 
 	JsonValue json_loads(const std::string& json_str)
@@ -59,7 +189,8 @@ namespace jsondiff
 	{
 		if (!diff_json.is_object())
 			return false;
-		auto diff_json_obj = diff_json.as<fjson::mutable_variant_object>();
-		return json_has_key(diff_json_obj, JSONDIFF_KEY_OLD_VALUE) && json_has_key(diff_json_obj, JSONDIFF_KEY_NEW_VALUE);
+		const auto& diff_json_obj = diff_json.get_object();
+		return diff_json_obj.find(JSONDIFF_KEY_OLD_VALUE) != diff_json_obj.end()
+			&& diff_json_obj.find(JSONDIFF_KEY_NEW_VALUE) != diff_json_obj.end();
 	}
 }
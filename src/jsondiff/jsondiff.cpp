@@ -8,8 +8,385 @@
 #include <fjson/variant.hpp>
 #include <fjson/variant_object.hpp>
 
+#include <deque>
+#include <unordered_map>
+
 namespace jsondiff
 {
+	namespace
+	{
+		// objects with more keys than this are looked up through a hash index of their keys
+		static const size_t MAX_LINEAR_LOOKUP_KEYS = 16;
+
+		struct KeyHash
+		{
+			size_t operator()(const std::string* key) const { return std::hash<std::string>()(*key); }
+		};
+
+		struct KeyEqual
+		{
+			bool operator()(const std::string* a, const std::string* b) const { return *a == *b; }
+		};
+
+		// finds keys of an object that isn't modified meanwhile, the first entry of a key wins like in find
+		class ObjectLookup
+		{
+		private:
+			const fjson::variant_object& _obj;
+			std::unordered_map<const std::string*, const JsonValue*, KeyHash, KeyEqual> _index;
+			bool _indexed;
+		public:
+			explicit ObjectLookup(const fjson::variant_object& obj) : _obj(obj), _indexed(false) {}
+
+			const JsonValue* find(const std::string& key)
+			{
+				if (_obj.size() <= MAX_LINEAR_LOOKUP_KEYS)
+				{
+					auto it = _obj.find(key);
+					return it == _obj.end() ? nullptr : &it->value();
+				}
+				if (!_indexed)
+				{
+					_index.reserve(_obj.size());
+					for (const auto& item : _obj)
+						_index.emplace(&item.key(), &item.value());
+					_indexed = true;
+				}
+				auto it = _index.find(&key);
+				return it == _index.end() ? nullptr : it->second;
+			}
+		};
+
+		// an object being built or patched in place, with the semantics of mutable_variant_object
+		// but without its linear lookups once the object has grown. erased entries are only skipped
+		// until the object is taken
+		class ObjectBuilder
+		{
+		private:
+			struct Entry
+			{
+				std::string key;
+				JsonValue value;
+				bool erased;
+			};
+			std::deque<Entry> _entries; // references stay valid on push_back
+			size_t _size;
+			std::unordered_map<const std::string*, Entry*, KeyHash, KeyEqual> _index;
+			bool _indexed;
+			bool _has_duplicate_keys;
+
+			Entry* find_entry(const std::string& key)
+			{
+				if (!_indexed && _entries.size() > MAX_LINEAR_LOOKUP_KEYS)
+				{
+					_index.reserve(_entries.size());
+					for (auto& entry : _entries)
+					{
+						if (!entry.erased && !_index.emplace(&entry.key, &entry).second)
+							_has_duplicate_keys = true;
+					}
+					_indexed = true;
+				}
+				if (_indexed)
+				{
+					auto it = _index.find(&key);
+					return it == _index.end() ? nullptr : it->second;
+				}
+				for (auto& entry : _entries)
+				{
+					if (!entry.erased && entry.key == key)
+						return &entry;
+				}
+				return nullptr;
+			}
+		public:
+			ObjectBuilder() : _size(0), _indexed(false), _has_duplicate_keys(false) {}
+			explicit ObjectBuilder(const fjson::variant_object& obj) : ObjectBuilder()
+			{
+				for (const auto& item : obj)
+					_entries.push_back(Entry{ item.key(), item.value(), false });
+				_size = _entries.size();
+			}
+
+			size_t size() const { return _size; }
+
+			// the value of the first entry of key, appended if there's none
+			JsonValue& operator[](const std::string& key)
+			{
+				auto entry = find_entry(key);
+				if (entry)
+					return entry->value;
+				_entries.push_back(Entry{ key, JsonValue(), false });
+				_size++;
+				if (_indexed)
+					_index.emplace(&_entries.back().key, &_entries.back());
+				return _entries.back().value;
+			}
+
+			// erases the first entry of key
+			void erase(const std::string& key)
+			{
+				auto entry = find_entry(key);
+				if (!entry)
+					return;
+				entry->erased = true;
+				_size--;
+				if (!_indexed)
+					return;
+				_index.erase(&entry->key);
+				if (!_has_duplicate_keys)
+					return;
+				for (auto& next : _entries)
+				{
+					if (!next.erased && next.key == key)
+					{
+						_index.emplace(&next.key, &next);
+						break;
+					}
+				}
+			}
+
+			JsonObject take()
+			{
+				JsonObject obj;
+				obj.reserve(_size);
+				for (auto& entry : _entries)
+				{
+					if (!entry.erased)
+						obj(std::move(entry.key), std::move(entry.value));
+				}
+				_entries.clear();
+				_index.clear();
+				_size = 0;
+				return obj;
+			}
+		};
+
+		// whether two scalar values of the same json value type have the same json
+		bool scalar_json_equals(const JsonValue& a, const JsonValue& b)
+		{
+			if (a.get_type() != b.get_type())
+			{
+				if (a.get_type() == fjson::variant::int64_type && b.get_type() == fjson::variant::uint64_type)
+					return a.as_int64() >= 0 && static_cast<uint64_t>(a.as_int64()) == b.as_uint64();
+				if (a.get_type() == fjson::variant::uint64_type && b.get_type() == fjson::variant::int64_type)
+					return b.as_int64() >= 0 && static_cast<uint64_t>(b.as_int64()) == a.as_uint64();
+				return json_dumps(a) == json_dumps(b);
+			}
+			switch (a.get_type())
+			{
+			case fjson::variant::null_type:
+				return true;
+			case fjson::variant::int64_type:
+				return a.as_int64() == b.as_int64();
+			case fjson::variant::uint64_type:
+				return a.as_uint64() == b.as_uint64();
+			case fjson::variant::bool_type:
+				return a.as_bool() == b.as_bool();
+			case fjson::variant::string_type:
+				// json strings escape characters one to one
+				return a.get_string() == b.get_string();
+			default:
+				return json_dumps(a) == json_dumps(b);
+			}
+		}
+
+		const DiffResultP& undefined_diff_result()
+		{
+			static const DiffResultP result = DiffResult::make_undefined_diff_result();
+			return result;
+		}
+
+		// patch with the diff json of a DiffResult, null when undefined. unchanged values are taken
+		// from json_deep_clone of old_json as ever, the stored values depend on its normalization
+		JsonValue patch_json(const JsonValue& old_json, const JsonValue& diff_json)
+		{
+			auto old_json_type = guess_json_value_type(old_json);
+			auto result = json_deep_clone(old_json);
+			if (diff_json.is_null())
+				return result;
+
+			if (is_scalar_json_value_type(old_json_type) || is_scalar_value_diff_format(diff_json))
+			{ // TODO: 这个判断要修改得简单准确一点，修改diffjson格式，区分{__old: ..., __new: ...}和普通object diff
+				if (!diff_json.is_object())
+					throw JsonDiffException("wrong format of diffjson of scalar json value");
+				return diff_json[JSONDIFF_KEY_NEW_VALUE];
+			}
+			else if (old_json_type == JsonValueType::JVT_OBJECT)
+			{
+				const auto& old_json_obj = old_json.get_object();
+				const auto& diff_json_obj = diff_json.get_object();
+				ObjectLookup old_keys(old_json_obj);
+				ObjectBuilder result_obj(result.get_object());
+				for (const auto& diff_json_item : diff_json_obj)
+				{
+					const auto& key = diff_json_item.key();
+					const auto& diff_item = diff_json_item.value();
+					// 如果key是 <key>__deleted 或者 <key>__added，则是删除或者添加，否则是修改现有key的值
+					if (utils::string_ends_with(key, JSONDIFF_KEY_DELETED_POSTFIX) && key.size() > strlen(JSONDIFF_KEY_DELETED_POSTFIX))
+					{
+						auto old_key = utils::string_without_ext(key, JSONDIFF_KEY_DELETED_POSTFIX);
+						if (old_keys.find(old_key))
+						{
+							// 是删除属性操作
+							result_obj.erase(old_key);
+							continue;
+						}
+					}
+					else if (utils::string_ends_with(key, JSONDIFF_KEY_ADDED_POSTFIX) && key.size() > strlen(JSONDIFF_KEY_ADDED_POSTFIX))
+					{
+						auto old_key = utils::string_without_ext(key, JSONDIFF_KEY_ADDED_POSTFIX);
+						// 是增加属性操作
+						result_obj[old_key] = diff_item;
+						continue;
+					}
+					// 可能是修改现有key的值
+					auto old_value = old_keys.find(key);
+					if (!old_value)
+						throw JsonDiffException("wrong format of diffjson of this old version json");
+					result_obj[key] = patch_json(*old_value, diff_item);
+				}
+				return result_obj.take();
+			}
+			else if (old_json_type == JsonValueType::JVT_ARRAY)
+			{
+				const auto& old_json_array = old_json.get_array();
+				const auto& diff_json_array = diff_json.get_array();
+				auto& result_array = result.get_array();
+				for (size_t i = 0; i < diff_json_array.size(); i++)
+				{
+					if (!diff_json_array[i].is_array())
+						throw JsonDiffException("diffjson format error for array diff");
+					const auto& diff_item = diff_json_array[i].get_array();
+					if (diff_item.size() != 3)
+						throw JsonDiffException("diffjson format error for array diff");
+					auto op_item = diff_item[0].as_string();
+					auto pos = diff_item[1].as_uint64();
+					const auto& inner_diff_json = diff_item[2];
+					// FIXME； 一个array有多项变化的时候， diff里的索引是用原始对象的index，所以这里应该找出 pos => old_json中同值的pos
+					if (op_item == std::string("+"))
+					{
+						// 添加元素
+						result_array.insert(result_array.begin() + pos, inner_diff_json);
+					}
+					else if (op_item == std::string("-"))
+					{
+						// 删除元素
+						result_array.erase(result_array.begin() + pos);
+					}
+					else if (op_item == std::string("~"))
+					{
+						// 修改元素
+						result_array[pos] = patch_json(old_json_array[i], inner_diff_json);
+					}
+					else
+					{
+						throw JsonDiffException(std::string("not supported diff array op now: ") + op_item);
+					}
+				}
+				return result;
+			}
+			else
+			{
+				throw JsonDiffException(std::string("not supported json value type to merge patch ") + json_dumps(old_json));
+			}
+		}
+
+		// the inverse of patch_json
+		JsonValue rollback_json(const JsonValue& new_json, const JsonValue& diff_json)
+		{
+			auto new_json_type = guess_json_value_type(new_json);
+			auto result = json_deep_clone(new_json);
+			if (diff_json.is_null())
+				return result;
+
+			if (is_scalar_json_value_type(new_json_type) || is_scalar_value_diff_format(diff_json))
+			{ // TODO: 这个判断要修改得简单准确一点，修改diffjson格式，区分{__old: ..., __new: ...}和普通object diff
+				if (!diff_json.is_object())
+					throw JsonDiffException("wrong format of diffjson of scalar json value");
+				return diff_json[JSONDIFF_KEY_OLD_VALUE];
+			}
+			else if (new_json_type == JsonValueType::JVT_OBJECT)
+			{
+				const auto& new_json_obj = new_json.get_object();
+				const auto& diff_json_obj = diff_json.get_object();
+				ObjectLookup new_keys(new_json_obj);
+				ObjectBuilder result_obj(result.get_object());
+				for (const auto& diff_json_item : diff_json_obj)
+				{
+					const auto& key = diff_json_item.key();
+					const auto& diff_item = diff_json_item.value();
+					// 如果key是 <key>__deleted 或者 <key>__added，则是删除或者添加，否则是修改现有key的值
+					if (utils::string_ends_with(key, JSONDIFF_KEY_ADDED_POSTFIX) && key.size() > strlen(JSONDIFF_KEY_ADDED_POSTFIX))
+					{
+						auto origin_key = utils::string_without_ext(key, JSONDIFF_KEY_ADDED_POSTFIX);
+						if (new_keys.find(origin_key))
+						{
+							// 是增加属性操作，需要回滚
+							result_obj.erase(origin_key);
+							continue;
+						}
+					}
+					else if (utils::string_ends_with(key, JSONDIFF_KEY_DELETED_POSTFIX) && key.size() > strlen(JSONDIFF_KEY_DELETED_POSTFIX))
+					{
+						auto origin_key = utils::string_without_ext(key, JSONDIFF_KEY_DELETED_POSTFIX);
+						// 是删除属性操作，需要回滚
+						result_obj[origin_key] = diff_item;
+						continue;
+					}
+					// 可能是修改现有key的值
+					auto new_value = new_keys.find(key);
+					if (!new_value)
+						throw JsonDiffException("wrong format of diffjson of this old version json");
+					result_obj[key] = rollback_json(*new_value, diff_item);
+				}
+				return result_obj.take();
+			}
+			else if (new_json_type == JsonValueType::JVT_ARRAY)
+			{
+				const auto& new_json_array = new_json.get_array();
+				const auto& diff_json_array = diff_json.get_array();
+				auto& result_array = result.get_array();
+				for (size_t i = 0; i < diff_json_array.size(); i++)
+				{
+					if (!diff_json_array[i].is_array())
+						throw JsonDiffException("diffjson format error for array diff");
+					const auto& diff_item = diff_json_array[i].get_array();
+					if (diff_item.size() != 3)
+						throw JsonDiffException("diffjson format error for array diff");
+					auto op_item = diff_item[0].as_string();
+					auto pos = diff_item[1].as_uint64(); // pos是old的pos， FIXME： 新旧对象的pos不一定一样
+					const auto& inner_diff_json = diff_item[2];
+					// FIXME； 一个array有多项变化的时候， diff里的索引是用原始对象的index，所以这里应该找出 pos => old_json中同值的pos
+					if (op_item == std::string("-"))
+					{
+						// 删除元素，需要回滚
+						result_array.insert(result_array.begin() + pos, inner_diff_json);
+					}
+					else if (op_item == std::string("+"))
+					{
+						// 添加元素，需要回滚
+						result_array.erase(result_array.begin() + pos);
+					}
+					else if (op_item == std::string("~"))
+					{
+						// 修改元素
+						result_array[pos] = rollback_json(new_json_array[i], inner_diff_json);
+					}
+					else
+					{
+						throw JsonDiffException(std::string("not supported diff array op now: ") + op_item);
+					}
+				}
+				return result;
+			}
+			else
+			{
+				throw JsonDiffException(std::string("not supported json value type to rollback diff from ") + json_dumps(new_json));
+			}
+		}
+	}
+
 	JsonDiff::JsonDiff()
 	{
 
@@ -25,6 +402,7 @@ namespace jsondiff
 		return diff(json_loads(old_json_str), json_loads(new_json_str));
 	}
 
+	// values are compared where they are, and unchanged values are shared with the diff rather than copied
 	DiffResultP JsonDiff::diff(const JsonValue& old_json, const JsonValue& new_json)
 	{
 		auto old_json_type = guess_json_value_type(old_json);
@@ -36,17 +414,17 @@ namespace jsondiff
 			// should return undefined for two identical values
 			// should return { __old: <old value>, __new : <new value> } object for two different numbers
 
-			if (old_json_type != new_json_type || json_dumps(old_json) != json_dumps(new_json))
+			if (old_json_type != new_json_type || !scalar_json_equals(old_json, new_json))
 			{
 				fjson::mutable_variant_object result_json;
-				result_json[JSONDIFF_KEY_OLD_VALUE] = old_json;
-				result_json[JSONDIFF_KEY_NEW_VALUE] = new_json;
+				result_json(JSONDIFF_KEY_OLD_VALUE, old_json);
+				result_json(JSONDIFF_KEY_NEW_VALUE, new_json);
 				return std::make_shared<DiffResult>(result_json);
 			}
 			else
 			{
 				// identical scalar values
-				return DiffResult::make_undefined_diff_result();
+				return undefined_diff_result();
 			}
 		}
 		else if (old_json_type == JsonValueType::JVT_OBJECT)
@@ -58,41 +436,42 @@ namespace jsondiff
 			// should return { <key>__added: <new value> } when the first object is missing a key
 			// should return { <key>: { __old: <old value>, __new : <new value> } } for two objects with diffent scalar values for a key
 			// should return { <key>: <diff> } with a recursive diff for two objects with diffent values for a key
-			auto a_obj = old_json.as<fjson::mutable_variant_object>();
-			auto b_obj = new_json.as<fjson::mutable_variant_object>();
-			bool same = false;
-			fjson::mutable_variant_object diff_json;
-			for (auto i = a_obj.begin(); i != a_obj.end(); i++)
+			const auto& a_obj = old_json.get_object();
+			const auto& b_obj = new_json.get_object();
+			ObjectLookup a_keys(a_obj);
+			ObjectLookup b_keys(b_obj);
+			// a changed key may collide with a <key>__deleted or <key>__added, the later one overwrites
+			ObjectBuilder diff_json;
+			for (const auto& a_item : a_obj)
 			{
-				auto a_i_value = i->value();
-				auto a_i_key = i->key();
-				if (b_obj.find(a_i_key) == b_obj.end())
+				const auto& a_i_key = a_item.key();
+				auto b_value = b_keys.find(a_i_key);
+				if (!b_value)
 				{
 					// 存在于old不存在于new
-					diff_json[a_i_key + JSONDIFF_KEY_DELETED_POSTFIX] = a_i_value;
+					diff_json[a_i_key + JSONDIFF_KEY_DELETED_POSTFIX] = a_item.value();
 				}
 				else
 				{
 					// old和new中都有这个key
-					auto sub_diff_value = diff(a_i_value, b_obj[a_i_key]);
+					auto sub_diff_value = diff(a_item.value(), *b_value);
 					if (sub_diff_value->is_undefined()) // same elements
 						continue;
 					// 修改
 					diff_json[a_i_key] = sub_diff_value->value();
 				}
 			}
-			for (auto j = b_obj.begin(); j != b_obj.end(); j++)
+			for (const auto& b_item : b_obj)
 			{
-				auto key = j->key();
-				if (a_obj.find(key) == a_obj.end())
+				if (!a_keys.find(b_item.key()))
 				{
 					// 不存在于old但是存在于new
-					diff_json[key + JSONDIFF_KEY_ADDED_POSTFIX] = j->value();
+					diff_json[b_item.key() + JSONDIFF_KEY_ADDED_POSTFIX] = b_item.value();
 				}
 			}
 			if (diff_json.size() < 1)
-				return DiffResult::make_undefined_diff_result();
-			return std::make_shared<DiffResult>(diff_json);
+				return undefined_diff_result();
+			return std::make_shared<DiffResult>(diff_json.take());
 		}
 		else if (old_json_type == JsonValueType::JVT_ARRAY)
 		{
@@ -108,8 +487,8 @@ namespace jsondiff
 			//   should return[..., ['+', insert_position_index, <added item>], ...] for two arrays when the second array has an extra value
 			//   should return[..., ['~', position_index, <diff>], ...] for two arrays when an item has been modified(note: involves a crazy heuristic)
 
-			auto a_array = old_json.as<fjson::variants>();
-			auto b_array = new_json.as<fjson::variants>();
+			const auto& a_array = old_json.get_array();
+			const auto& b_array = new_json.get_array();
 
 			// TODO: 当两个array的大部分元素相同时，但是可能前方插入部分元素，这时候应该尽量减少diff大小
 
@@ -122,10 +501,11 @@ namespace jsondiff
 				{
 					// 删除元素
 					fjson::variants item_diff;
+					item_diff.reserve(3);
 					item_diff.push_back("-");
 					item_diff.push_back((int)i);
 					item_diff.push_back(a_array[i]);
-					diff_json.push_back(item_diff);
+					diff_json.push_back(std::move(item_diff));
 				}
 				else
 				{
@@ -134,26 +514,28 @@ namespace jsondiff
 						continue;
 					// 修改元素
 					fjson::variants item_diff;
+					item_diff.reserve(3);
 					item_diff.push_back("~");
 					item_diff.push_back((int)i);
 					item_diff.push_back(item_value_diff->value());
-					diff_json.push_back(item_diff);
+					diff_json.push_back(std::move(item_diff));
 				}
 			}
 			for (size_t i = a_array.size(); i < b_array.size(); i++)
 			{
 				// 不存在于old但是存在于new中
 				fjson::variants item_diff;
+				item_diff.reserve(3);
 				item_diff.push_back("+");
 				item_diff.push_back((int)i);
 				item_diff.push_back(b_array[i]);
-				diff_json.push_back(item_diff);
+				diff_json.push_back(std::move(item_diff));
 			}
 			if (diff_json.size() < 1)
 			{
-				return DiffResult::make_undefined_diff_result();
+				return undefined_diff_result();
 			}
-			return std::make_shared<DiffResult>(diff_json);
+			return std::make_shared<DiffResult>(JsonValue(std::move(diff_json)));
 		}
 		else
 		{
@@ -168,100 +550,7 @@ namespace jsondiff
 
 	JsonValue JsonDiff::patch(const JsonValue& old_json, const DiffResultP& diff_info)
 	{
-		auto old_json_type = guess_json_value_type(old_json);
-		auto diff_json = diff_info->value();
-		auto result = json_deep_clone(old_json);
-		if (diff_info->is_undefined() || diff_json.is_null())
-			return result;
-		
-		auto old_json_str = json_dumps(old_json);
-		auto diff_json_str = json_dumps(diff_json);
-		
-		if (is_scalar_json_value_type(old_json_type) || is_scalar_value_diff_format(diff_json))
-		{ // TODO: 这个判断要修改得简单准确一点，修改diffjson格式，区分{__old: ..., __new: ...}和普通object diff
-			if (!diff_json.is_object())
-				throw JsonDiffException("wrong format of diffjson of scalar json value");
-			result = diff_json[JSONDIFF_KEY_NEW_VALUE];
-		}
-		else if (old_json_type == JsonValueType::JVT_OBJECT)
-		{
-			auto old_json_obj = old_json.as<fjson::mutable_variant_object>();
-			auto diff_json_obj = diff_json.as<fjson::mutable_variant_object>();
-			auto result_obj = result.as<fjson::mutable_variant_object>();
-			for (auto i = diff_json_obj.begin(); i != diff_json_obj.end(); i++)
-			{
-				auto key = i->key();
-				auto diff_item = i->value();
-				// 如果key是 <key>__deleted 或者 <key>__added，则是删除或者添加，否则是修改现有key的值
-				if (utils::string_ends_with(key, JSONDIFF_KEY_DELETED_POSTFIX) && key.size() > strlen(JSONDIFF_KEY_DELETED_POSTFIX))
-				{
-					auto old_key = utils::string_without_ext(key, JSONDIFF_KEY_DELETED_POSTFIX);
-					if (old_json_obj.find(old_key) != old_json_obj.end())
-					{
-						// 是删除属性操作
-						result_obj.erase(old_key);
-						continue;
-					}
-				}
-				else if (utils::string_ends_with(key, JSONDIFF_KEY_ADDED_POSTFIX) && key.size() > strlen(JSONDIFF_KEY_ADDED_POSTFIX))
-				{
-					auto old_key = utils::string_without_ext(key, JSONDIFF_KEY_ADDED_POSTFIX);
-					// 是增加属性操作
-					result_obj[old_key] = diff_item;
-					continue;
-				}
-				// 可能是修改现有key的值
-				if (old_json_obj.find(key) == old_json_obj.end())
-					throw JsonDiffException("wrong format of diffjson of this old version json");
-				auto sub_item_new = patch(old_json_obj[key], std::make_shared<DiffResult>(diff_item));
-				result_obj[key] = sub_item_new;
-			}
-			return result_obj;
-		}
-		else if (old_json_type == JsonValueType::JVT_ARRAY)
-		{
-			auto old_json_array = old_json.as<fjson::variants>();
-			auto diff_json_array = diff_json.as<fjson::variants>();
-			auto result_array = result.as<fjson::variants>();
-			for (size_t i = 0; i < diff_json_array.size(); i++)
-			{
-				if (!diff_json_array[i].is_array())
-					throw JsonDiffException("diffjson format error for array diff");
-				auto diff_item = diff_json_array[i].as<fjson::variants>();
-				if (diff_item.size() != 3)
-					throw JsonDiffException("diffjson format error for array diff");
-				auto op_item = diff_item[0].as_string();
-				auto pos = diff_item[1].as_uint64();
-				auto inner_diff_json = diff_item[2];
-				// FIXME； 一个array有多项变化的时候， diff里的索引是用原始对象的index，所以这里应该找出 pos => old_json中同值的pos
-				if (op_item == std::string("+"))
-				{
-					// 添加元素
-					result_array.insert(result_array.begin() + pos, inner_diff_json);
-				}
-				else if (op_item == std::string("-"))
-				{
-					// 删除元素
-					result_array.erase(result_array.begin() + pos);
-				}
-				else if (op_item == std::string("~"))
-				{
-					// 修改元素
-					auto sub_item_new = patch(old_json_array[i], std::make_shared<DiffResult>(inner_diff_json));
-					result_array[pos] = sub_item_new;
-				}
-				else
-				{
-					throw JsonDiffException(std::string("not supported diff array op now: ") + op_item);
-				}
-			}
-			return result_array;
-		}
-		else
-		{
-			throw JsonDiffException(std::string("not supported json value type to merge patch ") + json_dumps(old_json));
-		}
-		return result;
+		return patch_json(old_json, diff_info->value());
 	}
 
 	JsonValue JsonDiff::rollback_by_string(const std::string& new_json_value, DiffResultP diff_info)
@@ -271,99 +560,6 @@ namespace jsondiff
 
 	JsonValue JsonDiff::rollback(const JsonValue& new_json, DiffResultP diff_info)
 	{
-		auto new_json_type = guess_json_value_type(new_json);
-		auto diff_json = diff_info->value();
-		auto result = json_deep_clone(new_json);
-		if (diff_info->is_undefined() || diff_json.is_null())
-			return result;
-
-		auto new_json_str = json_dumps(new_json);
-		auto diff_json_str = json_dumps(diff_json);
-
-		if (is_scalar_json_value_type(new_json_type) || is_scalar_value_diff_format(diff_json))
-		{ // TODO: 这个判断要修改得简单准确一点，修改diffjson格式，区分{__old: ..., __new: ...}和普通object diff
-			if (!diff_json.is_object())
-				throw JsonDiffException("wrong format of diffjson of scalar json value");
-			result = diff_json[JSONDIFF_KEY_OLD_VALUE];
-		}
-		else if (new_json_type == JsonValueType::JVT_OBJECT)
-		{
-			auto new_json_obj = new_json.as<fjson::mutable_variant_object>();
-			auto diff_json_obj = diff_json.as<fjson::mutable_variant_object>();
-			auto result_obj = result.as<fjson::mutable_variant_object>();
-			for (auto i = diff_json_obj.begin(); i != diff_json_obj.end(); i++)
-			{
-				auto key = i->key();
-				auto diff_item = i->value();
-				// 如果key是 <key>__deleted 或者 <key>__added，则是删除或者添加，否则是修改现有key的值
-				if (utils::string_ends_with(key, JSONDIFF_KEY_ADDED_POSTFIX) && key.size() > strlen(JSONDIFF_KEY_ADDED_POSTFIX))
-				{
-					auto origin_key = utils::string_without_ext(key, JSONDIFF_KEY_ADDED_POSTFIX);
-					if (new_json_obj.find(origin_key) != new_json_obj.end())
-					{
-						// 是增加属性操作，需要回滚
-						result_obj.erase(origin_key);
-						continue;
-					}
-				}
-				else if (utils::string_ends_with(key, JSONDIFF_KEY_DELETED_POSTFIX) && key.size() > strlen(JSONDIFF_KEY_DELETED_POSTFIX))
-				{
-					auto origin_key = utils::string_without_ext(key, JSONDIFF_KEY_DELETED_POSTFIX);
-					// 是删除属性操作，需要回滚
-					result_obj[origin_key] = diff_item;
-					continue;
-				}
-				// 可能是修改现有key的值
-				if (new_json_obj.find(key) == new_json_obj.end())
-					throw JsonDiffException("wrong format of diffjson of this old version json");
-				auto sub_item_new = rollback(new_json_obj[key], std::make_shared<DiffResult>(diff_item));
-				result_obj[key] = sub_item_new;
-			}
-			return result_obj;
-		}
-		else if (new_json_type == JsonValueType::JVT_ARRAY)
-		{
-			auto new_json_array = new_json.as<fjson::variants>();
-			auto diff_json_array = diff_json.as<fjson::variants>();
-			auto result_array = result.as<fjson::variants>();
-			for (size_t i = 0; i < diff_json_array.size(); i++)
-			{
-				if (!diff_json_array[i].is_array())
-					throw JsonDiffException("diffjson format error for array diff");
-				auto diff_item = diff_json_array[i].as<fjson::variants>();
-				if (diff_item.size() != 3)
-					throw JsonDiffException("diffjson format error for array diff");
-				auto op_item = diff_item[0].as_string();
-				auto pos = diff_item[1].as_uint64(); // pos是old的pos， FIXME： 新旧对象的pos不一定一样
-				auto inner_diff_json = diff_item[2];
-				// FIXME； 一个array有多项变化的时候， diff里的索引是用原始对象的index，所以这里应该找出 pos => old_json中同值的pos
-				if (op_item == std::string("-"))
-				{
-					// 删除元素，需要回滚
-					result_array.insert(result_array.begin() + pos, inner_diff_json);
-				}
-				else if (op_item == std::string("+"))
-				{
-					// 添加元素，需要回滚
-					result_array.erase(result_array.begin() + pos);
-				}
-				else if (op_item == std::string("~"))
-				{
-					// 修改元素
-					auto sub_item_new = rollback(new_json_array[i], std::make_shared<DiffResult>(inner_diff_json));
-					result_array[pos] = sub_item_new;
-				}
-				else
-				{
-					throw JsonDiffException(std::string("not supported diff array op now: ") + op_item);
-				}
-			}
-			return result_array;
-		}
-		else
-		{
-			throw JsonDiffException(std::string("not supported json value type to rollback diff from ") + json_dumps(new_json));
-		}
-		return result;
+		return rollback_json(new_json, diff_info->value());
 	}
 }
@@ -40,6 +40,7 @@
 
 #include <boost/scope_exit.hpp>
 #include <contract_storage/contract_storage.hpp>
+#include <contract_engine/contract_exec_cache.hpp>
 #include "txdb.h"
 #include "wallet/wallet.h"
 #include "base58.h"
@@ -129,6 +130,9 @@ BlockAssembler::BlockAssembler(const CChainParams& params) : BlockAssembler(para
 void BlockAssembler::resetBlock()
 {
     inBlock.clear();
+    contractsInBlock.clear();
+    contractConflictFailures.clear();
+    nContractTxsSkipped = 0;
 
     // Reserve space for coinbase tx
     nBlockSize = 1000;
@@ -215,34 +219,20 @@ std::unique_ptr<CBlockTemplate> BlockAssembler::CreateNewBlock(const CScript& sc
 
     nBlockMaxSize = MaxBlockSerSize;
 
-	// save old root state hash
-	std::shared_ptr<::contract::storage::ContractStorageService> service;
-	std::string old_root_state_hash;
-    bool rollbacked_contract_storage = false;
-	if (allow_contract) {
-		service = get_contract_storage_service();
-		service->open();
-		old_root_state_hash = service->current_root_state_hash();
-		service->close();
-	}
+	// contract txs are executed on an overlay of the contract storage, so nothing is written to db
+	contractStorageOverlay.reset();
+	if (allow_contract)
+		contractStorageOverlay = ::contract::storage::ContractStorageService::create_overlay(get_contract_storage_service());
     BOOST_SCOPE_EXIT_ALL(&) {
-        if(allow_contract && !rollbacked_contract_storage) {
-            service->open();
-            service->rollback_contract_state(old_root_state_hash);
-            rollbacked_contract_storage = true;
-            service->close();
-        }
+        contractStorageOverlay.reset();
     };
     int nPackagesSelected = 0;
     int nDescendantsUpdated = 0;
     if(nHeight != Params().GetConsensus().ForkV4Height && nHeight != Params().GetConsensus().ForkV5Height)
         addPackageTxs(nPackagesSelected, nDescendantsUpdated, minGasPrice, allow_contract);
 
-	if(allow_contract)
-		service->open();
-
     if(allow_contract) {
-        const auto &root_state_hash_after_add_txs = service->current_root_state_hash();
+        const auto &root_state_hash_after_add_txs = contractStorageOverlay->current_root_state_hash();
 		CTxOut root_state_hash_out;
 		root_state_hash_out.scriptPubKey =
 			CScript() << ValtypeUtils::string_to_vch(root_state_hash_after_add_txs) << OP_ROOT_STATE_HASH;
@@ -282,12 +272,8 @@ std::unique_ptr<CBlockTemplate> BlockAssembler::CreateNewBlock(const CScript& sc
         pblock->vtx.push_back(vtx[0]);
     }
 
-	// rollback root state hash
-	if (allow_contract) {
-		service->rollback_contract_state(old_root_state_hash);
-        rollbacked_contract_storage = true;
-		service->close();
-	}
+	// discard the contract state of the block
+	contractStorageOverlay.reset();
 
 	RebuildRefundTransaction();
 
@@ -320,7 +306,7 @@ std::unique_ptr<CBlockTemplate> BlockAssembler::CreateNewBlock(const CScript& sc
     }
     int64_t nTime2 = GetTimeMicros();
 
-    LogPrint(BCLog::BENCH, "CreateNewBlock() packages: %.2fms (%d packages, %d updated descendants), validity: %.2fms (total %.2fms)\n", 0.001 * (nTime1 - nTimeStart), nPackagesSelected, nDescendantsUpdated, 0.001 * (nTime2 - nTime1), 0.001 * (nTime2 - nTimeStart));
+    LogPrint(BCLog::BENCH, "CreateNewBlock() packages: %.2fms (%d packages, %d updated descendants, %d contract txs skipped), validity: %.2fms (total %.2fms)\n", 0.001 * (nTime1 - nTimeStart), nPackagesSelected, nDescendantsUpdated, nContractTxsSkipped, 0.001 * (nTime2 - nTime1), 0.001 * (nTime2 - nTimeStart));
 
     return std::move(pblocktemplate);
 }
@@ -545,33 +531,20 @@ std::unique_ptr<CBlockTemplate> BlockAssembler::CreateNewBlockPos(CWalletRef& pw
 
     nBlockMaxSize = MaxBlockSerSize;
 
-    // save old root state hash
-    std::shared_ptr<::contract::storage::ContractStorageService> service;
-    std::string old_root_state_hash;
-    bool rollbacked_contract_storage = false;
-    if (allow_contract) {
-        service = get_contract_storage_service();
-        service->open();
-        old_root_state_hash = service->current_root_state_hash();
-        service->close();
-    }
+    // contract txs are executed on an overlay of the contract storage, so nothing is written to db
+    contractStorageOverlay.reset();
+    if (allow_contract)
+        contractStorageOverlay = ::contract::storage::ContractStorageService::create_overlay(get_contract_storage_service());
     BOOST_SCOPE_EXIT_ALL(&) {
-        if(allow_contract && !rollbacked_contract_storage) {
-            service->rollback_contract_state(old_root_state_hash);
-            rollbacked_contract_storage = true;
-            service->close();
-        }
+        contractStorageOverlay.reset();
     };
     int nPackagesSelected = 0;
     int nDescendantsUpdated = 0;
 
     addPackageTxs(nPackagesSelected, nDescendantsUpdated, minGasPrice, allow_contract, prevoutFound);
 
-    if(allow_contract)
-        service->open();
-
     if(allow_contract) {
-        const auto &root_state_hash_after_add_txs = service->current_root_state_hash();
+        const auto &root_state_hash_after_add_txs = contractStorageOverlay->current_root_state_hash();
         CMutableTransaction txCoinbase(*pblock->vtx[0]);
         CTxOut tout;
         tout.nValue = 0;
@@ -583,12 +556,8 @@ std::unique_ptr<CBlockTemplate> BlockAssembler::CreateNewBlockPos(CWalletRef& pw
                                            tout.scriptPubKey.end());
     }
 
-    // rollback root state hash
-    if (allow_contract) {
-        service->rollback_contract_state(old_root_state_hash);
-        rollbacked_contract_storage = true;
-        service->close();
-    }
+    // discard the contract state of the block
+    contractStorageOverlay.reset();
 
     RebuildRefundTransaction();
     ////////////////////////////////////////////////////////
@@ -675,8 +644,10 @@ bool BlockAssembler::AttemptToAddContractToBlock(CTxMemPool::txiter iter, uint64
         //therefore, this can only be triggered by using raw transactions on the staker itself
         return false;
     }
-    auto service = get_contract_storage_service();
-    service->open();
+    if (!contractStorageOverlay)
+        return false;
+    // changes of this tx go to the block overlay only when the tx is added to the block
+    auto service = ::contract::storage::ContractStorageService::create_overlay(contractStorageOverlay);
 
     std::vector<ContractTransaction> contractTransactions = resultConverter.txs;
 	CAmount sumGasCoins = 0;
@@ -708,15 +679,16 @@ bool BlockAssembler::AttemptToAddContractToBlock(CTxMemPool::txiter iter, uint64
 			return false;
 	}
 
-	const auto& old_root_state_hash = service->current_root_state_hash();
-    ContractExec exec(service.get(), *pblock, contractTransactions, hardBlockGasLimit, nTxFee);
-	bool success = false;
-	BOOST_SCOPE_EXIT_ALL(&service, &success, &old_root_state_hash) {
-		if(!success)
-			service->rollback_contract_state(old_root_state_hash);
-	};
+    ContractExec exec(service.get(), *pblock, chainActive.Tip(), contractTransactions, hardBlockGasLimit, nTxFee);
 
-    if (!exec.performByteCode()) {
+    // reuse the execution of the tx on this state by mempool acceptance or an earlier template
+    auto& exec_cache = blockchain::contract::ContractExecCache::instance();
+    const auto pre_state_root = service->current_root_state_hash();
+    const auto tip_hash = chainActive.Tip()->GetBlockHash();
+    const auto cached_result = exec_cache.get(iter->GetTx().GetHash(), nTxFee, pre_state_root, tip_hash);
+    if (cached_result) {
+        exec.pending_contract_exec_result = *cached_result;
+    } else if (!exec.performByteCode()) {
         //error, don't add contract
         return false;
     }
@@ -735,6 +707,8 @@ bool BlockAssembler::AttemptToAddContractToBlock(CTxMemPool::txiter iter, uint64
     // commit changes than can generate new root state hash
     if(!exec.commit_changes(service))
         return false;
+    if (!cached_result)
+        exec_cache.put(iter->GetTx().GetHash(), nTxFee, pre_state_root, tip_hash, testExecResult, service->current_root_state_hash());
 
     //apply contractTx costs to local state
     if (fNeedSizeAccounting) {
@@ -775,10 +749,45 @@ bool BlockAssembler::AttemptToAddContractToBlock(CTxMemPool::txiter iter, uint64
 	RebuildRefundTransaction();
     this->nBlockSigOpsCost += GetLegacySigOpCount(*pblock->vtx[0]);
 	
-	success = true;
+	service->flush();
+    std::vector<std::string> changedContracts;
+    testExecResult.changed_contracts(changedContracts);
+    contractsInBlock.insert(changedContracts.begin(), changedContracts.end());
     return true;
 }
 
+std::set<std::pair<std::string, std::string>> BlockAssembler::GetContractConflicts(CTxMemPool::txiter iter) const
+{
+    std::set<std::pair<std::string, std::string>> conflicts;
+    std::vector<std::string> conflictingContracts;
+    for (const std::string& address : iter->GetContractAddresses()) {
+        if (contractsInBlock.count(address))
+            conflictingContracts.push_back(address);
+    }
+    if (conflictingContracts.empty())
+        return conflicts;
+    ContractTxConverter convert(iter->GetTx(), nullptr, &pblock->vtx);
+    ExtractContractTX resultConverter;
+    std::string error_ret;
+    if (!convert.extractionContractTransactions(resultConverter, error_ret))
+        return conflicts;
+    for (const std::string& address : conflictingContracts) {
+        for (const auto& contractTransaction : resultConverter.txs)
+            conflicts.emplace(address, contractTransaction.params.caller_address);
+    }
+    return conflicts;
+}
+
+bool BlockAssembler::IsDoomedContractTx(const std::set<std::pair<std::string, std::string>>& conflicts) const
+{
+    for (const auto& conflict : conflicts) {
+        auto it = contractConflictFailures.find(conflict);
+        if (it != contractConflictFailures.end() && it->second >= MAX_CONTRACT_CONFLICT_FAILURES)
+            return true;
+    }
+    return false;
+}
+
 void BlockAssembler::AddToBlock(CTxMemPool::txiter iter)
 {
     pblock->vtx.emplace_back(iter->GetSharedTx());
@@ -1012,7 +1021,22 @@ void BlockAssembler::addPackageTxs(int &nPackagesSelected, int &nDescendantsUpda
 					continue;
 				}
                 if (tx.HasContractOp()) {
-                    wasAdded = AttemptToAddContractToBlock(sortedEntries[i], minGasPrice);
+                    // every contract tx is executed on the state of the block being assembled. the execution cached
+                    // on mempool entry is keyed on the root state hash, so it only serves txs running before the block
+                    // changes any contract. a tx touching a contract the block changed is skipped without execution
+                    // once MAX_CONTRACT_CONFLICT_FAILURES txs of its caller failed on it, the txs of other callers of
+                    // the contract are still executed
+                    const auto conflicts = GetContractConflicts(sortedEntries[i]);
+                    if (IsDoomedContractTx(conflicts)) {
+                        wasAdded = false;
+                        ++nContractTxsSkipped;
+                    } else {
+                        wasAdded = AttemptToAddContractToBlock(sortedEntries[i], minGasPrice);
+                        if (!wasAdded) {
+                            for (const auto& conflict : conflicts)
+                                ++contractConflictFailures[conflict];
+                        }
+                    }
                     if (!wasAdded) {
                         if (fUsingModified) {
                             //this only needs to be done once to mark the whole package (everything in sortedEntries) as failed
@@ -30,6 +30,8 @@ static const int32_t BYTECODE_TIME_BUFFER = 6;
 //How much time to spend trying to process transactions when using the generate RPC call
 static const int32_t POW_MINER_MAX_TIME = 60;
 static const int32_t POS_MINER_MAX_TIME = 60;
+//Contract txs of a caller touching a contract on which this many txs of the caller failed after the block changed it are not executed
+static const int MAX_CONTRACT_CONFLICT_FAILURES = 3;
 
 struct posState
 {
@@ -223,6 +225,14 @@ private:
     const CChainParams& chainparams;
 
     ContractExecResult bceResult; // block contracts exec result
+    // in-memory contract state of the block being assembled, discarded when the template is done
+    std::shared_ptr<::contract::storage::ContractStorageService> contractStorageOverlay;
+    // contracts changed by the contract txs already in the block
+    std::set<std::string> contractsInBlock;
+    // (contract address, caller address) => number of the caller's mempool txs on the contract which failed after the block changed it
+    std::map<std::pair<std::string, std::string>, int> contractConflictFailures;
+    // number of contract txs skipped without execution as their callers had too many such failures
+    int nContractTxsSkipped = 0;
     uint64_t minGasPrice = 1;
     uint64_t hardBlockGasLimit;
     uint64_t softBlockGasLimit;
@@ -255,6 +265,11 @@ private:
     void AddToBlock(CTxMemPool::txiter iter);
 
     bool AttemptToAddContractToBlock(CTxMemPool::txiter iter, uint64_t minGasPrice);
+    /** The (contract address, caller address) pairs of the contracts the tx touches which the block changed, so that it
+      * may not run as it did on mempool entry. Empty when the tx touches no such contract */
+    std::set<std::pair<std::string, std::string>> GetContractConflicts(CTxMemPool::txiter iter) const;
+    /** Whether too many txs of a caller failed already on a contract of the conflicts */
+    bool IsDoomedContractTx(const std::set<std::pair<std::string, std::string>>& conflicts) const;
 
     // Methods for how to add transactions to a block.
     /** Add transactions based on feerate including unconfirmed ancestors
@@ -41,8 +41,8 @@
 #include <contract_storage/contract_storage.hpp>
 #include <contract_engine/contract_helper.hpp>
 #include <contract_engine/native_contract.hpp>
+#include <contract_engine/contract_profiler.hpp>
 #include <fjson/crypto/base64.hpp>
-#include <boost/scope_exit.hpp>
 #include <boost/lexical_cast.hpp>
 
 struct CUpdatedBlock
@@ -481,6 +481,9 @@ std::string EntryDescriptionString()
            "    \"wtxid\" : hash,         (string) hash of serialized transaction, including witness data\n"
            "    \"depends\" : [           (array) unconfirmed transactions used as inputs for this transaction\n"
            "        \"transactionid\",    (string) parent transaction id\n"
+           "       ... ]\n"
+           "    \"contracts\" : [         (array) contracts the transaction called or changed when it entered pool\n"
+           "        \"address\",          (string) contract address\n"
            "       ... ]\n";
 }
 
@@ -515,6 +518,14 @@ void entryToJSON(UniValue &info, const CTxMemPoolEntry &e)
     }
 
     info.push_back(Pair("depends", depends));
+
+    UniValue contracts(UniValue::VARR);
+    for (const std::string& address : e.GetContractAddresses())
+    {
+        contracts.push_back(address);
+    }
+
+    info.push_back(Pair("contracts", contracts));
 }
 
 UniValue mempoolToJSON(bool fVerbose)
@@ -1871,11 +1882,8 @@ UniValue getsimplecontractinfo(const JSONRPCRequest& request)
                         "1. \"addressOrName\"          (string, required) The contract address or contract name\n"
         );
 
-    LOCK(cs_main);
-
     std::string strAddr = request.params[0].get_str();
-    auto service = get_contract_storage_service();
-    service->open();
+    auto service = get_contract_storage_snapshot();
 	::contract::storage::ContractInfoP contract_info;
 	if (ContractHelper::is_valid_contract_address_format(strAddr)) {
 		contract_info = service->get_contract_info(strAddr);
@@ -1951,11 +1959,8 @@ UniValue getcontractinfo(const JSONRPCRequest& request)
                         "1. \"addressOrName\"          (string, required) The contract address or name\n"
         );
 
-    LOCK(cs_main);
-
     std::string strAddr = request.params[0].get_str();
-    auto service = get_contract_storage_service();
-    service->open();
+    auto service = get_contract_storage_snapshot();
 	::contract::storage::ContractInfoP contract_info;
 	if (ContractHelper::is_valid_contract_address_format(strAddr)) {
 		contract_info = service->get_contract_info(strAddr);
@@ -2033,11 +2038,8 @@ UniValue gettransactionevents(const JSONRPCRequest& request)
 			"1. \"txid\"          (string, required) The transaction id\n"
 		);
 
-	LOCK(cs_main);
-
 	std::string txid = request.params[0].get_str();
-	auto service = get_contract_storage_service();
-	service->open();
+	auto service = get_contract_storage_snapshot();
 	::contract::storage::ContractInfoP contract_info;
 	
 	auto events = service->get_transaction_events(txid);
@@ -2201,7 +2203,6 @@ UniValue getcontractstorage(const JSONRPCRequest& request)
                 "2. \"storage_name\"              (string, required) The storage name to query\n"
         );
 
-    LOCK(cs_main);
     const auto& contract_address = request.params[0].get_str();
     const auto& storage_name = request.params[1].get_str();
     if(!ContractHelper::is_valid_contract_address_format(contract_address)) {
@@ -2210,7 +2211,7 @@ UniValue getcontractstorage(const JSONRPCRequest& request)
     if (storage_name.empty())
         throw JSONRPCError(RPC_INVALID_PARAMETER, "invalid storage name");
 
-    auto service = get_contract_storage_service();
+    auto service = get_contract_storage_snapshot();
     const auto& storage_value = service->get_contract_storage(contract_address, storage_name);
     const auto& storage_value_json = jsondiff::json_dumps(storage_value);
     UniValue result(UniValue::VOBJ);
@@ -2218,6 +2219,208 @@ UniValue getcontractstorage(const JSONRPCRequest& request)
     return result;
 }
 
+UniValue getcontractstateproof(const JSONRPCRequest& request)
+{
+    if (request.fHelp || request.params.size() < 1 || request.params.size() > 2)
+        throw runtime_error(
+                "getcontractstateproof \"contract_address\" ( \"storage_name\" )\n"
+                "\nReturns a contract storage value, or the contract info with balances when storage_name is omitted,\n"
+                "with its merkle proof against the contract state trie root.\n"
+                "\nArgument:\n"
+                "1. \"contract_address\"          (string, required) The contract address\n"
+                "2. \"storage_name\"              (string, optional) The storage name to prove\n"
+                "\nResult:\n"
+                "{\n"
+                "  \"value\": \"xxx\",             (string) The value in json\n"
+                "  \"exists\": true|false,        (boolean) Whether the value exists, the proof proves absence otherwise\n"
+                "  \"key_hash\": \"hex\",          (string) State trie key of the value\n"
+                "  \"value_hash\": \"hex\",        (string) State trie value hash, empty when the value doesn't exist\n"
+                "  \"root_state_hash\": \"xxx\",   (string) Root state hash of the commit the proof is against\n"
+                "  \"state_trie_root\": \"hex\",   (string) Contract state trie root the proof leads to\n"
+                "  \"proof\": {\n"
+                "    \"siblings\": [\"hex\",...], (array) Sibling hashes from the root down\n"
+                "    \"leaf_key_hash\": \"hex\",   (string) Key of the leaf the path ends at, empty for an empty subtree\n"
+                "    \"leaf_value_hash\": \"hex\"  (string) Value hash of the leaf the path ends at\n"
+                "  }\n"
+                "}\n"
+                "\nExamples:\n"
+                + HelpExampleCli("getcontractstateproof", "\"contract_address\" \"storage_name\"")
+                + HelpExampleRpc("getcontractstateproof", "\"contract_address\", \"storage_name\"")
+        );
+
+    const auto& contract_address = request.params[0].get_str();
+    if(!ContractHelper::is_valid_contract_address_format(contract_address)) {
+        throw JSONRPCError(RPC_INVALID_PARAMETER, "invalid contract address");
+    }
+    bool prove_storage = request.params.size() > 1;
+    std::string storage_name;
+    if (prove_storage) {
+        storage_name = request.params[1].get_str();
+        if (storage_name.empty())
+            throw JSONRPCError(RPC_INVALID_PARAMETER, "invalid storage name");
+    }
+
+    auto service = get_contract_storage_snapshot();
+    UniValue result(UniValue::VOBJ);
+    try {
+        using ::contract::storage::ContractStorageService;
+        std::string key_hash;
+        ::contract::storage::ContractStateProof proof;
+        jsondiff::JsonValue value;
+        if (prove_storage) {
+            key_hash = ContractStorageService::contract_storage_state_key_hash(contract_address, storage_name);
+            proof = service->prove_contract_storage(contract_address, storage_name, &value);
+        }
+        else {
+            key_hash = ContractStorageService::contract_info_state_key_hash(contract_address);
+            proof = service->prove_contract_info(contract_address, &value);
+        }
+        bool exists = proof.leaf_key_hash == key_hash;
+        UniValue siblings(UniValue::VARR);
+        for (const auto& sibling : proof.siblings)
+            siblings.push_back(HexStr(sibling.begin(), sibling.end()));
+        UniValue proof_json(UniValue::VOBJ);
+        proof_json.push_back(Pair("siblings", siblings));
+        proof_json.push_back(Pair("leaf_key_hash", HexStr(proof.leaf_key_hash.begin(), proof.leaf_key_hash.end())));
+        proof_json.push_back(Pair("leaf_value_hash", HexStr(proof.leaf_value_hash.begin(), proof.leaf_value_hash.end())));
+        const auto& value_hash = exists ? proof.leaf_value_hash : std::string();
+        const auto& state_trie_root = service->state_trie_root();
+        result.push_back(Pair("value", jsondiff::json_dumps(value)));
+        result.push_back(Pair("exists", exists));
+        result.push_back(Pair("key_hash", HexStr(key_hash.begin(), key_hash.end())));
+        result.push_back(Pair("value_hash", HexStr(value_hash.begin(), value_hash.end())));
+        // the db holds the state of the top commit, which differs from the current one only while a rollback is pending
+        result.push_back(Pair("root_state_hash", service->top_root_state_hash()));
+        result.push_back(Pair("state_trie_root", HexStr(state_trie_root.begin(), state_trie_root.end())));
+        result.push_back(Pair("proof", proof_json));
+    }
+    catch (::contract::storage::ContractStorageException& e) {
+        throw JSONRPCError(RPC_INVALID_PARAMETER, std::string("contract storage error ") + e.what());
+    }
+    return result;
+}
+
+UniValue getcontractstoragecacheinfo(const JSONRPCRequest& request)
+{
+    if (request.fHelp || request.params.size() != 0)
+        throw runtime_error(
+                "getcontractstoragecacheinfo\n"
+                "\nReturns statistics of the decoded contract storage value cache.\n"
+                "\nResult:\n"
+                "{\n"
+                "  \"hits\": xxxxx,         (numeric) Storage reads served from the cache\n"
+                "  \"misses\": xxxxx,       (numeric) Storage reads which went to the database\n"
+                "  \"entries\": xxxxx,      (numeric) Number of cached storage values\n"
+                "  \"usage\": xxxxx,        (numeric) Approximate memory usage of the cache in bytes\n"
+                "  \"maxusage\": xxxxx,     (numeric) Memory limit of the cache in bytes (-contractcache)\n"
+                "}\n"
+                "\nExamples:\n"
+                + HelpExampleCli("getcontractstoragecacheinfo", "")
+                + HelpExampleRpc("getcontractstoragecacheinfo", "")
+        );
+
+    LOCK(cs_main);
+    auto service = get_contract_storage_service();
+    const auto& stats = service->storage_cache_stats();
+    UniValue result(UniValue::VOBJ);
+    result.push_back(Pair("hits", (uint64_t) stats.hits));
+    result.push_back(Pair("misses", (uint64_t) stats.misses));
+    result.push_back(Pair("entries", (uint64_t) stats.entries));
+    result.push_back(Pair("usage", (uint64_t) stats.memory_usage));
+    result.push_back(Pair("maxusage", (uint64_t) stats.max_memory_usage));
+    return result;
+}
+
+UniValue getcontractprofile(const JSONRPCRequest& request)
+{
+    if (request.fHelp || request.params.size() > 2)
+        throw runtime_error(
+                "getcontractprofile ( \"format\" reset )\n"
+                "\nReturns the profile of contract executions since the node started or the profile was reset.\n"
+                "Only recorded when the node runs with -contractprofile.\n"
+                "Executions of nested contract calls are counted in the api called by the transaction.\n"
+                "\nArguments:\n"
+                "1. \"format\"     (string, optional, default=\"json\") \"json\", \"folded\" for flamegraph.pl input weighted by\n"
+                "                  microseconds, or \"foldedgas\" for flamegraph.pl input weighted by gas\n"
+                "2. reset        (boolean, optional, default=false) Clear the profile after returning it\n"
+                "\nResult (format \"json\", most time first):\n"
+                "[\n"
+                "  {\n"
+                "    \"contract\": \"xxxx\",         (string) Contract address\n"
+                "    \"api\": \"xxxx\",              (string) Api name\n"
+                "    \"calls\": xxxxx,             (numeric) Executions of the api\n"
+                "    \"errors\": xxxxx,            (numeric) Executions which failed\n"
+                "    \"gas\": xxxxx,               (numeric) Gas used\n"
+                "    \"time_us\": xxxxx,           (numeric) Wall time in microseconds\n"
+                "    \"storage_read_bytes\": xxx,  (numeric) Bytes of storage values read\n"
+                "    \"storage_write_bytes\": xxx, (numeric) Bytes of storage changes written\n"
+                "    \"opcodes\": {               (json object) Executed instructions by opcode\n"
+                "      \"opcode\": xxxxx,\n"
+                "      ...\n"
+                "    },\n"
+                "    \"host_apis\": {             (json object) Host api calls by name\n"
+                "      \"name\": { \"calls\": xxxxx, \"time_us\": xxxxx },\n"
+                "      ...\n"
+                "    }\n"
+                "  },\n"
+                "  ...\n"
+                "]\n"
+                "\nResult (formats \"folded\" and \"foldedgas\"):\n"
+                "\"contract;api;frame weight\\n...\"  (string) One line per stack\n"
+                "\nExamples:\n"
+                + HelpExampleCli("getcontractprofile", "")
+                + HelpExampleCli("getcontractprofile", "\"folded\" true")
+                + HelpExampleRpc("getcontractprofile", "\"json\", false")
+        );
+
+    std::string format = request.params[0].isNull() ? "json" : request.params[0].get_str();
+    bool reset = request.params[1].isNull() ? false : request.params[1].get_bool();
+    if (format != "json" && format != "folded" && format != "foldedgas")
+        throw JSONRPCError(RPC_INVALID_PARAMETER, "unknown format " + format);
+
+    const auto& profiles = blockchain::contract::ContractProfiler::instance().profiles(reset);
+    UniValue result;
+    if (format == "json") {
+        std::vector<blockchain::contract::ContractProfiles::const_iterator> sorted;
+        for (auto it = profiles.begin(); it != profiles.end(); ++it)
+            sorted.push_back(it);
+        std::stable_sort(sorted.begin(), sorted.end(), [](blockchain::contract::ContractProfiles::const_iterator a, blockchain::contract::ContractProfiles::const_iterator b) {
+            return a->second.time_ns > b->second.time_ns;
+        });
+        result = UniValue(UniValue::VARR);
+        for (const auto& it : sorted) {
+            const auto& profile = it->second;
+            UniValue item(UniValue::VOBJ);
+            item.push_back(Pair("contract", it->first.first));
+            item.push_back(Pair("api", it->first.second));
+            item.push_back(Pair("calls", (uint64_t) profile.calls));
+            item.push_back(Pair("errors", (uint64_t) profile.errors));
+            item.push_back(Pair("gas", profile.gas));
+            item.push_back(Pair("time_us", profile.time_ns / 1000));
+            item.push_back(Pair("storage_read_bytes", (uint64_t) profile.execution.storage_read_bytes));
+            item.push_back(Pair("storage_write_bytes", (uint64_t) profile.execution.storage_write_bytes));
+            UniValue opcodes(UniValue::VOBJ);
+            for (int op = 0; op < UNUM_OPCODES; op++) {
+                if (profile.execution.opcode_counts[op] > 0)
+                    opcodes.push_back(Pair(luaP_opnames[op], (uint64_t) profile.execution.opcode_counts[op]));
+            }
+            item.push_back(Pair("opcodes", opcodes));
+            UniValue host_apis(UniValue::VOBJ);
+            for (const auto& api : profile.execution.host_apis) {
+                UniValue host_api(UniValue::VOBJ);
+                host_api.push_back(Pair("calls", (uint64_t) api.second.calls));
+                host_api.push_back(Pair("time_us", api.second.time_ns / 1000));
+                host_apis.push_back(Pair(api.first, host_api));
+            }
+            item.push_back(Pair("host_apis", host_apis));
+            result.push_back(item);
+        }
+    } else {
+        result = UniValue(blockchain::contract::ContractProfiler::folded(profiles, format == "foldedgas"));
+    }
+    return result;
+}
+
 UniValue getcreatecontractaddress(const JSONRPCRequest& request)
 {
     if (request.fHelp || request.params.size() < 1)
@@ -2327,21 +2530,14 @@ UniValue invokecontractoffline(const JSONRPCRequest& request)
 		throw JSONRPCError(RPC_INVALID_PARAMETER, "Incorrect contract api name");
 	std::string api_arg = request.params[3].get_str();
 
-    auto service = get_contract_storage_service();
-	service->open();
-
-	const auto& old_root_state_hash = service->current_root_state_hash();
+	// offline calls don't commit, so they run on a snapshot without holding the storage lock
+	auto service = get_contract_storage_snapshot();
+	service->set_current_block_height(chainActive.Height());
 
 	auto contract_info = service->get_contract_info(contract_address);
 	if (!contract_info)
 		throw JSONRPCError(RPC_INVALID_ADDRESS_OR_KEY, "Address does not exist");
 
-	BOOST_SCOPE_EXIT_ALL(&service, old_root_state_hash) {
-		service->open();
-		service->rollback_contract_state(old_root_state_hash);
-		service->close();
-	};
-
 	CBlock block;
 	CMutableTransaction tx;
 	uint64_t gas_limit = testing_invoke_contract_gas_limit;
@@ -2365,7 +2561,7 @@ UniValue invokecontractoffline(const JSONRPCRequest& request)
 	contract_tx.params.version = CONTRACT_MAJOR_VERSION;
 	contractTransactions.push_back(contract_tx);
 
-	ContractExec exec(service.get(), block, contractTransactions, gas_limit, 0);
+	ContractExec exec(service.get(), block, chainActive.Tip(), contractTransactions, gas_limit, 0);
 	if (!exec.performByteCode()) {
 		//error, don't add contract
         throw JSONRPCError(RPC_INTERNAL_ERROR, exec.pending_contract_exec_result.error_message);
@@ -2413,17 +2609,8 @@ UniValue registercontracttesting(const JSONRPCRequest& request)
 
     std::vector<unsigned char> contract_data = ParseHexV(bytecode_hex,"Data");
 
-    auto service = get_contract_storage_service();
-    service->open();
-
-    const auto& old_root_state_hash = service->current_root_state_hash();
-
-
-    BOOST_SCOPE_EXIT_ALL(&service, old_root_state_hash) {
-        service->open();
-        service->rollback_contract_state(old_root_state_hash);
-        service->close();
-    };
+    // the testing execution runs on an overlay of the contract storage, which is discarded on return
+    auto service = ::contract::storage::ContractStorageService::create_overlay(get_contract_storage_service());
 
     CBlock block;
     CMutableTransaction tx;
@@ -2449,7 +2636,7 @@ UniValue registercontracttesting(const JSONRPCRequest& request)
     contract_tx.params.version = CONTRACT_MAJOR_VERSION;
     contractTransactions.push_back(contract_tx);
 
-    ContractExec exec(service.get(), block, contractTransactions, gas_limit, 0);
+    ContractExec exec(service.get(), block, chainActive.Tip(), contractTransactions, gas_limit, 0);
     if (!exec.performByteCode()) {
         //error, don't add contract
         return false;
@@ -2495,17 +2682,8 @@ UniValue registernativecontracttesting(const JSONRPCRequest& request)
 	if(!blockchain::contract::native_contract_finder::has_native_contract_with_key(template_name))
 		throw JSONRPCError(RPC_INVALID_PARAMETER, "Incorrect native contract template name");
 
-	auto service = get_contract_storage_service();
-	service->open();
-
-	const auto& old_root_state_hash = service->current_root_state_hash();
-
-
-	BOOST_SCOPE_EXIT_ALL(&service, old_root_state_hash) {
-		service->open();
-		service->rollback_contract_state(old_root_state_hash);
-		service->close();
-	};
+	// the testing execution runs on an overlay of the contract storage, which is discarded on return
+	auto service = ::contract::storage::ContractStorageService::create_overlay(get_contract_storage_service());
 
 	CBlock block;
 	CMutableTransaction tx;
@@ -2532,7 +2710,7 @@ UniValue registernativecontracttesting(const JSONRPCRequest& request)
 	contract_tx.params.version = CONTRACT_MAJOR_VERSION;
 	contractTransactions.push_back(contract_tx);
 
-	ContractExec exec(service.get(), block, contractTransactions, gas_limit, 0);
+	ContractExec exec(service.get(), block, chainActive.Tip(), contractTransactions, gas_limit, 0);
 	if (!exec.performByteCode()) {
 		//error, don't add contract
 		return false;
@@ -2587,14 +2765,8 @@ UniValue upgradecontracttesting(const JSONRPCRequest& request)
     if(!ContractHelper::is_valid_contract_desc_format(contract_desc))
         throw JSONRPCError(RPC_INVALID_PARAMETER, "Incorrect contract description format");
 
-    auto service = get_contract_storage_service();
-    service->open();
-    const auto& old_root_state_hash = service->current_root_state_hash();
-    BOOST_SCOPE_EXIT_ALL(&service, old_root_state_hash) {
-        service->open();
-        service->rollback_contract_state(old_root_state_hash);
-        service->close();
-    };
+    // the testing execution runs on an overlay of the contract storage, which is discarded on return
+    auto service = ::contract::storage::ContractStorageService::create_overlay(get_contract_storage_service());
 
     CBlock block;
     CMutableTransaction tx;
@@ -2621,7 +2793,7 @@ UniValue upgradecontracttesting(const JSONRPCRequest& request)
     contract_tx.params.version = CONTRACT_MAJOR_VERSION;
     contractTransactions.push_back(contract_tx);
 
-    ContractExec exec(service.get(), block, contractTransactions, gas_limit, 0);
+    ContractExec exec(service.get(), block, chainActive.Tip(), contractTransactions, gas_limit, 0);
     if (!exec.performByteCode()) {
         //error, don't add contract
         return false;
@@ -2674,14 +2846,8 @@ UniValue deposittocontracttesting(const JSONRPCRequest& request)
         throw JSONRPCError(RPC_INVALID_PARAMETER, "Incorrect deposit amount");
     const auto& memo = request.params[3].get_str();
 
-    auto service = get_contract_storage_service();
-    service->open();
-    const auto& old_root_state_hash = service->current_root_state_hash();
-    BOOST_SCOPE_EXIT_ALL(&service, old_root_state_hash) {
-        service->open();
-        service->rollback_contract_state(old_root_state_hash);
-        service->close();
-    };
+    // the testing execution runs on an overlay of the contract storage, which is discarded on return
+    auto service = ::contract::storage::ContractStorageService::create_overlay(get_contract_storage_service());
 
     CBlock block;
     CMutableTransaction tx;
@@ -2708,7 +2874,7 @@ UniValue deposittocontracttesting(const JSONRPCRequest& request)
     contract_tx.params.version = CONTRACT_MAJOR_VERSION;
     contractTransactions.push_back(contract_tx);
 
-    ContractExec exec(service.get(), block, contractTransactions, gas_limit, 0);
+    ContractExec exec(service.get(), block, chainActive.Tip(), contractTransactions, gas_limit, 0);
     if (!exec.performByteCode()) {
         //error, don't add contract
         return false;
@@ -2956,6 +3122,9 @@ static const CRPCCommand commands[] =
     { "blockchain",         "rollbacktoheight", &rollbacktoheight,{"to_height"} },
 
     { "blockchain",         "getcontractstorage", &getcontractstorage, {} },
+    { "blockchain",         "getcontractstoragecacheinfo", &getcontractstoragecacheinfo, {} },
+    { "blockchain",         "getcontractprofile",     &getcontractprofile,     {"format", "reset"} },
+    { "blockchain",         "getcontractstateproof", &getcontractstateproof, {} },
 
     /* Not shown in help */
     { "hidden",             "invalidateblock",        &invalidateblock,        {"blockhash"} },
@@ -163,6 +163,7 @@ static const CRPCConvertParam vRPCConvertParams[] =
     { "rollbackrootstatehash", 1, "to_rootstatehash" },
     { "rollbacktoheight", 1, "to_height" },
     { "getcontractstorage", 2, "contract_address" },
+    { "getcontractprofile", 1, "reset" },
     { "createcontract", 5, "owner_address" },
     { "callcontract", 7, "caller_address" },
     { "getcoinbase", 2, "scriptpubkey" },
@@ -25,6 +25,8 @@
 #include <wallet/walletdb.h>
 #endif
 #include <warnings.h>
+#include <contract_engine/contract_code_cache.hpp>
+#include <contract_engine/contract_exec_cache.hpp>
 
 #include <stdint.h>
 #ifdef HAVE_MALLOC_INFO
@@ -458,6 +460,32 @@ static UniValue RPCLockedMemoryInfo()
     return obj;
 }
 
+static UniValue RPCContractCodeCacheInfo()
+{
+    auto stats = blockchain::contract::ContractCodeCache::instance().stats();
+    UniValue obj(UniValue::VOBJ);
+    obj.push_back(Pair("hits", uint64_t(stats.hits)));
+    obj.push_back(Pair("misses", uint64_t(stats.misses)));
+    obj.push_back(Pair("hitrate", stats.hits + stats.misses > 0 ? double(stats.hits) / (stats.hits + stats.misses) : 0.0));
+    obj.push_back(Pair("entries", uint64_t(stats.entries)));
+    obj.push_back(Pair("usage", uint64_t(stats.memory_usage)));
+    obj.push_back(Pair("maxusage", uint64_t(stats.max_memory_usage)));
+    return obj;
+}
+
+static UniValue RPCContractExecCacheInfo()
+{
+    auto stats = blockchain::contract::ContractExecCache::instance().stats();
+    UniValue obj(UniValue::VOBJ);
+    obj.push_back(Pair("hits", uint64_t(stats.hits)));
+    obj.push_back(Pair("misses", uint64_t(stats.misses)));
+    obj.push_back(Pair("hitrate", stats.hits + stats.misses > 0 ? double(stats.hits) / (stats.hits + stats.misses) : 0.0));
+    obj.push_back(Pair("entries", uint64_t(stats.entries)));
+    obj.push_back(Pair("usage", uint64_t(stats.memory_usage)));
+    obj.push_back(Pair("maxusage", uint64_t(stats.max_memory_usage)));
+    return obj;
+}
+
 #ifdef HAVE_MALLOC_INFO
 static std::string RPCMallocInfo()
 {
@@ -499,6 +527,22 @@ UniValue getmemoryinfo(const JSONRPCRequest& request)
             "    \"locked\": xxxxxx,       (numeric) Amount of bytes that succeeded locking. If this number is smaller than total, locking pages failed at some point and key data could be swapped to disk.\n"
             "    \"chunks_used\": xxxxx,   (numeric) Number allocated chunks\n"
             "    \"chunks_free\": xxxxx,   (numeric) Number unused chunks\n"
+            "  },\n"
+            "  \"contractcode\": {         (json object) Information about the decoded contract code cache\n"
+            "    \"hits\": xxxxx,          (numeric) Contract loads served from the cache\n"
+            "    \"misses\": xxxxx,        (numeric) Contract loads which decoded the contract info\n"
+            "    \"hitrate\": x.xxx,       (numeric) hits / (hits + misses)\n"
+            "    \"entries\": xxxxx,       (numeric) Number of cached codes\n"
+            "    \"usage\": xxxxx,         (numeric) Approximate memory usage of the cache in bytes\n"
+            "    \"maxusage\": xxxxx,      (numeric) Memory limit of the cache in bytes (-contractcodecache)\n"
+            "  },\n"
+            "  \"contractexec\": {         (json object) Information about the contract tx execution cache\n"
+            "    \"hits\": xxxxx,          (numeric) Executions reused by block assembly and block connection\n"
+            "    \"misses\": xxxxx,        (numeric) Lookups which found no execution on the same state\n"
+            "    \"hitrate\": x.xxx,       (numeric) hits / (hits + misses)\n"
+            "    \"entries\": xxxxx,       (numeric) Number of cached executions\n"
+            "    \"usage\": xxxxx,         (numeric) Approximate memory usage of the cache in bytes\n"
+            "    \"maxusage\": xxxxx,      (numeric) Memory limit of the cache in bytes (-contractexeccache)\n"
             "  }\n"
             "}\n"
             "\nResult (mode \"mallocinfo\"):\n"
@@ -512,6 +556,8 @@ UniValue getmemoryinfo(const JSONRPCRequest& request)
     if (mode == "stats") {
         UniValue obj(UniValue::VOBJ);
         obj.push_back(Pair("locked", RPCLockedMemoryInfo()));
+        obj.push_back(Pair("contractcode", RPCContractCodeCacheInfo()));
+        obj.push_back(Pair("contractexec", RPCContractExecCacheInfo()));
         return obj;
     } else if (mode == "mallocinfo") {
 #ifdef HAVE_MALLOC_INFO
@@ -0,0 +1,98 @@
+#include <contract_storage/contract_storage.hpp>
+#include <contract_storage/exceptions.hpp>
+#include <fs.h>
+#include <test/test_bitcoin.h>
+
+#include <boost/test/unit_test.hpp>
+
+#include <sqlite3.h>
+
+using namespace contract::storage;
+
+// runs the statements on the sqlite db at path, creating it
+static void write_sql_db(const fs::path& path, const std::string& sql)
+{
+    sqlite3* db = nullptr;
+    BOOST_REQUIRE(sqlite3_open(path.string().c_str(), &db) == SQLITE_OK);
+    char* error_msg = nullptr;
+    int status = sqlite3_exec(db, sql.c_str(), nullptr, nullptr, &error_msg);
+    BOOST_CHECK_MESSAGE(status == SQLITE_OK, std::string(error_msg ? error_msg : ""));
+    sqlite3_free(error_msg);
+    sqlite3_close(db);
+}
+
+// the commit_info table as older versions created it
+static const std::string legacy_commit_info_table = "CREATE TABLE IF NOT EXISTS commit_info (id INTEGER PRIMARY KEY, commit_id varchar(255) not null, change_type varchar(50) not null, contract_id varchar(255));";
+
+BOOST_FIXTURE_TEST_SUITE(contract_commit_log_tests, BasicTestingSetup)
+
+BOOST_AUTO_TEST_CASE(commit_log_migrate_sql_commits)
+{
+    fs::path path = fs::temp_directory_path() / fs::unique_path();
+    fs::create_directories(path);
+    const fs::path sql_path = path / "sql.db";
+    std::string sql = legacy_commit_info_table;
+    for (int i = 1; i <= 2500; i++) {
+        sql += "insert into commit_info (commit_id, change_type, contract_id) values ('commit" + std::to_string(i) + "', '" +
+               (i % 2 ? "contract_changes" : "new_contract") + "', " + (i % 3 ? "'CON" + std::to_string(i) + "'" : "NULL") + ");";
+    }
+    write_sql_db(sql_path, sql);
+
+    {
+        ContractStorageService service(1, (path / "db").string(), sql_path.string());
+        BOOST_CHECK_EQUAL(service.top_commit_id(), "commit2500");
+        for (int i : {1, 2, 3, 1000, 1001, 2500}) {
+            const auto& commit_info = service.get_commit_info("commit" + std::to_string(i));
+            BOOST_REQUIRE(commit_info);
+            BOOST_CHECK_EQUAL(commit_info->id, (uint64_t)i);
+            BOOST_CHECK_EQUAL(commit_info->commit_id, "commit" + std::to_string(i));
+            BOOST_CHECK_EQUAL(commit_info->change_type, i % 2 ? "contract_changes" : "new_contract");
+            BOOST_CHECK_EQUAL(commit_info->contract_id, i % 3 ? "CON" + std::to_string(i) : "");
+        }
+        BOOST_CHECK(!service.get_commit_info("commit2501"));
+    }
+    // the sqlite db is kept aside and the commits aren't migrated again
+    BOOST_CHECK(!fs::exists(sql_path));
+    BOOST_CHECK(fs::exists(path / "sql.db.migrated"));
+    write_sql_db(sql_path, legacy_commit_info_table + "insert into commit_info (commit_id, change_type) values ('other', 'x');");
+    {
+        ContractStorageService service(1, (path / "db").string(), sql_path.string());
+        BOOST_CHECK_EQUAL(service.top_commit_id(), "commit2500");
+        BOOST_CHECK(!service.get_commit_info("other"));
+    }
+    fs::remove_all(path);
+}
+
+BOOST_AUTO_TEST_CASE(commit_log_migrate_sql_errors)
+{
+    fs::path path = fs::temp_directory_path() / fs::unique_path();
+    fs::create_directories(path);
+    const fs::path sql_path = path / "sql.db";
+
+    // a sqlite db without the commit_info table has no commits
+    write_sql_db(sql_path, "create table other (id INTEGER PRIMARY KEY);");
+    {
+        ContractStorageService service(1, (path / "empty_db").string(), sql_path.string());
+        BOOST_CHECK_EQUAL(service.top_commit_id(), EMPTY_COMMIT_ID);
+    }
+    BOOST_CHECK(!fs::exists(sql_path));
+
+    // a commit_info table which can't be read stops the open and keeps the sqlite db
+    write_sql_db(sql_path, "create table commit_info (id INTEGER PRIMARY KEY, commit_id varchar(255) not null);"
+                           "insert into commit_info (commit_id) values ('commit1');");
+    BOOST_CHECK_THROW(ContractStorageService(1, (path / "bad_schema_db").string(), sql_path.string()), ContractStorageException);
+    BOOST_CHECK(fs::exists(sql_path));
+    fs::remove(sql_path);
+
+    // so does a file which isn't a sqlite db
+    {
+        fs::ofstream file(sql_path);
+        file << std::string(4096, 'x');
+    }
+    BOOST_CHECK_THROW(ContractStorageService(1, (path / "corrupt_db").string(), sql_path.string()), ContractStorageException);
+    BOOST_CHECK(fs::exists(sql_path));
+
+    fs::remove_all(path);
+}
+
+BOOST_AUTO_TEST_SUITE_END()
@@ -0,0 +1,153 @@
+#include <contract_engine/native_contract.hpp>
+#include <contract_storage/contract_storage.hpp>
+#include <base58.h>
+#include <fs.h>
+#include <test/test_bitcoin.h>
+
+#include <boost/algorithm/string/replace.hpp>
+#include <boost/test/unit_test.hpp>
+
+using namespace blockchain::contract;
+using ::contract::storage::ContractStorageService;
+
+static const std::string dgp_contract_id = "CONdgp";
+
+// calls the dgp native contract like ContractExec does, with a new contract per call, and commits the storage changes
+// of each call. the results are dumped with the addresses replaced by their names
+class DgpCalls
+{
+private:
+    ContractStorageService& service;
+    std::map<std::string, std::string> addresses; // name => address
+
+public:
+    DgpCalls(ContractStorageService& _service) : service(_service)
+    {
+        for (unsigned char i = 1; i <= 3; i++)
+            addresses["addr" + std::to_string(i)] = EncodeDestination(CKeyID(uint160(std::vector<unsigned char>(20, i))));
+    }
+
+    std::string address(const std::string& name) const { return addresses.at(name); }
+
+    std::string call(const std::string& caller, int block_number, const std::string& api_name, std::string api_arg)
+    {
+        for (const auto& p : addresses)
+            boost::replace_all(api_arg, p.first, p.second);
+        PendingState pending_state(&service);
+        native_contract_sender sender;
+        sender.caller_address = address(caller);
+        sender.block_number = block_number;
+        auto native_contract = native_contract_finder::create_native_contract_by_key(&pending_state, "dgp", dgp_contract_id, sender);
+        BOOST_REQUIRE(native_contract);
+        const auto& result = native_contract->invoke(api_name, api_arg);
+
+        std::string dump = std::to_string(result.exit_code) + "|" + result.error_message + "|" + result.api_result + "|";
+        for (const auto& event : result.events)
+            dump += event.event_name + "(" + event.event_arg + ")";
+        auto changes = std::make_shared<::contract::storage::ContractChanges>();
+        for (const auto& p : result.contract_storage_changes) {
+            dump += "|" + p.first + " " + jsondiff::json_dumps(p.second->value());
+            ::contract::storage::ContractStorageChange change;
+            change.contract_id = p.first;
+            const auto& items = p.second->value().as<jsondiff::JsonObject>();
+            for (auto it = items.begin(); it != items.end(); it++) {
+                ::contract::storage::ContractStorageItemChange item;
+                item.name = it->key();
+                item.diff = std::make_shared<jsondiff::DiffResult>(it->value());
+                change.items.push_back(item);
+            }
+            changes->storage_changes.push_back(change);
+        }
+        if (!changes->storage_changes.empty()) {
+            service.set_current_block_height(block_number);
+            service.commit_contract_changes(changes);
+        }
+        for (const auto& p : addresses)
+            boost::replace_all(dump, p.second, p.first);
+        return dump;
+    }
+};
+
+BOOST_FIXTURE_TEST_SUITE(contract_native_tests, BasicTestingSetup)
+
+// the results were recorded with the dgp contract diffing its storages on every set, before the native api tables.
+// invoke returns the api result and the storage changes only, the events and errors of the calls don't show
+BOOST_AUTO_TEST_CASE(dgp_native_contract_calls)
+{
+    fs::path path = fs::temp_directory_path() / fs::unique_path();
+    fs::create_directories(path);
+    {
+        ContractStorageService service(1, (path / "db").string(), (path / "sql.db").string());
+        auto info = std::make_shared<::contract::storage::ContractInfo>();
+        info->id = dgp_contract_id;
+        info->is_native = true;
+        info->contract_template_key = "dgp";
+        service.set_current_block_height(1);
+        service.save_contract_info(info);
+        DgpCalls dgp(service);
+
+        const std::vector<std::tuple<std::string, int, std::string, std::string, std::string>> calls = {
+            // caller, block number, api, arg, result
+            std::make_tuple("addr1", 1, "init", "", "0||||CONdgp {\"admins\":{\"__old\":null,\"__new\":[\"addr1\"]},\"current_change_admin_proposal\":null,\"current_change_params_proposal\":null,\"dgp_params\":{\"__old\":null,\"__new\":{\"min_gas_price\":10,\"block_gas_limit\":40000000,\"min_gas_count\":10,\"max_contract_bytecode_store_fee_gas_count\":10000}}}"),
+            std::make_tuple("addr1", 1, "admins", "", "0||[\"addr1\"]|"),
+            std::make_tuple("addr1", 1, "min_gas_price", "", "0||10|"),
+            std::make_tuple("addr1", 1, "current_change_params_proposal", "", "0||null|"),
+            // params proposals
+            std::make_tuple("addr2", 2, "set_min_gas_price", "20,1", "0|||"),
+            std::make_tuple("addr1", 2, "set_min_gas_price", "20,1", "0||||CONdgp {\"current_change_params_proposal\":{\"__old\":null,\"__new\":{\"creator\":\"addr1\",\"property\":\"min_gas_price\",\"needAgreeCount\":1,\"value\":20,\"votes\":{},\"proposalStartBlockNumber\":12}}}"),
+            std::make_tuple("addr1", 2, "set_block_gas_limit", "5000000,1", "0|||"),
+            std::make_tuple("addr1", 2, "current_change_params_proposal", "", "0||[[\"creator\",\"addr1\"],[\"property\",\"min_gas_price\"],[\"needAgreeCount\",1],[\"value\",20],[\"votes\",[]],[\"proposalStartBlockNumber\",12]]|"),
+            std::make_tuple("addr1", 5, "vote_change_param", "true", "0|||"),
+            std::make_tuple("addr1", 12, "vote_change_param", "yes", "0|||"),
+            std::make_tuple("addr1", 12, "vote_change_param", "true", "0||||CONdgp {\"current_change_params_proposal\":{\"__old\":{\"creator\":\"addr1\",\"property\":\"min_gas_price\",\"needAgreeCount\":1,\"value\":20,\"votes\":{},\"proposalStartBlockNumber\":12},\"__new\":null},\"dgp_params\":{\"min_gas_price\":{\"__old\":10,\"__new\":20}}}"),
+            std::make_tuple("addr1", 12, "min_gas_price", "", "0||20|"),
+            std::make_tuple("addr1", 12, "current_change_params_proposal", "", "0||null|"),
+            std::make_tuple("addr1", 13, "set_min_gas_count", "abc", "0|||"),
+            std::make_tuple("addr1", 13, "set_min_gas_price", "20,1", "0|||"),
+            std::make_tuple("addr1", 13, "set_min_gas_price", "30,2", "0|||"),
+            std::make_tuple("addr1", 13, "set_max_contract_bytecode_store_fee_gas_count", "1000,1", "0||||CONdgp {\"current_change_params_proposal\":{\"__old\":null,\"__new\":{\"creator\":\"addr1\",\"property\":\"max_contract_bytecode_store_fee_gas_count\",\"needAgreeCount\":1,\"value\":1000,\"votes\":{},\"proposalStartBlockNumber\":23}}}"),
+            std::make_tuple("addr1", 23, "vote_change_param", "false", "0||||CONdgp {\"current_change_params_proposal\":{\"__old\":{\"creator\":\"addr1\",\"property\":\"max_contract_bytecode_store_fee_gas_count\",\"needAgreeCount\":1,\"value\":1000,\"votes\":{},\"proposalStartBlockNumber\":23},\"__new\":null}}"),
+            std::make_tuple("addr1", 23, "max_contract_bytecode_store_fee_gas_count", "", "0||10000|"),
+            std::make_tuple("addr1", 30, "set_block_gas_limit", "5000000,1", "0||||CONdgp {\"current_change_params_proposal\":{\"__old\":null,\"__new\":{\"creator\":\"addr1\",\"property\":\"block_gas_limit\",\"needAgreeCount\":1,\"value\":5000000,\"votes\":{},\"proposalStartBlockNumber\":40}}}"),
+            std::make_tuple("addr1", 40, "vote_change_param", "true", "0||||CONdgp {\"current_change_params_proposal\":{\"__old\":{\"creator\":\"addr1\",\"property\":\"block_gas_limit\",\"needAgreeCount\":1,\"value\":5000000,\"votes\":{},\"proposalStartBlockNumber\":40},\"__new\":null},\"dgp_params\":{\"block_gas_limit\":{\"__old\":40000000,\"__new\":5000000}}}"),
+            std::make_tuple("addr1", 40, "block_gas_limit", "", "0||5000000|"),
+            // admin proposals
+            std::make_tuple("addr1", 41, "create_change_admin_proposal", "{\"address\": \"addr2\", \"add\": true}", "0|||"),
+            std::make_tuple("addr1", 41, "create_change_admin_proposal", "{\"address\": \"addr1\", \"add\": true, \"needAgreeCount\": 1}", "0|||"),
+            std::make_tuple("addr1", 41, "create_change_admin_proposal", "{\"address\": \"addr2\", \"add\": true, \"needAgreeCount\": 1}", "0||||CONdgp {\"current_change_admin_proposal\":{\"__old\":null,\"__new\":{\"creator\":\"addr1\",\"address\":\"addr2\",\"add\":true,\"needAgreeCount\":1,\"votes\":{},\"proposalStartBlockNumber\":51}}}"),
+            std::make_tuple("addr1", 41, "current_change_admin_proposal", "", "0||[[\"creator\",\"addr1\"],[\"address\",\"addr2\"],[\"add\",true],[\"needAgreeCount\",1],[\"votes\",[]],[\"proposalStartBlockNumber\",51]]|"),
+            std::make_tuple("addr2", 41, "cancel_change_admin_proposal", "", "0|||"),
+            std::make_tuple("addr1", 41, "cancel_change_admin_proposal", "", "0||||CONdgp {\"current_change_admin_proposal\":{\"__old\":{\"creator\":\"addr1\",\"address\":\"addr2\",\"add\":true,\"needAgreeCount\":1,\"votes\":{},\"proposalStartBlockNumber\":51},\"__new\":null}}"),
+            std::make_tuple("addr1", 41, "cancel_change_admin_proposal", "", "0|||"),
+            std::make_tuple("addr1", 42, "create_change_admin_proposal", "{\"address\": \"addr2\", \"add\": true, \"needAgreeCount\": 1}", "0||||CONdgp {\"current_change_admin_proposal\":{\"__old\":null,\"__new\":{\"creator\":\"addr1\",\"address\":\"addr2\",\"add\":true,\"needAgreeCount\":1,\"votes\":{},\"proposalStartBlockNumber\":52}}}"),
+            std::make_tuple("addr1", 52, "vote_admin", "true", "0||||CONdgp {\"admins\":[[\"+\",1,\"addr2\"]],\"current_change_admin_proposal\":{\"__old\":{\"creator\":\"addr1\",\"address\":\"addr2\",\"add\":true,\"needAgreeCount\":1,\"votes\":{},\"proposalStartBlockNumber\":52},\"__new\":null}}"),
+            std::make_tuple("addr1", 52, "admins", "", "0||[\"addr1\",\"addr2\"]|"),
+            std::make_tuple("addr2", 53, "create_change_admin_proposal", "{\"address\": \"addr3\", \"add\": true, \"needAgreeCount\": 1}", "0|||"),
+            std::make_tuple("addr2", 53, "create_change_admin_proposal", "{\"address\": \"addr3\", \"add\": true, \"needAgreeCount\": 2}", "0||||CONdgp {\"current_change_admin_proposal\":{\"__old\":null,\"__new\":{\"creator\":\"addr2\",\"address\":\"addr3\",\"add\":true,\"needAgreeCount\":2,\"votes\":{},\"proposalStartBlockNumber\":63}}}"),
+            std::make_tuple("addr1", 63, "vote_admin", "true", "0||||CONdgp {\"current_change_admin_proposal\":{\"votes\":{\"addr1__added\":true}}}"),
+            std::make_tuple("addr1", 63, "vote_admin", "true", "0|||"),
+            std::make_tuple("addr2", 63, "vote_admin", "false", "0||||CONdgp {\"current_change_admin_proposal\":{\"__old\":{\"creator\":\"addr2\",\"address\":\"addr3\",\"add\":true,\"needAgreeCount\":2,\"votes\":{\"addr1\":true},\"proposalStartBlockNumber\":63},\"__new\":null}}"),
+            std::make_tuple("addr2", 64, "set_min_gas_count", "7,2", "0||||CONdgp {\"current_change_params_proposal\":{\"__old\":null,\"__new\":{\"creator\":\"addr2\",\"property\":\"min_gas_count\",\"needAgreeCount\":2,\"value\":7,\"votes\":{},\"proposalStartBlockNumber\":74}}}"),
+            std::make_tuple("addr1", 74, "vote_change_param", "true", "0||||CONdgp {\"current_change_params_proposal\":{\"votes\":{\"addr1__added\":true}}}"),
+            std::make_tuple("addr2", 74, "vote_change_param", "true", "0||||CONdgp {\"current_change_params_proposal\":{\"__old\":{\"creator\":\"addr2\",\"property\":\"min_gas_count\",\"needAgreeCount\":2,\"value\":7,\"votes\":{\"addr1\":true},\"proposalStartBlockNumber\":74},\"__new\":null},\"dgp_params\":{\"min_gas_count\":{\"__old\":10,\"__new\":7}}}"),
+            std::make_tuple("addr1", 74, "min_gas_count", "", "0||7|"),
+            std::make_tuple("addr2", 75, "set_min_gas_price", "40,2", "0||||CONdgp {\"current_change_params_proposal\":{\"__old\":null,\"__new\":{\"creator\":\"addr2\",\"property\":\"min_gas_price\",\"needAgreeCount\":2,\"value\":40,\"votes\":{},\"proposalStartBlockNumber\":85}}}"),
+            std::make_tuple("addr2", 75, "create_change_admin_proposal", "{\"address\": \"addr1\", \"add\": false, \"needAgreeCount\": 2}", "0||||CONdgp {\"current_change_admin_proposal\":{\"__old\":null,\"__new\":{\"creator\":\"addr2\",\"address\":\"addr1\",\"add\":false,\"needAgreeCount\":2,\"votes\":{},\"proposalStartBlockNumber\":85}}}"),
+            std::make_tuple("addr1", 85, "vote_admin", "true", "0||||CONdgp {\"current_change_admin_proposal\":{\"votes\":{\"addr1__added\":true}}}"),
+            std::make_tuple("addr2", 85, "vote_admin", "true", "0||||CONdgp {\"admins\":[[\"~\",0,{\"__old\":\"addr1\",\"__new\":\"addr2\"}],[\"-\",1,\"addr2\"]],\"current_change_admin_proposal\":{\"__old\":{\"creator\":\"addr2\",\"address\":\"addr1\",\"add\":false,\"needAgreeCount\":2,\"votes\":{\"addr1\":true},\"proposalStartBlockNumber\":85},\"__new\":null},\"current_change_params_proposal\":{\"__old\":{\"creator\":\"addr2\",\"property\":\"min_gas_price\",\"needAgreeCount\":2,\"value\":40,\"votes\":{},\"proposalStartBlockNumber\":85},\"__new\":null}}"),
+            std::make_tuple("addr2", 85, "admins", "", "0||[\"addr2\"]|"),
+            std::make_tuple("addr2", 85, "current_change_params_proposal", "", "0||null|"),
+            std::make_tuple("addr2", 85, "create_change_admin_proposal", "{\"address\": \"addr2\", \"add\": false, \"needAgreeCount\": 1}", "0|||"),
+            // apis without a handler and unknown apis
+            std::make_tuple("addr2", 86, "on_deposit", "", "1|Can't find dgp api on_deposit||"),
+            std::make_tuple("addr2", 86, "no_such_api", "", "1|Can't find dgp api no_such_api||"),
+        };
+        for (const auto& c : calls) {
+            const auto& result = dgp.call(std::get<0>(c), std::get<1>(c), std::get<2>(c), std::get<3>(c));
+            BOOST_CHECK_MESSAGE(result == std::get<4>(c), std::get<2>(c) + " " + std::get<3>(c) + "\n  result:   " + result + "\n  expected: " + std::get<4>(c));
+        }
+    }
+    fs::remove_all(path);
+}
+
+BOOST_AUTO_TEST_SUITE_END()
@@ -0,0 +1,133 @@
+#include <contract_storage/contract_info.hpp>
+#include <fcrypto/sha256.hpp>
+#include <test/test_bitcoin.h>
+
+#include <limits>
+#include <list>
+
+#include <boost/test/unit_test.hpp>
+
+using namespace contract::storage;
+using jsondiff::JsonValue;
+using jsondiff::JsonObject;
+using jsondiff::JsonArray;
+
+static bool compare_key(const std::string& first, const std::string& second)
+{
+    unsigned int i = 0;
+    while ((i < first.length()) && (i < second.length())) {
+        if (first[i] < second[i])
+            return true;
+        else if (first[i] > second[i])
+            return false;
+        else
+            ++i;
+    }
+    return (first.length() < second.length());
+}
+
+// ordered_json_digest used to hash the json dump of this conversion, the digests and sizes must stay the same
+static JsonValue nested_json_object_to_array(const JsonValue& json_value)
+{
+    if (json_value.is_object()) {
+        const auto& obj = json_value.as<JsonObject>();
+        JsonArray json_array;
+        std::list<std::string> keys;
+        for (auto it = obj.begin(); it != obj.end(); it++) {
+            keys.push_back(it->key());
+        }
+        keys.sort(&compare_key);
+        for (const auto& key : keys) {
+            JsonArray item_json;
+            item_json.push_back(key);
+            item_json.push_back(nested_json_object_to_array(obj[key]));
+            json_array.push_back(item_json);
+        }
+        return json_array;
+    }
+    if (json_value.is_array()) {
+        const auto& arr = json_value.as<JsonArray>();
+        JsonArray result;
+        for (const auto& item : arr) {
+            result.push_back(nested_json_object_to_array(item));
+        }
+        return result;
+    }
+    return json_value;
+}
+
+static void check_ordered_json(const JsonValue& value)
+{
+    const auto& dumped = jsondiff::json_dumps(nested_json_object_to_array(value));
+    BOOST_CHECK(ordered_json_digest(value) == fcrypto::sha256::hash(dumped));
+    BOOST_CHECK_EQUAL(ordered_json_size(value), dumped.size());
+}
+
+BOOST_FIXTURE_TEST_SUITE(contract_ordered_json_tests, BasicTestingSetup)
+
+BOOST_AUTO_TEST_CASE(ordered_json_text)
+{
+    // objects are written as [key, value] pairs sorted by key
+    JsonObject obj;
+    obj("b", 1);
+    obj("a", JsonArray{JsonValue(JsonObject("y", true)("x", JsonValue())), JsonValue("s")});
+    const std::string text = "[[\"a\",[[[\"x\",null],[\"y\",true]],\"s\"]],[\"b\",1]]";
+    BOOST_CHECK(ordered_json_digest(obj) == fcrypto::sha256::hash(text));
+    BOOST_CHECK_EQUAL(ordered_json_size(obj), text.size());
+    check_ordered_json(obj);
+}
+
+BOOST_AUTO_TEST_CASE(ordered_json_scalars)
+{
+    const std::vector<JsonValue> values = {
+        JsonValue(),
+        JsonValue(true),
+        JsonValue(false),
+        JsonValue((int64_t)0),
+        JsonValue((int64_t)-1),
+        JsonValue(std::numeric_limits<int64_t>::min()),
+        JsonValue(std::numeric_limits<int64_t>::max()),
+        JsonValue(std::numeric_limits<uint64_t>::max()),
+        JsonValue(0.5),
+        JsonValue(-1e300),
+        JsonValue(1.0 / 3),
+        JsonValue(""),
+        JsonValue("tab\t newline\n return\r backslash\\ bell\a quote\""),
+        JsonValue(std::string("nul\0 eot\x04 del\x7f high\x80\xff", 19)),
+        JsonValue(std::string(5000, 'x')),
+    };
+    for (const auto& value : values) {
+        check_ordered_json(value);
+        check_ordered_json(JsonArray{value});
+        check_ordered_json(JsonObject("k", value));
+    }
+    fjson::blob blob;
+    blob.data = {'a', 'b', '\0'};
+    check_ordered_json(JsonValue(blob));
+}
+
+BOOST_AUTO_TEST_CASE(ordered_json_nested)
+{
+    check_ordered_json(JsonObject());
+    check_ordered_json(JsonArray());
+    check_ordered_json(JsonArray{JsonValue(JsonObject()), JsonValue(JsonArray()), JsonValue(JsonArray{JsonValue(JsonArray())})});
+
+    // keys sort by their bytes as signed chars, escaped keys and duplicate keys
+    JsonObject keys;
+    for (const std::string& key : {"b", "B", "ab", "a", "a\xff", "a\x80", "\t", "\"q", "z\\", "k\a", "", "aa", "w10", "w2", "w1"})
+        keys(key, key.size());
+    keys("a", "duplicate");
+    check_ordered_json(keys);
+
+    JsonValue value = keys;
+    for (int depth = 0; depth < 20; depth++) {
+        JsonObject obj;
+        obj("value", value);
+        obj("depth", depth);
+        obj("items", JsonArray{JsonValue(depth), JsonValue(JsonObject())});
+        value = obj;
+    }
+    check_ordered_json(value);
+}
+
+BOOST_AUTO_TEST_SUITE_END()
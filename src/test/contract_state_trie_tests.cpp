@@ -0,0 +1,295 @@
+#include <contract_storage/contract_storage.hpp>
+#include <contract_storage/state_trie.hpp>
+#include <fs.h>
+#include <test/test_bitcoin.h>
+
+#include <algorithm>
+#include <map>
+
+#include <boost/test/unit_test.hpp>
+
+#include <leveldb/db.h>
+#include <leveldb/write_batch.h>
+
+using namespace contract::storage;
+
+typedef std::map<std::string, std::string> NodeStore;
+
+static ContractStateTrie make_trie(NodeStore& nodes)
+{
+    return ContractStateTrie([&nodes](const std::string& node_key, std::string* node) {
+        auto it = nodes.find(node_key);
+        if (it == nodes.end())
+            return false;
+        *node = it->second;
+        return true;
+    }, [&nodes](const std::string& node_key, const std::string* node) {
+        if (node)
+            nodes[node_key] = *node;
+        else
+            nodes.erase(node_key);
+    });
+}
+
+static std::string key_hash(int i)
+{
+    return ContractStorageService::contract_storage_state_key_hash("CONA", "name" + std::to_string(i));
+}
+
+static std::string value_hash(int i)
+{
+    return ContractStorageService::state_value_hash(jsondiff::JsonValue(i));
+}
+
+// the proof of key leads to root with its value and doesn't with any other value
+static void check_proof(const ContractStateTrie& trie, const std::string& key, const std::string& value)
+{
+    const auto& proof = trie.prove(key);
+    const auto& root = trie.root_hash();
+    BOOST_CHECK(ContractStateTrie::proof_root(key, value, proof) == root);
+    BOOST_CHECK(ContractStateTrie::proof_root(key, value.empty() ? value_hash(-1) : std::string(), proof) != root);
+    BOOST_CHECK(ContractStateTrie::proof_root(key, value_hash(-2), proof) != root);
+}
+
+BOOST_FIXTURE_TEST_SUITE(contract_state_trie_tests, BasicTestingSetup)
+
+BOOST_AUTO_TEST_CASE(state_trie_update)
+{
+    NodeStore nodes;
+    auto trie = make_trie(nodes);
+    BOOST_CHECK(trie.root_hash() == ContractStateTrie::empty_hash());
+
+    // a single leaf is stored at the root
+    trie.update(key_hash(0), value_hash(0));
+    BOOST_CHECK_EQUAL(nodes.size(), 1U);
+    BOOST_CHECK(trie.root_hash() == ContractStateTrie::leaf_hash(key_hash(0), value_hash(0)));
+    trie.update(key_hash(0), value_hash(1));
+    BOOST_CHECK_EQUAL(nodes.size(), 1U);
+    BOOST_CHECK(trie.root_hash() == ContractStateTrie::leaf_hash(key_hash(0), value_hash(1)));
+
+    for (int i = 1; i < 100; i++)
+        trie.update(key_hash(i), value_hash(i));
+    trie.update(key_hash(0), value_hash(0));
+    for (int i = 0; i < 100; i++)
+        check_proof(trie, key_hash(i), value_hash(i));
+
+    // deleting all leaves but one collapses the trie back to that leaf at the root
+    for (int i = 1; i < 100; i++)
+        trie.update(key_hash(i), std::string());
+    BOOST_CHECK_EQUAL(nodes.size(), 1U);
+    BOOST_CHECK(trie.root_hash() == ContractStateTrie::leaf_hash(key_hash(0), value_hash(0)));
+
+    // deleting a missing key changes nothing
+    trie.update(key_hash(1), std::string());
+    BOOST_CHECK_EQUAL(nodes.size(), 1U);
+
+    trie.update(key_hash(0), std::string());
+    BOOST_CHECK(nodes.empty());
+    BOOST_CHECK(trie.root_hash() == ContractStateTrie::empty_hash());
+}
+
+BOOST_AUTO_TEST_CASE(state_trie_long_common_prefix)
+{
+    // keys with the same first 31 bits branch at depth 31 under a chain of single child branches
+    const std::string first(32, '\0');
+    std::string second(first);
+    second[3] = 1;
+    NodeStore nodes;
+    auto trie = make_trie(nodes);
+    trie.update(first, value_hash(1));
+    trie.update(second, value_hash(2));
+    BOOST_CHECK_EQUAL(nodes.size(), 34U);
+    BOOST_CHECK_EQUAL(trie.prove(second).siblings.size(), 32U);
+    check_proof(trie, first, value_hash(1));
+    check_proof(trie, second, value_hash(2));
+
+    std::string hash = ContractStateTrie::branch_hash(ContractStateTrie::leaf_hash(first, value_hash(1)), ContractStateTrie::leaf_hash(second, value_hash(2)));
+    for (int depth = 0; depth < 31; depth++)
+        hash = ContractStateTrie::branch_hash(hash, ContractStateTrie::empty_hash());
+    BOOST_CHECK(trie.root_hash() == hash);
+
+    trie.update(first, std::string());
+    BOOST_CHECK_EQUAL(nodes.size(), 1U);
+    BOOST_CHECK(trie.root_hash() == ContractStateTrie::leaf_hash(second, value_hash(2)));
+}
+
+BOOST_AUTO_TEST_CASE(state_trie_order_independent)
+{
+    std::vector<int> order;
+    for (int i = 0; i < 64; i++)
+        order.push_back(i);
+    NodeStore expected_nodes;
+    auto expected = make_trie(expected_nodes);
+    for (int i : order)
+        expected.update(key_hash(i), value_hash(i));
+
+    for (int round = 0; round < 5; round++) {
+        std::random_shuffle(order.begin(), order.end());
+        NodeStore nodes;
+        auto trie = make_trie(nodes);
+        // leaves which are inserted, changed and deleted again leave no trace
+        for (int i : order) {
+            trie.update(key_hash(i + 1000), value_hash(i));
+            trie.update(key_hash(i), value_hash(i + 1));
+        }
+        for (int i : order) {
+            trie.update(key_hash(i), value_hash(i));
+            trie.update(key_hash(i + 1000), std::string());
+        }
+        BOOST_CHECK(trie.root_hash() == expected.root_hash());
+        BOOST_CHECK(nodes == expected_nodes);
+    }
+}
+
+BOOST_AUTO_TEST_CASE(state_trie_absence_proof)
+{
+    NodeStore nodes;
+    auto trie = make_trie(nodes);
+    // absence in the empty trie
+    check_proof(trie, key_hash(0), std::string());
+    trie.update(key_hash(0), value_hash(0));
+    // absence proved by the leaf of another key on the path
+    BOOST_CHECK_EQUAL(trie.prove(key_hash(1)).leaf_key_hash, key_hash(0));
+    check_proof(trie, key_hash(1), std::string());
+    for (int i = 2; i < 50; i += 2)
+        trie.update(key_hash(i), value_hash(i));
+    for (int i = 1; i < 50; i += 2)
+        check_proof(trie, key_hash(i), std::string());
+
+    // a proof can't prove a key absent with the leaf of another key
+    auto proof = trie.prove(key_hash(1));
+    const auto& root = trie.root_hash();
+    for (int i = 2; i < 50; i += 2) {
+        if (key_hash(i) == proof.leaf_key_hash)
+            continue;
+        auto forged = proof;
+        forged.leaf_key_hash = key_hash(i);
+        forged.leaf_value_hash = value_hash(i);
+        BOOST_CHECK(ContractStateTrie::proof_root(key_hash(1), std::string(), forged) != root);
+    }
+    // malformed proofs
+    proof.siblings.push_back("short");
+    BOOST_CHECK(ContractStateTrie::proof_root(key_hash(1), std::string(), proof).empty());
+    BOOST_CHECK(ContractStateTrie::proof_root("short", std::string(), ContractStateProof()).empty());
+}
+
+// storage changes of one block setting 4 of the storages name0-49 of contract CONA, every 5th block deletes them
+static ContractChangesP make_block_changes(const ContractStorageService& service, int height)
+{
+    jsondiff::JsonDiff differ;
+    auto changes = std::make_shared<ContractChanges>();
+    ContractStorageChange storage_change;
+    storage_change.contract_id = "CONA";
+    for (int i = 0; i < 4; i++) {
+        ContractStorageItemChange item;
+        item.name = "name" + std::to_string((height * 7 + i) % 50);
+        jsondiff::JsonValue value;
+        if (height % 5) {
+            jsondiff::JsonObject obj;
+            obj("h", height);
+            value = obj;
+        }
+        item.diff = differ.diff(service.get_contract_storage("CONA", item.name), value);
+        storage_change.items.push_back(item);
+    }
+    changes->storage_changes.push_back(storage_change);
+    return changes;
+}
+
+static void check_service_proofs(const ContractStorageService& service)
+{
+    const auto& root = service.state_trie_root();
+    // deleted storages are saved as null, name50-59 are never written and proved absent
+    for (int i = 0; i < 60; i++) {
+        const auto& name = "name" + std::to_string(i);
+        jsondiff::JsonValue value;
+        const auto& proof = service.prove_contract_storage("CONA", name, &value);
+        const auto& key = ContractStorageService::contract_storage_state_key_hash("CONA", name);
+        bool exists = proof.leaf_key_hash == key;
+        BOOST_CHECK(exists || value.is_null());
+        if (i >= 50)
+            BOOST_CHECK(!exists);
+        const auto& hash = exists ? ContractStorageService::state_value_hash(value) : std::string();
+        BOOST_CHECK(ContractStateTrie::proof_root(key, hash, proof) == root);
+    }
+    jsondiff::JsonValue info;
+    const auto& proof = service.prove_contract_info("CONA", &info);
+    BOOST_CHECK(!info.is_null());
+    BOOST_CHECK(ContractStateTrie::proof_root(ContractStorageService::contract_info_state_key_hash("CONA"), ContractStorageService::state_value_hash(info), proof) == root);
+}
+
+BOOST_AUTO_TEST_CASE(state_trie_storage_service)
+{
+    fs::path path = fs::temp_directory_path() / fs::unique_path();
+    fs::create_directories(path);
+    const std::string db_path = (path / "db").string();
+    auto service = std::make_shared<ContractStorageService>(1, db_path, (path / "sql.db").string());
+    auto info = std::make_shared<ContractInfo>();
+    info->id = "CONA";
+    info->name = "contract_a";
+    service->set_current_block_height(1);
+    const auto& info_root = service->save_contract_info(info);
+    const auto& info_trie_root = service->state_trie_root();
+    BOOST_CHECK(service->state_trie_root_of_commit(info_root) == info_trie_root);
+
+    std::vector<std::string> roots;
+    std::vector<std::string> trie_roots;
+    for (int height = 2; height < 40; height++) {
+        service->set_current_block_height(height);
+        roots.push_back(service->commit_contract_changes(make_block_changes(*service, height)));
+        trie_roots.push_back(service->state_trie_root());
+        BOOST_CHECK(service->state_trie_root_of_commit(roots.back()) == trie_roots.back());
+    }
+    check_service_proofs(*service);
+
+    // rolling back restores the trie of the commit and forgets the roots of the rollbacked commits
+    service->rollback_contract_state(roots[20]);
+    BOOST_CHECK(service->state_trie_root() == trie_roots[20]);
+    BOOST_CHECK(service->state_trie_root_of_commit(roots[21]).empty());
+    check_service_proofs(*service);
+    service->rollback_contract_state(info_root);
+    BOOST_CHECK(service->state_trie_root() == info_trie_root);
+
+    // replaying the same blocks gives the same tries
+    for (int height = 2; height < 40; height++) {
+        service->set_current_block_height(height);
+        service->commit_contract_changes(make_block_changes(*service, height));
+        BOOST_CHECK(service->state_trie_root() == trie_roots[height - 2]);
+    }
+
+    // an overlay updates its own trie only
+    auto overlay = ContractStorageService::create_overlay(service);
+    overlay->set_current_block_height(40);
+    overlay->commit_contract_changes(make_block_changes(*overlay, 41));
+    BOOST_CHECK(overlay->state_trie_root() != trie_roots.back());
+    check_service_proofs(*overlay);
+    overlay.reset();
+    BOOST_CHECK(service->state_trie_root() == trie_roots.back());
+    service->close();
+
+    // a db without the trie, as written before it existed, gets the trie built when opened
+    {
+        leveldb::DB* db = nullptr;
+        BOOST_REQUIRE(leveldb::DB::Open(leveldb::Options(), db_path, &db).ok());
+        std::unique_ptr<leveldb::DB> db_holder(db);
+        leveldb::WriteBatch batch;
+        int node_count = 0;
+        std::unique_ptr<leveldb::Iterator> it(db->NewIterator(leveldb::ReadOptions()));
+        for (it->Seek("state_trie$"); it->Valid() && it->key().starts_with("state_trie$"); it->Next()) {
+            batch.Delete(it->key());
+            node_count++;
+        }
+        BOOST_CHECK(node_count > 0);
+        batch.Delete("STATE_TRIE_VERSION");
+        it.reset();
+        BOOST_REQUIRE(db->Write(leveldb::WriteOptions(), &batch).ok());
+    }
+    service->open();
+    BOOST_CHECK(service->state_trie_root() == trie_roots.back());
+    check_service_proofs(*service);
+
+    service->close();
+    fs::remove_all(path);
+}
+
+BOOST_AUTO_TEST_SUITE_END()
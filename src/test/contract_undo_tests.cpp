@@ -0,0 +1,151 @@
+#include <contract_storage/contract_storage.hpp>
+#include <contract_storage/exceptions.hpp>
+#include <contract_storage/undo.hpp>
+#include <fs.h>
+#include <utilstrencodings.h>
+#include <test/test_bitcoin.h>
+
+#include <boost/test/unit_test.hpp>
+
+using namespace contract::storage;
+
+static void check_same_undo(const ContractCommitUndo& a, const ContractCommitUndo& b)
+{
+    BOOST_REQUIRE_EQUAL(a.items.size(), b.items.size());
+    for (size_t i = 0; i < a.items.size(); i++) {
+        BOOST_CHECK_EQUAL(a.items[i].key, b.items[i].key);
+        BOOST_CHECK_EQUAL(a.items[i].existed, b.items[i].existed);
+        BOOST_CHECK_EQUAL(a.items[i].value, b.items[i].value);
+    }
+}
+
+// storage changes of one block setting the storages name_i of contract CONA to {"h": height, "i": i}
+static ContractChangesP make_block_changes(const ContractStorageService& service, int height)
+{
+    jsondiff::JsonDiff differ;
+    auto changes = std::make_shared<ContractChanges>();
+    ContractStorageChange storage_change;
+    storage_change.contract_id = "CONA";
+    for (int i = 0; i < 3; i++) {
+        ContractStorageItemChange item;
+        item.name = "name" + std::to_string((height + i) % 5);
+        jsondiff::JsonObject value;
+        value("h", height);
+        value("i", -i);
+        item.diff = differ.diff(service.get_contract_storage("CONA", item.name), value);
+        storage_change.items.push_back(item);
+    }
+    changes->storage_changes.push_back(storage_change);
+    ContractBalanceChange balance_change;
+    balance_change.asset_id = 0;
+    balance_change.address = "CONA";
+    balance_change.amount = height;
+    balance_change.add = true;
+    balance_change.is_contract = true;
+    changes->balance_changes.push_back(balance_change);
+    ContractEventInfo event;
+    event.transaction_id = "tx" + std::to_string(height);
+    event.contract_id = "CONA";
+    event.event_name = "event";
+    event.event_arg = std::to_string(height);
+    changes->events.push_back(event);
+    return changes;
+}
+
+// everything a rollback must restore, as text
+static std::string dump_state(const ContractStorageService& service)
+{
+    std::string dump = service.current_root_state_hash() + "|" + HexStr(service.state_trie_root());
+    for (int i = 0; i < 5; i++)
+        dump += "|" + jsondiff::json_dumps(service.get_contract_storage("CONA", "name" + std::to_string(i)));
+    for (const auto& balance : service.get_contract_balances("CONA"))
+        dump += "|" + std::to_string(balance.asset_id) + ":" + std::to_string(balance.amount);
+    dump += "|" + std::to_string(service.has_contract_info("CONA"));
+    return dump;
+}
+
+BOOST_FIXTURE_TEST_SUITE(contract_undo_tests, BasicTestingSetup)
+
+BOOST_AUTO_TEST_CASE(undo_encoding)
+{
+    ContractCommitUndo undo;
+    BOOST_CHECK_EQUAL(undo.encode(), std::string(1, '\0'));
+    check_same_undo(ContractCommitUndo::decode(undo.encode()), undo);
+
+    ContractStorageUndoItem created;
+    created.key = "contract_storage$CONA$created";
+    created.existed = false;
+    ContractStorageUndoItem empty;
+    empty.key = "contract_storage$CONA$empty";
+    empty.existed = true;
+    ContractStorageUndoItem binary;
+    binary.key = std::string("binary\0key", 10);
+    binary.existed = true;
+    binary.value = std::string("\xff\x01\x00\x80 value", 10) + std::string(300, 'v');
+    undo.items = {created, empty, binary};
+    check_same_undo(ContractCommitUndo::decode(undo.encode()), undo);
+}
+
+BOOST_AUTO_TEST_CASE(undo_encoding_truncated)
+{
+    ContractCommitUndo undo;
+    for (int i = 0; i < 3; i++) {
+        ContractStorageUndoItem item;
+        item.key = "key" + std::to_string(i);
+        item.existed = i != 1;
+        item.value = std::string(i * 100, 'x');
+        undo.items.push_back(item);
+    }
+    const auto& encoded = undo.encode();
+    for (size_t size = 0; size < encoded.size(); size++) {
+        BOOST_CHECK_THROW(ContractCommitUndo::decode(encoded.substr(0, size)), ContractStorageException);
+    }
+    BOOST_CHECK_THROW(ContractCommitUndo::decode(encoded + '\0'), ContractStorageException);
+}
+
+BOOST_AUTO_TEST_CASE(commit_then_rollback)
+{
+    fs::path path = fs::temp_directory_path() / fs::unique_path();
+    fs::create_directories(path);
+    ContractStorageService service(1, (path / "db").string(), (path / "sql.db").string());
+    auto info = std::make_shared<ContractInfo>();
+    info->id = "CONA";
+    info->name = "contract_a";
+    service.set_current_block_height(1);
+    const auto& info_root = service.save_contract_info(info);
+    const auto& info_state = dump_state(service);
+
+    std::vector<std::string> roots;
+    std::vector<std::string> states;
+    for (int height = 2; height < 30; height++) {
+        service.set_current_block_height(height);
+        roots.push_back(service.commit_contract_changes(make_block_changes(service, height)));
+        BOOST_CHECK_EQUAL(service.current_root_state_hash(), roots.back());
+        states.push_back(dump_state(service));
+    }
+
+    // rolling back to a commit restores the state right after it, committing the same blocks again gives the same roots
+    service.rollback_contract_state(roots[10]);
+    BOOST_CHECK_EQUAL(dump_state(service), states[10]);
+    BOOST_CHECK_EQUAL(service.get_transaction_events("tx13")->size(), 0U);
+    for (int height = 13; height < 30; height++) {
+        service.set_current_block_height(height);
+        BOOST_CHECK_EQUAL(service.commit_contract_changes(make_block_changes(service, height)), roots[height - 2]);
+    }
+    BOOST_CHECK_EQUAL(dump_state(service), states.back());
+
+    service.rollback_contract_state(info_root);
+    BOOST_CHECK_EQUAL(dump_state(service), info_state);
+    BOOST_CHECK_EQUAL(service.get_transaction_events("tx5")->size(), 0U);
+    BOOST_CHECK(service.get_contract_balances("CONA").empty());
+    BOOST_CHECK(service.get_contract_storage("CONA", "name0").is_null());
+
+    service.rollback_contract_state(EMPTY_COMMIT_ID);
+    BOOST_CHECK(!service.get_contract_info("CONA"));
+    BOOST_CHECK(service.find_contract_id_by_name("contract_a").empty());
+
+    service.close();
+    fs::remove_all(path);
+}
+
+BOOST_AUTO_TEST_SUITE_END()
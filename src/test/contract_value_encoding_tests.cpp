@@ -0,0 +1,168 @@
+#include <contract_storage/value_encoding.hpp>
+#include <contract_storage/exceptions.hpp>
+#include <fjson/exception/exception.hpp>
+#include <test/test_bitcoin.h>
+
+#include <boost/test/unit_test.hpp>
+
+using namespace contract::storage;
+using jsondiff::JsonValue;
+using jsondiff::JsonObject;
+using jsondiff::JsonArray;
+
+// the decoded value must be the value a json text round-trip of value gives
+static void check_round_trip(const JsonValue& value)
+{
+    const auto& encoded = encode_storage_value(value);
+    BOOST_CHECK(is_binary_storage_value(encoded));
+    BOOST_CHECK_EQUAL(encoded[1], (char)CONTRACT_STORAGE_VALUE_FORMAT_VERSION);
+    const auto& decoded = decode_storage_value(encoded);
+    const auto& expected = jsondiff::json_loads(jsondiff::json_dumps(value));
+    BOOST_CHECK_EQUAL((int)decoded.get_type(), (int)expected.get_type());
+    BOOST_CHECK_EQUAL(jsondiff::json_dumps(decoded), jsondiff::json_dumps(value));
+}
+
+// values the binary format can't represent are saved as json text
+static void check_json_fallback(const JsonValue& value)
+{
+    const auto& encoded = encode_storage_value(value);
+    BOOST_CHECK(!is_binary_storage_value(encoded));
+    BOOST_CHECK_EQUAL(encoded, jsondiff::json_dumps(value));
+    // decoding fails the same way parsing the json text does
+    bool parsed = false;
+    std::string expected;
+    try {
+        expected = jsondiff::json_dumps(jsondiff::json_loads(encoded));
+        parsed = true;
+    } catch (const fjson::exception&) {
+    }
+    if (parsed)
+        BOOST_CHECK_EQUAL(jsondiff::json_dumps(decode_storage_value(encoded)), expected);
+    else
+        BOOST_CHECK_THROW(decode_storage_value(encoded), fjson::exception);
+}
+
+BOOST_FIXTURE_TEST_SUITE(contract_value_encoding_tests, BasicTestingSetup)
+
+BOOST_AUTO_TEST_CASE(value_encoding_tags)
+{
+    const std::vector<std::pair<JsonValue, int>> values = {
+        {JsonValue(), storage_value_tag_null},
+        {JsonValue((int64_t)-1), storage_value_tag_int},
+        {JsonValue(std::numeric_limits<int64_t>::min()), storage_value_tag_int},
+        {JsonValue((uint64_t)0), storage_value_tag_uint},
+        {JsonValue((int64_t)300), storage_value_tag_uint},
+        {JsonValue(std::numeric_limits<uint64_t>::max()), storage_value_tag_uint},
+        {JsonValue(1.5), storage_value_tag_number},
+        {JsonValue(-0.25), storage_value_tag_number},
+        {JsonValue(true), storage_value_tag_bool},
+        {JsonValue(false), storage_value_tag_bool},
+        {JsonValue(std::string()), storage_value_tag_string},
+        {JsonValue(std::string("hello \"world\"\t\n\\")), storage_value_tag_string},
+        {JsonValue(std::string("nul\0byte", 8)), storage_value_tag_string},
+        {JsonValue(JsonObject()), storage_value_tag_table},
+        {JsonValue(JsonArray()), storage_value_tag_array},
+    };
+    for (const auto& p : values) {
+        const auto& encoded = encode_storage_value(p.first);
+        BOOST_CHECK_EQUAL(encoded[0], CONTRACT_STORAGE_BINARY_VALUE_MAGIC);
+        BOOST_CHECK_EQUAL((int)(unsigned char)encoded[2], p.second);
+        check_round_trip(p.first);
+    }
+}
+
+BOOST_AUTO_TEST_CASE(value_encoding_nested)
+{
+    JsonObject inner;
+    inner("x", (int64_t)-7);
+    inner("y", JsonArray{JsonValue(1.25), JsonValue(), JsonValue(std::string("s"))});
+    JsonArray arr{JsonValue(inner), JsonValue(JsonArray()), JsonValue(JsonObject())};
+    JsonObject obj;
+    obj("b", true);
+    obj("a", arr);
+    obj("", std::string("empty key"));
+    check_round_trip(obj);
+
+    // the key order of tables is kept
+    const auto& decoded = decode_storage_value(encode_storage_value(obj));
+    BOOST_CHECK_EQUAL(jsondiff::json_dumps(decoded), "{\"b\":true,\"a\":[{\"x\":-7,\"y\":[1.25000000000000000,null,\"s\"]},[],{}],\"\":\"empty key\"}");
+}
+
+BOOST_AUTO_TEST_CASE(value_encoding_json_fallback)
+{
+    // the json text parser turns \a into a and can't read 0x04, the binary format must not change these
+    check_json_fallback(JsonValue(std::string("bell\a")));
+    check_json_fallback(JsonValue(std::string("eot\x04")));
+    JsonObject bad_key;
+    bad_key("k\a", 1);
+    check_json_fallback(bad_key);
+    JsonArray nested{JsonValue(1), JsonValue(std::string("\x04"))};
+    check_json_fallback(nested);
+
+    // doubles which aren't plain decimals keep their json text
+    check_json_fallback(JsonValue(std::numeric_limits<double>::infinity()));
+    check_json_fallback(JsonValue(-std::numeric_limits<double>::infinity()));
+    check_json_fallback(JsonValue(std::numeric_limits<double>::quiet_NaN()));
+
+    // doubles of integer values are saved as integers, as the json text parser reads them
+    const auto& encoded = encode_storage_value(JsonValue(2.0));
+    BOOST_CHECK(is_binary_storage_value(encoded));
+    BOOST_CHECK_EQUAL(jsondiff::json_dumps(decode_storage_value(encoded)), jsondiff::json_dumps(jsondiff::json_loads(jsondiff::json_dumps(JsonValue(2.0)))));
+}
+
+BOOST_AUTO_TEST_CASE(value_encoding_legacy_json)
+{
+    for (const std::string& text : {"null", "-12", "12", "1.5", "true", "\"str\"", "[]", "{}",
+                                    "{\"a\":1,\"b\":[true,null,\"x\",{\"c\":-2.5}]}"}) {
+        BOOST_CHECK(!is_binary_storage_value(text));
+        BOOST_CHECK_EQUAL(jsondiff::json_dumps(decode_storage_value(text)), jsondiff::json_dumps(jsondiff::json_loads(text)));
+    }
+}
+
+BOOST_AUTO_TEST_CASE(value_encoding_truncated)
+{
+    JsonObject obj;
+    obj("name", std::string("a long enough string"));
+    obj("items", JsonArray{JsonValue((int64_t)-1000000), JsonValue((uint64_t)1000000), JsonValue(0.5), JsonValue(false), JsonValue()});
+    const auto& encoded = encode_storage_value(obj);
+    BOOST_CHECK(is_binary_storage_value(encoded));
+    for (size_t size = 1; size < encoded.size(); size++) {
+        BOOST_CHECK_THROW(decode_storage_value(encoded.substr(0, size)), ContractStorageException);
+    }
+    BOOST_CHECK_THROW(decode_storage_value(encoded + '\0'), ContractStorageException);
+}
+
+BOOST_AUTO_TEST_CASE(value_encoding_corrupt)
+{
+    const std::string header = {CONTRACT_STORAGE_BINARY_VALUE_MAGIC, (char)CONTRACT_STORAGE_VALUE_FORMAT_VERSION};
+    // unknown version
+    BOOST_CHECK_THROW(decode_storage_value(std::string{CONTRACT_STORAGE_BINARY_VALUE_MAGIC, 2, storage_value_tag_null}), ContractStorageException);
+    // unknown tag
+    BOOST_CHECK_THROW(decode_storage_value(header + '\x07'), ContractStorageException);
+    // varint longer than 64 bits
+    BOOST_CHECK_THROW(decode_storage_value(header + (char)storage_value_tag_uint + std::string(10, '\xff') + '\x01'), ContractStorageException);
+    // string longer than the data
+    BOOST_CHECK_THROW(decode_storage_value(header + (char)storage_value_tag_string + '\x05' + "abc"), ContractStorageException);
+    // array with more items than the data
+    BOOST_CHECK_THROW(decode_storage_value(header + (char)storage_value_tag_array + '\x7f' + (char)storage_value_tag_null), ContractStorageException);
+}
+
+BOOST_AUTO_TEST_CASE(value_encoding_varint)
+{
+    for (uint64_t n : {(uint64_t)0, (uint64_t)0x7f, (uint64_t)0x80, (uint64_t)0x3fff, (uint64_t)0x4000, std::numeric_limits<uint64_t>::max()}) {
+        std::string out;
+        write_varint(out, n);
+        size_t pos = 0;
+        BOOST_CHECK_EQUAL(read_varint(out, pos), n);
+        BOOST_CHECK_EQUAL(pos, out.size());
+    }
+    std::string out;
+    write_bytes(out, "abc");
+    write_bytes(out, "");
+    size_t pos = 0;
+    BOOST_CHECK_EQUAL(read_bytes(out, pos), "abc");
+    BOOST_CHECK_EQUAL(read_bytes(out, pos), "");
+    BOOST_CHECK_EQUAL(pos, out.size());
+}
+
+BOOST_AUTO_TEST_SUITE_END()
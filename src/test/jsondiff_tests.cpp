@@ -0,0 +1,309 @@
+#include <jsondiff/jsondiff.h>
+#include <jsondiff/exceptions.h>
+#include <fjson/exception/exception.hpp>
+#include <test/test_bitcoin.h>
+
+#include <limits>
+#include <set>
+#include <sstream>
+
+#include <boost/test/unit_test.hpp>
+
+using namespace jsondiff;
+
+// json_dumps with the type of every scalar, json_dumps doesn't tell int64 from uint64 or double
+static void typed_dumps(std::ostream& os, const JsonValue& value)
+{
+    if (value.is_object()) {
+        os << "{";
+        for (const auto& item : value.get_object()) {
+            os << json_dumps(JsonValue(item.key())) << ":";
+            typed_dumps(os, item.value());
+            os << ",";
+        }
+        os << "}";
+    } else if (value.is_array()) {
+        os << "[";
+        for (const auto& item : value.get_array()) {
+            typed_dumps(os, item);
+            os << ",";
+        }
+        os << "]";
+    } else {
+        os << (int)value.get_type() << ":" << json_dumps(value);
+    }
+}
+
+static std::string typed_dumps(const JsonValue& value)
+{
+    std::ostringstream os;
+    typed_dumps(os, value);
+    return os.str();
+}
+
+// value nested depth times in objects(kind 0), arrays(kind 1) or both alternately(kind 2)
+static JsonValue make_nested(int depth, int kind, const JsonValue& leaf)
+{
+    JsonValue value = leaf;
+    for (int i = 0; i < depth; i++) {
+        if (kind == 1 || (kind == 2 && i % 2))
+            value = JsonArray{value};
+        else
+            value = JsonObject("k", value);
+    }
+    return value;
+}
+
+// old and new values of the diff cases
+static std::vector<std::pair<JsonValue, JsonValue>> make_diff_cases()
+{
+    std::vector<std::pair<JsonValue, JsonValue>> cases;
+    auto add_json = [&cases](const std::string& old_json, const std::string& new_json) {
+        cases.emplace_back(json_loads(old_json), json_loads(new_json));
+    };
+    // nested objects and arrays
+    add_json("{\"a\":1,\"b\":{\"c\":{\"d\":\"x\",\"e\":[1,2]},\"f\":true},\"g\":\"s\"}",
+             "{\"a\":2,\"b\":{\"c\":{\"d\":\"y\",\"e\":[1,2]},\"f\":true},\"h\":null}");
+    add_json("[1,[2,3],{\"a\":1},\"x\"]", "[1,[2,4],{\"a\":2},\"x\",5]");
+    add_json("[1,2,3]", "[1,3]");
+    add_json("[{\"a\":[1,{\"b\":2}]}]", "[{\"a\":[1,{\"b\":3}]}]");
+    add_json("{\"a\":[1,2]}", "{\"a\":{\"0\":1}}");
+    add_json("1", "{\"a\":1}");
+    add_json("null", "\"s\"");
+    add_json("{\"a\":{\"b\":1}}", "{\"a\":{\"b\":1}}");
+    add_json("{}", "{\"a\":[],\"b\":{}}");
+    add_json("[]", "[[]]");
+    // keys colliding with the diff format
+    add_json("{\"x\":1,\"x__deleted\":2,\"y\":{\"z\":1}}", "{\"x__added\":3,\"x__deleted\":{\"q\":1},\"y\":{\"z\":1,\"z__added\":2}}");
+    add_json("{\"__added\":1,\"__deleted\":2}", "{\"__added\":2,\"__deleted__added\":1}");
+    add_json("{\"__old\":1,\"__new\":2}", "{\"__old\":1}");
+    add_json("{\"a\":{\"__old\":1,\"__new\":2}}", "{\"a\":{\"__old\":3,\"__new\":2}}");
+    // duplicate keys
+    cases.emplace_back(JsonObject("k", 1)("k", 2)("j", 1), JsonObject("k", 3)("j", 1));
+    cases.emplace_back(JsonObject("j", 1), JsonObject("k", 1)("k", 1));
+    // int64, uint64 and double values
+    cases.emplace_back(JsonObject("a", (int64_t)5), JsonObject("a", (uint64_t)5));
+    cases.emplace_back(JsonObject("a", (int64_t)-1), JsonObject("a", std::numeric_limits<uint64_t>::max()));
+    cases.emplace_back(JsonArray{JsonValue(std::numeric_limits<int64_t>::min())}, JsonArray{JsonValue(std::numeric_limits<int64_t>::max())});
+    cases.emplace_back(JsonObject("a", 1.5), JsonObject("a", 2.5));
+    cases.emplace_back(JsonObject("a", 1.5), JsonObject("a", 1.5));
+    cases.emplace_back(JsonObject("a", 2.0), JsonObject("a", (int64_t)2));
+    cases.emplace_back(JsonValue((int64_t)7), JsonValue((uint64_t)7));
+    // escaped strings
+    cases.emplace_back(JsonObject("s", "a\tb\n\"c\\"), JsonObject("s", "a\tb\n\"c\\d")("t", "[{]}\a"));
+    return cases;
+}
+
+struct JsonDiffGolden
+{
+    std::string diff;
+    std::string patch;
+    std::string rollback;
+};
+
+// outputs of the JsonDiff implementation before diff and patch walked values structurally, for make_diff_cases.
+// diff is the diff text, patch and rollback the typed_dumps of their results. the array patches of that
+// implementation fail for some diffs of nested arrays, which has to stay that way as it is consensus
+static const std::vector<JsonDiffGolden> diff_goldens = {
+    {"{\"a\":{\"__old\":1,\"__new\":2},\"b\":{\"c\":{\"d\":{\"__old\":\"x\",\"__new\":\"y\"}}},\"g__deleted\":\"s\",\"h__added\":null}",
+     "{\"a\":2:2,\"b\":{\"c\":{\"d\":5:\"y\",\"e\":[2:1,2:2,],},\"f\":4:true,},\"h\":0:null,}",
+     "{\"a\":2:1,\"b\":{\"c\":{\"d\":5:\"x\",\"e\":[2:1,2:2,],},\"f\":4:true,},\"g\":5:\"s\",}"},
+    {"[[\"~\",1,[[\"~\",1,{\"__old\":3,\"__new\":4}]]],[\"~\",2,{\"a\":{\"__old\":1,\"__new\":2}}],[\"+\",4,5]]",
+     "JsonDiffException",
+     "JsonDiffException"},
+    {"[[\"~\",1,{\"__old\":2,\"__new\":3}],[\"-\",2,3]]",
+     "[2:1,2:3,]",
+     "[2:1,2:2,2:3,]"},
+    {"[[\"~\",0,{\"a\":[[\"~\",1,{\"b\":{\"__old\":2,\"__new\":3}}]]}]]",
+     "fjson::exception",
+     "fjson::exception"},
+    {"{\"a\":{\"__old\":[1,2],\"__new\":{\"0\":1}}}",
+     "{\"a\":{\"0\":2:1,},}",
+     "{\"a\":[2:1,2:2,],}"},
+    {"{\"__old\":1,\"__new\":{\"a\":1}}",
+     "{\"a\":2:1,}",
+     "2:1"},
+    {"{\"__old\":null,\"__new\":\"s\"}",
+     "5:\"s\"",
+     "0:null"},
+    {"null",
+     "{\"a\":{\"b\":2:1,},}",
+     "{\"a\":{\"b\":2:1,},}"},
+    {"{\"a__added\":[],\"b__added\":{}}",
+     "{\"a\":[],\"b\":{},}",
+     "{}"},
+    {"[[\"+\",0,[]]]",
+     "[[],]",
+     "[]"},
+    {"{\"x__deleted\":{\"__old\":2,\"__new\":{\"q\":1}},\"y\":{\"z__added__added\":2},\"x__added__added\":3}",
+     "JsonDiffException",
+     "JsonDiffException"},
+    {"{\"__added\":{\"__old\":1,\"__new\":2},\"__deleted__deleted\":2,\"__deleted__added__added\":1}",
+     "JsonDiffException",
+     "JsonDiffException"},
+    {"{\"__new__deleted\":2}",
+     "{\"__old\":2:1,}",
+     "{\"__old\":2:1,\"__new\":2:2,}"},
+    {"{\"a\":{\"__old\":{\"__old\":1,\"__new\":3}}}",
+     "{\"a\":{\"__old\":2:3,\"__new\":2:2,},}",
+     "{\"a\":{\"__old\":2:1,\"__new\":2:2,},}"},
+    {"{\"k\":{\"__old\":2,\"__new\":3}}",
+     "{\"k\":1:3,\"j\":2:1,}",
+     "{\"k\":1:2,\"j\":2:1,}"},
+    {"{\"j__deleted\":1,\"k__added\":1}",
+     "{\"k\":1:1,}",
+     "{\"j\":1:1,}"},
+    {"null",
+     "{\"a\":2:5,}",
+     "{\"a\":2:5,}"},
+    {"{\"a\":{\"__old\":-1,\"__new\":18446744073709551615}}",
+     "{\"a\":2:18446744073709551615,}",
+     "{\"a\":1:-1,}"},
+    {"[[\"~\",0,{\"__old\":-9223372036854775808,\"__new\":9223372036854775807}]]",
+     "[1:9223372036854775807,]",
+     "[1:-9223372036854775808,]"},
+    {"JsonDiffException",
+     "",
+     ""},
+    {"JsonDiffException",
+     "",
+     ""},
+    {"JsonDiffException",
+     "",
+     ""},
+    {"null",
+     "2:7",
+     "2:7"},
+    {"{\"s\":{\"__old\":\"a\\tb\\n\\\"c\\\\\",\"__new\":\"a\\tb\\n\\\"c\\\\d\"},\"t__added\":\"[{]}\\a\"}",
+     "{\"s\":5:\"a\\tb\\n\\\"c\\\\d\",\"t\":5:\"[{]}\\a\",}",
+     "{\"s\":5:\"a\\tb\\n\\\"c\\\\\",}"}
+};
+
+// typed_dumps of the result of f, or the type of the exception it throws
+template <typename F>
+static std::string run_typed(F f)
+{
+    try {
+        return f();
+    } catch (const JsonDiffException&) {
+        return "JsonDiffException";
+    } catch (const fjson::exception&) {
+        return "fjson::exception";
+    }
+}
+
+static bool has_duplicate_keys(const JsonValue& value)
+{
+    if (value.is_object()) {
+        std::set<std::string> keys;
+        for (const auto& item : value.get_object()) {
+            if (!keys.insert(item.key()).second || has_duplicate_keys(item.value()))
+                return true;
+        }
+    } else if (value.is_array()) {
+        for (const auto& item : value.get_array()) {
+            if (has_duplicate_keys(item))
+                return true;
+        }
+    }
+    return false;
+}
+
+BOOST_FIXTURE_TEST_SUITE(jsondiff_tests, BasicTestingSetup)
+
+BOOST_AUTO_TEST_CASE(jsondiff_golden)
+{
+    const auto& cases = make_diff_cases();
+    BOOST_REQUIRE_EQUAL(cases.size(), diff_goldens.size());
+    JsonDiff differ;
+    for (size_t i = 0; i < cases.size(); i++) {
+        const auto& c = cases[i];
+        DiffResultP diff;
+        BOOST_CHECK_EQUAL(run_typed([&] { diff = differ.diff(c.first, c.second); return diff->str(); }), diff_goldens[i].diff);
+        if (!diff)
+            continue;
+        BOOST_CHECK_EQUAL(run_typed([&] { return typed_dumps(differ.patch(c.first, diff)); }), diff_goldens[i].patch);
+        BOOST_CHECK_EQUAL(run_typed([&] { return typed_dumps(differ.rollback(c.second, diff)); }), diff_goldens[i].rollback);
+    }
+}
+
+BOOST_AUTO_TEST_CASE(jsondiff_patch_rollback)
+{
+    const auto& cases = make_diff_cases();
+    JsonDiff differ;
+    for (size_t i = 0; i < cases.size(); i++) {
+        const auto& c = cases[i];
+        const auto& golden = diff_goldens[i];
+        if (golden.patch.empty() || golden.patch == "JsonDiffException" || golden.patch == "fjson::exception" || has_duplicate_keys(c.first) || has_duplicate_keys(c.second))
+            continue;
+        const auto& diff = differ.diff(c.first, c.second);
+        BOOST_CHECK_EQUAL(json_dumps(differ.patch(differ.rollback(c.second, diff), diff)), json_dumps(c.second));
+        BOOST_CHECK_EQUAL(json_dumps(differ.rollback(differ.patch(c.first, diff), diff)), json_dumps(c.first));
+    }
+}
+
+BOOST_AUTO_TEST_CASE(jsondiff_nesting_depth)
+{
+    JsonDiff differ;
+    for (int depth = 97; depth <= 101; depth++) {
+        for (int kind = 0; kind < 3; kind++) {
+            const auto& old_json = make_nested(depth, kind, JsonValue((int64_t)1));
+            const auto& new_json = make_nested(depth, kind, JsonValue((int64_t)2));
+            // the diff of the leaf wrapped in the object and array diffs of each level
+            JsonValue expected_diff = JsonObject(JSONDIFF_KEY_OLD_VALUE, 1)(JSONDIFF_KEY_NEW_VALUE, 2);
+            for (int i = 0; i < depth; i++) {
+                if (kind == 1 || (kind == 2 && i % 2))
+                    expected_diff = JsonArray{JsonArray{JsonValue("~"), JsonValue(0), expected_diff}};
+                else
+                    expected_diff = JsonObject("k", expected_diff);
+            }
+            const auto& diff = differ.diff(old_json, new_json);
+            BOOST_CHECK_EQUAL(diff->str(), json_dumps(expected_diff));
+            // patch and rollback go through json text, which fails nested 100 objects or arrays deep
+            if (depth >= 100 && kind != 2) {
+                BOOST_CHECK_THROW(differ.patch(old_json, diff), fjson::exception);
+                BOOST_CHECK_THROW(differ.rollback(new_json, diff), fjson::exception);
+            } else {
+                BOOST_CHECK_EQUAL(typed_dumps(differ.patch(old_json, diff)), typed_dumps(new_json));
+                BOOST_CHECK_EQUAL(typed_dumps(differ.rollback(new_json, diff)), typed_dumps(old_json));
+            }
+        }
+    }
+}
+
+BOOST_AUTO_TEST_CASE(json_deep_clone_normalization)
+{
+    // json_deep_clone is json_loads(json_dumps(value)), without the text when it changes nothing
+    std::vector<JsonValue> values = {
+        JsonValue(),
+        JsonValue((int64_t)-1),
+        JsonValue((int64_t)0),
+        JsonValue((int64_t)5),
+        JsonValue(std::numeric_limits<int64_t>::min()),
+        JsonValue(std::numeric_limits<uint64_t>::max()),
+        JsonValue(1.5),
+        JsonValue(2.0),
+        JsonValue(true),
+        JsonValue("plain"),
+        JsonValue("bell\a"),
+        JsonValue("eot\x04"),
+        JsonValue("[{"),
+        JsonValue("}]"),
+        JsonValue("\t\n\r\\\""),
+        JsonObject("a", (int64_t)1)("b", JsonArray{JsonValue((int64_t)-2), JsonValue((int64_t)3), JsonValue(0.5)}),
+        JsonObject("k\a", 1),
+        JsonObject("}", 1),
+        JsonObject("k", 1)("k", 2),
+        JsonArray{JsonValue(JsonObject()), JsonValue(JsonArray()), JsonValue("x")},
+    };
+    for (int depth = 97; depth <= 101; depth++) {
+        for (int kind = 0; kind < 3; kind++)
+            values.push_back(make_nested(depth, kind, JsonValue((int64_t)1)));
+    }
+    for (const auto& value : values) {
+        BOOST_CHECK_EQUAL(run_typed([&] { return typed_dumps(json_deep_clone(value)); }),
+                          run_typed([&] { return typed_dumps(json_loads(json_dumps(value))); }));
+    }
+}
+
+BOOST_AUTO_TEST_SUITE_END()
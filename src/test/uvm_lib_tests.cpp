@@ -0,0 +1,164 @@
+#include <chainparams.h>
+#include <validation.h>
+#include <btc_uvm_api.h>
+#include <uvm/lprefix.h>
+#include <uvm/uvm_lib.h>
+#include <uvm/lauxlib.h>
+#include <uvm/lstate.h>
+#include <test/test_bitcoin.h>
+
+#include <boost/test/unit_test.hpp>
+
+static int gas(lua_State *L)
+{
+    lua_pushinteger(L, uvm::lua::lib::get_lua_state_instructions_executed_count(L));
+    return 1;
+}
+
+struct PairsRun
+{
+    std::string output; // what the code returns, or its error
+    int gas;
+    bool lua_loaded; // whether the lua version of pairsByKeys was loaded
+};
+
+static void init_uvm_chain_api()
+{
+    if (!uvm::lua::api::global_uvm_chain_api)
+        uvm::lua::api::global_uvm_chain_api = new uvm::lua::api::BtcUvmChainApi();
+}
+
+// runs code in a contract state whose live memory is capped at max_memory_size, gives what it returns or its error
+static std::string run_with_memory_limit(const std::string& code, size_t max_memory_size)
+{
+    init_uvm_chain_api();
+    uvm::lua::lib::UvmStateScope scope(true);
+    luaL_setarenamaxsize(scope.L(), max_memory_size);
+    std::string output = luaL_dostring(scope.L(), code.c_str()) == 0 ? "ok " : "error ";
+    if (lua_isstring(scope.L(), -1))
+        output += lua_tostring(scope.L(), -1);
+    return output;
+}
+
+// runs code in a contract state. without native, table.sort as opened is unknown so pairsByKeys always takes the lua path
+static PairsRun run_pairs(const std::string& code, bool native)
+{
+    init_uvm_chain_api();
+    uvm::lua::lib::UvmStateScope scope(true);
+    auto L = scope.L();
+    lua_pushcfunction(L, &gas);
+    lua_setglobal(L, "gas");
+    if (!native) {
+        lua_pushnil(L);
+        lua_setfield(L, LUA_REGISTRYINDEX, "uvm_pairs_by_keys_table_sort");
+    }
+    // record(k, v) logs an iteration step with the gas used so far
+    const std::string prelude = "local log = {} "
+                                "local function str(x) if type(x) == 'table' then return 'table' end return tostring(x) end "
+                                "local function record(k, v) log[#log + 1] = str(k) .. '=' .. str(v) .. '@' .. gas() end "
+                                "local function result() return table.concat(log, ',') end ";
+    PairsRun run;
+    run.output = luaL_dostring(L, (prelude + code).c_str()) == 0 ? "ok " : "error ";
+    if (lua_isstring(L, -1))
+        run.output += lua_tostring(L, -1);
+    run.gas = scope.get_instructions_executed_count();
+    lua_getglobal(L, "__real_pairs_by_keys_func");
+    run.lua_loaded = lua_isfunction(L, -1);
+    lua_pop(L, 1);
+    return run;
+}
+
+// the native path must iterate the same keys and values and charge the same gas as the lua path
+static void check_pairs(const std::string& code, bool runs_natively = true)
+{
+    const auto& native = run_pairs(code, true);
+    const auto& lua = run_pairs(code, false);
+    BOOST_CHECK_MESSAGE(native.output == lua.output, code + "\nnative: " + native.output + "\nlua: " + lua.output);
+    BOOST_CHECK_MESSAGE(native.gas == lua.gas, code + "\nnative gas: " + std::to_string(native.gas) + ", lua gas: " + std::to_string(lua.gas));
+    BOOST_CHECK_MESSAGE(native.lua_loaded == !runs_natively, code);
+    BOOST_CHECK(lua.lua_loaded);
+}
+
+BOOST_FIXTURE_TEST_SUITE(uvm_lib_tests, BasicTestingSetup)
+
+BOOST_AUTO_TEST_CASE(pairs_by_keys_order)
+{
+    check_pairs("for k, v in pairs({}) do record(k, v) end return result()");
+    check_pairs("for k, v in pairs({3, 2, 1}) do record(k, v) end return result()");
+    check_pairs("local t = {10, 20, 30, x = 1, yy = 2, [2.5] = 3, [-1] = 4, ['10'] = 5, [''] = 6, ab = 7, b = 8, B = 9, ['a b'] = 10} "
+                "t[100] = 11 t[-0.5] = 12 t[1e300] = 13 t[math.mininteger] = 14 "
+                "for k, v in pairs(t) do record(k, v) end return result()");
+    check_pairs("local t = {} for i = 1, 300 do t['k' .. (i * 7919 % 1000)] = i t[i * 7919 % 1000] = -i end "
+                "for k, v in pairs(t) do record(k, v) end return result()");
+    // values of any type, nested and early-ending iterations
+    check_pairs("local t = {a = {1}, b = true, c = 'x', d = 1.5, [1] = false} "
+                "for k, v in pairs(t) do record(k, v) for k2, v2 in pairs(t) do record(k2, v2) if k2 == 'b' then break end end end "
+                "return result()");
+    check_pairs("local n = 0 for r = 1, 10 do for k, v in pairs({x = r, [r] = r}) do n = n + v end end record('n', n) return result()");
+}
+
+BOOST_AUTO_TEST_CASE(pairs_by_keys_changes)
+{
+    // deleting the current key, later keys and adding keys while iterating
+    check_pairs("local t = {1, 2, 3, a = 1, b = 2, c = 3, d = 4} "
+                "for k, v in pairs(t) do record(k, v) t[k] = nil if k == 'a' then t.c = nil t.e = 5 t[2] = nil end end "
+                "for k, v in pairs(t) do record(k, v) end return result()");
+    check_pairs("local t = {a = 1, b = 2} for k, v in pairs(t) do t[k] = v * 10 record(k, t[k]) end return result()");
+}
+
+BOOST_AUTO_TEST_CASE(pairs_by_keys_metatables)
+{
+    // t[key] reads through __index for keys deleted while iterating
+    check_pairs("local t = setmetatable({a = 1, b = 2, [1] = 3}, {__index = function(t, k) return 'index ' .. tostring(k) end}) "
+                "for k, v in pairs(t) do record(k, v) t.b = nil t[1] = nil end return result()");
+    check_pairs("local t = setmetatable({a = 1, b = 2}, {__index = {b = 'b from index'}}) "
+                "for k, v in pairs(t) do record(k, v) t.b = nil end return result()");
+    check_pairs("local t = setmetatable({a = 1, b = 2}, {__index = function(t, k) error('no ' .. k) end}) "
+                "for k, v in pairs(t) do record(k, v) t.b = nil end return result()");
+    // __newindex and __len don't change the iteration
+    check_pairs("local t = setmetatable({a = 1, b = 2}, {__newindex = function(t, k, v) rawset(t, k, v) end, __len = function() return 7 end}) "
+                "for k, v in pairs(t) do record(k, v) end return result()");
+}
+
+BOOST_AUTO_TEST_CASE(pairs_by_keys_fallback)
+{
+    // pairsByKeys falls back to the lua version for __pairs, keys other than numbers and strings, non table arguments
+    // and a replaced table.sort
+    check_pairs("local t = setmetatable({a = 1}, {__pairs = function(t) return next, {z = 1, y = 2}, nil end}) "
+                "for k, v in pairs(t) do record(k, v) end return result()", false);
+    check_pairs("local t = {a = 1, [true] = 2, [false] = 3, [1] = 4} for k, v in pairs(t) do record(k, v) end return result()", false);
+    check_pairs("local t = {a = 1, [{}] = 2} local n = 0 for k, v in pairs(t) do n = n + 1 end record('n', n) return result()", false);
+    check_pairs("for k, v in pairs('abc') do record(k, v) end return result()", false);
+    check_pairs("for k, v in pairs(nil) do record(k, v) end return result()", false);
+    check_pairs("local sort = table.sort table.sort = function(a) sort(a, function(x, y) return x > y end) end "
+                "for k, v in pairs({1, 2, a = 1, b = 2}) do record(k, v) end return result()", false);
+    // the load gas is charged once, whichever path runs first
+    check_pairs("for k, v in pairs({[true] = 1, a = 2}) do record(k, v) end "
+                "for k, v in pairs({a = 1, [2] = 2}) do record(k, v) end return result()", false);
+    check_pairs("for k, v in pairs({a = 1, [2] = 2}) do record(k, v) end "
+                "for k, v in pairs({[true] = 1, a = 2}) do record(k, v) end "
+                "for k, v in pairs({b = 1}) do record(k, v) end return result()", false);
+}
+
+BOOST_AUTO_TEST_CASE(contract_memory_limit_fork)
+{
+    const auto& params = Params().GetConsensus();
+    const int fork_height = params.CONTRACT_MEMORY_LIMIT_Height;
+    BOOST_CHECK_EQUAL(GetContractMaxMemorySize(fork_height - 1, params), std::numeric_limits<size_t>::max());
+    BOOST_CHECK_EQUAL(GetContractMaxMemorySize(fork_height, params), (size_t)LUA_STATE_MAX_MEMORY_SIZE);
+
+    // a contract keeping more than LUA_STATE_MAX_MEMORY_SIZE alive runs below the fork height and fails as out of memory from it
+    const std::string big = "local s = string.rep('x', 1024) for i = 1, 14 do s = s .. s end "
+                            "local t = {} for i = 1, 20 do t[i] = s .. i end return #t";
+    BOOST_CHECK_EQUAL(run_with_memory_limit(big, GetContractMaxMemorySize(fork_height - 1, params)), "ok 20");
+    for (int height : {fork_height, fork_height + 1}) {
+        const auto& output = run_with_memory_limit(big, GetContractMaxMemorySize(height, params));
+        BOOST_CHECK_MESSAGE(output.find("error ") == 0 && output.find("not enough memory") != std::string::npos, output);
+    }
+    // memory the contract freed doesn't count
+    const std::string churn = "local s = string.rep('x', 1024) for i = 1, 14 do s = s .. s end "
+                              "local n = 0 for i = 1, 20 do n = n + #(s .. i) end return n";
+    BOOST_CHECK_EQUAL(run_with_memory_limit(churn, GetContractMaxMemorySize(fork_height, params)), "ok " + std::to_string(20 * 16 * 1024 * 1024 + 31));
+}
+
+BOOST_AUTO_TEST_SUITE_END()
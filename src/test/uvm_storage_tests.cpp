@@ -0,0 +1,160 @@
+#include <uvm/uvm_api.h>
+#include <jsondiff/jsondiff.h>
+#include <jsondiff/exceptions.h>
+#include <fjson/exception/exception.hpp>
+#include <test/test_bitcoin.h>
+
+#include <list>
+
+#include <boost/test/unit_test.hpp>
+
+using uvm::blockchain::StorageValueTypes;
+
+// owns the strings and tables of the storage values it makes
+class StorageValues
+{
+private:
+    std::list<std::string> strings;
+    std::list<UvmTableMap> tables;
+
+public:
+    UvmStorageValue integer(lua_Integer value)
+    {
+        UvmStorageValue result;
+        result.type = StorageValueTypes::storage_value_int;
+        result.value.int_value = value;
+        return result;
+    }
+    UvmStorageValue number(lua_Number value)
+    {
+        UvmStorageValue result;
+        result.type = StorageValueTypes::storage_value_number;
+        result.value.number_value = value;
+        return result;
+    }
+    UvmStorageValue boolean(bool value)
+    {
+        UvmStorageValue result;
+        result.type = StorageValueTypes::storage_value_bool;
+        result.value.bool_value = value;
+        return result;
+    }
+    UvmStorageValue string(const std::string& value)
+    {
+        strings.push_back(value);
+        return UvmStorageValue::from_string(const_cast<char*>(strings.back().c_str()));
+    }
+    UvmStorageValue table(StorageValueTypes type, const std::vector<std::pair<std::string, UvmStorageValue>>& items)
+    {
+        tables.emplace_back();
+        for (const auto& item : items)
+            tables.back()[item.first] = item.second;
+        UvmStorageValue result;
+        result.type = type;
+        result.value.table_value = &tables.back();
+        return result;
+    }
+};
+
+// the diff text, "undefined" or the exception JsonDiff::diff throws
+template <typename F>
+static std::string diff_str(F f)
+{
+    try {
+        const auto& diff = f();
+        return diff->is_undefined() ? "undefined" : diff->str();
+    } catch (const jsondiff::JsonDiffException&) {
+        return "JsonDiffException";
+    } catch (const fjson::exception&) {
+        return "fjson::exception";
+    }
+}
+
+// uvm_storage_value_diff must be the diff of the json values of the storages
+static std::string check_storage_diff(const UvmStorageValue& before, const UvmStorageValue& after)
+{
+    jsondiff::JsonDiff json_diff;
+    const auto& expected = diff_str([&] { return json_diff.diff(uvm_storage_value_to_json(before), uvm_storage_value_to_json(after)); });
+    const auto& diff = diff_str([&] { return uvm_storage_value_diff(before, after); });
+    BOOST_CHECK_EQUAL(diff, expected);
+    return diff;
+}
+
+BOOST_FIXTURE_TEST_SUITE(uvm_storage_tests, BasicTestingSetup)
+
+BOOST_AUTO_TEST_CASE(uvm_storage_diff_table)
+{
+    StorageValues v;
+    const auto type = StorageValueTypes::storage_value_int_table;
+    const auto& before = v.table(type, {{"a", v.integer(1)}, {"b", v.integer(2)}, {"cc", v.integer(3)}, {"ddd", v.integer(4)}});
+    // unchanged
+    BOOST_CHECK_EQUAL(check_storage_diff(before, v.table(type, {{"ddd", v.integer(4)}, {"cc", v.integer(3)}, {"b", v.integer(2)}, {"a", v.integer(1)}})), "undefined");
+    // added, removed and changed keys
+    check_storage_diff(before, v.table(type, {{"a", v.integer(1)}, {"b", v.integer(2)}, {"cc", v.integer(3)}, {"ddd", v.integer(4)}, {"e", v.integer(5)}, {"ffff", v.integer(6)}}));
+    check_storage_diff(before, v.table(type, {{"b", v.integer(2)}, {"ddd", v.integer(4)}}));
+    check_storage_diff(before, v.table(type, {{"a", v.integer(-1)}, {"b", v.integer(2)}, {"cc", v.integer(30)}, {"ddd", v.integer(4)}}));
+    check_storage_diff(before, v.table(type, {{"b", v.integer(20)}, {"c", v.integer(3)}, {"ddd", v.integer(4)}, {"eeeee", v.integer(5)}}));
+    check_storage_diff(before, v.table(type, {}));
+    check_storage_diff(v.table(type, {}), before);
+    // keys colliding with the diff format
+    check_storage_diff(v.table(type, {{"x", v.integer(1)}, {"x__deleted", v.integer(2)}}), v.table(type, {{"x__added", v.integer(1)}, {"x__deleted", v.integer(3)}}));
+
+    const auto string_type = StorageValueTypes::storage_value_string_table;
+    check_storage_diff(v.table(string_type, {{"k", v.string("a\tb\n\"c\\")}, {"l", v.string("")}}), v.table(string_type, {{"k", v.string("a\tb\n\"c\\d")}, {"m", v.string("x")}}));
+    const auto bool_type = StorageValueTypes::storage_value_bool_table;
+    check_storage_diff(v.table(bool_type, {{"k", v.boolean(true)}, {"l", v.boolean(false)}}), v.table(bool_type, {{"k", v.boolean(false)}, {"l", v.boolean(false)}}));
+    const auto unknown_type = StorageValueTypes::storage_value_unknown_table;
+    check_storage_diff(v.table(unknown_type, {{"k", v.integer(1)}, {"l", v.string("1")}, {"m", UvmStorageValue()}}),
+                       v.table(unknown_type, {{"k", v.string("1")}, {"l", v.integer(1)}, {"m", v.boolean(true)}, {"n", UvmStorageValue()}}));
+}
+
+BOOST_AUTO_TEST_CASE(uvm_storage_diff_nested)
+{
+    StorageValues v;
+    const auto table_type = StorageValueTypes::storage_value_unknown_table;
+    const auto array_type = StorageValueTypes::storage_value_unknown_array;
+    const auto& inner = v.table(StorageValueTypes::storage_value_int_table, {{"x", v.integer(1)}, {"y", v.integer(2)}});
+    const auto& inner_changed = v.table(StorageValueTypes::storage_value_int_table, {{"x", v.integer(1)}, {"y", v.integer(3)}, {"z", v.integer(4)}});
+    const auto& list = v.table(StorageValueTypes::storage_value_string_array, {{"1", v.string("a")}, {"2", v.string("b")}});
+    const auto& before = v.table(table_type, {{"inner", inner}, {"list", list}, {"n", v.integer(1)}});
+    check_storage_diff(before, v.table(table_type, {{"inner", inner_changed}, {"list", list}, {"n", v.integer(1)}}));
+    check_storage_diff(before, v.table(table_type, {{"inner", inner}, {"list", inner}, {"n", v.integer(1)}}));
+    check_storage_diff(before, v.table(table_type, {{"inner", v.integer(1)}, {"list", list}}));
+    check_storage_diff(before, v.table(table_type, {{"inner", inner}, {"list", v.table(array_type, {{"1", v.string("a")}, {"2", v.integer(2)}, {"3", inner}})}, {"n", v.integer(1)}}));
+    BOOST_CHECK_EQUAL(check_storage_diff(before, v.table(table_type, {{"list", list}, {"n", v.integer(1)}, {"inner", inner}})), "undefined");
+
+    // arrays diff by position
+    const auto& array = v.table(array_type, {{"1", inner}, {"2", v.integer(2)}, {"3", v.string("s")}});
+    check_storage_diff(array, v.table(array_type, {{"1", inner_changed}, {"2", v.integer(2)}, {"3", v.string("s")}}));
+    check_storage_diff(array, v.table(array_type, {{"1", inner}, {"2", v.integer(2)}}));
+    check_storage_diff(array, v.table(array_type, {{"1", inner}, {"2", v.integer(2)}, {"3", v.string("s")}, {"4", list}, {"5", v.integer(5)}}));
+    check_storage_diff(array, v.table(array_type, {}));
+    // tables changing between arrays and tables, and to or from scalars
+    check_storage_diff(array, v.table(table_type, {{"1", inner}, {"2", v.integer(2)}, {"3", v.string("s")}}));
+    check_storage_diff(before, UvmStorageValue());
+    check_storage_diff(UvmStorageValue(), before);
+    check_storage_diff(v.integer(1), v.integer(2));
+}
+
+BOOST_AUTO_TEST_CASE(uvm_storage_diff_numbers)
+{
+    // JsonDiff::diff throws on compared doubles, diffing the tables falls back to the diff of the whole json
+    StorageValues v;
+    const auto type = StorageValueTypes::storage_value_number_table;
+    const auto& before = v.table(type, {{"a", v.number(1.5)}, {"b", v.number(2.5)}});
+    check_storage_diff(before, v.table(type, {{"a", v.number(1.5)}, {"b", v.number(2.5)}}));
+    check_storage_diff(before, v.table(type, {{"a", v.number(1.5)}, {"b", v.number(3.5)}}));
+    check_storage_diff(before, v.table(type, {{"b", v.number(2.5)}, {"c", v.number(0.5)}}));
+    check_storage_diff(before, v.table(type, {{"c", v.number(0.5)}}));
+    check_storage_diff(before, v.table(type, {}));
+    const auto unknown_type = StorageValueTypes::storage_value_unknown_table;
+    check_storage_diff(v.table(unknown_type, {{"a", v.integer(1)}, {"b", v.number(2.5)}}), v.table(unknown_type, {{"a", v.integer(2)}, {"b", v.number(2.5)}}));
+    check_storage_diff(v.table(unknown_type, {{"a", v.integer(1)}, {"b", v.number(2.5)}}), v.table(unknown_type, {{"a", v.integer(1)}, {"b", v.integer(2)}}));
+    check_storage_diff(v.table(unknown_type, {{"a", v.number(2)}}), v.table(unknown_type, {{"a", v.integer(2)}}));
+    const auto& nested = v.table(unknown_type, {{"t", before}, {"n", v.integer(1)}});
+    check_storage_diff(nested, v.table(unknown_type, {{"t", before}, {"n", v.integer(2)}}));
+    const auto array_type = StorageValueTypes::storage_value_number_array;
+    check_storage_diff(v.table(array_type, {{"1", v.number(0.5)}, {"2", v.number(1.5)}}), v.table(array_type, {{"1", v.number(0.5)}, {"2", v.number(2.5)}, {"3", v.number(3.5)}}));
+}
+
+BOOST_AUTO_TEST_SUITE_END()
@@ -21,12 +21,18 @@
 
 CTxMemPoolEntry::CTxMemPoolEntry(const CTransactionRef& _tx, const CAmount& _nFee,
                                  int64_t _nTime, unsigned int _entryHeight,
-                                 bool _spendsCoinbase, int64_t _sigOpsCost, LockPoints lp, CAmount _nMinGasPrice):
+                                 bool _spendsCoinbase, int64_t _sigOpsCost, LockPoints lp, CAmount _nMinGasPrice,
+                                 std::vector<std::string> _contractAddresses):
     tx(_tx), nFee(_nFee), nTime(_nTime), entryHeight(_entryHeight),
-    spendsCoinbase(_spendsCoinbase), sigOpCost(_sigOpsCost), lockPoints(lp), nMinGasPrice(_nMinGasPrice)
+    spendsCoinbase(_spendsCoinbase), sigOpCost(_sigOpsCost), lockPoints(lp), nMinGasPrice(_nMinGasPrice),
+    contractAddresses(std::move(_contractAddresses))
 {
+    std::sort(contractAddresses.begin(), contractAddresses.end());
+    contractAddresses.erase(std::unique(contractAddresses.begin(), contractAddresses.end()), contractAddresses.end());
     nTxWeight = GetTransactionWeight(*tx);
-    nUsageSize = RecursiveDynamicUsage(tx);
+    nUsageSize = RecursiveDynamicUsage(tx) + memusage::DynamicUsage(contractAddresses);
+    for (const std::string& address : contractAddresses)
+        nUsageSize += memusage::MallocUsage(address.capacity());
 
     nCountWithDescendants = 1;
     nSizeWithDescendants = GetTxSize();
@@ -414,6 +420,11 @@ bool CTxMemPool::addUnchecked(const uint256& hash, const CTxMemPoolEntry &entry,
     vTxHashes.emplace_back(tx.GetWitnessHash(), newit);
     newit->vTxHashesIdx = vTxHashes.size() - 1;
 
+    for (const std::string& address : entry.GetContractAddresses()) {
+        if (mapContractTxs[address].insert(newit).second)
+            cachedInnerUsage += memusage::IncrementalDynamicUsage(mapContractTxs[address]);
+    }
+
     return true;
 }
 
@@ -433,6 +444,16 @@ void CTxMemPool::removeUnchecked(txiter it, MemPoolRemovalReason reason)
     } else
         vTxHashes.clear();
 
+    for (const std::string& address : it->GetContractAddresses()) {
+        auto contractit = mapContractTxs.find(address);
+        if (contractit == mapContractTxs.end())
+            continue;
+        if (contractit->second.erase(it))
+            cachedInnerUsage -= memusage::IncrementalDynamicUsage(contractit->second);
+        if (contractit->second.empty())
+            mapContractTxs.erase(contractit);
+    }
+
     totalTxSize -= it->GetTxSize();
     cachedInnerUsage -= it->DynamicMemoryUsage();
     cachedInnerUsage -= memusage::DynamicUsage(mapLinks[it].parents) + memusage::DynamicUsage(mapLinks[it].children);
@@ -598,6 +619,7 @@ void CTxMemPool::_clear()
     mapLinks.clear();
     mapTx.clear();
     mapNextTx.clear();
+    mapContractTxs.clear();
     totalTxSize = 0;
     cachedInnerUsage = 0;
     lastRollingFeeUpdate = GetTime();
@@ -648,6 +670,13 @@ void CTxMemPool::check(const CCoinsViewCache *pcoins) const
         assert(linksiter != mapLinks.end());
         const TxLinks &links = linksiter->second;
         innerUsage += memusage::DynamicUsage(links.parents) + memusage::DynamicUsage(links.children);
+        // Check that the contracts of the tx are indexed in mapContractTxs.
+        for (const std::string& address : it->GetContractAddresses()) {
+            auto contractit = mapContractTxs.find(address);
+            assert(contractit != mapContractTxs.end());
+            assert(contractit->second.count(it));
+            innerUsage += memusage::IncrementalDynamicUsage(contractit->second);
+        }
         bool fDependsWait = false;
         setEntries setParentCheck;
         int64_t parentSizes = 0;
@@ -738,6 +767,13 @@ void CTxMemPool::check(const CCoinsViewCache *pcoins) const
         assert(it2 != mapTx.end());
         assert(&tx == it->second);
     }
+    for (const auto& contractTxs : mapContractTxs) {
+        assert(!contractTxs.second.empty());
+        for (txiter contractit : contractTxs.second) {
+            const std::vector<std::string>& addresses = contractit->GetContractAddresses();
+            assert(std::binary_search(addresses.begin(), addresses.end(), contractTxs.first));
+        }
+    }
 
     assert(totalTxSize == checkTotal);
     assert(innerUsage == cachedInnerUsage);
@@ -912,7 +948,7 @@ bool CCoinsViewMemPool::GetCoin(const COutPoint &outpoint, Coin &coin) const {
 size_t CTxMemPool::DynamicMemoryUsage() const {
     LOCK(cs);
     // Estimate the overhead of mapTx to be 15 pointers + an allocation, as no exact formula for boost::multi_index_contained is implemented.
-    return memusage::MallocUsage(sizeof(CTxMemPoolEntry) + 15 * sizeof(void*)) * mapTx.size() + memusage::DynamicUsage(mapNextTx) + memusage::DynamicUsage(mapDeltas) + memusage::DynamicUsage(mapLinks) + memusage::DynamicUsage(vTxHashes) + cachedInnerUsage;
+    return memusage::MallocUsage(sizeof(CTxMemPoolEntry) + 15 * sizeof(void*)) * mapTx.size() + memusage::DynamicUsage(mapNextTx) + memusage::DynamicUsage(mapDeltas) + memusage::DynamicUsage(mapLinks) + memusage::DynamicUsage(vTxHashes) + memusage::DynamicUsage(mapContractTxs) + cachedInnerUsage;
 }
 
 void CTxMemPool::RemoveStaged(setEntries &stage, bool updateDescendants, MemPoolRemovalReason reason) {
@@ -1067,4 +1103,10 @@ bool CTxMemPool::TransactionWithinChainLimit(const uint256& txid, size_t chainLi
        it->GetCountWithDescendants() < chainLimit);
 }
 
+size_t CTxMemPool::CountContractTxs(const std::string& contractAddress) const {
+    LOCK(cs);
+    auto it = mapContractTxs.find(contractAddress);
+    return it == mapContractTxs.end() ? 0 : it->second.size();
+}
+
 SaltedTxidHasher::SaltedTxidHasher() : k0(GetRand(std::numeric_limits<uint64_t>::max())), k1(GetRand(std::numeric_limits<uint64_t>::max())) {}
@@ -23,6 +23,7 @@
 #include <vector>
 #include <stack>
 #include <algorithm>
+#include <mutex>
 
 
 /* This file uses only the official API of Lua.
@@ -1169,7 +1170,7 @@ static bool contract_table_traverser_to_wrap_api(lua_State *L, void *ud)
 
 static bool lua_get_contract_apis_direct(lua_State *L, UvmModuleByteStream *stream, char *error)
 {
-    int *stopped_pointer = uvm::lua::lib::get_lua_state_value(L, LUA_STATE_STOP_TO_RUN_IN_LVM_STATE_MAP_KEY).int_pointer_value;
+    int *stopped_pointer = uvm::lua::lib::get_lua_state_slot_value(L, UVM_STATE_SLOT_STOP_TO_RUN_IN_LVM).int_pointer_value;
     if (nullptr != stopped_pointer && (*stopped_pointer) > 0)
         return false;
     intptr_t stream_p = (intptr_t)stream;
@@ -2874,6 +2875,209 @@ static void *l_alloc(void *ud, void *ptr, size_t osize, size_t nsize) {
 }
 
 
+/*
+** {======================================================
+** Arena allocator of contract states
+** =======================================================
+*/
+
+/*
+** blocks up to LUAL_ARENA_SMALL_SIZE bytes are rounded up to a size class and carved
+** out of chunks owned by the state, freed blocks go to the free list of their class.
+** bigger blocks are malloced with a header linking them to the state. so the state
+** doesn't share malloc with the other threads running contracts for most blocks, and
+** all of its memory is given back when it is closed, even blocks it never freed
+*/
+#define LUAL_ARENA_CHUNK_SIZE	(64*1024)
+#define LUAL_ARENA_SMALL_SIZE	512
+#define LUAL_ARENA_CLASS_SIZE	16
+#define LUAL_ARENA_NUM_CLASSES	(LUAL_ARENA_SMALL_SIZE / LUAL_ARENA_CLASS_SIZE)
+/* chunks of closed arenas kept for the next ones */
+#define LUAL_ARENA_CHUNK_POOL_SIZE	256
+
+typedef struct ArenaFreeBlock {
+    struct ArenaFreeBlock *next;
+} ArenaFreeBlock;
+
+typedef struct ArenaBigBlock {
+    struct ArenaBigBlock *prev;
+    struct ArenaBigBlock *next;
+} ArenaBigBlock;
+
+static_assert(sizeof(ArenaBigBlock) % LUAL_ARENA_CLASS_SIZE == 0, "big block header breaks alignment");
+
+typedef struct LuaArena {
+    size_t max_size;
+    size_t used_size; /* sum of the requested sizes of live blocks */
+    ArenaFreeBlock *free_blocks[LUAL_ARENA_NUM_CLASSES];
+    char *chunk_pos;
+    char *chunk_end;
+    std::vector<void*> chunks;
+    ArenaBigBlock big_blocks; /* sentinel of the big blocks list */
+} LuaArena;
+
+static std::mutex arena_chunk_pool_mutex;
+static std::vector<void*> arena_chunk_pool;
+
+static void *acquire_arena_chunk() {
+    {
+        std::lock_guard<std::mutex> lock(arena_chunk_pool_mutex);
+        if (!arena_chunk_pool.empty()) {
+            void *chunk = arena_chunk_pool.back();
+            arena_chunk_pool.pop_back();
+            return chunk;
+        }
+    }
+    return malloc(LUAL_ARENA_CHUNK_SIZE);
+}
+
+static void release_arena_chunks(std::vector<void*> &chunks) {
+    size_t i = 0;
+    {
+        std::lock_guard<std::mutex> lock(arena_chunk_pool_mutex);
+        for (; i < chunks.size() && arena_chunk_pool.size() < LUAL_ARENA_CHUNK_POOL_SIZE; i++)
+            arena_chunk_pool.push_back(chunks[i]);
+    }
+    for (; i < chunks.size(); i++)
+        free(chunks[i]);
+    chunks.clear();
+}
+
+static bool arena_is_small(size_t size) {
+    return size <= LUAL_ARENA_SMALL_SIZE;
+}
+
+static int arena_class(size_t size) {
+    return (int)((size + LUAL_ARENA_CLASS_SIZE - 1) / LUAL_ARENA_CLASS_SIZE) - 1;
+}
+
+static void *arena_alloc_small(LuaArena *arena, size_t size) {
+    int c = arena_class(size);
+    ArenaFreeBlock *block = arena->free_blocks[c];
+    if (block) {
+        arena->free_blocks[c] = block->next;
+        return block;
+    }
+    size_t class_size = (size_t)(c + 1) * LUAL_ARENA_CLASS_SIZE;
+    if ((size_t)(arena->chunk_end - arena->chunk_pos) < class_size) {
+        /* the tail of the old chunk is lost, it is smaller than a block */
+        char *chunk = (char*)acquire_arena_chunk();
+        if (nullptr == chunk)
+            return nullptr;
+        arena->chunks.push_back(chunk);
+        arena->chunk_pos = chunk;
+        arena->chunk_end = chunk + LUAL_ARENA_CHUNK_SIZE;
+    }
+    void *p = arena->chunk_pos;
+    arena->chunk_pos += class_size;
+    return p;
+}
+
+static void arena_free_small(LuaArena *arena, void *ptr, size_t size) {
+    int c = arena_class(size);
+    ArenaFreeBlock *block = (ArenaFreeBlock*)ptr;
+    block->next = arena->free_blocks[c];
+    arena->free_blocks[c] = block;
+}
+
+static void arena_link_big(LuaArena *arena, ArenaBigBlock *block) {
+    block->prev = &arena->big_blocks;
+    block->next = arena->big_blocks.next;
+    block->next->prev = block;
+    arena->big_blocks.next = block;
+}
+
+static void arena_unlink_big(ArenaBigBlock *block) {
+    block->prev->next = block->next;
+    block->next->prev = block->prev;
+}
+
+static void *arena_alloc_big(LuaArena *arena, size_t size) {
+    ArenaBigBlock *block = (ArenaBigBlock*)malloc(sizeof(ArenaBigBlock) + size);
+    if (nullptr == block)
+        return nullptr;
+    arena_link_big(arena, block);
+    return block + 1;
+}
+
+static void arena_free_big(void *ptr) {
+    ArenaBigBlock *block = (ArenaBigBlock*)ptr - 1;
+    arena_unlink_big(block);
+    free(block);
+}
+
+static void *arena_realloc_big(LuaArena *arena, void *ptr, size_t size) {
+    ArenaBigBlock *block = (ArenaBigBlock*)ptr - 1;
+    arena_unlink_big(block);
+    ArenaBigBlock *newblock = (ArenaBigBlock*)realloc(block, sizeof(ArenaBigBlock) + size);
+    if (nullptr == newblock) {
+        arena_link_big(arena, block);
+        return nullptr;
+    }
+    arena_link_big(arena, newblock);
+    return newblock + 1;
+}
+
+static void *arena_alloc(LuaArena *arena, size_t size) {
+    return arena_is_small(size) ? arena_alloc_small(arena, size) : arena_alloc_big(arena, size);
+}
+
+static void arena_free(LuaArena *arena, void *ptr, size_t size) {
+    if (arena_is_small(size))
+        arena_free_small(arena, ptr, size);
+    else
+        arena_free_big(ptr);
+}
+
+/*
+** the cap counts the sizes lua asks for, not what the arena takes for them, so an
+** allocation over it fails at the same point of a contract on every node
+*/
+static void *l_arena_alloc(void *ud, void *ptr, size_t osize, size_t nsize) {
+    LuaArena *arena = (LuaArena*)ud;
+    if (nullptr == ptr)
+        osize = 0;  /* 'osize' is the type of the new object */
+    if (nsize == 0) {
+        if (ptr) {
+            arena_free(arena, ptr, osize);
+            arena->used_size -= osize;
+        }
+        return nullptr;
+    }
+    if (nsize > osize && nsize - osize > arena->max_size - arena->used_size)
+        return nullptr;
+    void *newptr;
+    if (nullptr == ptr) {
+        newptr = arena_alloc(arena, nsize);
+    }
+    else if (arena_is_small(osize) && arena_is_small(nsize) && arena_class(osize) == arena_class(nsize)) {
+        newptr = ptr;
+    }
+    else if (!arena_is_small(osize) && !arena_is_small(nsize)) {
+        newptr = arena_realloc_big(arena, ptr, nsize);
+    }
+    else {
+        newptr = arena_alloc(arena, nsize);
+        if (newptr) {
+            memcpy(newptr, ptr, (std::min)(osize, nsize));
+            arena_free(arena, ptr, osize);
+        }
+    }
+    if (newptr)
+        arena->used_size = arena->used_size - osize + nsize;
+    return newptr;
+}
+
+static void free_arena(LuaArena *arena) {
+    while (arena->big_blocks.next != &arena->big_blocks)
+        arena_free_big(arena->big_blocks.next + 1);
+    release_arena_chunks(arena->chunks);
+    delete arena;
+}
+
+/* }====================================================== */
+
+
 static int panic(lua_State *L) {
     lua_writestringerror("PANIC: unprotected error in call to Lua API (%s)\n",
         lua_tostring(L, -1));
@@ -2888,6 +3092,40 @@ LUALIB_API lua_State *luaL_newstate(void) {
 }
 
 
+LUALIB_API lua_State *luaL_newarenastate(size_t max_size) {
+    LuaArena *arena = new LuaArena();
+    arena->max_size = max_size;
+    arena->used_size = 0;
+    memset(arena->free_blocks, 0, sizeof(arena->free_blocks));
+    arena->chunk_pos = arena->chunk_end = nullptr;
+    arena->big_blocks.prev = arena->big_blocks.next = &arena->big_blocks;
+    lua_State *L = lua_newstate(l_arena_alloc, arena);
+    if (nullptr == L) {
+        free_arena(arena);
+        return nullptr;
+    }
+    lua_atpanic(L, &panic);
+    return L;
+}
+
+
+LUALIB_API void luaL_closearenastate(lua_State *L) {
+    void *ud;
+    lua_Alloc allocf = lua_getallocf(L, &ud);
+    lua_close(L);
+    if (allocf == l_arena_alloc)
+        free_arena((LuaArena*)ud);
+}
+
+
+LUALIB_API void luaL_setarenamaxsize(lua_State *L, size_t max_size) {
+    void *ud;
+    lua_Alloc allocf = lua_getallocf(L, &ud);
+    if (allocf == l_arena_alloc)
+        ((LuaArena*)ud)->max_size = max_size;
+}
+
+
 LUALIB_API void luaL_checkversion_(lua_State *L, lua_Number ver, size_t sz) {
     const lua_Number *v = lua_version(L);
     if (sz != LUAL_NUMSIZES)  /* check numeric types */
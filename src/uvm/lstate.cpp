@@ -13,6 +13,8 @@
 #include <stddef.h>
 #include <string.h>
 #include <cstdint>
+#include <mutex>
+#include <vector>
 
 #include "uvm/lua.h"
 
@@ -239,6 +241,7 @@ static void preinit_thread(lua_State *L, global_State *g) {
     L->nny = 1;
     L->status = LUA_OK;
     L->errfunc = 0;
+    L->state_values = nullptr;
 }
 
 
@@ -291,11 +294,49 @@ void luaE_freethread(lua_State *L, lua_State *L1) {
     luaF_close(L1, L1->stack);  /* close all upvalues for this thread */
     lua_assert(L1->openupval == nullptr);
     luai_userstatefree(L, L1);
+    uvm::lua::lib::close_lua_state_values(L1);
     freestack(L1);
     luaM_free(L, l);
 }
 
 
+/*
+** malloc buffers of closed states are kept for the next states. a fresh buffer costs a
+** mmap/munmap pair and a page fault on every page the state touches, which is most of
+** the setup cost of a short contract call. a pooled buffer has its used part zeroed, so
+** it is the same as a fresh one to the state
+*/
+static std::mutex malloc_buffer_pool_mutex;
+static std::vector<void*> malloc_buffer_pool;
+
+static void *acquire_malloc_buffer() {
+    {
+        std::lock_guard<std::mutex> lock(malloc_buffer_pool_mutex);
+        if (!malloc_buffer_pool.empty()) {
+            void *buffer = malloc_buffer_pool.back();
+            malloc_buffer_pool.pop_back();
+            return buffer;
+        }
+    }
+    return malloc(LUA_MALLOC_TOTAL_SIZE);
+}
+
+static void release_malloc_buffer(void *buffer, ptrdiff_t used_size) {
+    if (nullptr == buffer)
+        return;
+    /* buffers a state used much of are freed, the pool shouldn't pin their pages */
+    if (used_size <= LUA_MALLOC_POOLED_BUFFER_MAX_USED_SIZE) {
+        memset(buffer, 0, (size_t)used_size);
+        std::lock_guard<std::mutex> lock(malloc_buffer_pool_mutex);
+        if (malloc_buffer_pool.size() < LUA_MALLOC_BUFFER_POOL_SIZE) {
+            malloc_buffer_pool.push_back(buffer);
+            return;
+        }
+    }
+    free(buffer);
+}
+
+
 LUA_API lua_State *lua_newstate(lua_Alloc f, void *ud) {
     int i;
     lua_State *L;
@@ -308,7 +349,7 @@ LUA_API lua_State *lua_newstate(lua_Alloc f, void *ud) {
     L->tt = LUA_TTHREAD;
     g->currentwhite = bitmask(WHITE0BIT);
     L->marked = luaC_white(g);
-    L->malloc_buffer = malloc(LUA_MALLOC_TOTAL_SIZE);
+    L->malloc_buffer = acquire_malloc_buffer();
     L->malloc_pos = 0;
     L->malloced_buffers = new std::list<std::pair<ptrdiff_t, ptrdiff_t>>();
     memset(L->compile_error, 0x0, LUA_COMPILE_ERROR_MAX_LENGTH);
@@ -363,7 +404,7 @@ LUA_API void lua_close(lua_State *L) {
     L = G(L)->mainthread;  /* only the main thread can be closed */
     uvm::lua::lib::close_lua_state_values(L);
     delete L->malloced_buffers;
-    free(L->malloc_buffer);
+    release_malloc_buffer(L->malloc_buffer, L->malloc_pos);
     lua_lock(L);
     close_state(L);
 }
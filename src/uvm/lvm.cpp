@@ -37,6 +37,7 @@
 #include <uvm/lvm.h>
 #include <uvm/uvm_api.h>
 #include <uvm/uvm_lib.h>
+#include <uvm/uvm_profile.h>
 
 using uvm::lua::api::global_uvm_chain_api;
 
@@ -808,6 +809,7 @@ void luaV_finishOp(lua_State *L) {
 
 #define vmdispatch(o)	switch(o)
 #define vmcase(l)	case l:
+#define vmdefault	default:
 #define vmbreak		break
 
 
@@ -838,6 +840,103 @@ static int get_line_in_current_proto(CallInfo* ci, Proto *proto)
 		return 0;
 }
 
+static bool gas_blocks_enabled = true;
+
+void luaV_setgasblocks(bool enabled)
+{
+    gas_blocks_enabled = enabled;
+}
+
+#define GAS_BLOCK_NONE 0
+#define GAS_BLOCK_STRAIGHT 1
+#define GAS_BLOCK_LAST 2
+
+/*
+** instructions that can't observe or stop on the instructions executed count: they don't call
+** out, raise errors, allocate or change the frame. straight ones always go on to the next
+** instruction, last ones may jump
+*/
+static int gas_block_instruction_kind(const Proto *p, Instruction i)
+{
+    switch (GET_OPCODE(i)) {
+    case UOP_MOVE:
+    case UOP_LOADK:
+    case UOP_LOADNIL:
+    case UOP_NOT:
+        return GAS_BLOCK_STRAIGHT;
+    case UOP_GETUPVAL:
+        return GETARG_B(i) < p->sizeupvalues ? GAS_BLOCK_STRAIGHT : GAS_BLOCK_NONE;
+    case UOP_LOADBOOL:
+        return GETARG_C(i) ? GAS_BLOCK_LAST : GAS_BLOCK_STRAIGHT;
+    case UOP_JMP:
+    case UOP_TEST:
+    case UOP_TESTSET:
+    case UOP_FORLOOP:
+        return GAS_BLOCK_LAST;
+    default:
+        return GAS_BLOCK_NONE;
+    }
+}
+
+/*
+** gasblocks[pc] is the number of instructions from pc on that run one after another without
+** a way to observe the instructions executed count, 0 when the instruction at pc isn't one of
+** them. when a whole block fits in the instructions limit it is charged at once, which ends in
+** the same counts as charging the instructions one by one
+*/
+static const lu_byte *get_gas_blocks(LClosure *cl)
+{
+    Proto *p = cl->p;
+    /* GETUPVAL is only checked against the proto */
+    if (!gas_blocks_enabled || cl->nupvalues != p->sizeupvalues)
+        return nullptr;
+    if (nullptr == p->gasblocks && p->sizecode > 0) {
+        p->gasblocks = new lu_byte[p->sizecode];
+        for (int pc = p->sizecode - 1; pc >= 0; pc--) {
+            int kind = gas_block_instruction_kind(p, p->code[pc]);
+            int size = kind == GAS_BLOCK_NONE ? 0 : 1;
+            if (kind == GAS_BLOCK_STRAIGHT && pc + 1 < p->sizecode && p->gasblocks[pc + 1] < UCHAR_MAX)
+                size += p->gasblocks[pc + 1];
+            p->gasblocks[pc] = (lu_byte)size;
+        }
+    }
+    return p->gasblocks;
+}
+
+#ifdef DEBUG
+#define vmtrace(i)	printf("%d\n", GET_OPCODE(i))
+#else
+#define vmtrace(i)	((void)0)
+#endif
+
+/* size of the gas block at the instruction just fetched, 0 when there is none */
+#define current_gas_block_size() \
+  (gas_blocks && (size_t)(ci->u.l.savedpc - 1 - cl->p->code) < (size_t)cl->p->sizecode \
+    ? gas_blocks[ci->u.l.savedpc - 1 - cl->p->code] : 0)
+
+/*
+** fetch and charge the next instruction at the end of an instruction, for the
+** jump table dispatch. the instruction is only counted here when the checks at
+** the top of the main loop would do nothing else with it: under the limit, not
+** stopped, not a call, no hooks, not profiled and no gas block starting there.
+** else it goes back to 'vmcheck' to run them
+*/
+#define vmfetch() { \
+  i = *(ci->u.l.savedpc++); \
+  vmtrace(i); \
+  if (gas_block_left > 0) \
+    gas_block_left--;  /* charged with its gas block */ \
+  else if ((!has_insts_limit || *insts_executed_count < insts_limit) \
+           && !(stopped_pointer && *stopped_pointer > 0) && !L->force_stopping \
+           && GET_OPCODE(i) != UOP_CALL && GET_OPCODE(i) != UOP_TAILCALL \
+           && !(L->hookmask & (LUA_MASKLINE | LUA_MASKCOUNT)) && !opcode_counts \
+           && current_gas_block_size() <= 1) \
+    *insts_executed_count += 1; \
+  else \
+    goto vmcheck; \
+  ra = RA(i); \
+}
+
 #define lua_check_in_vm_error(cond, error_msg) {    \
 if (!(cond)) {      \
   L->force_stopping = true; \
@@ -847,12 +946,17 @@ if (!(cond)) {      \
 }
 void luaV_execute(lua_State *L)
 {
+#if LUA_USE_JUMPTABLE
+#include <uvm/ljumptab.h>
+#endif
     if (L->force_stopping)
         return;
     CallInfo *ci = L->ci;
     LClosure *cl;
     TValue *k;
     StkId base;
+    Instruction i;
+    StkId ra;
     ci->callstatus |= CIST_FRESH;  /* fresh invocation of 'luaV_execute" */
 newframe:  /* reentry point when frame changes (call/return) */
     lua_assert(ci == L->ci);
@@ -860,26 +964,30 @@ newframe:  /* reentry point when frame changes (call/return) */
     k = cl->p->k;  /* local reference to function's constant table */
     base = ci->u.l.base;  /* local copy of function's base */
 
-    int insts_limit = uvm::lua::lib::get_lua_state_value(L, INSTRUCTIONS_LIMIT_LUA_STATE_MAP_KEY).int_value;
-    int *stopped_pointer = uvm::lua::lib::get_lua_state_value(L, LUA_STATE_STOP_TO_RUN_IN_LVM_STATE_MAP_KEY).int_pointer_value;
+    int insts_limit = uvm::lua::lib::get_lua_state_slot_value(L, UVM_STATE_SLOT_INSTRUCTIONS_LIMIT).int_value;
+    int *stopped_pointer = uvm::lua::lib::get_lua_state_slot_value(L, UVM_STATE_SLOT_STOP_TO_RUN_IN_LVM).int_pointer_value;
     if (nullptr == stopped_pointer)
     {
         uvm::lua::lib::notify_lua_state_stop(L);
         uvm::lua::lib::resume_lua_state_running(L);
-        stopped_pointer = uvm::lua::lib::get_lua_state_value(L, LUA_STATE_STOP_TO_RUN_IN_LVM_STATE_MAP_KEY).int_pointer_value;
+        stopped_pointer = uvm::lua::lib::get_lua_state_slot_value(L, UVM_STATE_SLOT_STOP_TO_RUN_IN_LVM).int_pointer_value;
     }
     int has_insts_limit = insts_limit > 0 ? 1 : 0;
-    int *insts_executed_count = uvm::lua::lib::get_lua_state_value(L, INSTRUCTIONS_EXECUTED_COUNT_LUA_STATE_MAP_KEY).int_pointer_value;
+    int *insts_executed_count = uvm::lua::lib::get_lua_state_slot_value(L, UVM_STATE_SLOT_INSTRUCTIONS_EXECUTED_COUNT).int_pointer_value;
     if (nullptr == insts_executed_count)
     {
         insts_executed_count = static_cast<int*>(lua_malloc(L, sizeof(int)));
         *insts_executed_count = 0;
         UvmStateValue lua_state_value_of_exected_count;
         lua_state_value_of_exected_count.int_pointer_value = insts_executed_count;
-        uvm::lua::lib::set_lua_state_value(L, INSTRUCTIONS_EXECUTED_COUNT_LUA_STATE_MAP_KEY, lua_state_value_of_exected_count, LUA_STATE_VALUE_INT_POINTER);
+        uvm::lua::lib::set_lua_state_slot_value(L, UVM_STATE_SLOT_INSTRUCTIONS_EXECUTED_COUNT, lua_state_value_of_exected_count, LUA_STATE_VALUE_INT_POINTER);
     }
     if (*insts_executed_count < 0)
         *insts_executed_count = 0;
+    const lu_byte *gas_blocks = get_gas_blocks(cl);
+    int gas_block_left = 0; /* instructions left in the charged gas block */
+    UvmExecutionProfile *profile = uvm::lua::lib::get_lua_state_profile(L);
+    uint64_t *opcode_counts = profile ? profile->opcode_counts : nullptr; /* profiled instructions are charged one by one */
 
     lua_getglobal(L, "last_return");
 	bool use_last_return = true; // lua_istable(L, -1);
@@ -891,40 +999,63 @@ newframe:  /* reentry point when frame changes (call/return) */
     for (;;) {
         if (!ci || ci->u.l.savedpc == nullptr) {
           global_uvm_chain_api->throw_exception(L, UVM_API_LVM_LIMIT_OVER_ERROR, "wrong bytecode instruction, can't find savedpc");
-          vmbreak;
+          return;
         }
-        Instruction i = *(ci->u.l.savedpc++);
+        i = *(ci->u.l.savedpc++);
+        vmtrace(i);
+#if LUA_USE_JUMPTABLE
+    vmcheck:  /* from 'vmfetch', with the instruction fetched */
+#endif
 
-#ifdef DEBUG
-	printf("%d\n", GET_OPCODE(i));
-#endif // DEBUG
+        bool gas_charged = false;
+        if (gas_block_left > 0) {
+            gas_block_left--; // charged with its gas block
+            gas_charged = true;
+        }
+        else if (gas_blocks) {
+            int gas_block_size = current_gas_block_size();
+            // nothing in the block can see the count or stop the vm, so charge it all now
+            if (gas_block_size > 1
+                && !(has_insts_limit && (int64_t)*insts_executed_count + gas_block_size > insts_limit)
+                && !(stopped_pointer && *stopped_pointer > 0)
+                && !L->force_stopping
+                && !(L->hookmask & (LUA_MASKLINE | LUA_MASKCOUNT))
+                && !opcode_counts)
+            {
+                *insts_executed_count += gas_block_size;
+                gas_block_left = gas_block_size - 1;
+                gas_charged = true;
+            }
+        }
+        if (!gas_charged)
+        {
+            *insts_executed_count += 1; // executed instructions count
+
+            // limit instructions count, and executed instructions
+            if (has_insts_limit && *insts_executed_count > insts_limit)
+            {
+                global_uvm_chain_api->throw_exception(L, UVM_API_LVM_LIMIT_OVER_ERROR, "over instructions limit");
+                return;
+            }
+            if (stopped_pointer && *stopped_pointer > 0)
+                return;
+            if (L->force_stopping)
+                return;
 
-        StkId ra;
 
-		*insts_executed_count += 1; // executed instructions count
+            // when over contract api limit, also stop
+            if ((GET_OPCODE(i) == UOP_CALL || GET_OPCODE(i) == UOP_TAILCALL)
+                && global_uvm_chain_api->check_contract_api_instructions_over_limit(L))
+            {
+                global_uvm_chain_api->throw_exception(L, UVM_API_LVM_LIMIT_OVER_ERROR, "over instructions limit");
+                return;
+            }
 
-        // limit instructions count, and executed instructions
-        if (has_insts_limit && *insts_executed_count > insts_limit)
-        {
-            global_uvm_chain_api->throw_exception(L, UVM_API_LVM_LIMIT_OVER_ERROR, "over instructions limit");
-            vmbreak;
-        }
-        if (stopped_pointer && *stopped_pointer > 0)
-            vmbreak;
-        if (L->force_stopping)
-            vmbreak;
-        
-
-        // when over contract api limit, also vmbreak
-        if ((GET_OPCODE(i) == UOP_CALL || GET_OPCODE(i) == UOP_TAILCALL)
-            && global_uvm_chain_api->check_contract_api_instructions_over_limit(L))
-        {
-            global_uvm_chain_api->throw_exception(L, UVM_API_LVM_LIMIT_OVER_ERROR, "over instructions limit");
-            vmbreak;
+            if (L->hookmask & (LUA_MASKLINE | LUA_MASKCOUNT))
+                Protect(luaG_traceexec(L));
+            if (opcode_counts)
+                opcode_counts[GET_OPCODE(i)]++;
         }
-
-        if (L->hookmask & (LUA_MASKLINE | LUA_MASKCOUNT))
-            Protect(luaG_traceexec(L));
         /* WARNING: several calls may realloc the stack and invalidate 'ra' */
         ra = RA(i);
         lua_assert(base == ci->u.l.base);
@@ -1629,6 +1760,9 @@ newframe:  /* reentry point when frame changes (call/return) */
 					)
 					vmbreak;
 			}
+			vmdefault {  /* opcodes the vm doesn't know do nothing */
+				vmbreak;
+			}
         }
     }
 }
@@ -2,6 +2,7 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <stdarg.h>
+#include <algorithm>
 #include <cassert>
 #include <cstdio>
 #include <string>
@@ -30,6 +31,7 @@
 #include <uvm/lauxlib.h>
 #include <uvm/lualib.h>
 #include <uvm/lfunc.h>
+#include <uvm/lvm.h>
 #include <uvm/uvm_storage.h>
 
 namespace uvm
@@ -72,37 +74,42 @@ namespace uvm
 				"hex_to_bytes", "bytes_to_hex", "sha256_hex", "sha1_hex", "sha3_hex", "ripemd160_hex"
             };
 
-            typedef lua_State* L_Key1;
-
-            typedef std::unordered_map<std::string, UvmStateValueNode> L_VM1;
-
-            typedef std::shared_ptr<L_VM1> L_V1;
-
-            typedef std::unordered_map<L_Key1, L_V1> LStatesMap;
-
-            static LStatesMap states_map;
+            // keys of the values kept in UvmStateValues::slots, by slot
+            static const char *state_slot_keys[UVM_STATE_SLOT_COUNT] = {
+                INSTRUCTIONS_LIMIT_LUA_STATE_MAP_KEY,
+                INSTRUCTIONS_EXECUTED_COUNT_LUA_STATE_MAP_KEY,
+                LUA_STATE_STOP_TO_RUN_IN_LVM_STATE_MAP_KEY,
+                GLUA_CONTRACT_API_CALL_STACK_STATE_MAP_KEY,
+                LUA_STORAGE_CHANGELIST_KEY,
+                UVM_STATE_EVALUATOR_KEY,
+                UVM_STATE_STORAGE_SERVICE_KEY,
+                UVM_STATE_EXCEPTION_CODE_KEY,
+                UVM_STATE_EXCEPTION_MSG_KEY,
+                UVM_STATE_PROFILE_KEY
+            };
 
-            static LStatesMap *get_lua_states_value_hashmap()
+            static int get_state_slot_of_key(const char *key)
             {
-                return &states_map;
+                for (int i = 0; i < UVM_STATE_SLOT_COUNT; i++)
+                {
+                    if (strcmp(state_slot_keys[i], key) == 0)
+                        return i;
+                }
+                return -1;
             }
 
-            static std::mutex states_map_mutex;
-
-            static L_V1 create_value_map_for_lua_state(lua_State *L)
+            static UvmStateValues *create_state_values(lua_State *L)
             {
-                LStatesMap *states_map = get_lua_states_value_hashmap();
-                auto it = states_map->find(L);
-                if (it == states_map->end())
+                if (nullptr == L->state_values)
                 {
-                    states_map_mutex.lock();
-                    L_V1 map = std::make_shared<L_VM1>();
-                    states_map->insert(std::make_pair(L, map));
-                    states_map_mutex.unlock();
-                    return map;
+                    L->state_values = new UvmStateValues();
+                    for (int i = 0; i < UVM_STATE_SLOT_COUNT; i++)
+                    {
+                        L->state_values->slots[i].type = LUA_STATE_VALUE_nullptr;
+                        L->state_values->slots[i].value.pointer_value = nullptr;
+                    }
                 }
-                else
-                    return it->second;
+                return L->state_values;
             }
 
 			// transfer from contract to account
@@ -965,6 +972,19 @@ namespace uvm
                 return uvm::lib::uvmlib_set_storage_impl(L, contract_id, key, "", false, 3);
             }
 
+// gas of the lua version of pairsByKeys, which the native one charges the same way: loading it on first use in a
+// state, the setup for each number key and each other key, and each iterator call before and after it reads t[key]
+#define PAIRS_BY_KEYS_LOAD_GAS 3
+#define PAIRS_BY_KEYS_SETUP_GAS 23
+#define PAIRS_BY_KEYS_NUMBER_KEY_GAS 10
+#define PAIRS_BY_KEYS_STRING_KEY_GAS 15
+#define PAIRS_BY_KEYS_NUMBER_STEP_GAS 11
+#define PAIRS_BY_KEYS_STRING_STEP_GAS 15
+#define PAIRS_BY_KEYS_STEP_RETURN_GAS 1
+// registry keys: whether the load gas was charged, and table.sort as opened
+#define PAIRS_BY_KEYS_LOADED_KEY "uvm_pairs_by_keys_loaded"
+#define PAIRS_BY_KEYS_TABLE_SORT_KEY "uvm_pairs_by_keys_table_sort"
+
 			static int uvm_core_lib_pairs_by_keys_func_loader(lua_State *L)
             {
 				lua_getglobal(L, "__real_pairs_by_keys_func");
@@ -972,6 +992,10 @@ namespace uvm
 				lua_pop(L, 1);
 				if (exist)
 					return 0; 
+				lua_getfield(L, LUA_REGISTRYINDEX, PAIRS_BY_KEYS_LOADED_KEY);
+				bool load_charged = lua_toboolean(L, -1) != 0;
+				lua_pop(L, 1);
+				auto count_before_load = get_lua_state_instructions_executed_count(L);
 				// pairsByKeys' iterate order is number first(than string), short string first(than long string), little ASCII string first
 				const char *code = R"END(
 function __real_pairs_by_keys_func(t)
@@ -1004,22 +1028,148 @@ function __real_pairs_by_keys_func(t)
 end
 )END";
 				luaL_dostring(L, code);
+				// the native pairsByKeys charged the load already
+				if (load_charged)
+					increment_lvm_instructions_executed_count(L, count_before_load - get_lua_state_instructions_executed_count(L));
+				lua_pushboolean(L, 1);
+				lua_setfield(L, LUA_REGISTRYINDEX, PAIRS_BY_KEYS_LOADED_KEY);
 				return 0;
             }
 
+			// the lua version sets last_return when its functions return, see UOP_RETURN
+			static void set_pairs_by_keys_last_return(lua_State *L, int idx)
+			{
+				idx = lua_absindex(L, idx);
+				lua_getglobal(L, "_G");
+				lua_pushvalue(L, idx);
+				lua_setfield(L, -2, "last_return");
+				lua_pop(L, 1);
+			}
+
+			/*
+			whether pairsByKeys(t) can run natively with the same results and gas as the lua version: t is a table
+			without __pairs whose keys are numbers or strings, tostring and table.sort of strings have no hooks, and
+			the lua version wouldn't overflow the C stack or the lua stack. counts the number and string keys
+			*/
+			static bool can_pairs_by_keys_natively(lua_State *L, int *number_keys_count, int *string_keys_count)
+			{
+				if (lua_type(L, 1) != LUA_TTABLE)
+					return false;
+				if (luaL_getmetafield(L, 1, "__pairs") != LUA_TNIL)
+				{
+					lua_pop(L, 1);
+					return false;
+				}
+				if (L->nCcalls + 2 >= LUAI_MAXCCALLS || (L->top - L->stack) + 8 * LUA_MINSTACK >= LUAI_MAXSTACK)
+					return false;
+				bool table_sort_opened = false;
+				if (lua_getglobal(L, "table") == LUA_TTABLE)
+				{
+					lua_pushliteral(L, "sort");
+					lua_rawget(L, -2);
+					lua_getfield(L, LUA_REGISTRYINDEX, PAIRS_BY_KEYS_TABLE_SORT_KEY);
+					table_sort_opened = lua_rawequal(L, -1, -2) != 0;
+					lua_pop(L, 2);
+				}
+				lua_pop(L, 1);
+				if (!table_sort_opened)
+					return false;
+				*number_keys_count = 0;
+				*string_keys_count = 0;
+				lua_pushnil(L);
+				while (lua_next(L, 1))
+				{
+					lua_pop(L, 1);
+					int key_type = lua_type(L, -1);
+					if (key_type == LUA_TNUMBER)
+						++*number_keys_count;
+					else if (key_type == LUA_TSTRING)
+						++*string_keys_count;
+					else
+					{
+						lua_pop(L, 1);
+						return false;
+					}
+				}
+				if (*string_keys_count > 0)
+				{
+					lua_pushliteral(L, "");
+					bool has_tostring = luaL_getmetafield(L, -1, "__tostring") != LUA_TNIL;
+					lua_pop(L, has_tostring ? 2 : 1);
+					if (has_tostring)
+						return false;
+				}
+				return true;
+			}
+
+			// iterator of the native pairsByKeys. upvalues: the table, its sorted keys, the count of number keys, the position
+			static int uvm_core_lib_pairs_by_keys_next(lua_State *L)
+			{
+				lua_Integer i = lua_tointeger(L, lua_upvalueindex(4)) + 1;
+				lua_pushinteger(L, i);
+				lua_replace(L, lua_upvalueindex(4));
+				increment_lvm_instructions_executed_count(L, i <= lua_tointeger(L, lua_upvalueindex(3))
+					? PAIRS_BY_KEYS_NUMBER_STEP_GAS : PAIRS_BY_KEYS_STRING_STEP_GAS);
+				lua_rawgeti(L, lua_upvalueindex(2), i); // nil after the last key
+				lua_pushvalue(L, -1);
+				lua_gettable(L, lua_upvalueindex(1)); // may call __index, as t[key] does
+				increment_lvm_instructions_executed_count(L, PAIRS_BY_KEYS_STEP_RETURN_GAS);
+				set_pairs_by_keys_last_return(L, -2);
+				return 2;
+			}
+
 			/*
 			function pairsByKeys(t)
 				uvm_core_lib_pairs_by_keys_func_loader()
 				return __real_pairs_by_keys_func(t)
 			end 
+			iterates number keys in order, then other keys by tostring. runs natively when it can, with the same gas
 			*/
 			static int uvm_core_lib_pairs_by_keys(lua_State *L)
             {
-				lua_getglobal(L, "uvm_core_lib_pairs_by_keys_func_loader");
-				lua_call(L, 0, 0);
-				lua_getglobal(L, "__real_pairs_by_keys_func");
+				int number_keys_count;
+				int string_keys_count;
+				if (!can_pairs_by_keys_natively(L, &number_keys_count, &string_keys_count))
+				{
+					lua_getglobal(L, "uvm_core_lib_pairs_by_keys_func_loader");
+					lua_call(L, 0, 0);
+					lua_getglobal(L, "__real_pairs_by_keys_func");
+					lua_pushvalue(L, 1);
+					lua_call(L, 1, 1);
+					return 1;
+				}
+				if (lua_getfield(L, LUA_REGISTRYINDEX, PAIRS_BY_KEYS_LOADED_KEY) == LUA_TNIL)
+				{
+					increment_lvm_instructions_executed_count(L, PAIRS_BY_KEYS_LOAD_GAS);
+					lua_pushboolean(L, 1);
+					lua_setfield(L, LUA_REGISTRYINDEX, PAIRS_BY_KEYS_LOADED_KEY);
+				}
+				lua_pop(L, 1);
+				increment_lvm_instructions_executed_count(L, PAIRS_BY_KEYS_SETUP_GAS
+					+ number_keys_count * PAIRS_BY_KEYS_NUMBER_KEY_GAS + string_keys_count * PAIRS_BY_KEYS_STRING_KEY_GAS);
+
+				// number keys, then string keys, each sorted as table.sort does
+				lua_createtable(L, number_keys_count + string_keys_count, 0);
+				int number_pos = 0;
+				int string_pos = number_keys_count;
+				lua_pushnil(L);
+				while (lua_next(L, 1))
+				{
+					lua_pop(L, 1);
+					lua_pushvalue(L, -1);
+					lua_rawseti(L, -3, lua_type(L, -1) == LUA_TNUMBER ? ++number_pos : ++string_pos);
+				}
+				Table *keys = hvalue(L->top - 1);
+				auto less_than = [L](const TValue &a, const TValue &b) { return luaV_lessthan(L, &a, &b) != 0; };
+				std::sort(keys->array, keys->array + number_keys_count, less_than);
+				std::sort(keys->array + number_keys_count, keys->array + number_keys_count + string_keys_count, less_than);
+
 				lua_pushvalue(L, 1);
-				lua_call(L, 1, 1);
+				lua_insert(L, -2);
+				lua_pushinteger(L, number_keys_count);
+				lua_pushinteger(L, 0);
+				lua_pushcclosure(L, &uvm_core_lib_pairs_by_keys_next, 4);
+				set_pairs_by_keys_last_return(L, -1);
 				return 1;
             }
 
@@ -1073,7 +1223,7 @@ end
 
             lua_State *create_lua_state(bool use_contract)
             {
-                lua_State *L = luaL_newstate();
+                lua_State *L = luaL_newarenastate(LUA_STATE_MAX_MEMORY_SIZE);
                 luaL_openlibs(L);
                 // run init lua code here, eg. init storage api, load some modules
 				add_global_c_function(L, "debugger", &enter_lua_debugger);
@@ -1145,6 +1295,10 @@ end
 				*/
 				lua_getglobal(L, "pairs");
 				lua_setglobal(L, "__old_pairs");
+				lua_getglobal(L, "table");
+				lua_getfield(L, -1, "sort");
+				lua_setfield(L, LUA_REGISTRYINDEX, PAIRS_BY_KEYS_TABLE_SORT_KEY);
+				lua_pop(L, 1);
 				lua_pushcfunction(L, &uvm_core_lib_pairs_by_keys);
 				lua_setglobal(L, "pairs");
 
@@ -1196,8 +1350,7 @@ end
             {
                 luaL_commit_storage_changes(L);
 				uvm::lua::api::global_uvm_chain_api->release_objects_in_pool(L);
-                LStatesMap *states_map = get_lua_states_value_hashmap();
-                if (nullptr != states_map)
+                if (nullptr != L->state_values)
                 {
                     auto lua_table_map_list_p = get_lua_state_value(L, LUA_TABLE_MAP_LIST_STATE_MAP_KEY).pointer_value;
                     if (nullptr != lua_table_map_list_p)
@@ -1213,8 +1366,16 @@ end
                         delete list_p;
                     }
 
-                    L_V1 map = create_value_map_for_lua_state(L);
-                    for (auto it = map->begin(); it != map->end(); ++it)
+                    // int pointers(eg. instructions executed count, stop flag) are freed here
+                    for (auto &node : L->state_values->slots)
+                    {
+                        if (node.type == LUA_STATE_VALUE_INT_POINTER)
+                        {
+                            lua_free(L, node.value.int_pointer_value);
+                            node.value.int_pointer_value = nullptr;
+                        }
+                    }
+                    for (auto it = L->state_values->values.begin(); it != L->state_values->values.end(); ++it)
                     {
                         if (it->second.type == LUA_STATE_VALUE_INT_POINTER)
                         {
@@ -1223,23 +1384,10 @@ end
                         }
                     }
                     // close values in state values(some pointers need free), eg. storage infos, contract infos
-                    UvmStateValueNode storage_changelist_node = get_lua_state_value_node(L, LUA_STORAGE_CHANGELIST_KEY);
+                    UvmStateValueNode storage_changelist_node = get_lua_state_slot_node(L, UVM_STATE_SLOT_STORAGE_CHANGELIST);
                     if (storage_changelist_node.type == LUA_STATE_VALUE_POINTER && nullptr != storage_changelist_node.value.pointer_value)
                     {
                         UvmStorageChangeList *list = (UvmStorageChangeList*)storage_changelist_node.value.pointer_value;
-                        for (auto it = list->begin(); it != list->end(); ++it)
-                        {
-                            UvmStorageValue before = it->before;
-                            UvmStorageValue after = it->after;
-                            if (lua_storage_is_table(before.type))
-                            {
-                                // free_lua_table_map(L, before.value.table_value);
-                            }
-                            if (lua_storage_is_table(after.type))
-                            {
-                                // free_lua_table_map(L, after.value.table_value);
-                            }
-                        }
                         list->~UvmStorageChangeList();
                         lua_free(L, list);
                     }
@@ -1252,35 +1400,21 @@ end
                         lua_free(L, list);
                     }
 
-                    int *insts_executed_count = get_lua_state_value(L, INSTRUCTIONS_EXECUTED_COUNT_LUA_STATE_MAP_KEY).int_pointer_value;
-                    if (nullptr != insts_executed_count)
-                    {
-                        lua_free(L, insts_executed_count);
-                    }
-                    int *stopped_pointer = uvm::lua::lib::get_lua_state_value(L, LUA_STATE_STOP_TO_RUN_IN_LVM_STATE_MAP_KEY).int_pointer_value;
-                    if (nullptr != stopped_pointer)
-                    {
-                        lua_free(L, stopped_pointer);
-                    }
-                    
-                    states_map->erase(L);
+                    close_lua_state_values(L);
                 }
 
-                lua_close(L);
+                luaL_closearenastate(L);
             }
 
             /**
             * share some values in L
             */
-            void close_all_lua_state_values()
-            {
-                LStatesMap *states_map = get_lua_states_value_hashmap();
-                states_map->clear();
-            }
             void close_lua_state_values(lua_State *L)
             {
-                LStatesMap *states_map = get_lua_states_value_hashmap();
-                states_map->erase(L);
+                if (nullptr == L)
+                    return;
+                delete L->state_values;
+                L->state_values = nullptr;
             }
 
             UvmStateValueNode get_lua_state_value_node(lua_State *L, const char *key)
@@ -1289,19 +1423,19 @@ end
                 UvmStateValueNode nil_value_node;
                 nil_value_node.type = LUA_STATE_VALUE_nullptr;
                 nil_value_node.value = nil_value;
-                if (nullptr == L || nullptr == key || strlen(key) < 1)
+                if (nullptr == L || nullptr == key || strlen(key) < 1 || nullptr == L->state_values)
                 {
                     return nil_value_node;
                 }
 
-                LStatesMap *states_map = get_lua_states_value_hashmap();
-                L_V1 map = create_value_map_for_lua_state(L);
-                std::string key_str(key);
-                auto it = map->find(key_str);
-                if (it == map->end())
+                auto slot = get_state_slot_of_key(key);
+                if (slot >= 0)
+                    return L->state_values->slots[slot];
+                auto it = L->state_values->values.find(std::string(key));
+                if (it == L->state_values->values.end())
                     return nil_value_node;
                 else
-                    return map->at(key_str);
+                    return it->second;
             }
 
             UvmStateValue get_lua_state_value(lua_State *L, const char *key)
@@ -1311,17 +1445,17 @@ end
             void set_lua_state_instructions_limit(lua_State *L, int limit)
             {
                 UvmStateValue value = { limit };
-                set_lua_state_value(L, INSTRUCTIONS_LIMIT_LUA_STATE_MAP_KEY, value, LUA_STATE_VALUE_INT);
+                set_lua_state_slot_value(L, UVM_STATE_SLOT_INSTRUCTIONS_LIMIT, value, LUA_STATE_VALUE_INT);
             }
 
             int get_lua_state_instructions_limit(lua_State *L)
             {
-                return get_lua_state_value(L, INSTRUCTIONS_LIMIT_LUA_STATE_MAP_KEY).int_value;
+                return get_lua_state_slot_value(L, UVM_STATE_SLOT_INSTRUCTIONS_LIMIT).int_value;
             }
 
             int get_lua_state_instructions_executed_count(lua_State *L)
             {
-                int *insts_executed_count = get_lua_state_value(L, INSTRUCTIONS_EXECUTED_COUNT_LUA_STATE_MAP_KEY).int_pointer_value;
+                int *insts_executed_count = get_lua_state_slot_value(L, UVM_STATE_SLOT_INSTRUCTIONS_EXECUTED_COUNT).int_pointer_value;
                 if (nullptr == insts_executed_count)
                 {
                     return 0;
@@ -1356,14 +1490,14 @@ end
             */
             void notify_lua_state_stop(lua_State *L)
             {
-                int *pointer = get_lua_state_value(L, LUA_STATE_STOP_TO_RUN_IN_LVM_STATE_MAP_KEY).int_pointer_value;
+                int *pointer = get_lua_state_slot_value(L, UVM_STATE_SLOT_STOP_TO_RUN_IN_LVM).int_pointer_value;
                 if (nullptr == pointer)
                 {
                     pointer = (int*)lua_malloc(L, sizeof(int));
                     *pointer = 1;
                     UvmStateValue value;
                     value.int_pointer_value = pointer;
-                    set_lua_state_value(L, LUA_STATE_STOP_TO_RUN_IN_LVM_STATE_MAP_KEY, value, LUA_STATE_VALUE_INT_POINTER);
+                    set_lua_state_slot_value(L, UVM_STATE_SLOT_STOP_TO_RUN_IN_LVM, value, LUA_STATE_VALUE_INT_POINTER);
                 }
                 else
                 {
@@ -1376,7 +1510,7 @@ end
             */
             bool check_lua_state_notified_stop(lua_State *L)
             {
-                int *pointer = get_lua_state_value(L, LUA_STATE_STOP_TO_RUN_IN_LVM_STATE_MAP_KEY).int_pointer_value;
+                int *pointer = get_lua_state_slot_value(L, UVM_STATE_SLOT_STOP_TO_RUN_IN_LVM).int_pointer_value;
                 if (nullptr == pointer)
                     return false;
                 return (*pointer) > 0;
@@ -1387,13 +1521,23 @@ end
             */
             void resume_lua_state_running(lua_State *L)
             {
-                int *pointer = get_lua_state_value(L, LUA_STATE_STOP_TO_RUN_IN_LVM_STATE_MAP_KEY).int_pointer_value;
+                int *pointer = get_lua_state_slot_value(L, UVM_STATE_SLOT_STOP_TO_RUN_IN_LVM).int_pointer_value;
                 if (nullptr != pointer)
                 {
                     *pointer = 0;
                 }
             }
 
+            static UvmStateValueNode make_state_value_node(lua_State *L, UvmStateValue value, enum UvmStateValueType type)
+            {
+                UvmStateValueNode node_v;
+                node_v.type = type;
+                node_v.value = value;
+                if (node_v.type == LUA_STATE_VALUE_STRING)
+                    node_v.value.string_value = uvm::lua::lib::malloc_and_copy_string(L, value.string_value);
+                return node_v;
+            }
+
             void set_lua_state_value(lua_State *L, const char *key, UvmStateValue value, enum UvmStateValueType type)
             {
                 if (nullptr == L || nullptr == key || strlen(key) < 1)
@@ -1401,15 +1545,22 @@ end
                     return;
                 }
 
-                L_V1 map = create_value_map_for_lua_state(L);
-                UvmStateValueNode node_v;
-                node_v.type = type;
-                node_v.value = value;
-                if (node_v.type == LUA_STATE_VALUE_STRING)
-                    node_v.value.string_value = uvm::lua::lib::malloc_and_copy_string(L, value.string_value);
-                std::string key_str(key);
-                map->erase(key_str);
-                map->insert(std::make_pair(key_str, node_v));
+                auto slot = get_state_slot_of_key(key);
+                if (slot >= 0)
+                {
+                    set_lua_state_slot_value(L, (UvmStateSlot)slot, value, type);
+                    return;
+                }
+                auto state_values = create_state_values(L);
+                state_values->values[std::string(key)] = make_state_value_node(L, value, type);
+            }
+
+            void set_lua_state_slot_value(lua_State *L, UvmStateSlot slot, UvmStateValue value, enum UvmStateValueType type)
+            {
+                if (nullptr == L)
+                    return;
+                auto state_values = create_state_values(L);
+                state_values->slots[slot] = make_state_value_node(L, value, type);
             }
 
             static const char* reader_of_stream(lua_State *L, void *ud, size_t *size)
@@ -1799,7 +1950,7 @@ end
 			std::stack<contract_info_stack_entry> *get_using_contract_id_stack(lua_State *L, bool init_if_not_exist)
             {
 				std::stack<contract_info_stack_entry> *contract_id_stack = nullptr;
-				auto contract_id_stack_value_in_state_map = uvm::lua::lib::get_lua_state_value(L, GLUA_CONTRACT_API_CALL_STACK_STATE_MAP_KEY);
+				auto contract_id_stack_value_in_state_map = uvm::lua::lib::get_lua_state_slot_value(L, UVM_STATE_SLOT_CONTRACT_API_CALL_STACK);
 				if (!contract_id_stack_value_in_state_map.pointer_value)
 				{
 					if (!init_if_not_exist)
@@ -1811,7 +1962,7 @@ end
 						return nullptr;
 					}
 					contract_id_stack_value_in_state_map.pointer_value = (void*)contract_id_stack;
-					uvm::lua::lib::set_lua_state_value(L, GLUA_CONTRACT_API_CALL_STACK_STATE_MAP_KEY, contract_id_stack_value_in_state_map, UvmStateValueType::LUA_STATE_VALUE_POINTER);
+					uvm::lua::lib::set_lua_state_slot_value(L, UVM_STATE_SLOT_CONTRACT_API_CALL_STACK, contract_id_stack_value_in_state_map, UvmStateValueType::LUA_STATE_VALUE_POINTER);
 				}
 				else
 					contract_id_stack = (std::stack<contract_info_stack_entry>*) (contract_id_stack_value_in_state_map.pointer_value);
@@ -1932,7 +2083,7 @@ end
 
 			void reset_lvm_instructions_executed_count(lua_State *L)
             {
-				int *insts_executed_count = get_lua_state_value(L, INSTRUCTIONS_EXECUTED_COUNT_LUA_STATE_MAP_KEY).int_pointer_value;
+				int *insts_executed_count = get_lua_state_slot_value(L, UVM_STATE_SLOT_INSTRUCTIONS_EXECUTED_COUNT).int_pointer_value;
 				if (insts_executed_count)
 				{
 					*insts_executed_count = 0;
@@ -1941,7 +2092,7 @@ end
 
             void increment_lvm_instructions_executed_count(lua_State *L, int add_count)
             {
-              int *insts_executed_count = get_lua_state_value(L, INSTRUCTIONS_EXECUTED_COUNT_LUA_STATE_MAP_KEY).int_pointer_value;
+              int *insts_executed_count = get_lua_state_slot_value(L, UVM_STATE_SLOT_INSTRUCTIONS_EXECUTED_COUNT).int_pointer_value;
               if (insts_executed_count)
               {
                 *insts_executed_count = *insts_executed_count + add_count;
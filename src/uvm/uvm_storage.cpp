@@ -72,7 +72,7 @@ static struct UvmStorageValue get_last_storage_changed_value(lua_State *L, const
 			new (list)UvmStorageChangeList();
 			UvmStateValue value_to_store;
 			value_to_store.pointer_value = list;
-			uvm::lua::lib::set_lua_state_value(L, LUA_STORAGE_CHANGELIST_KEY, value_to_store, LUA_STATE_VALUE_POINTER);
+			uvm::lua::lib::set_lua_state_slot_value(L, UVM_STATE_SLOT_STORAGE_CHANGELIST, value_to_store, LUA_STATE_VALUE_POINTER);
 		}
 		UvmStorageChangeItem change_item;
 		change_item.before = value;
@@ -336,6 +336,146 @@ UvmStorageValue json_to_uvm_storage_value(lua_State *L, jsondiff::JsonValue json
 	}
 }
 
+// whether uvm_storage_value_to_json converts value
+static bool is_json_storage_value(const UvmStorageValue &value)
+{
+	switch (value.type)
+	{
+	case uvm::blockchain::StorageValueTypes::storage_value_null:
+	case uvm::blockchain::StorageValueTypes::storage_value_bool:
+	case uvm::blockchain::StorageValueTypes::storage_value_int:
+	case uvm::blockchain::StorageValueTypes::storage_value_number:
+	case uvm::blockchain::StorageValueTypes::storage_value_string:
+		return true;
+	case uvm::blockchain::StorageValueTypes::storage_value_stream_table:
+	case uvm::blockchain::StorageValueTypes::storage_value_stream_array:
+		return false;
+	default:
+		if (!lua_storage_is_table(value.type))
+			return false;
+		for (const auto &p : *value.value.table_value)
+		{
+			if (!is_json_storage_value(p.second))
+				return false;
+		}
+		return true;
+	}
+}
+
+// whether value is or has a number, which JsonDiff::diff throws on when it compares it
+static bool has_number_storage_value(const UvmStorageValue &value)
+{
+	if (value.type == uvm::blockchain::StorageValueTypes::storage_value_number)
+		return true;
+	if (!lua_storage_is_table(value.type))
+		return false;
+	for (const auto &p : *value.value.table_value)
+	{
+		if (has_number_storage_value(p.second))
+			return true;
+	}
+	return false;
+}
+
+jsondiff::DiffResultP uvm_storage_value_diff(const UvmStorageValue &before, const UvmStorageValue &after)
+{
+	jsondiff::JsonDiff json_diff;
+	const bool is_array = lua_storage_is_array(before.type);
+	if (!lua_storage_is_table(before.type) || !lua_storage_is_table(after.type) || is_array != lua_storage_is_array(after.type)
+		|| !is_json_storage_value(before) || !is_json_storage_value(after))
+		return json_diff.diff(uvm_storage_value_to_json(before), uvm_storage_value_to_json(after));
+	// same result as diffing the json values of the tables, but entries are compared in place
+	// and only the changed ones are converted to json
+	const auto &before_map = *before.value.table_value;
+	const auto &after_map = *after.value.table_value;
+	auto full_diff = [&]() {
+		return json_diff.diff(uvm_storage_value_to_json(before), uvm_storage_value_to_json(after));
+	};
+	// nullptr when JsonDiff::diff would throw on the unchanged entry, the full diff throws the same
+	const auto unchanged = jsondiff::DiffResult::make_undefined_diff_result();
+	auto entry_diff = [&](UvmStorageValue before_item, UvmStorageValue after_item) -> jsondiff::DiffResultP {
+		if (before_item.equals(after_item))
+			return has_number_storage_value(before_item) ? nullptr : unchanged;
+		return json_diff.diff(uvm_storage_value_to_json(before_item), uvm_storage_value_to_json(after_item));
+	};
+	auto i = before_map.begin();
+	auto j = after_map.begin();
+	if (is_array)
+	{
+		// entries by position, as in the json arrays
+		jsondiff::JsonArray diff_json;
+		int index = 0;
+		for (; i != before_map.end(); ++i, ++index)
+		{
+			jsondiff::JsonArray item_diff;
+			if (j == after_map.end())
+			{
+				item_diff.push_back("-");
+				item_diff.push_back(index);
+				item_diff.push_back(uvm_storage_value_to_json(i->second));
+			}
+			else
+			{
+				auto sub_diff = entry_diff(i->second, j->second);
+				++j;
+				if (!sub_diff)
+					return full_diff();
+				if (sub_diff->is_undefined())
+					continue;
+				item_diff.push_back("~");
+				item_diff.push_back(index);
+				item_diff.push_back(sub_diff->value());
+			}
+			diff_json.push_back(item_diff);
+		}
+		for (; j != after_map.end(); ++j, ++index)
+		{
+			jsondiff::JsonArray item_diff;
+			item_diff.push_back("+");
+			item_diff.push_back(index);
+			item_diff.push_back(uvm_storage_value_to_json(j->second));
+			diff_json.push_back(item_diff);
+		}
+		if (diff_json.empty())
+			return jsondiff::DiffResult::make_undefined_diff_result();
+		return std::make_shared<jsondiff::DiffResult>(diff_json);
+	}
+	// deleted and changed keys in the order of before, then added keys in the order of after
+	jsondiff::JsonObject diff_json;
+	std::vector<UvmTableMap::const_iterator> added;
+	const auto key_less = before_map.key_comp();
+	while (i != before_map.end() || j != after_map.end())
+	{
+		if (j == after_map.end() || (i != before_map.end() && key_less(i->first, j->first)))
+		{
+			diff_json[i->first + JSONDIFF_KEY_DELETED_POSTFIX] = uvm_storage_value_to_json(i->second);
+			++i;
+		}
+		else if (i == before_map.end() || key_less(j->first, i->first))
+		{
+			added.push_back(j);
+			++j;
+		}
+		else
+		{
+			auto sub_diff = entry_diff(i->second, j->second);
+			if (!sub_diff)
+				return full_diff();
+			if (!sub_diff->is_undefined())
+				diff_json[i->first] = sub_diff->value();
+			++i;
+			++j;
+		}
+	}
+	for (const auto &it : added)
+	{
+		diff_json[it->first + JSONDIFF_KEY_ADDED_POSTFIX] = uvm_storage_value_to_json(it->second);
+	}
+	if (diff_json.size() < 1)
+		return jsondiff::DiffResult::make_undefined_diff_result();
+	return std::make_shared<jsondiff::DiffResult>(diff_json);
+}
+
 static UvmStorageChangeItem diff_storage_change_if_is_table(lua_State *L, UvmStorageChangeItem change_item)
 {
 	if (!lua_storage_is_table(change_item.after.type))
@@ -344,11 +484,7 @@ static UvmStorageChangeItem diff_storage_change_if_is_table(lua_State *L, UvmSto
 		return change_item;
 	try
 	{
-		const auto &before_json = uvm_storage_value_to_json(change_item.before);
-		const auto &after_json = uvm_storage_value_to_json(change_item.after);
-		jsondiff::JsonDiff json_diff;
-		const auto &diff_json = json_diff.diff(before_json, after_json);
-		change_item.diff = *diff_json;
+		change_item.diff = *uvm_storage_value_diff(change_item.before, change_item.after);
 	}
 	catch (jsondiff::JsonDiffException &e)
 	{
@@ -370,7 +506,7 @@ static bool has_property_changed_in_changelist(UvmStorageChangeList *list, std::
 }
 bool luaL_commit_storage_changes(lua_State *L)
 {
-	UvmStateValueNode storage_changelist_node = uvm::lua::lib::get_lua_state_value_node(L, LUA_STORAGE_CHANGELIST_KEY);
+	UvmStateValueNode storage_changelist_node = uvm::lua::lib::get_lua_state_slot_node(L, UVM_STATE_SLOT_STORAGE_CHANGELIST);
 	if (global_uvm_chain_api->has_exception(L))
 	{
 		if (storage_changelist_node.type == LUA_STATE_VALUE_POINTER && nullptr != storage_changelist_node.value.pointer_value)
@@ -390,7 +526,7 @@ bool luaL_commit_storage_changes(lua_State *L)
 		new (list)UvmStorageChangeList();
 		UvmStateValue value_to_store;
 		value_to_store.pointer_value = list;
-		uvm::lua::lib::set_lua_state_value(L, LUA_STORAGE_CHANGELIST_KEY, value_to_store, LUA_STATE_VALUE_POINTER);
+		uvm::lua::lib::set_lua_state_slot_value(L, UVM_STATE_SLOT_STORAGE_CHANGELIST, value_to_store, LUA_STATE_VALUE_POINTER);
 		storage_changelist_node.value.pointer_value = list;
 	}
 	if (storage_changelist_node.type == LUA_STATE_VALUE_POINTER && nullptr != storage_changelist_node.value.pointer_value)
@@ -722,7 +858,7 @@ namespace uvm {
 				return 1;
 			}
 			lua_pop(L, 1);
-			const auto &state_value_node = uvm::lua::lib::get_lua_state_value_node(L, LUA_STORAGE_CHANGELIST_KEY);
+			const auto &state_value_node = uvm::lua::lib::get_lua_state_slot_node(L, UVM_STATE_SLOT_STORAGE_CHANGELIST);
 			int result;
 			if (state_value_node.type != LUA_STATE_VALUE_POINTER || !state_value_node.value.pointer_value)
 			{
@@ -821,7 +957,7 @@ namespace uvm {
 			*/
 
 			// log the value before and the new value
-			UvmStateValueNode state_value_node = uvm::lua::lib::get_lua_state_value_node(L, LUA_STORAGE_CHANGELIST_KEY);
+			UvmStateValueNode state_value_node = uvm::lua::lib::get_lua_state_slot_node(L, UVM_STATE_SLOT_STORAGE_CHANGELIST);
 			UvmStorageChangeList *list;
 			if (state_value_node.type != LUA_STATE_VALUE_POINTER || nullptr == state_value_node.value.pointer_value)
 			{
@@ -829,7 +965,7 @@ namespace uvm {
 				new (list)UvmStorageChangeList();
 				UvmStateValue value_to_store;
 				value_to_store.pointer_value = list;
-				uvm::lua::lib::set_lua_state_value(L, LUA_STORAGE_CHANGELIST_KEY, value_to_store, LUA_STATE_VALUE_POINTER);
+				uvm::lua::lib::set_lua_state_slot_value(L, UVM_STATE_SLOT_STORAGE_CHANGELIST, value_to_store, LUA_STATE_VALUE_POINTER);
 			}
 			else
 			{
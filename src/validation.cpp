@@ -48,8 +48,10 @@
 #include <contract_engine/contract_helper.hpp>
 #include <contract_engine/pending_state.hpp>
 #include <contract_engine/native_contract.hpp>
+#include <contract_engine/contract_exec_cache.hpp>
 
 #include <future>
+#include <thread>
 #include <atomic>
 #include <sstream>
 #include <list>
@@ -227,6 +229,7 @@ CBlockIndex *pindexBestHeader = nullptr;
 CWaitableCriticalSection csBestBlock;
 CConditionVariable cvBlockChange;
 int nScriptCheckThreads = 0;
+int nContractExecThreads = 0;
 std::atomic_bool fImporting(false);
 std::atomic_bool fReindex(false);
 bool fTxIndex = false;
@@ -237,6 +240,8 @@ bool fRequireStandard = true;
 bool fCheckBlockIndex = false;
 bool fCheckpointsEnabled = DEFAULT_CHECKPOINTS_ENABLED;
 size_t nCoinCacheUsage = 5000 * 300;
+size_t nContractStorageCacheUsage = DEFAULT_CONTRACT_STORAGE_CACHE << 20;
+size_t nContractStorageDBCache = DEFAULT_CONTRACT_STORAGE_DB_CACHE << 20;
 uint64_t nPruneTarget = 0;
 int64_t nMaxTipAge = DEFAULT_MAX_TIP_AGE;
 bool fEnableReplacement = DEFAULT_ENABLE_REPLACEMENT;
@@ -557,7 +562,9 @@ static bool CheckInputsFromMempoolAndCache(const CTransaction& tx, CValidationSt
     return CheckInputs(tx, state, view, true, flags, cacheSigStore, true, txdata);
 }
 
-static bool CheckAddContractTxToMempoolAvailable(const CTransaction& tx, CCoinsViewCache& view, CAmount& txMinGasPrice, std::string& error_out, std::string& short_error_out)
+// contracts_out, if set, gets the addresses of the contracts the tx calls or which its execution changed
+static bool CheckAddContractTxToMempoolAvailable(const CTransaction& tx, CCoinsViewCache& view, CAmount& txMinGasPrice, std::string& error_out, std::string& short_error_out,
+    std::vector<std::string>* contracts_out = nullptr)
 {
 	if (!tx.HasContractOp())
 		return false;
@@ -588,8 +595,8 @@ static bool CheckAddContractTxToMempoolAvailable(const CTransaction& tx, CCoinsV
     {
         nTxFee += withdrawInfo.amount;
     }
-    auto service = get_contract_storage_service();
-    service->open();
+    // the tx is executed on an overlay of the contract storage, which is discarded on return
+    auto service = ::contract::storage::ContractStorageService::create_overlay(get_contract_storage_service());
 	std::string error_str;
     for (ContractTransaction &ctx : resultConvertContractTx.txs) {
 		if (!ctx.is_params_valid(service, nTxFee, sumGas, gasAllTxs, blockGasLimit, error_str)) {
@@ -613,13 +620,10 @@ static bool CheckAddContractTxToMempoolAvailable(const CTransaction& tx, CCoinsV
         return false;
     }
     // attempt to evaluate this contract transaction
-    const auto& old_root_state_hash = service->current_root_state_hash();
     CBlock block;
     block.vtx.push_back(MakeTransactionRef(CTransaction(tx)));
-    ContractExec exec(service.get(), block, resultConvertContractTx.txs, hardBlockGasLimit, nTxFee);
-    BOOST_SCOPE_EXIT_ALL(&) {
-        service->rollback_contract_state(old_root_state_hash);
-    };
+    const auto pre_state_root = service->current_root_state_hash();
+    ContractExec exec(service.get(), block, chainActive.Tip(), resultConvertContractTx.txs, hardBlockGasLimit, nTxFee);
 
     if (!exec.performByteCode()) {
         //error, don't add contract
@@ -658,6 +662,16 @@ static bool CheckAddContractTxToMempoolAvailable(const CTransaction& tx, CCoinsV
         short_error_out = "bad-contracttx-execution";
         return false;
     }
+    // block assembly on this tip starts from the same state, it reuses the execution for the first contract tx
+    blockchain::contract::ContractExecCache::instance().put(tx.GetHash(), nTxFee, pre_state_root, chainActive.Tip()->GetBlockHash(),
+        testExecResult, service->current_root_state_hash());
+    if (contracts_out) {
+        for (const auto& ctx : resultConvertContractTx.txs) {
+            if (!ctx.params.contract_address.empty())
+                contracts_out->push_back(ctx.params.contract_address);
+        }
+        testExecResult.changed_contracts(*contracts_out);
+    }
     return true;
 }
 
@@ -810,6 +824,7 @@ static bool AcceptToMemoryPoolWorker(const CChainParams& chainparams, CTxMemPool
 
 		CAmount nValueOut = tx.GetValueOut();
 		CAmount txMinGasPrice = 0;
+		std::vector<std::string> txContracts;
 
 		bool allow_contract = chainActive.Tip() && ((chainActive.Tip()->nHeight + 1) >= Params().GetConsensus().UBCONTRACT_Height);
 		if(!allow_contract && (tx.HasContractOp() || tx.HasOpSpend()))
@@ -818,9 +833,17 @@ static bool AcceptToMemoryPoolWorker(const CChainParams& chainparams, CTxMemPool
 		if (tx.HasContractOp()) {
 			std::string error_out;
 			std::string short_error_out;
-			if (!CheckAddContractTxToMempoolAvailable(tx, view, txMinGasPrice, error_out, short_error_out)) {
+			if (!CheckAddContractTxToMempoolAvailable(tx, view, txMinGasPrice, error_out, short_error_out, &txContracts)) {
 				return state.DoS(100, error("AcceptContractTxToMempool(): %s", error_out.c_str()), REJECT_INVALID, short_error_out.c_str());
 			}
+			// don't let one hot contract fill the mempool with txs of which only a few can be mined per block
+			size_t nLimitContractTxs = gArgs.GetArg("-limitcontracttxs", DEFAULT_CONTRACT_TXS_LIMIT);
+			for (const std::string& contract_address : txContracts) {
+				size_t nContractTxs = pool.CountContractTxs(contract_address);
+				if (nContractTxs >= nLimitContractTxs)
+					return state.DoS(0, false, REJECT_NONSTANDARD, "too-many-contract-txs", false,
+						strprintf("contract %s has %u in-mempool transactions", contract_address, nContractTxs));
+			}
 		} else if(tx.HasOpSpend()) {
             return state.DoS(100, false, REJECT_INVALID, "bad-contracttx-incorrect-format");
         }
@@ -842,7 +865,7 @@ static bool AcceptToMemoryPoolWorker(const CChainParams& chainparams, CTxMemPool
         }
 
         CTxMemPoolEntry entry(ptx, nFees, nAcceptTime, chainActive.Height(),
-                              fSpendsCoinbase, nSigOpsCost, lp, txMinGasPrice);
+                              fSpendsCoinbase, nSigOpsCost, lp, txMinGasPrice, std::move(txContracts));
         unsigned int nSize = entry.GetTxSize();
 
         // Check that the transaction doesn't have an excessive number of
@@ -1817,7 +1840,6 @@ DisconnectResult CChainState::DisconnectBlock(const CBlock& block, const CBlockI
 			std::string block_root_state_hash = maybe_block_root_state_hash ? *maybe_block_root_state_hash : std::string(EMPTY_COMMIT_ID);
 			
 			auto service = get_contract_storage_service();
-			service->open();
 			try {
 				if (only_reset_root_state_hash)
 					service->reset_root_state_hash(block_root_state_hash);
@@ -2098,6 +2120,13 @@ else \
 
 using uvm::lua::api::global_uvm_chain_api;
 
+size_t GetContractMaxMemorySize(int nHeight, const Consensus::Params& consensusParams)
+{
+    if (nHeight < consensusParams.CONTRACT_MEMORY_LIMIT_Height)
+        return std::numeric_limits<size_t>::max();
+    return LUA_STATE_MAX_MEMORY_SIZE;
+}
+
 bool ContractExec::performByteCode()
 {
     if(!global_uvm_chain_api)
@@ -2124,16 +2153,18 @@ bool ContractExec::performByteCode()
 
 		blockchain::contract::native_contract_sender sender;
 		sender.caller_address = caller_address;
-		sender.block_number = chainActive.Height();
+		sender.block_number = pindexPrev->nHeight;
 
         engine_builder.set_caller(caller, caller_address);
         auto engine = engine_builder.build();
         engine->set_gas_limit(params.gasLimit);
+        engine->set_memory_limit(GetContractMaxMemorySize(nHeight, Params().GetConsensus()));
 		CAmount gas_used_of_native_contract = 0;
 		bool is_native_contract_exec = false;
         std::string api_result_json_string;
 
 		blockchain::contract::PendingState pending_state(storage_service);
+        pending_state.tip = pindexPrev;
         pending_state.tx_id = tx.tx_id;
         pending_state.nTxFee = nTxFee;
 		pending_state.origin_opcode = tx.opcode;
@@ -2172,8 +2203,8 @@ bool ContractExec::performByteCode()
 			pending_state.pending_contracts_to_create[contract_info.address] = contract_info;
 		}
 
-		engine->set_state_pointer_value("evaluator", &pending_state);
-		engine->set_state_pointer_value("storage_service", storage_service);
+		engine->set_state_pointer_value(UVM_STATE_EVALUATOR_KEY, &pending_state);
+		engine->set_state_pointer_value(UVM_STATE_STORAGE_SERVICE_KEY, storage_service);
 
         if(OP_CREATE == tx.opcode) {
             try {
@@ -2395,7 +2426,7 @@ bool ContractExec::commit_changes(std::shared_ptr<::contract::storage::ContractS
 		new_contract_info_to_commit->version = con_tx.params.version;
 		::blockchain::contract::native_contract_sender sender;
 		sender.caller_address = con_tx.params.caller_address;
-		sender.block_number = chainActive.Height();
+		sender.block_number = pindexPrev->nHeight;
 		if(new_contract_info_to_commit->is_native) {
 		    new_contract_info_to_commit->contract_template_key = con_tx.params.template_name;
 			const auto& native_contract_info = blockchain::contract::native_contract_finder::create_native_contract_by_key(nullptr, con_tx.params.template_name, con_tx.params.contract_address, sender);
@@ -2963,20 +2994,53 @@ bool ContractExecResult::match_contract_withdraw_infos(const std::vector<Contrac
     return true;
 }
 
+void ContractExecResult::changed_contracts(std::vector<std::string>& addresses) const
+{
+    for (const auto& p : contract_storage_changes)
+        addresses.push_back(p.first);
+    for (const auto& transfer_info : balance_changes) {
+        if (transfer_info.is_contract)
+            addresses.push_back(transfer_info.address);
+    }
+    for (const auto& info : contract_upgrade_infos)
+        addresses.push_back(info.address);
+}
+
 void ContractExecResult::clear() {
 	*this = ContractExecResult();
 }
 
+static ::contract::storage::ContractStorageDBOptions get_contract_storage_db_options()
+{
+	::contract::storage::ContractStorageDBOptions db_options;
+	db_options.cache_size = nContractStorageDBCache;
+	db_options.force_compact = gArgs.GetBoolArg("-forcecompactdb", false);
+	return db_options;
+}
+
 std::shared_ptr<::contract::storage::ContractStorageService> get_contract_storage_service()
 {
 	fs::path storage_db_path = GetDataDir() / CONTRACT_STORAGE_DB_PATH;
 	fs::path storage_sql_db_path = GetDataDir() / CONTRACT_STORAGE_SQL_DB_PATH;
-	auto service = ::contract::storage::ContractStorageService::get_instance(CONTRACT_STORAGE_MAGIC_NUMBER, storage_db_path.string(), storage_sql_db_path.string());
+	auto service = ::contract::storage::ContractStorageService::get_instance(CONTRACT_STORAGE_MAGIC_NUMBER, storage_db_path.string(), storage_sql_db_path.string(), get_contract_storage_db_options());
 	auto chain_height = chainActive.Height();
 	service->set_current_block_height(chain_height);
+	service->set_storage_cache_max_usage(nContractStorageCacheUsage);
 	return service;
 }
 
+std::shared_ptr<::contract::storage::ContractStorageService> get_contract_storage_snapshot()
+{
+	fs::path storage_db_path = GetDataDir() / CONTRACT_STORAGE_DB_PATH;
+	fs::path storage_sql_db_path = GetDataDir() / CONTRACT_STORAGE_SQL_DB_PATH;
+	return ::contract::storage::ContractStorageService::get_snapshot(CONTRACT_STORAGE_MAGIC_NUMBER, storage_db_path.string(), storage_sql_db_path.string(), get_contract_storage_db_options());
+}
+
+void close_contract_storage_service()
+{
+	::contract::storage::ContractStorageService::close_instance();
+}
+
 std::shared_ptr<std::string> get_root_state_hash_from_block(const CBlock* block) {
     if(block->vtx.empty())
         return nullptr;
@@ -3006,6 +3070,133 @@ std::shared_ptr<std::string> get_root_state_hash_from_block(const CBlock* block)
     return nullptr;
 }
 
+/** A contract transaction of a block, converted in block order and executed after the transaction loop */
+struct BlockContractTx
+{
+    uint256 txid;
+    ExtractContractTX contract_txs;
+    CAmount nTxFee = 0; // before the deposits of contract_txs
+    // execution cached when the block was assembled locally, for the contract state at cached_pre_state_root
+    std::shared_ptr<const ContractExecResult> cached_result;
+    std::string cached_pre_state_root;
+    // speculative execution against the contract state before the block's contract txs, and the snapshot it read
+    std::shared_ptr<::contract::storage::ContractStorageService> snapshot;
+    std::unique_ptr<ContractExec> exec;
+    std::set<std::string> read_keys; // db keys the speculative execution read
+};
+
+/** Check the params of the contract txs of a transaction and take their deposits out of nTxFee */
+static bool CheckBlockContractTxParams(const ExtractContractTX& contract_txs, std::shared_ptr<::contract::storage::ContractStorageService> service,
+    uint64_t blockGasLimit, CAmount& nTxFee, std::string& error_str)
+{
+    uint64_t gasAllTxs = 0;
+    uint64_t sumGas = 0;
+    for (const ContractTransaction &ctx : contract_txs.txs) {
+        if (!ctx.is_params_valid(service, nTxFee, sumGas, gasAllTxs, blockGasLimit, error_str))
+            return false;
+        sumGas += ctx.params.gasLimit * ctx.params.gasPrice;
+        nTxFee -= ctx.params.deposit_amount;
+        gasAllTxs += ctx.params.gasLimit;
+    }
+    return true;
+}
+
+/** The fee the contract txs of a transaction leave for gas after their deposits, as CheckBlockContractTxParams leaves it */
+static CAmount BlockContractTxGasFee(const BlockContractTx& contract_tx)
+{
+    CAmount nTxFee = contract_tx.nTxFee;
+    for (const ContractTransaction &ctx : contract_tx.contract_txs.txs)
+        nTxFee -= ctx.params.deposit_amount;
+    return nTxFee;
+}
+
+/**
+ * Look up the cached executions of the contract txs of a block in block order, each on the state the cached
+ * execution of the tx before it leaves, until one isn't cached. Returns the number of txs found
+ */
+static size_t FindCachedBlockContractTxs(std::vector<BlockContractTx>& contract_txs, std::string state_root, const uint256& tip_hash)
+{
+    auto& exec_cache = blockchain::contract::ContractExecCache::instance();
+    size_t count = 0;
+    for (auto& contract_tx : contract_txs) {
+        std::string post_state_root;
+        contract_tx.cached_result = exec_cache.get(contract_tx.txid, BlockContractTxGasFee(contract_tx), state_root, tip_hash, &post_state_root);
+        if (!contract_tx.cached_result)
+            break;
+        contract_tx.cached_pre_state_root = state_root;
+        state_root = post_state_root;
+        count++;
+    }
+    return count;
+}
+
+/**
+ * Execute the contract txs of a block in parallel, each against its own snapshot of the contract state
+ * before them, recording the keys they read. Nothing is committed, a speculative execution is only used
+ * when no earlier tx of the block wrote a key it read, otherwise the tx is executed again in block order.
+ * Invalid txs and executions that throw are left to the serial execution to report. Txs with a cached
+ * execution are skipped.
+ */
+static void SpeculateBlockContractTxs(const CBlock& block, const CBlockIndex* pindexPrev, std::vector<BlockContractTx>& contract_txs,
+    std::shared_ptr<::contract::storage::ContractStorageService> service)
+{
+    // the workers don't take cs_main. they read the chain only through pindexPrev and its ancestors, whose
+    // heights, times and block positions don't change, never through chainActive. the shared chain api is
+    // created before they start. the caller holds cs_main until they are joined, so the tip can't move either
+    AssertLockHeld(cs_main);
+    const size_t nThreads = std::min<size_t>(nContractExecThreads, contract_txs.size());
+    if (nThreads <= 1)
+        return;
+    if (!global_uvm_chain_api)
+        global_uvm_chain_api = new uvm::lua::api::BtcUvmChainApi();
+    const auto snapshot = service->create_snapshot();
+    std::atomic<size_t> next(0);
+    auto worker = [&]() {
+        for (size_t i = next++; i < contract_txs.size(); i = next++) {
+            auto& contract_tx = contract_txs[i];
+            if (contract_tx.cached_result)
+                continue;
+            try {
+                const auto tx_snapshot = snapshot->create_snapshot();
+                tx_snapshot->set_read_keys(&contract_tx.read_keys);
+                CAmount nTxFee = contract_tx.nTxFee;
+                std::string error_str;
+                if (!CheckBlockContractTxParams(contract_tx.contract_txs, tx_snapshot, UINT64_MAX, nTxFee, error_str))
+                    continue;
+                std::unique_ptr<ContractExec> exec(new ContractExec(tx_snapshot.get(), block, pindexPrev, contract_tx.contract_txs.txs, UINT64_MAX, nTxFee));
+                if (!exec->performByteCode() || exec->pending_contract_exec_result.exit_code != 0)
+                    continue;
+                contract_tx.snapshot = tx_snapshot;
+                contract_tx.exec = std::move(exec);
+            } catch (...) {
+                contract_tx.exec.reset();
+            }
+        }
+    };
+    std::vector<std::thread> threads;
+    for (size_t i = 1; i < nThreads; i++)
+        threads.emplace_back(worker);
+    worker();
+    for (auto& thread : threads)
+        thread.join();
+}
+
+/** Whether the sorted sets a and b have a key in common */
+static bool HasCommonKey(const std::set<std::string>& a, const std::set<std::string>& b)
+{
+    auto it_a = a.begin();
+    auto it_b = b.begin();
+    while (it_a != a.end() && it_b != b.end()) {
+        if (*it_a < *it_b)
+            ++it_a;
+        else if (*it_b < *it_a)
+            ++it_b;
+        else
+            return true;
+    }
+    return false;
+}
+
 static int64_t nTimeCheck = 0;
 static int64_t nTimeForks = 0;
 static int64_t nTimeVerify = 0;
@@ -3160,7 +3351,6 @@ bool CChainState::ConnectBlock(const CBlock& block, CValidationState& state, CBl
     std::string old_root_state_hash_before_connect_block;
     if(allow_contract) {
         service = get_contract_storage_service();
-        service->open();
         old_root_state_hash_before_connect_block = service->current_root_state_hash();
     }
     bool success_connect_block = false;
@@ -3292,6 +3482,7 @@ bool CChainState::ConnectBlock(const CBlock& block, CValidationState& state, CBl
 	    }	    
     }
     
+    std::vector<BlockContractTx> block_contract_txs;
     for (unsigned int i = 0; i < block.vtx.size(); i++)
     {
         const CTransaction &tx = *(block.vtx[i]);
@@ -3361,71 +3552,21 @@ bool CChainState::ConnectBlock(const CBlock& block, CValidationState& state, CBl
         }
 
         if(allow_contract) {
-            uint64_t blockGasLimit = UINT64_MAX;
             if (tx.HasContractOp()) {
+                // converted against the coins of the tx, executed after the loop
                 ContractTxConverter converter(tx, &view, &block.vtx);
-                ExtractContractTX resultConvertContractTx;
+                BlockContractTx contract_tx;
+                contract_tx.txid = tx.GetHash();
                 std::string error_ret;
-                if (!converter.extractionContractTransactions(resultConvertContractTx, error_ret)) {
+                if (!converter.extractionContractTransactions(contract_tx.contract_txs, error_ret)) {
                     return state.DoS(100, error("ConnectBlock(): Contract transaction of the wrong format %s", error_ret.c_str()),
                                      REJECT_INVALID, "bad-tx-bad-contract-format");
                 }
-                uint64_t gasAllTxs = 0;
-                uint64_t sumGas = 0;
-                CAmount nTxFee = view.GetValueIn(tx) - tx.GetValueOut();
-                for (const auto &withdrawInfo : resultConvertContractTx.contract_withdraw_infos) {
-                    nTxFee += withdrawInfo.amount;
+                contract_tx.nTxFee = view.GetValueIn(tx) - tx.GetValueOut();
+                for (const auto &withdrawInfo : contract_tx.contract_txs.contract_withdraw_infos) {
+                    contract_tx.nTxFee += withdrawInfo.amount;
                 }
-				std::string error_str;
-                for (ContractTransaction &ctx : resultConvertContractTx.txs) {
-					if (!ctx.is_params_valid(service, nTxFee, sumGas, gasAllTxs, blockGasLimit, error_str)) {
-						std::string full_error_str = std::string("ConnectBlock(): ") + error_str;
-						return state.DoS(100, error(full_error_str.c_str()),
-							REJECT_INVALID, error_str);
-					}
-                    sumGas += ctx.params.gasLimit * ctx.params.gasPrice;
-                    nTxFee -= ctx.params.deposit_amount;
-                    gasAllTxs += ctx.params.gasLimit;
-                }
-
-                ContractExec exec(service.get(), block, resultConvertContractTx.txs, blockGasLimit, nTxFee);
-                const auto &old_root_hash = service->current_root_state_hash();
-                bool success = false;
-                BOOST_SCOPE_EXIT_ALL(service, &old_root_hash, &success) {
-                    if (!success)
-                        service->rollback_contract_state(old_root_hash);
-                };
-                auto execRes = exec.performByteCode();
-                if (!execRes) {
-                    return state.DoS(100,
-                                     error("ConnectBlock(): exec bytecode error"),
-                                     REJECT_INVALID, exec.pending_contract_exec_result.error_message);
-                }
-                ContractExecResult contract_exec_result;
-                exec.processingResults(contract_exec_result);
-                if (contract_exec_result.exit_code != 0)
-                    return state.DoS(100,
-                                     error("ConnectBlock(): exec bytecode error"),
-                                     REJECT_INVALID, exec.pending_contract_exec_result.error_message);
-
-				if (!exec.commit_changes(service)) {
-					return state.DoS(100,
-						error("ConnectBlock(): commit contract result error"),
-						REJECT_INVALID, exec.pending_contract_exec_result.error_message);
-				}
-
-                blockGasUsed += contract_exec_result.usedGas;
-                if (blockGasUsed > blockGasLimit) {
-                    return state.DoS(1000, error("ConnectBlock(): Block exceeds gas limit"), REJECT_INVALID,
-                                     "bad-blk-gaslimit");
-                }
-                // check withdraw-from-contract info correct
-                if (!contract_exec_result.match_contract_withdraw_infos(
-                        resultConvertContractTx.contract_withdraw_infos)) {
-                    return state.DoS(1000, error("ConnectBlock(): Contract tx withdraw info error"), REJECT_INVALID,
-                                     "bad-tx-contractwithdrawinfo");
-                }
-                success = true;
+                block_contract_txs.push_back(std::move(contract_tx));
             } else if (tx.HasOpSpend()) {
                 return state.DoS(1000, error("ConnectBlock(): Contract tx format error"), REJECT_INVALID,
                                  "bad-tx-contracttx-format");
@@ -3438,6 +3579,82 @@ bool CChainState::ConnectBlock(const CBlock& block, CValidationState& state, CBl
         }
         UpdateCoins(tx, view, i == 0 ? undoDummy : blockundo.vtxundo.back(), pindex->nHeight);
     }
+    // contract txs commit in block order, reusing their cached executions from block assembly and their
+    // speculative executions that read no key an earlier one wrote
+    if (!block_contract_txs.empty()) {
+        const auto tip_hash = chainActive.Tip()->GetBlockHash();
+        if (FindCachedBlockContractTxs(block_contract_txs, service->current_root_state_hash(), tip_hash) < block_contract_txs.size())
+            SpeculateBlockContractTxs(block, pindex->pprev, block_contract_txs, service);
+        std::set<std::string> written_keys;
+        service->set_written_keys(&written_keys);
+        BOOST_SCOPE_EXIT_ALL(service) {
+            service->set_written_keys(nullptr);
+        };
+        for (auto &contract_tx : block_contract_txs) {
+            uint64_t blockGasLimit = UINT64_MAX;
+            // declared before exec so that the speculative exec reading it is destroyed first, the snapshot is
+            // released at the end of the iteration rather than with the whole block
+            const auto snapshot = std::move(contract_tx.snapshot);
+            std::unique_ptr<ContractExec> exec;
+            const auto old_root_hash = service->current_root_state_hash();
+            bool cached = false;
+            if (contract_tx.exec && !HasCommonKey(contract_tx.read_keys, written_keys)) {
+                exec = std::move(contract_tx.exec);
+            } else {
+                CAmount nTxFee = contract_tx.nTxFee;
+                std::string error_str;
+                if (!CheckBlockContractTxParams(contract_tx.contract_txs, service, blockGasLimit, nTxFee, error_str)) {
+                    std::string full_error_str = std::string("ConnectBlock(): ") + error_str;
+                    return state.DoS(100, error(full_error_str.c_str()),
+                                     REJECT_INVALID, error_str);
+                }
+                exec.reset(new ContractExec(service.get(), block, pindex->pprev, contract_tx.contract_txs.txs, blockGasLimit, nTxFee));
+                if (contract_tx.cached_result && contract_tx.cached_pre_state_root == old_root_hash) {
+                    exec->pending_contract_exec_result = *contract_tx.cached_result;
+                    cached = true;
+                } else if (!exec->performByteCode()) {
+                    return state.DoS(100,
+                                     error("ConnectBlock(): exec bytecode error"),
+                                     REJECT_INVALID, exec->pending_contract_exec_result.error_message);
+                }
+            }
+            bool success = false;
+            BOOST_SCOPE_EXIT_ALL(service, &old_root_hash, &success) {
+                if (!success)
+                    service->rollback_contract_state(old_root_hash);
+            };
+            ContractExecResult contract_exec_result;
+            exec->processingResults(contract_exec_result);
+            if (contract_exec_result.exit_code != 0)
+                return state.DoS(100,
+                                 error("ConnectBlock(): exec bytecode error"),
+                                 REJECT_INVALID, exec->pending_contract_exec_result.error_message);
+
+            if (!exec->commit_changes(service)) {
+                return state.DoS(100,
+                                 error("ConnectBlock(): commit contract result error"),
+                                 REJECT_INVALID, exec->pending_contract_exec_result.error_message);
+            }
+
+            blockGasUsed += contract_exec_result.usedGas;
+            if (blockGasUsed > blockGasLimit) {
+                return state.DoS(1000, error("ConnectBlock(): Block exceeds gas limit"), REJECT_INVALID,
+                                 "bad-blk-gaslimit");
+            }
+            // check withdraw-from-contract info correct
+            if (!contract_exec_result.match_contract_withdraw_infos(
+                    contract_tx.contract_txs.contract_withdraw_infos)) {
+                return state.DoS(1000, error("ConnectBlock(): Contract tx withdraw info error"), REJECT_INVALID,
+                                 "bad-tx-contractwithdrawinfo");
+            }
+            // like script checks, only executions of blocks that are just checked are cached
+            if (fJustCheck && !cached) {
+                blockchain::contract::ContractExecCache::instance().put(contract_tx.txid, exec->nTxFee, old_root_hash, tip_hash,
+                    contract_exec_result, service->current_root_state_hash());
+            }
+            success = true;
+        }
+    }
     int64_t nTime3 = GetTimeMicros(); nTimeConnect += nTime3 - nTime2;
     LogPrint(BCLog::BENCH, "      - Connect %u transactions: %.2fms (%.3fms/tx, %.3fms/txin) [%.2fs (%.2fms/blk)]\n", (unsigned)block.vtx.size(), MILLI * (nTime3 - nTime2), MILLI * (nTime3 - nTime2) / block.vtx.size(), nInputs <= 1 ? 0 : MILLI * (nTime3 - nTime2) / (nInputs-1), nTimeConnect * MICRO, nTimeConnect * MILLI / nBlocksTotal);
 
@@ -5548,9 +5765,7 @@ bool CVerifyDB::VerifyDB(const CChainParams& chainparams, CCoinsView *coinsview,
     int reportDone = 0;
 
     auto service = get_contract_storage_service();
-    service->open();
     const auto& old_root_state_hash = service->current_root_state_hash();
-    service->close();
 
     LogPrintf("[0%%]...");
     for (CBlockIndex* pindex = chainActive.Tip(); pindex && pindex->pprev; pindex = pindex->pprev)
@@ -5619,22 +5834,16 @@ bool CVerifyDB::VerifyDB(const CChainParams& chainparams, CCoinsView *coinsview,
             CBlock block;
             if (!ReadBlockFromDisk(block, pindex, chainparams.GetConsensus()))
                 return error("VerifyDB(): *** ReadBlockFromDisk failed at %d, hash=%s", pindex->nHeight, pindex->GetBlockHash().ToString());
-            service->open();
             const auto& old_root_state_hash = service->current_root_state_hash();
-            service->close();
 
             if (!g_chainstate.ConnectBlock(block, state, pindex, coins, chainparams)) {
-                service->open();
                 service->rollback_contract_state(old_root_state_hash);
-                service->close();
                 return error("VerifyDB(): *** found unconnectable block at %d, hash=%s", pindex->nHeight,
                              pindex->GetBlockHash().ToString());
             }
         }
     } else {
-        service->open();
         service->reset_root_state_hash(old_root_state_hash);
-        service->close();
     }
 
     LogPrintf("[DONE].\n");
@@ -5664,9 +5873,6 @@ bool CChainState::RollforwardBlock(const CBlockIndex* pindex, CCoinsViewCache& i
 //        // Pass check = true as every addition may be an overwrite.
 //        AddCoins(inputs, *tx, pindex->nHeight, true);
 //    }
-    auto service = get_contract_storage_service();
-    service->open();
-    const auto& root_state_hash = service->current_root_state_hash();
     return true;
 }
 
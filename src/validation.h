@@ -58,7 +58,15 @@ struct PrecomputedTransactionData;
 struct LockPoints;
 
 #define CONTRACT_STORAGE_DB_PATH "contract_storage.db"
-#define CONTRACT_STORAGE_SQL_DB_PATH "contract_storage_sql.db"
+#define CONTRACT_STORAGE_SQL_DB_PATH "contract_storage_sql.db" // commit_info db of older versions, migrated into the contract storage db
+/** -contractcache default (MiB) for decoded contract storage values */
+static const int64_t DEFAULT_CONTRACT_STORAGE_CACHE = 32;
+/** -contractdbcache default (MiB) for the contract storage database */
+static const int64_t DEFAULT_CONTRACT_STORAGE_DB_CACHE = 16;
+/** -contractcodecache default (MiB) for decoded contract codes */
+static const int64_t DEFAULT_CONTRACT_CODE_CACHE = 16;
+/** -contractexeccache default (MiB) for contract tx executions reused by block assembly and connection */
+static const int64_t DEFAULT_CONTRACT_EXEC_CACHE = 16;
 
 #define CONTRACT_MAJOR_VERSION 1
 #define CONTRACT_MINOR_VERSION 0
@@ -88,6 +96,8 @@ static const unsigned int DEFAULT_ANCESTOR_SIZE_LIMIT = 101;
 static const unsigned int DEFAULT_DESCENDANT_LIMIT = 25;
 /** Default for -limitdescendantsize, maximum kilobytes of in-mempool descendants */
 static const unsigned int DEFAULT_DESCENDANT_SIZE_LIMIT = 101;
+/** Default for -limitcontracttxs, max number of in-mempool transactions touching one contract */
+static const unsigned int DEFAULT_CONTRACT_TXS_LIMIT = 500;
 /** Default for -mempoolexpiry, expiration time for mempool transactions in hours */
 static const unsigned int DEFAULT_MEMPOOL_EXPIRY = 336;
 /** Maximum kilobytes for transactions to store for processing during reorg */
@@ -103,6 +113,10 @@ static const unsigned int UNDOFILE_CHUNK_SIZE = 0x100000; // 1 MiB
 static const int MAX_SCRIPTCHECK_THREADS = 16;
 /** -par default (number of script-checking threads, 0 = auto) */
 static const int DEFAULT_SCRIPTCHECK_THREADS = 0;
+/** Maximum number of threads executing the contract txs of a block */
+static const int MAX_CONTRACT_EXEC_THREADS = 16;
+/** -contractexecthreads default (number of contract execution threads, 0 = auto) */
+static const int DEFAULT_CONTRACT_EXEC_THREADS = 0;
 /** Number of blocks that can be requested at any given time from a single peer. */
 static const int MAX_BLOCKS_IN_TRANSIT_PER_PEER = 16;
 /** Timeout in seconds during which a peer must stall block download progress before being disconnected. */
@@ -152,6 +166,10 @@ static const int64_t MAX_FEE_ESTIMATION_TIP_AGE = 3 * 60 * 60;
 /** Default for -permitbaremultisig */
 static const bool DEFAULT_PERMIT_BAREMULTISIG = true;
 static const bool DEFAULT_CHECKPOINTS_ENABLED = true;
+/** Default for -contractgasblocks */
+static const bool DEFAULT_CONTRACT_GAS_BLOCKS = true;
+/** Default for -contractprofile */
+static const bool DEFAULT_CONTRACT_PROFILE = false;
 static const bool DEFAULT_TXINDEX = false;
 static const unsigned int DEFAULT_BANSCORE_THRESHOLD = 100;
 /** Default for -persistmempool */
@@ -191,12 +209,18 @@ extern CConditionVariable cvBlockChange;
 extern std::atomic_bool fImporting;
 extern std::atomic_bool fReindex;
 extern int nScriptCheckThreads;
+/** Threads executing the contract txs of a block speculatively, 0 executes them one after another */
+extern int nContractExecThreads;
 extern bool fTxIndex;
 extern bool fIsBareMultisigStd;
 extern bool fRequireStandard;
 extern bool fCheckBlockIndex;
 extern bool fCheckpointsEnabled;
 extern size_t nCoinCacheUsage;
+/** Memory limit of the decoded contract storage value cache */
+extern size_t nContractStorageCacheUsage;
+/** Block cache and write buffer size of the contract storage database */
+extern size_t nContractStorageDBCache;
 /** A fee rate smaller than this is considered zero fee (for relaying, mining and transaction creation) */
 extern CFeeRate minRelayTxFee;
 /** Absolute maximum transaction fee (in satoshis) used by wallet and mempool (rejects high fee in sendrawtransaction) */
@@ -673,6 +697,8 @@ struct ContractExecResult {
 	std::map<DgpChangeIntParamType, int64_t> dgp_int_params_changes; // changes of dgp params. not all native dgp contracts will change chain's dgp params.
 
   bool match_contract_withdraw_infos(const std::vector<ContractWithdrawInfo> withdraw_infos) const;
+  // appends the addresses of the contracts whose storage, balance or info the execution changed, maybe repeated
+  void changed_contracts(std::vector<std::string>& addresses) const;
 
 	void clear();
 };
@@ -699,8 +725,8 @@ private:
 
 class ContractExec {
 public:
-    ContractExec(::contract::storage::ContractStorageService* _storage_service, const CBlock& _block, std::vector<ContractTransaction> _txs, const uint64_t _blockGasLimit, CAmount _nTxFee)
-            : storage_service(_storage_service), block(_block), txs(_txs), blockGasLimit(_blockGasLimit), nTxFee(_nTxFee)
+    ContractExec(::contract::storage::ContractStorageService* _storage_service, const CBlock& _block, const CBlockIndex* _pindexPrev, std::vector<ContractTransaction> _txs, const uint64_t _blockGasLimit, CAmount _nTxFee)
+            : storage_service(_storage_service), txs(_txs), block(_block), pindexPrev(_pindexPrev), nHeight(_pindexPrev->nHeight + 1), blockGasLimit(_blockGasLimit), nTxFee(_nTxFee)
     {}
     bool performByteCode();
     bool processingResults(ContractExecResult &result);
@@ -712,12 +738,21 @@ public:
     std::vector<ContractTransaction> txs;
     std::vector<ResultExecute> result;
     const CBlock &block;
+    const CBlockIndex* pindexPrev; // the tip the block builds on, the executions read the chain from it rather than chainActive
+    const int nHeight; // height of the block the txs execute in
     const uint64_t blockGasLimit;
     const CAmount nTxFee;
     ContractExecResult pending_contract_exec_result; // pending contract exec changes not committed
 };
 
+/** Cap on the live memory of a contract execution in a block at nHeight, unlimited before CONTRACT_MEMORY_LIMIT_Height */
+size_t GetContractMaxMemorySize(int nHeight, const Consensus::Params& consensusParams);
+
 std::shared_ptr<::contract::storage::ContractStorageService> get_contract_storage_service();
+/** Read-only contract storage at the last released state, doesn't wait for block connection or mempool acceptance */
+std::shared_ptr<::contract::storage::ContractStorageService> get_contract_storage_snapshot();
+/** Close the contract storage databases kept open by get_contract_storage_service */
+void close_contract_storage_service();
 
 std::shared_ptr<std::string> get_root_state_hash_from_block(const CBlock* block);
 
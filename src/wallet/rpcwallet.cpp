@@ -41,7 +41,6 @@
 #include <univalue.h>
 
 #include <fjson/crypto/hex.hpp>
-#include <boost/scope_exit.hpp>
 #include <boost/lexical_cast.hpp>
 
 
@@ -1394,21 +1393,13 @@ UniValue callcontract(const JSONRPCRequest& request)
 	std::map<std::string, CAmount> withdraw_infos;
 	// run testing to get withdraw infos
 	{
-		auto service = get_contract_storage_service();
-		service->open();
-
-		const auto& old_root_state_hash = service->current_root_state_hash();
+		// the testing execution runs on an overlay of the contract storage, which is discarded on return
+		auto service = ::contract::storage::ContractStorageService::create_overlay(get_contract_storage_service());
 
 		auto contract_info = service->get_contract_info(contract_address);
 		if (!contract_info)
 			throw JSONRPCError(RPC_INVALID_ADDRESS_OR_KEY, "contract address does not exist");
 
-		BOOST_SCOPE_EXIT_ALL(&service, old_root_state_hash) {
-			service->open();
-			service->rollback_contract_state(old_root_state_hash);
-			service->close();
-		};
-
 		CBlock block;
 		CMutableTransaction tx;
 		uint64_t gas_limit = 100000000;
@@ -1432,7 +1423,7 @@ UniValue callcontract(const JSONRPCRequest& request)
 		contract_tx.params.version = CONTRACT_MAJOR_VERSION;
 		contractTransactions.push_back(contract_tx);
 
-		ContractExec exec(service.get(), block, contractTransactions, gas_limit, 0);
+		ContractExec exec(service.get(), block, chainActive.Tip(), contractTransactions, gas_limit, 0);
 		if (!exec.performByteCode()) {
 			//error, don't add contract
 			throw JSONRPCError(RPC_INTERNAL_ERROR, exec.pending_contract_exec_result.error_message);
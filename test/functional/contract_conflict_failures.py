@@ -0,0 +1,70 @@
+#!/usr/bin/env python3
+"""Test the skipping of contract txs of a caller which keep failing after the block changed their contract.
+
+All the withdrawals of the whole balance of a contract are accepted on its mempool state, block
+assembly executes the first on the state of the block and the next MAX_CONTRACT_CONFLICT_FAILURES,
+which fail. The remaining ones are skipped without being executed and stay in the mempool. Valid
+calls of the contract by another caller, considered after them, are still executed and mined.
+"""
+import os
+import re
+from decimal import Decimal
+
+from test_framework.contract import ContractTestFramework, contract_code_path
+from test_framework.util import *
+from contract import create_new_contract, deposit_to_contract, invoke_contract_api, generate_block, config
+
+MAX_CONTRACT_CONFLICT_FAILURES = 3
+
+
+class ContractConflictFailuresTest(ContractTestFramework):
+
+    def set_test_params(self):
+        self.num_nodes = 1
+        self.setup_clean_chain = True
+
+    def contract_txs_skipped(self):
+        """Contract txs skipped by the last block assembly, from the debug log"""
+        with open(os.path.join(self.nodes[0].datadir, 'regtest', 'debug.log'), encoding='utf8') as f:
+            skipped = re.findall(r'CreateNewBlock\(\) packages: .*, (\d+) contract txs skipped\)', f.read())
+        return int(skipped[-1])
+
+    def run_test(self):
+        node = self.nodes[0]
+        contract = create_new_contract(node, self.address, contract_code_path('test.gpc'))
+        generate_block(node, self.address)
+        amount = Decimal('0.3')
+        deposit_to_contract(node, self.address, contract, amount)
+        generate_block(node, self.address)
+        assert_equal(node.getrawmempool(), [])
+
+        other_address = node.getnewaddress()
+        other_calls = 2
+        for _ in range(other_calls):
+            node.sendtoaddress(other_address, 10)
+        generate_block(node, self.address)
+        assert_equal(node.getrawmempool(), [])
+
+        # the withdrawals have a higher gas price than the calls of the other caller, so they are executed first
+        withdraw_txids = [invoke_contract_api(node, self.address, contract, 'withdraw',
+                                              str(int(amount * config['PRECISION'])),
+                                              {self.address: amount}, {contract: amount}, gas_price=20)
+                          for _ in range(MAX_CONTRACT_CONFLICT_FAILURES + 2)]
+        other_txids = [invoke_contract_api(node, other_address, contract, 'hello', 'abc') for _ in range(other_calls)]
+        assert_equal(sorted(node.getrawmempool()), sorted(withdraw_txids + other_txids))
+
+        block = node.getblock(generate_block(node, self.address)[0])
+        assert_equal(len(set(block['tx']) & set(withdraw_txids)), 1)
+        assert_equal(set(block['tx']) & set(other_txids), set(other_txids))
+        assert_equal(len(node.getrawmempool()), MAX_CONTRACT_CONFLICT_FAILURES + 1)
+        assert_equal(self.contract_txs_skipped(), 1)
+
+        # without a contract changed by the block there is nothing to skip, the withdrawals fail on the empty balance
+        block = node.getblock(generate_block(node, self.address)[0])
+        assert_equal(set(block['tx']) & set(withdraw_txids), set())
+        assert_equal(len(node.getrawmempool()), MAX_CONTRACT_CONFLICT_FAILURES + 1)
+        assert_equal(self.contract_txs_skipped(), 0)
+
+
+if __name__ == '__main__':
+    ContractConflictFailuresTest().main()
@@ -0,0 +1,55 @@
+#!/usr/bin/env python3
+"""Test the reuse of contract tx executions with -contractexeccache.
+
+Node 0 caches the executions of contract txs on mempool entry and in block assembly and reuses them
+for its templates and for the connection of the blocks it mines, node 1 executes every tx again.
+"""
+from test_framework.contract import ContractTestFramework, contract_code_path
+from test_framework.util import *
+from contract import create_new_contract, deposit_to_contract, invoke_contract_api, generate_block
+
+
+class ContractExecCacheTest(ContractTestFramework):
+
+    def set_test_params(self):
+        self.num_nodes = 2
+        self.setup_clean_chain = True
+        self.extra_args = [[], ['-contractexeccache=0']]
+
+    def run_test(self):
+        node = self.nodes[0]
+        code_path = contract_code_path('test.gpc')
+        contracts = [create_new_contract(node, self.address, code_path) for _ in range(2)]
+        generate_block(node, self.address)
+        self.sync_all()
+        self.assert_same_contract_state(contracts)
+
+        # the executions of the txs of a block node 0 mines are reused by its template check and its connection
+        hits = node.getmemoryinfo()['contractexec']['hits']
+        for contract in contracts:
+            for _ in range(2):
+                deposit_to_contract(node, self.address, contract, 0.1)
+            invoke_contract_api(node, self.address, contract, 'hello', 'abc')
+        generate_block(node, self.address)
+        self.sync_all()
+        self.assert_same_contract_state(contracts)
+        assert node.getmemoryinfo()['contractexec']['hits'] > hits
+        assert node.getsimplecontractinfo(contracts[0])['balances'][0]['amount'] > 0
+
+        # node 1 caches nothing
+        exec_cache = self.nodes[1].getmemoryinfo()['contractexec']
+        assert_equal(exec_cache['entries'], 0)
+        assert_equal(exec_cache['hits'], 0)
+        assert_equal(exec_cache['maxusage'], 0)
+
+        # and node 0 executes a block node 1 mined
+        for contract in contracts:
+            deposit_to_contract(node, self.address, contract, 0.1)
+        self.sync_all()
+        generate_block(self.nodes[1], self.address)
+        self.sync_all()
+        self.assert_same_contract_state(contracts)
+
+
+if __name__ == '__main__':
+    ContractExecCacheTest().main()
@@ -0,0 +1,87 @@
+#!/usr/bin/env python3
+"""Test that gas counts of contract executions are those of the interpreter before gas blocks.
+
+Node 0 charges gas per block of instructions (the default), node 1 charges every instruction
+alone. Every contract in this directory is registered, and some apis are called, on both nodes.
+Gas counts must be the ones recorded on the binary charging every instruction alone before gas
+blocks were added, and results must be the same on both nodes.
+"""
+from test_framework.contract import ContractTestFramework, contract_code_path
+from test_framework.util import *
+from test_framework.script import read_contract_bytecode_hex
+from contract import create_new_contract, generate_block
+import glob
+import os
+
+# gas counts of registercontracttesting recorded before gas blocks, None where registering fails
+REGISTER_GAS_COUNTS = {
+    'any_mortgage_token.gpc': None,
+    'new_any_mortgage_token.gpc': None,
+    'newtoken.gpc': 6129,
+    'price_feeder.gpc': 3533,
+    'test.gpc': 1698,
+    'test_big_data.gpc': 1545,
+    'token.gpc': 6129,
+}
+
+# gas counts of invokecontractoffline recorded before gas blocks by api name, None where the call fails
+INVOKE_GAS_COUNTS = {
+    'query': 235,
+    'import_contract_by_address_demo': 80,
+    'init_token': 4082,
+    'state': 375,
+    # the offline init_token isn't kept
+    'balanceOf': None,
+}
+
+
+def gas_count(res):
+    """gasCount of an rpc result, None for a failed call"""
+    return res.get('gasCount') if isinstance(res, dict) else None
+
+
+class ContractGasMeteringTest(ContractTestFramework):
+
+    def set_test_params(self):
+        self.num_nodes = 2
+        self.setup_clean_chain = True
+        self.extra_args = [[], ['-contractgasblocks=0']]
+
+    def call_both(self, method, *args):
+        results = []
+        for node in self.nodes:
+            try:
+                results.append(getattr(node, method)(*args))
+            except JSONRPCException as e:
+                results.append(e.error)
+        assert_equal(results[0], results[1])
+        return results[0]
+
+    def run_test(self):
+        contract_paths = sorted(glob.glob(contract_code_path('*.gpc')))
+        assert_equal([os.path.basename(path) for path in contract_paths], sorted(REGISTER_GAS_COUNTS))
+        for path in contract_paths:
+            res = self.call_both('registercontracttesting', self.address, read_contract_bytecode_hex(path))
+            self.log.info("%s: %s" % (os.path.basename(path), gas_count(res)))
+            assert_equal(gas_count(res), REGISTER_GAS_COUNTS[os.path.basename(path)])
+
+        test_contract = create_new_contract(self.nodes[0], self.address, contract_code_path('test.gpc'))
+        token_contract = create_new_contract(self.nodes[0], self.address, contract_code_path('newtoken.gpc'))
+        generate_block(self.nodes[0], self.address)
+        self.sync_all()
+
+        calls = [
+            (test_contract, 'query', 'abc'),
+            (test_contract, 'import_contract_by_address_demo', test_contract),
+            (token_contract, 'init_token', 'test,TEST,1000000,100'),
+            (token_contract, 'state', ' '),
+            (token_contract, 'balanceOf', self.address),
+        ]
+        for contract_addr, api_name, api_arg in calls:
+            res = self.call_both('invokecontractoffline', self.address, contract_addr, api_name, api_arg)
+            self.log.info("%s: %s" % (api_name, gas_count(res)))
+            assert_equal(gas_count(res), INVOKE_GAS_COUNTS[api_name])
+
+
+if __name__ == '__main__':
+    ContractGasMeteringTest().main()
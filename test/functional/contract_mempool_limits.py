@@ -0,0 +1,48 @@
+#!/usr/bin/env python3
+"""Test the contract index of the mempool and -limitcontracttxs.
+
+Mempool entries list the contracts their txs call or change. A node doesn't accept a contract tx
+touching a contract which already has -limitcontracttxs txs in its mempool, the other contracts
+are unaffected and the contract takes txs again once its txs are mined.
+"""
+from test_framework.contract import ContractTestFramework, contract_code_path
+from test_framework.util import *
+from contract import create_new_contract, deposit_to_contract, invoke_contract_api, generate_block
+
+
+class ContractMempoolLimitsTest(ContractTestFramework):
+
+    def set_test_params(self):
+        self.num_nodes = 1
+        self.setup_clean_chain = True
+        self.extra_args = [['-limitcontracttxs=2']]
+
+    def run_test(self):
+        node = self.nodes[0]
+        code_path = contract_code_path('test.gpc')
+        contracts = [create_new_contract(node, self.address, code_path) for _ in range(2)]
+        generate_block(node, self.address)
+        assert_equal(node.getrawmempool(), [])
+
+        txids = [deposit_to_contract(node, self.address, contracts[0], 0.1),
+                 invoke_contract_api(node, self.address, contracts[0], 'hello', 'abc')]
+        for txid in txids:
+            assert_equal(node.getmempoolentry(txid)['contracts'], [contracts[0]])
+        assert_raises_rpc_error(-26, "too-many-contract-txs", deposit_to_contract, node, self.address, contracts[0], 0.1)
+
+        # the limit is per contract
+        txid = deposit_to_contract(node, self.address, contracts[1], 0.1)
+        assert_equal(node.getmempoolentry(txid)['contracts'], [contracts[1]])
+        txids.append(txid)
+        assert_equal(sorted(node.getrawmempool()), sorted(txids))
+
+        generate_block(node, self.address)
+        assert_equal(node.getrawmempool(), [])
+        txid = deposit_to_contract(node, self.address, contracts[0], 0.1)
+        assert_equal(node.getmempoolentry(txid)['contracts'], [contracts[0]])
+        generate_block(node, self.address)
+        assert_equal(node.getrawmempool(), [])
+
+
+if __name__ == '__main__':
+    ContractMempoolLimitsTest().main()
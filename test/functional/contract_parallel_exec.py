@@ -0,0 +1,48 @@
+#!/usr/bin/env python3
+"""Test the parallel execution of the contract txs of a block with -contractexecthreads.
+
+Node 0 executes contract txs on several threads, node 1 one after another. Deposits to the same
+contract conflict, deposits to different contracts don't.
+"""
+from test_framework.contract import ContractTestFramework, contract_code_path
+from test_framework.util import *
+from contract import create_new_contract, deposit_to_contract, invoke_contract_api, generate_block
+
+
+class ContractParallelExecTest(ContractTestFramework):
+
+    def set_test_params(self):
+        self.num_nodes = 2
+        self.setup_clean_chain = True
+        self.extra_args = [['-contractexecthreads=4'], ['-contractexecthreads=1']]
+
+    def run_test(self):
+        node = self.nodes[0]
+        code_path = contract_code_path('test.gpc')
+        contracts = [create_new_contract(node, self.address, code_path) for _ in range(3)]
+        generate_block(node, self.address)
+        self.sync_all()
+
+        # each contract gets deposits, the deposits to one contract depend on each other
+        for contract in contracts:
+            for _ in range(3):
+                deposit_to_contract(node, self.address, contract, 0.1)
+            invoke_contract_api(node, self.address, contract, 'hello', 'abc')
+        generate_block(node, self.address)
+        self.sync_all()
+        self.assert_same_contract_state(contracts)
+        amounts = [node.getsimplecontractinfo(contract)['balances'][0]['amount'] for contract in contracts]
+        assert amounts[0] > 0
+        assert_equal(amounts, [amounts[0]] * len(contracts))
+
+        # and the other way round, node 0 executes a block node 1 mined
+        for contract in contracts:
+            deposit_to_contract(node, self.address, contract, 0.1)
+        self.sync_all()
+        generate_block(self.nodes[1], self.address)
+        self.sync_all()
+        self.assert_same_contract_state(contracts)
+
+
+if __name__ == '__main__':
+    ContractParallelExecTest().main()
@@ -0,0 +1,55 @@
+#!/usr/bin/env python3
+"""Test the contract execution profile of -contractprofile and getcontractprofile.
+
+Node 0 profiles contract executions, node 1 doesn't. Both run the same contract calls, the
+profile of node 0 must cover them without changing their gas counts.
+"""
+from test_framework.contract import ContractTestFramework, contract_code_path
+from test_framework.util import *
+from contract import create_new_contract, generate_block
+
+
+class ContractProfileTest(ContractTestFramework):
+
+    def set_test_params(self):
+        self.num_nodes = 2
+        self.setup_clean_chain = True
+        self.extra_args = [['-contractprofile'], []]
+
+    def run_test(self):
+        node = self.nodes[0]
+        test_contract = create_new_contract(node, self.address, contract_code_path('test.gpc'))
+        generate_block(node, self.address)
+        self.sync_all()
+        node.getcontractprofile('json', True)
+
+        gas_counts = []
+        for n in self.nodes:
+            res = n.invokecontractoffline(self.address, test_contract, 'query', 'abc')
+            gas_counts.append(res['gasCount'])
+        assert_equal(gas_counts[0], gas_counts[1])
+        assert_equal(self.nodes[1].getcontractprofile(), [])
+
+        profile = node.getcontractprofile()
+        assert_equal(len(profile), 1)
+        entry = profile[0]
+        assert_equal(entry['contract'], test_contract)
+        assert_equal(entry['api'], 'query')
+        assert_equal(entry['calls'], 1)
+        assert_equal(entry['errors'], 0)
+        assert_equal(entry['gas'], gas_counts[0])
+        assert 0 < sum(entry['opcodes'].values()) <= entry['gas']
+
+        folded = node.getcontractprofile('foldedgas').splitlines()
+        assert len(folded) > 0
+        assert_equal(sum(int(line.rsplit(' ', 1)[1]) for line in folded), entry['gas'])
+        for line in folded:
+            assert line.startswith('%s;query;' % test_contract)
+
+        assert_raises_rpc_error(-8, "unknown format", node.getcontractprofile, 'xml')
+        node.getcontractprofile('folded', True)
+        assert_equal(node.getcontractprofile(), [])
+
+
+if __name__ == '__main__':
+    ContractProfileTest().main()
@@ -0,0 +1,94 @@
+#!/usr/bin/env python3
+"""Test getcontractstateproof.
+
+The proofs of contract infos and storages, present or absent, lead to the contract state trie root
+of the node, which changes with the contract state and is the same on the nodes.
+"""
+import hashlib
+
+from test_framework.contract import ContractTestFramework, contract_code_path
+from test_framework.util import *
+from contract import create_new_contract, deposit_to_contract, generate_block
+
+HASH_SIZE = 32
+
+
+def key_bit(key_hash, depth):
+    return (key_hash[depth // 8] >> (7 - depth % 8)) & 1
+
+
+def proof_root(key_hash, value_hash, proof):
+    """Contract state trie root the proof leads to, the same as ContractStateTrie::proof_root"""
+    leaf_key_hash = bytes.fromhex(proof['leaf_key_hash'])
+    leaf_value_hash = bytes.fromhex(proof['leaf_value_hash'])
+    siblings = [bytes.fromhex(sibling) for sibling in proof['siblings']]
+    assert len(key_hash) == HASH_SIZE and len(siblings) < HASH_SIZE * 8
+    assert all(len(sibling) == HASH_SIZE for sibling in siblings)
+    if not leaf_key_hash:
+        assert not value_hash and not leaf_value_hash
+        node_hash = bytes(HASH_SIZE)
+    else:
+        if leaf_key_hash == key_hash:
+            assert_equal(leaf_value_hash, value_hash)
+        else:
+            # the leaf of another key must be on the path of key_hash
+            assert not value_hash
+            assert all(key_bit(leaf_key_hash, depth) == key_bit(key_hash, depth) for depth in range(len(siblings)))
+        node_hash = hashlib.sha256(b'\x00' + leaf_key_hash + leaf_value_hash).digest()
+    for depth in reversed(range(len(siblings))):
+        children = siblings[depth] + node_hash if key_bit(key_hash, depth) else node_hash + siblings[depth]
+        node_hash = hashlib.sha256(b'\x01' + children).digest()
+    return node_hash
+
+
+class ContractStateProofTest(ContractTestFramework):
+
+    def set_test_params(self):
+        self.num_nodes = 2
+        self.setup_clean_chain = True
+
+    def check_proof(self, node, contract, storage_name=None):
+        """Checks the proof against the state trie root and returns it"""
+        args = [contract] if storage_name is None else [contract, storage_name]
+        res = node.getcontractstateproof(*args)
+        value_hash = bytes.fromhex(res['value_hash'])
+        assert_equal(res['exists'], len(value_hash) == HASH_SIZE)
+        assert_equal(res['root_state_hash'], node.currentrootstatehash()['root_state_hash'])
+        assert_equal(proof_root(bytes.fromhex(res['key_hash']), value_hash, res['proof']).hex(), res['state_trie_root'])
+        return res
+
+    def run_test(self):
+        node = self.nodes[0]
+        contract = create_new_contract(node, self.address, contract_code_path('test.gpc'))
+        generate_block(node, self.address)
+        self.sync_all()
+
+        info = self.check_proof(node, contract)
+        assert info['exists']
+        storage_names = [storage['name'] for storage in node.getcontractinfo(contract)['storages']]
+        assert len(storage_names) > 0
+        for storage_name in storage_names:
+            res = self.check_proof(node, contract, storage_name)
+            assert_equal(res['state_trie_root'], info['state_trie_root'])
+        absent = self.check_proof(node, contract, 'no_such_storage')
+        assert not absent['exists']
+        assert_equal(absent['value_hash'], '')
+
+        # the other node has the same trie
+        assert_equal(self.check_proof(self.nodes[1], contract), info)
+
+        # a deposit changes the contract info and the trie root
+        deposit_to_contract(node, self.address, contract, 0.1)
+        generate_block(node, self.address)
+        self.sync_all()
+        deposited = self.check_proof(node, contract)
+        assert deposited['value_hash'] != info['value_hash']
+        assert deposited['state_trie_root'] != info['state_trie_root']
+        assert_equal(self.check_proof(self.nodes[1], contract), deposited)
+
+        assert_raises_rpc_error(-8, "invalid contract address", node.getcontractstateproof, 'not a contract')
+        assert_raises_rpc_error(-8, "invalid storage name", node.getcontractstateproof, contract, '')
+
+
+if __name__ == '__main__':
+    ContractStateProofTest().main()
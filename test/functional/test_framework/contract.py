@@ -0,0 +1,35 @@
+#!/usr/bin/env python3
+"""Shared setup of the contract_*.py tests."""
+
+import os
+
+from .test_framework import BitcoinTestFramework
+from .util import assert_equal
+
+# contracts are enabled from this height on regtest
+CONTRACT_ACTIVATION_HEIGHT = 1500
+
+
+def contract_code_path(name):
+    """Path of the compiled contract name, like test.gpc, in the functional tests directory"""
+    return os.path.join(os.path.dirname(os.path.dirname(os.path.abspath(__file__))), name)
+
+
+class ContractTestFramework(BitcoinTestFramework):
+    """The nodes are connected as a chain, node 0 mines up to CONTRACT_ACTIVATION_HEIGHT to self.address,
+    which then pays for the contract txs of the test. Tests comparing nodes configured differently check
+    with assert_same_contract_state that each accepts the blocks of the others with the same contract state."""
+
+    def setup_network(self):
+        super().setup_network()
+        self.address = self.nodes[0].getnewaddress()
+        self.nodes[0].generatetoaddress(CONTRACT_ACTIVATION_HEIGHT, self.address, 5000000)
+        self.sync_all()
+
+    def assert_same_contract_state(self, contracts):
+        """The nodes have the same root state hash and the same balances of contracts"""
+        root_state_hashes = [n.currentrootstatehash() for n in self.nodes]
+        assert_equal(root_state_hashes, [root_state_hashes[0]] * self.num_nodes)
+        for contract in contracts:
+            balances = [n.getsimplecontractinfo(contract)['balances'] for n in self.nodes]
+            assert_equal(balances, [balances[0]] * self.num_nodes)
@@ -77,6 +77,13 @@ BASE_SCRIPTS= [
     'receivedby.py',
     'abandonconflict.py',
     'contract.py',
+    'contract_gas_metering.py',
+    'contract_profile.py',
+    'contract_parallel_exec.py',
+    'contract_exec_cache.py',
+    'contract_mempool_limits.py',
+    'contract_conflict_failures.py',
+    'contract_state_proof.py',
     'bip68-112-113-p2p.py',
     'rawtransactions.py',
     'reindex.py',